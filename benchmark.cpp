@@ -0,0 +1,888 @@
+// File: benchmark.cpp
+// Description: Micro-benchmarks for the file server's building blocks. Each
+//              benchmark prints its own table of results.
+//              Usage: benchmark [name ...]   (no names runs every benchmark)
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>      // unlink, fork, pipe
+#include <sys/wait.h>    // waitpid
+#include <malloc.h>      // mallinfo2
+#include <time.h>        // clock_gettime
+#include <sys/stat.h>    // stat
+
+#include "hashmap.hpp"   // FileServerMap
+#include "flattable.hpp" // FlatTable
+#include "persist.hpp"   // encode_store, decode_store
+#include "wal.hpp"       // WriteAheadLog
+#include "snapshot.hpp"  // Snapshotter
+#include "protocol.hpp"  // Message classes
+#include "pack109.hpp"   // Serialization
+#include "lz.hpp"        // lz_compress, inflate
+#include "digest.hpp"    // content_digest
+
+using Clock = std::chrono::steady_clock;
+
+// Results are added here so the compiler cannot discard the measured work
+static std::atomic<size_t> g_sink(0);
+
+// Function: seconds_since
+// Purpose: Returns the time elapsed since `start` in seconds.
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Function: run_threads
+// Purpose: Runs `body(thread_index)` on `n` threads at once and times the batch.
+// Returns:
+//   - Wall-clock seconds from the first thread starting to the last one finishing.
+template <typename Body>
+static double run_threads(size_t n, Body body) {
+    std::atomic<bool> go(false);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < n; ++t) {
+        pool.emplace_back([&go, &body, t] {
+            while (!go.load()) std::this_thread::yield();
+            body(t);
+        });
+    }
+    auto start = Clock::now();
+    go = true;
+    for (auto &th : pool) th.join();
+    return seconds_since(start);
+}
+
+// Function: distinct_body
+// Purpose: A body of `size` bytes of (uint8_t)i, with i stamped on its first
+//          bytes so no two files share it: benchmarks of memory and disk use
+//          must not be flattered by deduplication.
+static std::vector<uint8_t> distinct_body(size_t size, size_t i) {
+    std::vector<uint8_t> v(size, (uint8_t)i);
+    for (size_t k = 0; k < std::min<size_t>(size, 8); ++k) v[k] = (uint8_t)(i >> (8 * k));
+    return v;
+}
+
+// Benchmark: store
+// Purpose: GET and PUT throughput of FileServerMap from 1 to N threads, where N
+//          is at least 8 or the number of hardware threads.
+static void bench_store() {
+    const size_t keys = 10000, ops = 200000, value_size = 1024;
+    size_t max_threads = std::max(8u, std::thread::hardware_concurrency());
+
+    FileServerMap store;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < keys; ++i) {
+        names.push_back("file_" + std::to_string(i) + ".bin");
+        store.insert(names.back(), std::vector<uint8_t>(value_size, (uint8_t)i));
+    }
+
+    std::cout << "store: " << keys << " keys, " << value_size << "-byte values, "
+              << ops << " ops per thread\n";
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "GET ops/s"
+              << std::setw(16) << "PUT ops/s" << "\n";
+    for (size_t n = 1; n <= max_threads; n *= 2) {
+        double get_secs = run_threads(n, [&](size_t t) {
+            size_t sink = 0;
+            for (size_t i = 0; i < ops; ++i)
+                sink += store.get(names[(i * 7919 + t) % keys])->size();
+            g_sink += sink;
+        });
+        std::vector<uint8_t> value(value_size, 0x5a);
+        double put_secs = run_threads(n, [&](size_t t) {
+            for (size_t i = 0; i < ops; ++i)
+                store.insert(names[(i * 7919 + t) % keys], value);
+        });
+        std::cout << std::setw(8) << n
+                  << std::setw(16) << std::fixed << std::setprecision(0) << n * ops / get_secs
+                  << std::setw(16) << n * ops / put_secs << "\n";
+    }
+}
+
+// Function: ns_per_op
+// Purpose: Runs `op` `iters` times and returns the mean time per call in nanoseconds.
+template <typename Op>
+static double ns_per_op(size_t iters, Op op) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < iters; ++i) op();
+    return seconds_since(start) * 1e9 / iters;
+}
+
+// Benchmark: dispatch
+// Purpose: Per-message decode latency of the old trial-decoding dispatch (try
+//          Request, catch, try File) against peeking at the outer key first.
+static void bench_dispatch() {
+    const size_t iters = 200000;
+    Bytes put = FileMessage("bench.txt", Bytes(200, 'x')).serialize();
+    Bytes get = RequestMessage("bench.txt").serialize();
+
+    auto trial = [](const Bytes &m) -> size_t {
+        try { return RequestMessage::deserialize(m).name.size(); } catch (const std::exception &) {}
+        try { return FileMessage::deserialize(m).data.size(); } catch (const std::exception &) {}
+        return 0;
+    };
+    auto peek = [](const Bytes &m) -> size_t {
+        switch (peek_message_type(m)) {
+        case MessageType::Request: return RequestMessage::deserialize(m).name.size();
+        case MessageType::File:    return FileMessage::deserialize(m).data.size();
+        default:                   return 0;
+        }
+    };
+
+    std::cout << "dispatch: mean decode latency per message, " << iters << " iterations\n";
+    std::cout << std::setw(10) << "message" << std::setw(14) << "trial ns"
+              << std::setw(14) << "peek ns" << std::setw(10) << "speedup" << "\n";
+    const std::pair<const char *, const Bytes *> cases[] = {{"PUT", &put}, {"GET", &get}};
+    for (const auto &c : cases) {
+        double t = ns_per_op(iters, [&] { g_sink += trial(*c.second); });
+        double p = ns_per_op(iters, [&] { g_sink += peek(*c.second); });
+        std::cout << std::setw(10) << c.first << std::setw(14) << std::fixed << std::setprecision(0) << t
+                  << std::setw(14) << p << std::setw(9) << std::setprecision(2) << t / p << "x\n";
+    }
+}
+
+// Benchmark: xor
+// Purpose: Throughput of the XOR-42 cipher. "alloc" is the original approach
+//          (a fresh vector per call, byte-at-a-time loop); "inplace" is the
+//          dispatched SIMD kernel working on the caller's buffer.
+static void bench_xor() {
+    const size_t sizes[] = {64, 4096, 65536, 1 << 20};
+    const size_t total = size_t(1) << 30;   // Bytes processed per measurement
+
+    auto alloc_xor = [](const Bytes &buf) {
+        Bytes out(buf.size());
+        for (size_t i = 0; i < buf.size(); ++i) out[i] = buf[i] ^ 42;
+        return out;
+    };
+
+    std::cout << "xor: GB/s over " << (total >> 20) << " MiB per size, kernel "
+              << xor42_impl() << "\n";
+    std::cout << std::setw(10) << "size" << std::setw(12) << "alloc"
+              << std::setw(12) << "inplace" << "\n";
+    for (size_t size : sizes) {
+        Bytes buf(size, 0x37);
+        size_t iters = total / size;
+        double a = ns_per_op(iters, [&] { g_sink += alloc_xor(buf)[size - 1]; });
+        double b = ns_per_op(iters, [&] { xor42_inplace(buf.data(), size); g_sink += buf[size - 1]; });
+        std::cout << std::setw(10) << size << std::fixed << std::setprecision(2)
+                  << std::setw(12) << size / a << std::setw(12) << size / b << "\n";
+    }
+}
+
+// Benchmark: encode
+// Purpose: Time to build a File message. "kvmap" is the original approach (every
+//          element serialized into its own vector, then copied into a map and
+//          again into the result); "exact" sizes the buffer first and encodes
+//          into it directly with one allocation.
+static void bench_encode() {
+    const size_t sizes[] = {16, 64, 255};
+    const size_t iters = 200000;
+    const std::string name = "bench_file.bin";
+
+    auto kvmap = [&name](const Bytes &data) {
+        KVMap inner;
+        inner["name"] = pack109::serialize(name);
+        inner["bytes"] = pack109::serialize(data);
+        KVMap outer{{"File", pack109::serialize_map(inner)}};
+        return pack109::serialize_map(outer);
+    };
+
+    std::cout << "encode: File message build time, " << iters << " iterations\n";
+    std::cout << std::setw(10) << "payload" << std::setw(14) << "kvmap ns"
+              << std::setw(14) << "exact ns" << std::setw(10) << "speedup" << "\n";
+    for (size_t size : sizes) {
+        Bytes data(size, 0x33);
+        double k = ns_per_op(iters, [&] { g_sink += kvmap(data).size(); });
+        double e = ns_per_op(iters, [&] { g_sink += FileMessage::serialize(name, data.data(), size).size(); });
+        std::cout << std::setw(10) << size << std::setw(14) << std::fixed << std::setprecision(0) << k
+                  << std::setw(14) << e << std::setw(9) << std::setprecision(2) << k / e << "x\n";
+    }
+}
+
+// Benchmark: decode
+// Purpose: Time to decode a File message. "kvmap" copies every element into a
+//          map of vectors and decodes nested maps from those copies; "view"
+//          walks the buffer in place and only copies the file content out.
+static void bench_decode() {
+    const size_t sizes[] = {16, 64, 255};
+    const size_t iters = 200000;
+
+    auto kvmap = [](const Bytes &m) {
+        auto outer = pack109::deserialize_map(m);
+        auto inner = pack109::deserialize_map(outer.at("File"));
+        std::string name = pack109::deserialize_string(inner.at("name"));
+        Bytes data = pack109::deserialize_vec_u8(inner.at("bytes"));
+        return name.size() + data.size();
+    };
+    auto view = [](const Bytes &m) {
+        FileMessage::View v = FileMessage::parse(m.data(), m.size());
+        return v.name.size + v.data.to_vec().size();
+    };
+
+    std::cout << "decode: File message decode time, " << iters << " iterations\n";
+    std::cout << std::setw(10) << "payload" << std::setw(14) << "kvmap ns"
+              << std::setw(14) << "view ns" << std::setw(10) << "speedup" << "\n";
+    for (size_t size : sizes) {
+        Bytes msg = FileMessage("bench_file.bin", Bytes(size, 0x33)).serialize();
+        double k = ns_per_op(iters, [&] { g_sink += kvmap(msg); });
+        double v = ns_per_op(iters, [&] { g_sink += view(msg); });
+        std::cout << std::setw(10) << size << std::setw(14) << std::fixed << std::setprecision(0) << k
+                  << std::setw(14) << v << std::setw(9) << std::setprecision(2) << k / v << "x\n";
+    }
+}
+
+// Benchmark: payload
+// Purpose: Wire size and decode time of file content. "tagged" is the original
+//          layout (a U8 tag before every byte, decoded element by element, as
+//          A8 would be if it could hold the length); "binary" is the raw B16/B32
+//          block FileMessage now uses, viewed in place and copied with memcpy.
+static void bench_payload() {
+    const size_t sizes[] = {255, 4096, 65536};
+    const size_t total = size_t(256) << 20;   // Content bytes decoded per measurement
+
+    auto tagged_decode = [](const Bytes &enc, size_t count) {
+        Bytes out;
+        size_t i = 3;                          // Tag and 16-bit count
+        while (out.size() < count) {
+            if (i + 2 > enc.size() || enc[i] != PACK109_U8) throw std::runtime_error("bad");
+            out.push_back(enc[i + 1]);
+            i += 2;
+        }
+        return out;
+    };
+
+    std::cout << "payload: file content encoding, " << (total >> 20) << " MiB decoded per size\n";
+    std::cout << std::setw(10) << "size" << std::setw(14) << "tagged B" << std::setw(14) << "binary B"
+              << std::setw(14) << "tagged ns" << std::setw(14) << "binary ns" << std::setw(10) << "speedup" << "\n";
+    for (size_t size : sizes) {
+        Bytes content(size, 0x61);
+        Bytes tagged = {PACK109_A16, (uint8_t)(size >> 8), (uint8_t)size};
+        for (uint8_t b : content) { tagged.push_back(PACK109_U8); tagged.push_back(b); }
+        Bytes binary = pack109::serialize_binary(content.data(), size);
+
+        size_t iters = total / size;
+        double t = ns_per_op(iters, [&] { g_sink += tagged_decode(tagged, size).size(); });
+        double b = ns_per_op(iters, [&] {
+            pack109::Reader in(binary);
+            g_sink += in.read_bytes().to_vec().size();
+        });
+        std::cout << std::setw(10) << size << std::setw(14) << tagged.size() << std::setw(14) << binary.size()
+                  << std::setw(14) << std::fixed << std::setprecision(0) << t << std::setw(14) << b
+                  << std::setw(9) << std::setprecision(2) << t / b << "x\n";
+    }
+}
+
+// Benchmark: persist
+// Purpose: Encode and load time of a 100k-file store. "kvmap" goes through a
+//          KVMap of per-file vectors (the original persistence path, which
+//          is only possible now that maps have 16/32-bit forms); "direct"
+//          is encode_store/decode_store; "mapped" writes the indexed store
+//          file and loads it by mapping (contents are not read until used).
+static void bench_persist() {
+    const size_t files = 100000, value_size = 256;
+    FileServerMap store;
+    for (size_t i = 0; i < files; ++i)
+        store.insert("file_" + std::to_string(i) + ".bin", distinct_body(value_size, i));
+
+    Bytes kv_bytes, direct_bytes;
+    auto start = Clock::now();
+    {
+        KVMap out;
+        store.for_each([&out](const std::string &name, const BlobRef &blob) {
+            out[name] = pack109::serialize_binary(blob->data(), blob->size());
+        });
+        kv_bytes = pack109::serialize_map(out);
+    }
+    double kv_enc = seconds_since(start);
+    start = Clock::now();
+    encode_store(store, direct_bytes);
+    double direct_enc = seconds_since(start);
+
+    start = Clock::now();
+    {
+        FileServerMap loaded;
+        for (auto &kv : pack109::deserialize_map(kv_bytes))
+            loaded.insert(kv.first, pack109::deserialize_vec_u8(kv.second));
+        g_sink += loaded.size();
+    }
+    double kv_dec = seconds_since(start);
+    start = Clock::now();
+    {
+        FileServerMap loaded;
+        g_sink += decode_store(direct_bytes.data(), direct_bytes.size(), loaded);
+    }
+    double direct_dec = seconds_since(start);
+
+    const char *path = "bench_persist.bin";
+    start = Clock::now();
+    write_store_file(path, store);
+    double mapped_enc = seconds_since(start);
+    start = Clock::now();
+    {
+        FileServerMap loaded;
+        g_sink += read_store_file(path, loaded);
+    }
+    double mapped_dec = seconds_since(start);
+    unlink(path);
+
+    std::cout << "persist: " << files << " files of " << value_size << " bytes, "
+              << (direct_bytes.size() >> 20) << " MiB encoded\n";
+    std::cout << std::setw(10) << "path" << std::setw(14) << "encode ms" << std::setw(14) << "load ms" << "\n";
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(10) << "kvmap" << std::setw(14) << kv_enc * 1e3 << std::setw(14) << kv_dec * 1e3 << "\n"
+              << std::setw(10) << "direct" << std::setw(14) << direct_enc * 1e3 << std::setw(14) << direct_dec * 1e3 << "\n"
+              << std::setw(10) << "mapped" << std::setw(14) << mapped_enc * 1e3 << std::setw(14) << mapped_dec * 1e3 << "\n";
+
+    // Startup with large files: the old format is read and copied in full,
+    // the indexed one only has its index read
+    const size_t big_files = 256, big_size = 1 << 20;
+    FileServerMap big;
+    for (size_t i = 0; i < big_files; ++i)
+        big.insert("big_" + std::to_string(i), distinct_body(big_size, i));
+    Bytes old_bytes;
+    encode_store(big, old_bytes);
+    FILE *f = fopen(path, "wb");
+    fwrite(old_bytes.data(), 1, old_bytes.size(), f);
+    fclose(f);
+    old_bytes = Bytes();
+    start = Clock::now();
+    {
+        FileServerMap loaded;
+        g_sink += read_store_file(path, loaded);
+    }
+    double old_load = seconds_since(start);
+    write_store_file(path, big);
+    start = Clock::now();
+    {
+        FileServerMap loaded;
+        g_sink += read_store_file(path, loaded);
+    }
+    double mapped_load = seconds_since(start);
+    unlink(path);
+    std::cout << "startup: " << big_files << " files of " << (big_size >> 20) << " MiB: single map "
+              << old_load * 1e3 << " ms, mapped " << mapped_load * 1e3 << " ms\n";
+}
+
+// Benchmark: wal
+// Purpose: Latency and throughput of logged PUTs with fsync on every commit,
+//          for several writer counts and group-commit windows. The log is
+//          written to the current directory so it lands on a real disk.
+static void bench_wal() {
+    const size_t threads_list[] = {1, 8, 32};
+    const unsigned windows_us[] = {0, 100, 1000};
+    const size_t value_size = 1024;
+    const double seconds = 1.0;           // Run time per configuration
+    const char *path = "bench_wal.log";
+
+    std::cout << "wal: fsync=always, " << value_size << "-byte files, " << seconds << " s per row\n";
+    std::cout << std::setw(8) << "threads" << std::setw(11) << "window us" << std::setw(12) << "ops/s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(11) << "per batch" << "\n";
+    for (size_t threads : threads_list) {
+        for (unsigned window : windows_us) {
+            unlink(path);
+            FileServerMap store;
+            WriteAheadLog wal(path, FsyncPolicy::Always, 0, window);
+            std::vector<std::vector<double>> lat(threads);
+            auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(seconds));
+            double secs = run_threads(threads, [&](size_t t) {
+                std::string name = "w" + std::to_string(t);
+                while (Clock::now() < deadline) {
+                    auto start = Clock::now();
+                    wal.insert(store, name, std::vector<uint8_t>(value_size, (uint8_t)t));
+                    lat[t].push_back(seconds_since(start) * 1e6);
+                }
+            });
+            std::vector<double> all;
+            for (auto &l : lat) all.insert(all.end(), l.begin(), l.end());
+            std::sort(all.begin(), all.end());
+            std::cout << std::setw(8) << threads << std::setw(11) << window << std::fixed << std::setprecision(0)
+                      << std::setw(12) << all.size() / secs
+                      << std::setw(10) << all[all.size() / 2] << std::setw(10) << all[all.size() * 99 / 100]
+                      << std::setw(11) << std::setprecision(1) << double(wal.records()) / wal.batches() << "\n";
+        }
+    }
+    unlink(path);
+}
+
+// Benchmark: snapshot
+// Purpose: How long saving a large store stops the caller: writing the file
+//          in-line versus forking a child to write it. The files are written
+//          to the current directory so they land on a real disk.
+static void bench_snapshot() {
+    const size_t files = 100000, value_size = 1024;
+    const char *path = "bench_snapshot.bin";
+    FileServerMap store;
+    for (size_t i = 0; i < files; ++i)
+        store.insert("file_" + std::to_string(i) + ".bin", distinct_body(value_size, i));
+
+    auto start = Clock::now();
+    write_store_file(path, store);
+    double inline_ms = seconds_since(start) * 1e3;
+
+    double pause_ms, total_ms;
+    {
+        Snapshotter snapshots(path, store, nullptr, 0);
+        start = Clock::now();
+        snapshots.start();
+        pause_ms = seconds_since(start) * 1e3;
+        snapshots.wait();
+        total_ms = seconds_since(start) * 1e3;
+    }
+    unlink(path);
+
+    std::cout << "snapshot: " << files << " files of " << value_size << " bytes\n";
+    std::cout << std::setw(10) << "path" << std::setw(14) << "blocked ms" << std::setw(14) << "total ms" << "\n";
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(10) << "inline" << std::setw(14) << inline_ms << std::setw(14) << inline_ms << "\n"
+              << std::setw(10) << "fork" << std::setw(14) << pause_ms << std::setw(14) << total_ms << "\n";
+}
+
+// Benchmark: load
+// Purpose: Startup time for stores of 256k and 2.5M 4 KiB files: the old
+//          single-map file (smaller store only, since it is read into memory
+//          whole) and the indexed file decoded on one thread and on every
+//          core. Every file shares one blob, and the indexed file writes a
+//          shared body once, so it holds the index and one body; its real
+//          size is printed. It is written to the current directory.
+static void bench_load() {
+    const size_t file_size = 4096;
+    const char *path = "bench_load.bin";
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    BlobRef content = make_blob(std::vector<uint8_t>(file_size, 0x42));
+
+    std::cout << "load: " << file_size << "-byte files sharing one body, " << cores << " core(s)\n";
+    std::cout << std::setw(10) << "files" << std::setw(10) << "file MiB" << std::setw(14) << "single map"
+              << std::setw(12) << "1 thread" << std::setw(12) << "all cores" << "   (ms)\n";
+    for (size_t files : {size_t(1) << 18, size_t(10) << 18}) {
+        double single_ms = 0;
+        {
+            FileServerMap store;
+            store.reserve(files);
+            for (size_t i = 0; i < files; ++i) store.insert("file_" + std::to_string(i), content);
+            if (files == size_t(1) << 18) {
+                Bytes old_bytes;
+                encode_store(store, old_bytes);
+                FILE *f = fopen(path, "wb");
+                fwrite(old_bytes.data(), 1, old_bytes.size(), f);
+                fclose(f);
+                old_bytes = Bytes();
+                auto start = Clock::now();
+                FileServerMap loaded;
+                g_sink += read_store_file(path, loaded);
+                single_ms = seconds_since(start) * 1e3;
+            }
+            write_store_file(path, store);
+        }
+        struct stat st;
+        stat(path, &st);
+        double ms[2];
+        size_t threads[2] = {1, cores};
+        for (int k = 0; k < 2; ++k) {
+            auto start = Clock::now();
+            FileServerMap loaded;
+            g_sink += read_store_file(path, loaded, threads[k]);
+            ms[k] = seconds_since(start) * 1e3;
+        }
+        std::cout << std::setw(10) << files << std::fixed << std::setprecision(1)
+                  << std::setw(10) << st.st_size / double(1 << 20)
+                  << std::setw(14) << (single_ms ? std::to_string(int(single_ms)) : std::string("-"))
+                  << std::setw(12) << ms[0] << std::setw(12) << ms[1] << "\n";
+        unlink(path);
+    }
+}
+
+// Benchmark: table
+// Purpose: Insert and lookup cost of the shard table, FlatTable, against the
+//          node-based std::unordered_map it replaced, at 1k, 1M and 10M keys.
+//          Lookups hit existing keys in a scattered order; each timing
+//          includes hashing the key.
+static void bench_table() {
+    const size_t sizes[] = {1000, 1000000, 10000000};
+    BlobRef value = make_blob(std::vector<uint8_t>(16, 1));
+    std::cout << "table: ns per op, lookups in scattered order\n";
+    std::cout << std::setw(10) << "keys" << std::setw(16) << "flat insert" << std::setw(16) << "flat lookup"
+              << std::setw(16) << "std insert" << std::setw(16) << "std lookup" << "\n";
+    for (size_t n : sizes) {
+        std::vector<std::string> keys(n);
+        for (size_t i = 0; i < n; ++i) keys[i] = "file_" + std::to_string(i);
+        size_t lookups = std::max<size_t>(n, 2000000);
+        auto order = [n](size_t i) { return (i * 2654435761u) % n; };   // Scatters the keys
+
+        double flat_ins, flat_get, std_ins, std_get;
+        {
+            FlatTable table;
+            size_t i = 0;
+            bool added;
+            flat_ins = ns_per_op(n, [&] {
+                const std::string &k = keys[i++];
+                table.find_or_insert(k, FlatTable::hash(k), added).assign(value);
+            });
+            i = 0;
+            size_t sink = 0;
+            flat_get = ns_per_op(lookups, [&] {
+                const std::string &k = keys[order(i++)];
+                sink += table.find(k, FlatTable::hash(k))->value_size();
+            });
+            g_sink += sink;
+        }
+        {
+            std::unordered_map<std::string, BlobRef> table;
+            size_t i = 0;
+            std_ins = ns_per_op(n, [&] { table[keys[i++]] = value; });
+            i = 0;
+            size_t sink = 0;
+            std_get = ns_per_op(lookups, [&] { sink += table.find(keys[order(i++)])->second->size(); });
+            g_sink += sink;
+        }
+        std::cout << std::setw(10) << n << std::fixed << std::setprecision(1)
+                  << std::setw(16) << flat_ins << std::setw(16) << flat_get
+                  << std::setw(16) << std_ins << std::setw(16) << std_get << "\n";
+    }
+}
+
+// Function: heap_in_use
+// Returns:
+//   - Bytes currently allocated from malloc, including chunk overhead and
+//     blocks large enough to be mapped on their own.
+static size_t heap_in_use() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+// Benchmark: memory
+// Purpose: Heap and slab memory per stored entry for 1M files of several shapes:
+//          short names with tiny bodies, a long name, and a body too large to
+//          keep in the table.
+static void bench_memory() {
+    const size_t files = 1000000;
+    struct Shape { const char *label; const char *prefix; size_t value_size; };
+    const Shape shapes[] = {
+        {"tiny", "cfg/", 16},
+        {"small", "config/service_", 48},
+        {"long name", "configuration/services/production/instance_", 32},
+        {"large", "cfg/", 200},
+    };
+    std::cout << "memory: " << files << " files per row\n";
+    std::cout << std::setw(12) << "shape" << std::setw(10) << "name" << std::setw(10) << "body"
+              << std::setw(16) << "bytes/entry" << "\n";
+    for (const Shape &shape : shapes) {
+        size_t before = heap_in_use(), name_len = 0;
+        {
+            FileServerMap store;
+            for (size_t i = 0; i < files; ++i) {
+                std::string name = shape.prefix + std::to_string(i % 10) + "_" + std::to_string(i);
+                name_len = name.size();
+                store.insert(name, distinct_body(shape.value_size, i));
+            }
+            size_t after = heap_in_use() + store.slab_stats().mapped;
+            std::cout << std::setw(12) << shape.label << std::setw(10) << name_len << std::setw(10) << shape.value_size
+                      << std::setw(16) << std::fixed << std::setprecision(1)
+                      << double(after - before) / files << "\n";
+        }
+    }
+}
+
+// Function: resident_bytes
+// Returns:
+//   - The process's resident set size, from /proc/self/statm.
+static size_t resident_bytes() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return size_t(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// Benchmark: churn
+// Purpose: Resident memory against live data while files are replaced over
+//          and over, with body sizes that drift between phases of small and
+//          large files. Bodies go on the general heap, into slabs, or into
+//          slabs compacted after every round; each runs in its own forked
+//          child so one allocator's leftovers cannot flatter the next.
+static void bench_churn() {
+    const size_t keys = 20000, rounds = 12, per_round = 100000;
+    const char *modes[] = {"heap", "slab", "compacted"};
+    std::vector<double> rss[3];
+    std::vector<double> live;
+    for (int mode = 0; mode < 3; ++mode) {
+        int fds[2];
+        if (pipe(fds) != 0) return;
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            std::vector<double> out;
+            {
+                FileServerMap store;
+                std::vector<std::string> names(keys);
+                std::vector<size_t> sizes(keys, 0);
+                for (size_t i = 0; i < keys; ++i) names[i] = "file_" + std::to_string(i);
+                uint64_t rng = 88172645463325252ull;
+                auto next = [&rng] { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+                size_t live_bytes = 0;
+                std::vector<uint8_t> body;
+                for (size_t r = 0; r < rounds; ++r) {
+                    bool large = (r / 2) % 2 == 0;   // Two rounds of each phase
+                    for (size_t n = 0; n < per_round; ++n) {
+                        size_t k = next() % keys;
+                        size_t len = large ? 4096 + next() % 12288 : 200 + next() % 1800;
+                        body = distinct_body(len, r * per_round + n);
+                        live_bytes += len - sizes[k];
+                        sizes[k] = len;
+                        if (mode == 0) store.insert(names[k], make_blob(std::move(body)));
+                        else store.insert(names[k], body);
+                    }
+                    if (mode == 2) store.compact();
+                    out.push_back(double(live_bytes));
+                    out.push_back(double(resident_bytes()));
+                }
+            }
+            ssize_t w = write(fds[1], out.data(), out.size() * sizeof(double));
+            _exit(w == ssize_t(out.size() * sizeof(double)) ? 0 : 1);
+        }
+        close(fds[1]);
+        std::vector<double> in(rounds * 2);
+        size_t got = 0;
+        while (got < in.size() * sizeof(double)) {
+            ssize_t n = read(fds[0], reinterpret_cast<char *>(in.data()) + got, in.size() * sizeof(double) - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        close(fds[0]);
+        waitpid(pid, nullptr, 0);
+        live.clear();
+        for (size_t r = 0; r < rounds; ++r) {
+            live.push_back(in[2 * r]);
+            rss[mode].push_back(in[2 * r + 1]);
+        }
+    }
+
+    std::cout << "churn: " << keys << " files, " << per_round << " replacements per round, MB\n";
+    std::cout << std::setw(6) << "round" << std::setw(8) << "phase" << std::setw(10) << "live";
+    for (const char *m : modes) std::cout << std::setw(12) << m;
+    std::cout << "\n" << std::fixed << std::setprecision(1);
+    for (size_t r = 0; r < rounds; ++r) {
+        std::cout << std::setw(6) << r << std::setw(8) << ((r / 2) % 2 == 0 ? "large" : "small")
+                  << std::setw(10) << live[r] / (1 << 20);
+        for (int mode = 0; mode < 3; ++mode) std::cout << std::setw(12) << rss[mode][r] / (1 << 20);
+        std::cout << "\n";
+    }
+}
+
+// Benchmark: cache
+// Purpose: GETs against a store larger than its memory budget. Four in five
+//          requests go to a hot fifth of the files; the rest are spread over
+//          all of them. Reports the hit rate, the cost per GET and where the
+//          bytes ended up, for budgets from unbounded down to a tenth of the
+//          data. The spill file goes to the current directory.
+static void bench_cache() {
+    const size_t files = 20000, size = 16384, gets = 400000;
+    const size_t total = files * size;
+    std::vector<std::string> names(files);
+    for (size_t i = 0; i < files; ++i) names[i] = "file_" + std::to_string(i);
+    std::cout << "cache: " << files << " files of " << size << " bytes (" << (total >> 20) << " MiB), 80/20 GETs\n";
+    std::cout << std::setw(12) << "budget MiB" << std::setw(10) << "hit %" << std::setw(12) << "ns/get"
+              << std::setw(12) << "evictions" << std::setw(14) << "memory MiB" << std::setw(12) << "disk MiB" << "\n";
+    for (size_t divisor : {0, 2, 10}) {
+        FileServerMap store;
+        size_t budget = divisor ? total / divisor : 0;
+        if (budget) store.enable_spill("bench_cache.spill", budget);
+        for (size_t i = 0; i < files; ++i) store.insert(names[i], distinct_body(size, i));
+        FileServerMap::CacheStats before = store.cache_stats();
+        uint64_t rng = 2463534242ull;
+        size_t sink = 0;
+        double ns = ns_per_op(gets, [&] {
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+            size_t k = rng % 5 ? (rng >> 8) % (files / 5) : (rng >> 8) % files;
+            sink += store.get(names[k])->size();
+        });
+        g_sink += sink;
+        FileServerMap::CacheStats st = store.cache_stats();
+        uint64_t hits = st.hits - before.hits, misses = st.misses - before.misses;
+        std::cout << std::setw(12) << (budget ? std::to_string(budget >> 20) : std::string("unbounded"))
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << (budget ? 100.0 * hits / (hits + misses) : 100.0)
+                  << std::setw(12) << ns << std::setw(12) << st.evictions
+                  << std::setw(14) << double(budget ? st.resident : total) / (1 << 20)
+                  << std::setw(12) << double(st.spilled) / (1 << 20) << "\n";
+    }
+}
+
+// Function: cpu_seconds
+// Returns:
+//   - The CPU time used by the process so far.
+static double cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Benchmark: compress
+// Purpose: What --compress buys and costs for JSON, log text and random
+//          bytes: the ratio of content to stored bytes, the CPU seconds per
+//          GB of content to compress on upload and decompress on GET, and
+//          the snapshot size with and without compression. Snapshots go to
+//          the current directory.
+static void bench_compress() {
+    const size_t files = 4096, size = 16384;
+    const char *path = "bench_compress.bin";
+    const char *levels[] = {"DEBUG", "INFO", "WARN"};
+    std::cout << "compress: " << files << " files of " << size << " bytes per data set\n";
+    std::cout << std::setw(8) << "data" << std::setw(8) << "ratio" << std::setw(14) << "comp s/GB"
+              << std::setw(14) << "decomp s/GB" << std::setw(14) << "raw snap MiB" << std::setw(14) << "lz snap MiB" << "\n";
+    for (int kind = 0; kind < 3; ++kind) {
+        std::vector<std::vector<uint8_t>> bodies(files);
+        uint64_t rng = 88172645463325252ull;
+        for (size_t i = 0; i < files; ++i) {
+            std::string body;
+            for (size_t n = 0; body.size() < size; ++n) {
+                rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+                if (kind == 0) {
+                    body += "{\"id\": " + std::to_string(i * 1000 + n) + ", \"user\": \"user" + std::to_string(rng % 5000)
+                          + "\", \"active\": " + (rng & 1 ? "true" : "false") + ", \"score\": " + std::to_string(rng % 100000)
+                          + ", \"tags\": [\"t" + std::to_string(rng % 40) + "\", \"t" + std::to_string(rng % 7) + "\"]},\n";
+                } else if (kind == 1) {
+                    body += "2025-05-12 10:" + std::to_string(10 + n % 50) + ":" + std::to_string(10 + rng % 50) + " "
+                          + levels[rng % 3] + " request " + std::to_string(rng % 1000000) + " served /files/doc"
+                          + std::to_string(rng % 300) + ".txt in " + std::to_string(rng % 900) + " us\n";
+                } else {
+                    body.append(reinterpret_cast<const char *>(&rng), sizeof(rng));
+                }
+            }
+            bodies[i].assign(body.begin(), body.begin() + size);
+        }
+
+        std::vector<uint8_t> out;
+        double cpu = cpu_seconds();
+        for (const std::vector<uint8_t> &body : bodies)   // What a compressing insert adds
+            g_sink += lz_compress(body.data(), body.size(), out, size - size / 8);
+        double comp = cpu_seconds() - cpu;
+
+        FileServerMap raw, packed;
+        packed.enable_compression();
+        for (size_t i = 0; i < files; ++i) {
+            packed.insert("f" + std::to_string(i), std::vector<uint8_t>(bodies[i]));
+            raw.insert("f" + std::to_string(i), std::move(bodies[i]));
+        }
+
+        size_t stored = 0, sink = 0;
+        std::vector<BlobRef> blobs;
+        for (size_t i = 0; i < files; ++i) blobs.push_back(packed.get_stored("f" + std::to_string(i)));
+        for (const BlobRef &b : blobs) stored += b->size();
+        cpu = cpu_seconds();
+        for (const BlobRef &b : blobs) sink += inflate(b)->size();
+        double decomp = cpu_seconds() - cpu;
+        g_sink += sink;
+
+        double snap[2];
+        for (int k = 0; k < 2; ++k) {
+            write_store_file(path, k ? packed : raw);
+            struct stat st;
+            stat(path, &st);
+            snap[k] = double(st.st_size) / (1 << 20);
+        }
+        unlink(path);
+
+        double gb = double(files) * size / 1e9;
+        std::cout << std::setw(8) << (kind == 0 ? "json" : kind == 1 ? "text" : "random")
+                  << std::fixed << std::setprecision(2) << std::setw(8) << double(files) * size / stored
+                  << std::setw(14) << comp / gb << std::setw(14) << decomp / gb
+                  << std::setprecision(1) << std::setw(14) << snap[0] << std::setw(14) << snap[1] << "\n";
+    }
+}
+
+// Benchmark: dedup
+// Purpose: Uploads of 16 KiB files drawn from fewer and fewer distinct
+//          bodies: the dedup ratio, the memory the bodies take, the snapshot
+//          size and the cost per insert (which now includes hashing the
+//          body), plus the digest's own speed. The snapshot goes to the
+//          current directory.
+static void bench_dedup() {
+    const size_t files = 20000, size = 16384;
+    const char *path = "bench_dedup.bin";
+    std::vector<uint8_t> block(64 << 20, 7);
+    auto start = Clock::now();
+    for (int i = 0; i < 4; ++i) g_sink += content_digest(block.data(), block.size()).lo;
+    double digest_gbs = 4.0 * block.size() / 1e9 / seconds_since(start);
+    std::cout << "dedup: " << files << " uploads of " << size << " bytes, digest "
+              << std::fixed << std::setprecision(1) << digest_gbs << " GB/s\n";
+    std::cout << std::setw(10) << "distinct" << std::setw(8) << "ratio" << std::setw(12) << "ns/insert"
+              << std::setw(14) << "memory MiB" << std::setw(12) << "snap MiB" << "\n";
+    for (size_t distinct : {files, files / 4, files / 40}) {
+        std::vector<std::vector<uint8_t>> bodies(files);
+        for (size_t i = 0; i < files; ++i) bodies[i] = distinct_body(size, i % distinct);
+        FileServerMap store;
+        start = Clock::now();
+        for (size_t i = 0; i < files; ++i) store.insert("file_" + std::to_string(i), std::move(bodies[i]));
+        double ns = seconds_since(start) * 1e9 / files;
+        ContentTable::Stats st = store.dedup_stats();
+        write_store_file(path, store);
+        struct stat info;
+        stat(path, &info);
+        unlink(path);
+        std::cout << std::setw(10) << distinct << std::setprecision(1) << std::setw(8) << double(st.logical) / st.stored
+                  << std::setw(12) << ns << std::setw(14) << double(store.slab_stats().in_use) / (1 << 20)
+                  << std::setw(12) << double(info.st_size) / (1 << 20) << "\n";
+    }
+}
+
+// Struct: Benchmark
+// Purpose: Associates a benchmark name with the function that runs it.
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+    {"store", bench_store},
+    {"dispatch", bench_dispatch},
+    {"xor", bench_xor},
+    {"encode", bench_encode},
+    {"decode", bench_decode},
+    {"payload", bench_payload},
+    {"persist", bench_persist},
+    {"wal", bench_wal},
+    {"snapshot", bench_snapshot},
+    {"load", bench_load},
+    {"table", bench_table},
+    {"memory", bench_memory},
+    {"churn", bench_churn},
+    {"cache", bench_cache},
+    {"compress", bench_compress},
+    {"dedup", bench_dedup},
+};
+
+// Entry point
+// Function: main
+// Purpose: Runs the benchmarks named on the command line, or all of them.
+int main(int argc, char *argv[]) {
+    bool ran = false;
+    for (const Benchmark &b : BENCHMARKS) {
+        bool selected = (argc == 1);
+        for (int i = 1; i < argc; ++i)
+            if (strcmp(argv[i], b.name) == 0) selected = true;
+        if (!selected) continue;
+        b.run();
+        std::cout << "\n";
+        ran = true;
+    }
+    if (!ran) {
+        std::cerr << "Unknown benchmark. Available:";
+        for (const Benchmark &b : BENCHMARKS) std::cerr << " " << b.name;
+        std::cerr << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+// File: blob.hpp
+// Description: Header file for the immutable, reference-counted byte buffers that
+//              hold stored file contents. A blob is never modified after it is
+//              created, so any number of threads can read it without locking and
+//              handing one out only costs a reference-count increment.
+// Author: [Your Name]
+// Date: [Insert Date]
+
+#ifndef BLOB_HPP
+#define BLOB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "digest.hpp"   // Digest
+
+// Class: Blob
+// Purpose: Read-only view of one stored file's bytes, together with the storage
+//          that keeps them alive. The bytes may be the file's content
+//          compressed with lz_compress (see lz.hpp); decoded_size() then gives
+//          the content's length.
+class Blob {
+public:
+    // Constructor
+    // Purpose: Takes ownership of a byte vector without copying it.
+    // Parameters:
+    //   - bytes: The file content.
+    //   - decoded_size: The content's length if `bytes` is compressed, else 0.
+    explicit Blob(std::vector<uint8_t> bytes, size_t decoded_size = 0)
+      : owned_(std::move(bytes)), data_(owned_.data()), size_(owned_.size()),
+        decoded_size_(decoded_size) {}
+
+    // Constructor
+    // Purpose: Refers to bytes owned by something else, such as a memory-mapped
+    //          store file, without copying them.
+    // Parameters:
+    //   - keeper: Keeps the bytes alive for as long as the blob exists.
+    //   - data, size: The file content.
+    //   - decoded_size: The content's length if the bytes are compressed, else 0.
+    Blob(std::shared_ptr<const void> keeper, const uint8_t *data, size_t size, size_t decoded_size = 0)
+      : keeper_(std::move(keeper)), data_(data), size_(size), decoded_size_(decoded_size) {}
+
+    Blob(const Blob &) = delete;
+    Blob &operator=(const Blob &) = delete;
+
+    // Method: data
+    // Returns:
+    //   - A pointer to the first byte of the file content.
+    const uint8_t *data() const { return data_; }
+
+    // Method: size
+    // Returns:
+    //   - The length of the bytes held, in bytes.
+    size_t size() const { return size_; }
+
+    // Method: compressed
+    // Returns:
+    //   - Whether the bytes are compressed content.
+    bool compressed() const { return decoded_size_ != 0; }
+
+    // Method: decoded_size
+    // Returns:
+    //   - The length of the file content, compressed or not.
+    size_t decoded_size() const { return decoded_size_ ? decoded_size_ : size_; }
+
+    // Method: copy
+    // Returns:
+    //   - A new vector holding the bytes (for callers that need ownership).
+    std::vector<uint8_t> copy() const { return std::vector<uint8_t>(data_, data_ + size_); }
+
+    // Method: digest
+    // Returns:
+    //   - The digest of the file content if the blob takes part in
+    //     deduplication (see ContentTable), else an empty one.
+    const Digest &digest() const { return digest_; }
+
+    // Method: set_digest
+    // Purpose: Records the content digest. Only called by the blob's creator,
+    //          before the blob is shared with anyone.
+    void set_digest(const Digest &d) const { digest_ = d; }
+
+private:
+    std::vector<uint8_t> owned_; // Storage for the bytes, unless kept by keeper_
+    std::shared_ptr<const void> keeper_; // Owner of borrowed bytes, if any
+    const uint8_t *data_;        // First byte of the content
+    size_t size_;                // Length of the content
+    size_t decoded_size_;        // Length once decompressed, or 0 if not compressed
+    mutable Digest digest_;      // Content digest, empty if not deduplicated
+};
+
+// Type alias for a shared handle to a stored blob
+using BlobRef = std::shared_ptr<const Blob>;
+
+// Function: make_blob
+// Purpose: Wraps a byte vector in a new shared blob without copying the bytes.
+//          `decoded_size` is as for the Blob constructor.
+inline BlobRef make_blob(std::vector<uint8_t> bytes, size_t decoded_size = 0) {
+    return std::make_shared<const Blob>(std::move(bytes), decoded_size);
+}
+
+// Constant: SMALL_BLOB_SIZE
+// Purpose: Largest content copy_blob keeps in the same allocation as the blob.
+constexpr size_t SMALL_BLOB_SIZE = 80;
+
+// Function: copy_blob
+// Purpose: Copies a byte range into a new blob. Contents of up to
+//          SMALL_BLOB_SIZE bytes share one allocation with the blob and its
+//          reference count; larger ones get a vector as usual.
+inline BlobRef copy_blob(const uint8_t *data, size_t len) {
+    if (len > SMALL_BLOB_SIZE) return make_blob(std::vector<uint8_t>(data, data + len));
+    struct Small {
+        uint8_t bytes[SMALL_BLOB_SIZE];
+        Blob blob;
+        Small(const uint8_t *d, size_t n) : blob(nullptr, bytes, n) { if (n) std::memcpy(bytes, d, n); }
+    };
+    std::shared_ptr<Small> holder = std::make_shared<Small>(data, len);
+    return BlobRef(holder, &holder->blob);   // Shares the holder's count
+}
+
+#endif // BLOB_HPP
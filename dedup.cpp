@@ -0,0 +1,315 @@
+// File: dedup.cpp
+// Description: Implementation of the content table.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "dedup.hpp"
+#include "lz.hpp"   // lz_decompress
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// Method: find
+// Purpose: Looks the digest up under its shard's lock.
+BlobRef ContentTable::find(const Digest &d) const {
+    Shard &s = shard_for(d);
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(d);
+    return it == s.entries.end() ? BlobRef() : it->second.blob;
+}
+
+// Method: acquire
+// Purpose: Adds a reference to the digest's entry, creating the entry with
+//          `blob` if there is none. A different body found under the digest
+//          is compared with `blob` with no lock held (read back from disk
+//          first if it is only there), then the entry is looked up again,
+//          since it may have changed meanwhile.
+BlobRef ContentTable::acquire(BlobRef blob, size_t &resident) {
+    resident = 0;
+    if (!blob || blob->digest().empty()) return blob;
+    Shard &s = shard_for(blob->digest());
+    BlobRef dropped, matched, loaded;        // Released after the lock is dropped
+    uint64_t loaded_at = 0;
+    for (;;) {
+        BlobRef other;
+        bool load = false;
+        uint64_t offset = 0;
+        size_t size = 0, decoded_size = 0;
+        {
+            std::lock_guard<std::mutex> guard(s.lock);
+            auto result = s.entries.emplace(blob->digest(),
+                Entry{blob, 0, 0, false, 0, blob->size(), blob->compressed() ? blob->decoded_size() : 0});
+            Entry &e = result.first->second;
+            if (result.second) {
+                ++s.stats.bodies;
+                s.stats.stored += blob->size();
+            } else if (!e.blob && loaded && e.on_disk && e.offset == loaded_at) {
+                e.blob = loaded;                 // Only on disk, and the same: revive it
+                dropped = std::move(blob);
+                blob = loaded;
+            } else if (!e.blob) {
+                if (!load_) {
+                    blob->set_digest(Digest());  // Cannot compare: keep it apart
+                    return blob;
+                }
+                load = true;
+                offset = e.offset;
+                size = e.size;
+                decoded_size = e.decoded_size;
+            } else if (e.blob != blob && e.blob != matched) {
+                other = e.blob;                  // Compare before sharing it
+            } else if (e.blob != blob) {
+                dropped = std::move(blob);
+                blob = e.blob;
+            }
+            if (!other && !load) {
+                if (e.refs++ == 0) resident = e.size;
+                count_reference(s, e);
+                return blob;
+            }
+        }
+        if (load) {
+            try {
+                loaded = load_(offset, size, decoded_size);
+            } catch (const std::exception &) {
+                loaded.reset();
+            }
+            if (!loaded || !same_content(*loaded, *blob)) {
+                blob->set_digest(Digest());      // Not yet shared: only the caller holds it
+                return blob;
+            }
+            loaded->set_digest(blob->digest());
+            loaded_at = offset;
+            continue;
+        }
+        if (!same_content(*other, *blob)) {
+            blob->set_digest(Digest());
+            return blob;
+        }
+        matched = std::move(other);
+    }
+}
+
+// Method: release
+// Purpose: Drops the blob with its last in-memory reference, and the entry
+//          with its last reference of either kind.
+size_t ContentTable::release(const BlobRef &blob) {
+    if (!blob || blob->digest().empty()) return 0;
+    Shard &s = shard_for(blob->digest());
+    BlobRef last, dead;                      // Released after the lock is dropped
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(blob->digest());
+    if (it == s.entries.end() || it->second.blob != blob) return 0;
+    Entry &e = it->second;
+    size_t freed = 0;
+    if (--e.refs == 0) {
+        last = std::move(e.blob);
+        freed = e.size;
+    }
+    dead = drop_reference(s, it);
+    return freed;
+}
+
+// Method: extent_of
+// Purpose: Reads the entry's extent under its shard's lock.
+bool ContentTable::extent_of(const BlobRef &blob, uint64_t &offset) const {
+    if (!blob || blob->digest().empty()) return false;
+    Shard &s = shard_for(blob->digest());
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(blob->digest());
+    if (it == s.entries.end() || !it->second.on_disk) return false;
+    offset = it->second.offset;
+    return true;
+}
+
+// Method: spill
+// Purpose: The entry keeps the first extent written for it for as long as
+//          some slot refers to it; later spills of the body share it.
+bool ContentTable::spill(const BlobRef &blob, uint64_t &offset, bool written, size_t &freed) {
+    freed = 0;
+    if (!blob || blob->digest().empty()) return false;
+    Shard &s = shard_for(blob->digest());
+    BlobRef last;                            // Released after the lock is dropped
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(blob->digest());
+    if (it == s.entries.end() || it->second.blob != blob) return false;
+    Entry &e = it->second;
+    if (e.on_disk) {
+        offset = e.offset;
+    } else if (!written) {
+        return false;                        // Freed since extent_of()
+    } else {
+        e.on_disk = true;
+        e.offset = offset;
+        std::lock_guard<std::mutex> extents_guard(extents_lock_);
+        extents_[offset] = blob->digest();
+    }
+    ++e.spilled;
+    if (--e.refs == 0) {
+        last = std::move(e.blob);
+        freed = e.size;
+    }
+    return true;
+}
+
+// Method: resident_at
+// Purpose: The caller's slot still refers to the extent, so it stays
+//          registered between the two lookups.
+bool ContentTable::resident_at(uint64_t offset, Digest &d, BlobRef &blob) const {
+    {
+        std::lock_guard<std::mutex> guard(extents_lock_);
+        auto it = extents_.find(offset);
+        if (it == extents_.end()) return false;
+        d = it->second;
+    }
+    Shard &s = shard_for(d);
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(d);
+    if (it != s.entries.end()) blob = it->second.blob;
+    return true;
+}
+
+// Method: fault_in
+// Purpose: The first slot read back makes its blob the entry's; the others
+//          share it.
+BlobRef ContentTable::fault_in(uint64_t offset, BlobRef blob, size_t &resident, bool &free_extent) {
+    resident = 0;
+    free_extent = true;
+    Digest d;
+    {
+        std::lock_guard<std::mutex> guard(extents_lock_);
+        auto it = extents_.find(offset);
+        if (it == extents_.end()) return blob;
+        d = it->second;
+    }
+    Shard &s = shard_for(d);
+    BlobRef dropped;                         // Released after the lock is dropped
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(d);
+    if (it == s.entries.end()) return blob;
+    Entry &e = it->second;
+    if (e.blob) {
+        dropped = std::move(blob);
+        blob = e.blob;
+    } else {
+        e.blob = blob;
+    }
+    if (e.refs++ == 0) resident = e.size;
+    free_extent = --e.spilled == 0;
+    if (free_extent) forget_extent(e);
+    return blob;
+}
+
+// Method: release_extent
+// Purpose: As release(), for a reference on disk.
+bool ContentTable::release_extent(uint64_t offset) {
+    Digest d;
+    {
+        std::lock_guard<std::mutex> guard(extents_lock_);
+        auto it = extents_.find(offset);
+        if (it == extents_.end()) return true;
+        d = it->second;
+    }
+    Shard &s = shard_for(d);
+    BlobRef dead;                            // Released after the lock is dropped
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(d);
+    if (it == s.entries.end() || !it->second.on_disk || it->second.offset != offset) return true;
+    bool last = --it->second.spilled == 0;
+    if (last) forget_extent(it->second);
+    dead = drop_reference(s, it);
+    return last;
+}
+
+// Method: count_reference
+// Purpose: Counts one more slot referring to the entry.
+void ContentTable::count_reference(Shard &s, const Entry &e) {
+    ++s.stats.references;
+    s.stats.logical += e.size;
+}
+
+// Method: drop_reference
+// Purpose: Uncounts a slot; erases the entry if none is left.
+// Returns:
+//   - The entry's blob if it was erased, to be released outside the lock.
+BlobRef ContentTable::drop_reference(Shard &s, Entries::iterator it) {
+    Entry &e = it->second;
+    --s.stats.references;
+    s.stats.logical -= e.size;
+    if (e.refs || e.spilled) return BlobRef();
+    --s.stats.bodies;
+    s.stats.stored -= e.size;
+    BlobRef last = std::move(e.blob);
+    s.entries.erase(it);
+    return last;
+}
+
+// Method: forget_extent
+// Purpose: Unregisters the extent, which the caller then frees.
+void ContentTable::forget_extent(Entry &e) {
+    e.on_disk = false;
+    std::lock_guard<std::mutex> guard(extents_lock_);
+    extents_.erase(e.offset);
+}
+
+// Method: holds
+// Purpose: Checks the decoded length first, so a blob of another size is
+//          never decoded.
+bool ContentTable::holds(const Blob &blob, const uint8_t *data, size_t len) {
+    if (blob.decoded_size() != len) return false;
+    if (!blob.compressed()) return std::memcmp(blob.data(), data, len) == 0;
+    std::vector<uint8_t> plain(len);
+    try {
+        lz_decompress(blob.data(), blob.size(), len, 0, len, plain.data());
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return std::memcmp(plain.data(), data, len) == 0;
+}
+
+// Method: same_content
+// Purpose: Blobs stored the same way are compared byte for byte; otherwise
+//          the compressed one is decoded.
+bool ContentTable::same_content(const Blob &a, const Blob &b) {
+    if (a.decoded_size() != b.decoded_size()) return false;
+    if (a.compressed() == b.compressed() && a.size() == b.size() &&
+        std::memcmp(a.data(), b.data(), a.size()) == 0)
+        return true;
+    if (!a.compressed() && !b.compressed()) return false;
+    if (!b.compressed()) return holds(a, b.data(), b.size());
+    std::vector<uint8_t> plain(b.decoded_size());
+    try {
+        lz_decompress(b.data(), b.size(), plain.size(), 0, plain.size(), plain.data());
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return holds(a, plain.data(), plain.size());
+}
+
+// Method: replace
+// Purpose: The copy has the same size, so the counts stay as they are.
+void ContentTable::replace(const BlobRef &old, const BlobRef &now) {
+    if (!old || old->digest().empty()) return;
+    Shard &s = shard_for(old->digest());
+    BlobRef previous;                        // Released after the lock is dropped
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(old->digest());
+    if (it == s.entries.end() || it->second.blob != old) return;
+    previous = std::move(it->second.blob);
+    it->second.blob = now;
+}
+
+// Method: stats
+// Purpose: Locks each shard in turn.
+ContentTable::Stats ContentTable::stats() const {
+    Stats st;
+    for (const Shard &s : shards_) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        st.references += s.stats.references;
+        st.bodies += s.stats.bodies;
+        st.logical += s.stats.logical;
+        st.stored += s.stats.stored;
+    }
+    return st;
+}
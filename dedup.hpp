@@ -0,0 +1,220 @@
+// File: dedup.hpp
+// Description: Header file for the content table, which lets files with the
+//              same body share one blob in memory and one extent in the spill
+//              file.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef DEDUP_HPP
+#define DEDUP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "blob.hpp"     // Blob, BlobRef
+#include "digest.hpp"   // Digest
+
+// Class: ContentTable
+// Purpose: Maps content digests to the one body holding that content, with a
+//          count of the table slots referring to it. A body is held in memory
+//          as a blob, on disk as a spill file extent, or both; every slot
+//          holding it in memory holds the same blob, and every slot holding it
+//          on disk the same extent. FileServerMap acquires a blob when a slot
+//          starts holding it, moves the reference between memory and disk as
+//          the slot is spilled and read back, and releases it when the slot
+//          lets go, so an entry lives exactly as long as some slot refers to
+//          its body, and a new upload of the same content gets that body
+//          instead of a copy. The blob is dropped with its last in-memory
+//          reference and the extent with its last on-disk one, and the calls
+//          that do so report it, so the caller can count resident bytes per
+//          distinct body and free extents. Only blobs with a digest take part.
+//          The table is split into shards by digest, each with its own mutex.
+class ContentTable {
+public:
+    // Struct: Stats
+    // Purpose: Sizes of the deduplicated part of the store.
+    struct Stats {
+        uint64_t references = 0;   // Slots holding a tracked body, in memory or on disk
+        uint64_t bodies = 0;       // Distinct tracked bodies
+        uint64_t logical = 0;      // Bytes the references would take as copies
+        uint64_t stored = 0;       // Bytes the distinct bodies take
+    };
+
+    // Type: Loader
+    // Purpose: Reads a spilled body back from the extent at `offset`, which
+    //          holds `length` bytes (compressed content if `decoded_size` is
+    //          not 0). Used to compare a new upload with a body that is only
+    //          on disk.
+    using Loader = std::function<BlobRef(uint64_t offset, size_t length, size_t decoded_size)>;
+
+    // Method: set_loader
+    // Purpose: Installs the loader; without one, a body that is only on disk
+    //          is not shared with new uploads. Call before the table is used.
+    void set_loader(Loader load) { load_ = std::move(load); }
+
+    // Method: find
+    // Returns:
+    //   - The blob holding the content with digest `d` in memory, or nullptr.
+    //     No reference is counted; acquire() does that.
+    BlobRef find(const Digest &d) const;
+
+    // Method: acquire
+    // Purpose: Counts a slot that is about to hold `blob` in memory. If
+    //          another body with the same digest and the same content is
+    //          already tracked (two uploads raced past find(), or the body is
+    //          only on disk), that one is shared: its blob is returned, or
+    //          `blob` becomes its blob. If its content differs, the digests
+    //          collided: `blob` loses its digest and is left out of
+    //          deduplication.
+    // Parameters:
+    //   - blob: The new content.
+    //   - resident: Set to the bytes that are now held in memory and were not
+    //     before (the body's size when it had no in-memory reference), else 0.
+    // Returns:
+    //   - The blob the slot should hold.
+    BlobRef acquire(BlobRef blob, size_t &resident);
+
+    // Method: release
+    // Purpose: Uncounts a slot that no longer holds `blob` in memory; the
+    //          entry is dropped with its last reference. Blobs that are not
+    //          tracked are ignored.
+    // Returns:
+    //   - The bytes no longer held in memory: the body's size if that was its
+    //     last in-memory reference, else 0.
+    size_t release(const BlobRef &blob);
+
+    // Method: extent_of
+    // Purpose: Finds the extent a body was already spilled to, so another
+    //          slot holding it can be spilled without writing it again.
+    // Returns:
+    //   - true, with `offset` set, if the body of `blob` is on disk.
+    bool extent_of(const BlobRef &blob, uint64_t &offset) const;
+
+    // Method: spill
+    // Purpose: Moves a slot's reference from `blob` to the body's extent. The
+    //          caller holds the slot's shard lock and has checked that the slot
+    //          still holds `blob`.
+    // Parameters:
+    //   - blob: The blob the slot holds.
+    //   - offset: The extent the caller wrote the body to, if `written`, or got
+    //     from extent_of(); set to the extent the slot must refer to, which
+    //     differs from a written one if another slot spilled the body first.
+    //   - written: Whether the caller wrote the extent itself.
+    //   - freed: Set to the bytes no longer held in memory, as for release().
+    // Returns:
+    //   - false if the slot must stay as it is: the entry changed, or the
+    //     extent from extent_of() was freed meanwhile.
+    bool spill(const BlobRef &blob, uint64_t &offset, bool written, size_t &freed);
+
+    // Method: resident_at
+    // Purpose: Looks up the body spilled at `offset`.
+    // Parameters:
+    //   - offset: The slot's extent.
+    //   - d: Set to the body's digest, if tracked.
+    // Returns:
+    //   - true if the extent belongs to a tracked body, with `blob` set to
+    //     its in-memory blob, if any, so it need not be read from disk.
+    bool resident_at(uint64_t offset, Digest &d, BlobRef &blob) const;
+
+    // Method: fault_in
+    // Purpose: Moves a slot's reference from the extent at `offset` back to
+    //          memory. The caller holds the slot's shard lock and has checked
+    //          that the slot still refers to the extent.
+    // Parameters:
+    //   - offset: The slot's extent.
+    //   - blob: The body read back, with its digest set; kept unless the body
+    //     is in memory already.
+    //   - resident: Set as for acquire().
+    //   - free_extent: Set to whether that was the extent's last reference,
+    //     so the caller must free it.
+    // Returns:
+    //   - The blob the slot should hold.
+    BlobRef fault_in(uint64_t offset, BlobRef blob, size_t &resident, bool &free_extent);
+
+    // Method: release_extent
+    // Purpose: Uncounts a slot that no longer refers to the extent at
+    //          `offset`; the entry is dropped with its last reference.
+    // Returns:
+    //   - Whether the caller must free the extent: it was the last reference
+    //     to it, or the extent does not belong to a tracked body.
+    bool release_extent(uint64_t offset);
+
+    // Method: replace
+    // Purpose: Points the entry of `old` at `now`, a copy of it that its
+    //          slots are being switched to (see FileServerMap::compact).
+    void replace(const BlobRef &old, const BlobRef &now);
+
+    // Method: holds
+    // Purpose: Compares a blob's content with a byte range, decoding the blob
+    //          first if it is compressed. A digest match is only a hint: the
+    //          digest is not cryptographic, so anyone can craft a body that
+    //          collides with a known one.
+    // Returns:
+    //   - true if the blob holds exactly `len` bytes equal to `data`.
+    static bool holds(const Blob &blob, const uint8_t *data, size_t len);
+
+    // Method: same_content
+    // Returns:
+    //   - true if the two blobs hold the same content, compressed or not.
+    static bool same_content(const Blob &a, const Blob &b);
+
+    // Method: stats
+    // Returns:
+    //   - The current counts, summed over the shards.
+    Stats stats() const;
+
+private:
+    static constexpr size_t SHARDS = 16;
+
+    // Struct: DigestHash
+    // Purpose: The digest is already well mixed; its low half is the hash.
+    struct DigestHash {
+        size_t operator()(const Digest &d) const { return static_cast<size_t>(d.lo); }
+    };
+
+    // Struct: Entry
+    // Purpose: The shared body and the number of slots holding it each way.
+    struct Entry {
+        BlobRef blob;              // In-memory copy, while `refs` > 0
+        uint64_t refs;             // Slots holding `blob`
+        uint64_t spilled;          // Slots holding the extent
+        bool on_disk;              // Whether `offset` is valid
+        uint64_t offset;           // The extent, while `spilled` > 0 or about to be
+        size_t size;               // Bytes of the body as stored
+        size_t decoded_size;       // Blob::decoded_size if compressed, else 0
+    };
+
+    using Entries = std::unordered_map<Digest, Entry, DigestHash>;
+
+    // Struct: Shard
+    // Purpose: One slice of the digest space with its own lock and counts.
+    struct alignas(64) Shard {
+        mutable std::mutex lock;
+        Entries entries;
+        Stats stats;
+    };
+
+    Shard &shard_for(const Digest &d) const { return shards_[d.hi % SHARDS]; }
+
+    // Method: count_reference / drop_reference
+    // Purpose: Keep a shard's stats and drop an entry with its last
+    //          reference, returning its blob to be released after the lock.
+    //          Called with the shard's lock held.
+    void count_reference(Shard &s, const Entry &e);
+    BlobRef drop_reference(Shard &s, Entries::iterator it);
+
+    // Method: forget_extent
+    // Purpose: Marks an entry as no longer on disk. Called with the shard's
+    //          lock held.
+    void forget_extent(Entry &e);
+
+    mutable Shard shards_[SHARDS];
+    Loader load_;                                   // Reads spilled bodies back
+    mutable std::mutex extents_lock_;               // Guards extents_; taken inside a shard lock
+    std::unordered_map<uint64_t, Digest> extents_;  // Digest of each tracked extent
+};
+
+#endif // DEDUP_HPP
@@ -0,0 +1,71 @@
+// File: digest.cpp
+// Description: Implementation of the 128-bit content digest.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "digest.hpp"
+
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t C1 = 0x87c37b91114253d5ull;
+constexpr uint64_t C2 = 0x4cf5ad432745937full;
+
+uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Function: fmix
+// Purpose: Final avalanche, so every input bit affects every output bit.
+uint64_t fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+} // namespace
+
+// Function: content_digest
+// Purpose: Mixes each 16-byte block into the two lanes, then the zero-padded
+//          tail, then the length.
+Digest content_digest(const uint8_t *data, size_t len) {
+    uint64_t h1 = 0x9E3779B97F4A7C15ull, h2 = 0xC2B2AE3D27D4EB4Full;
+    size_t blocks = len / 16;
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t k1 = read64(data + i * 16), k2 = read64(data + i * 16 + 8);
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    if (len % 16) {
+        uint8_t tail[16] = {0};
+        std::memcpy(tail, data + blocks * 16, len % 16);
+        uint64_t k1 = read64(tail), k2 = read64(tail + 8);
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+    }
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    Digest d;
+    d.lo = h1;
+    d.hi = h2;
+    if (d.empty()) d.lo = 1;                  // Zero is reserved for "none"
+    return d;
+}
@@ -0,0 +1,36 @@
+// File: digest.hpp
+// Description: Header file for the 128-bit content digest used to find file
+//              bodies that are stored more than once.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef DIGEST_HPP
+#define DIGEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Struct: Digest
+// Purpose: A 128-bit hash of a file's content. The all-zero value means "no
+//          digest"; content_digest never returns it.
+struct Digest {
+    uint64_t lo = 0, hi = 0;
+
+    bool empty() const { return (lo | hi) == 0; }
+    bool operator==(const Digest &other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Digest &other) const { return !(*this == other); }
+};
+
+// Function: content_digest
+// Purpose: Hashes a byte range with a MurmurHash3-style 128-bit function: two
+//          64-bit lanes mixed 16 bytes at a time, then a final avalanche. It
+//          is not cryptographic, but at 128 bits an accidental collision
+//          between uploads is not a practical concern, and it runs at several
+//          GB/s.
+// Parameters:
+//   - data, len: The content.
+// Returns:
+//   - The digest (never empty()).
+Digest content_digest(const uint8_t *data, size_t len);
+
+#endif // DIGEST_HPP
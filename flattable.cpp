@@ -0,0 +1,251 @@
+// File: flattable.cpp
+// Description: Implementation of the open-addressing hash table used by the
+//              FileServerMap shards.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "flattable.hpp"
+
+#include <cstring>        // memset
+#include <functional>     // std::hash
+#include <new>            // placement new
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>    // SSE2 byte compares
+#endif
+
+// Function: match
+// Purpose: Compares the 16 control bytes at `group` against `c`.
+// Returns:
+//   - A bit mask with bit k set when group[k] == c.
+static inline uint32_t match(const int8_t *group, int8_t c) {
+#if defined(__SSE2__)
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c))));
+#else
+    uint32_t mask = 0;
+    for (int k = 0; k < 16; ++k) mask |= uint32_t(group[k] == c) << k;
+    return mask;
+#endif
+}
+
+// Function: h2
+// Purpose: The 7 hash bits kept in a full slot's control byte.
+static inline int8_t h2(uint64_t h) { return static_cast<int8_t>(h & 0x7F); }
+
+// Constructor
+// Purpose: Copies the key into the slot, or into its own allocation when it
+//          is longer than KEY_INLINE; the value starts as an empty inline one.
+FlatTable::Slot::Slot(uint64_t hash, const std::string &key)
+  : hash_(hash), key_len_(static_cast<uint32_t>(key.size())), value_len_(0), referenced_(0) {
+    if (key_len_ <= KEY_INLINE) {
+        std::memcpy(area_, key.data(), key_len_);
+    } else {
+        char *heap = new char[key_len_];
+        std::memcpy(heap, key.data(), key_len_);
+        std::memcpy(area_, &heap, sizeof(heap));
+    }
+}
+
+// Destructor
+// Purpose: Frees the heap key and drops the blob, if any.
+FlatTable::Slot::~Slot() {
+    release();
+}
+
+// Method: release
+// Purpose: Destroys whatever the slot owns outside area_.
+void FlatTable::Slot::release() {
+    if (value_len_ == BLOB) blob()->~BlobRef();
+    if (key_len_ > KEY_INLINE) delete[] key_data();
+}
+
+// Method: key_data
+// Purpose: Returns the inline key, or reads the pointer stored in its place.
+const char *FlatTable::Slot::key_data() const {
+    if (key_len_ <= KEY_INLINE) return reinterpret_cast<const char *>(area_);
+    char *heap;
+    std::memcpy(&heap, area_, sizeof(heap));
+    return heap;
+}
+
+// Method: key_footprint
+// Purpose: The key's bytes, or the size of the pointer to them.
+size_t FlatTable::Slot::key_footprint() const {
+    return key_len_ <= KEY_INLINE ? key_len_ : sizeof(char *);
+}
+
+// Method: blob
+// Purpose: The BlobRef living at the end of area_.
+BlobRef *FlatTable::Slot::blob() {
+    return reinterpret_cast<BlobRef *>(area_ + KEY_INLINE);
+}
+
+const BlobRef *FlatTable::Slot::blob() const {
+    return reinterpret_cast<const BlobRef *>(area_ + KEY_INLINE);
+}
+
+// Method: has_key
+// Purpose: Compares lengths first, then bytes.
+bool FlatTable::Slot::has_key(const std::string &key) const {
+    return key.size() == key_len_ && std::memcmp(key_data(), key.data(), key_len_) == 0;
+}
+
+// Method: key
+// Purpose: Copies the key out.
+std::string FlatTable::Slot::key() const {
+    return std::string(key_data(), key_len_);
+}
+
+// Method: value
+// Purpose: Shares the blob, or copies the inline bytes into a small one.
+BlobRef FlatTable::Slot::value() const {
+    if (value_len_ == BLOB) return *blob();
+    if (is_spilled()) return nullptr;
+    return copy_blob(area_ + key_footprint(), value_len_);
+}
+
+// Method: value_size
+// Purpose: Reports the content length without materializing it.
+size_t FlatTable::Slot::value_size() const {
+    if (value_len_ == BLOB) return (*blob())->size();
+    return is_spilled() ? extent().length : value_len_;
+}
+
+// Method: extent
+// Purpose: Reads the extent stored where the blob would be.
+FlatTable::Slot::Extent FlatTable::Slot::extent() const {
+    Extent e;
+    std::memcpy(&e, area_ + KEY_INLINE, sizeof(e));
+    return e;
+}
+
+// Method: spill
+// Purpose: Moves the blob out, then records the extent in its place.
+BlobRef FlatTable::Slot::spill(uint64_t offset) {
+    BlobRef old = std::move(*blob());
+    blob()->~BlobRef();
+    Extent e = {offset, static_cast<uint32_t>(old->size()),
+                static_cast<uint32_t>(old->compressed() ? old->decoded_size() : 0)};
+    std::memcpy(area_ + KEY_INLINE, &e, sizeof(e));
+    value_len_ = SPILLED;
+    return old;
+}
+
+// Method: assign
+// Purpose: Inlines the content when it fits after the key, else keeps the blob.
+BlobRef FlatTable::Slot::assign(BlobRef b) {
+    BlobRef old;
+    if (value_len_ == BLOB) {
+        old = std::move(*blob());
+        blob()->~BlobRef();
+    }
+    size_t room = INLINE - key_footprint();
+    if (!b->compressed() && b->size() <= room) {
+        std::memcpy(area_ + key_footprint(), b->data(), b->size());
+        value_len_ = static_cast<uint16_t>(b->size());
+    } else {
+        new (blob()) BlobRef(std::move(b));
+        value_len_ = BLOB;
+    }
+    return old;
+}
+
+// Destructor
+// Purpose: Destroys the entries and frees the chunks and the index.
+FlatTable::~FlatTable() {
+    for (size_t i = 0; i < size_; ++i) entry(i).~Slot();
+    for (Slot *chunk : chunks_) ::operator delete(chunk);
+    delete[] ctrl_;
+    delete[] index_;
+}
+
+// Method: hash
+// Purpose: Mixes std::hash so that both the high bits (used to pick a shard)
+//          and the low bits (used for the control byte and the probe start)
+//          depend on the whole key.
+uint64_t FlatTable::hash(const std::string &key) {
+    uint64_t h = std::hash<std::string>()(key);
+    return (h ^ (h >> 32)) * 0x9E3779B97F4A7C15ull;
+}
+
+// Method: find
+// Purpose: Walks the probe sequence a group at a time. Candidate buckets are
+//          those whose control byte matches the hash's low 7 bits; a group
+//          with a free bucket ends the search.
+FlatTable::Slot *FlatTable::find(const std::string &key, uint64_t h) const {
+    if (capacity_ == 0) return nullptr;
+    size_t mask = capacity_ - 1, pos = (h >> 7) & mask;
+    for (size_t step = GROUP;; pos = (pos + step) & mask, step += GROUP) {
+        const int8_t *group = ctrl_ + pos;
+        for (uint32_t m = match(group, h2(h)); m; m &= m - 1) {
+            Slot &s = entry(index_[(pos + __builtin_ctz(m)) & mask]);
+            if (s.hash() == h && s.has_key(key)) return &s;
+        }
+        if (match(group, EMPTY)) return nullptr;
+    }
+}
+
+// Method: find_empty
+// Purpose: Same probe sequence as find, stopping at the first free bucket.
+//          The index is never more than 7/8 full, so there always is one.
+size_t FlatTable::find_empty(uint64_t h) const {
+    size_t mask = capacity_ - 1, pos = (h >> 7) & mask;
+    for (size_t step = GROUP;; pos = (pos + step) & mask, step += GROUP) {
+        uint32_t m = match(ctrl_ + pos, EMPTY);
+        if (m) return (pos + __builtin_ctz(m)) & mask;
+    }
+}
+
+// Method: find_or_insert
+// Purpose: Returns the existing entry, or appends one (adding a chunk when the
+//          last is full) and points a free bucket at it.
+FlatTable::Slot &FlatTable::find_or_insert(const std::string &key, uint64_t h, bool &inserted) {
+    if (Slot *s = find(key, h)) {
+        inserted = false;
+        return *s;
+    }
+    if ((size_ + 1) * 8 > capacity_ * 7) rehash(capacity_ ? capacity_ * 2 : GROUP);
+    if (size_ % CHUNK == 0) chunks_.push_back(static_cast<Slot *>(::operator new(CHUNK * sizeof(Slot))));
+    Slot *s = new (&entry(size_)) Slot(h, key);
+    size_t i = find_empty(h);
+    set_ctrl(i, h2(h));
+    index_[i] = static_cast<uint32_t>(size_++);
+    inserted = true;
+    return *s;
+}
+
+// Method: reserve
+// Purpose: Rebuilds the index once, at the smallest capacity that holds
+//          `count` entries.
+void FlatTable::reserve(size_t count) {
+    size_t capacity = GROUP;
+    while (capacity * 7 < count * 8) capacity *= 2;
+    if (capacity > capacity_) rehash(capacity);
+    chunks_.reserve(count / CHUNK + 1);
+}
+
+// Method: rehash
+// Purpose: Points new buckets at the entries, using each stored hash instead
+//          of hashing the key again.
+void FlatTable::rehash(size_t capacity) {
+    delete[] ctrl_;
+    delete[] index_;
+    ctrl_ = new int8_t[capacity + GROUP];
+    std::memset(ctrl_, EMPTY, capacity + GROUP);
+    index_ = new uint32_t[capacity];
+    capacity_ = capacity;
+    for (size_t e = 0; e < size_; ++e) {
+        uint64_t h = entry(e).hash();
+        size_t i = find_empty(h);
+        set_ctrl(i, h2(h));
+        index_[i] = static_cast<uint32_t>(e);
+    }
+}
+
+// Method: set_ctrl
+// Purpose: Keeps the mirrored tail in step with the first group.
+void FlatTable::set_ctrl(size_t i, int8_t c) {
+    ctrl_[i] = c;
+    if (i < GROUP) ctrl_[capacity_ + i] = c;
+}
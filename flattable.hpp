@@ -0,0 +1,242 @@
+// File: flattable.hpp
+// Description: Header file for the open-addressing hash table used by each
+//              FileServerMap shard. Entries live in dense, fixed-size chunks
+//              instead of one heap node each, found through an open-addressed
+//              index of 4-byte entry numbers with a control byte per bucket
+//              that is searched 16 buckets at a time (SwissTable-style), so a
+//              lookup usually touches one control group and one entry.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef FLATTABLE_HPP
+#define FLATTABLE_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "blob.hpp"   // BlobRef, copy_blob
+
+// Class: FlatTable
+// Purpose: Map from file name to file content with open addressing. Each
+//          index bucket has a control byte (EMPTY, or the low 7 bits of its
+//          entry's hash) and the number of its entry. Entries keep the key's
+//          full 64-bit hash, so probing compares hashes and only compares key
+//          bytes on a hash match. Only the index is sparse: it doubles at 7/8
+//          full, while entries are appended densely and never move, so an
+//          entry costs its own size plus about 10 bytes of index. Entries are
+//          never removed.
+class FlatTable {
+public:
+    // Class: Slot
+    // Purpose: One stored entry, 96 bytes. Names of up to KEY_INLINE bytes
+    //          are kept in the slot, longer ones in their own allocation. A
+    //          body that fits in the rest of the INLINE area is kept in the
+    //          slot too, right after the name; anything larger is held as a
+    //          shared blob. Small config files thus cost no allocation at all.
+    //          A large body may also be spilled to disk, leaving only its
+    //          extent in the slot.
+    class Slot {
+    public:
+        static constexpr size_t INLINE = 80;      // Bytes of name and body kept in the slot
+        static constexpr size_t KEY_INLINE = 64;  // Longest name kept in the slot
+
+        // Constructor
+        // Purpose: Copies the key; the value starts out empty.
+        Slot(uint64_t hash, const std::string &key);
+        ~Slot();
+        Slot(const Slot &) = delete;
+        Slot &operator=(const Slot &) = delete;
+
+        // Method: hash
+        // Returns:
+        //   - The full hash of the key.
+        uint64_t hash() const { return hash_; }
+
+        // Method: has_key
+        // Returns:
+        //   - Whether the slot's key equals `key`.
+        bool has_key(const std::string &key) const;
+
+        // Method: key
+        // Returns:
+        //   - A copy of the key.
+        std::string key() const;
+
+        // Struct: Extent
+        // Purpose: Where a spilled body lives in the spill file.
+        struct Extent {
+            uint64_t offset;
+            uint32_t length;         // Bytes in the spill file
+            uint32_t decoded_size;   // Blob::decoded_size if compressed, else 0
+        };
+
+        // Method: value
+        // Returns:
+        //   - The content: the shared blob itself, or a new blob holding a
+        //     copy of an inline body (one allocation, at most INLINE bytes).
+        //     nullptr if the body is spilled.
+        BlobRef value() const;
+
+        // Method: value_size
+        // Returns:
+        //   - The length of the content.
+        size_t value_size() const;
+
+        // Method: is_inline
+        // Returns:
+        //   - Whether the content is kept in the slot.
+        bool is_inline() const { return value_len_ <= INLINE; }
+
+        // Method: is_spilled
+        // Returns:
+        //   - Whether the content is on disk; see extent().
+        bool is_spilled() const { return value_len_ == SPILLED; }
+
+        // Method: extent
+        // Returns:
+        //   - The spilled body's place in the spill file, when is_spilled().
+        Extent extent() const;
+
+        // Method: spill
+        // Purpose: Replaces the out-of-line blob by the extent it was written to.
+        // Parameters:
+        //   - offset: Where the blob's bytes now are in the spill file.
+        // Returns:
+        //   - The blob, so the caller can release it outside its lock.
+        BlobRef spill(uint64_t offset);
+
+        // Method: touch
+        // Purpose: Sets the reference bit read by the CLOCK sweep. Safe under a
+        //          shared lock.
+        void touch() const { referenced_.store(1, std::memory_order_relaxed); }
+
+        // Method: clear_referenced
+        // Returns:
+        //   - Whether the slot was touched since the last call.
+        bool clear_referenced() const { return referenced_.exchange(0, std::memory_order_relaxed) != 0; }
+
+        // Method: assign
+        // Purpose: Replaces the content, copying it into the slot when it fits
+        //          beside the key and keeping a reference to the blob otherwise.
+        //          Compressed blobs are always kept as they are. The extent of a spilled body is forgotten; the caller frees it.
+        // Parameters:
+        //   - blob: The new content.
+        // Returns:
+        //   - The previous blob, if the old content was out of line, so the
+        //     caller can release it outside its lock.
+        BlobRef assign(BlobRef blob);
+
+    private:
+        static constexpr uint16_t BLOB = 0xFFFF;      // value_len_ when held as a blob
+        static constexpr uint16_t SPILLED = 0xFFFE;   // value_len_ when on disk
+
+        const char *key_data() const;    // The key's bytes, wherever they are
+        size_t key_footprint() const;    // Bytes of area_ used by the key
+        BlobRef *blob();                 // The out-of-line value, when !is_inline()
+        const BlobRef *blob() const;
+        void release();                  // Frees the heap key and blob, if any
+
+        uint64_t hash_;                  // Full hash of the key
+        uint32_t key_len_;               // Length of the key
+        uint16_t value_len_;             // Length of an inline value, BLOB or SPILLED
+        mutable std::atomic<uint8_t> referenced_; // CLOCK reference bit
+        alignas(8) unsigned char area_[INLINE]; // Key (or a pointer to it), then the
+                                         // inline value; a blob or an extent sits
+                                         // at KEY_INLINE
+    };
+
+    FlatTable() = default;
+    ~FlatTable();
+    FlatTable(const FlatTable &) = delete;
+    FlatTable &operator=(const FlatTable &) = delete;
+
+    // Method: hash
+    // Returns:
+    //   - The hash of a key, as find and find_or_insert expect it.
+    static uint64_t hash(const std::string &key);
+
+    // Method: find
+    // Purpose: Looks up a key.
+    // Parameters:
+    //   - key: The file name.
+    //   - h: hash(key).
+    // Returns:
+    //   - The slot holding the key, or nullptr.
+    Slot *find(const std::string &key, uint64_t h) const;
+
+    // Method: find_or_insert
+    // Purpose: Looks up a key, adding a slot with an empty inline value if it
+    //          is absent.
+    // Parameters:
+    //   - key: The file name.
+    //   - h: hash(key).
+    //   - inserted: Set to whether the slot is new.
+    // Returns:
+    //   - The slot holding the key; it never moves while the table exists.
+    Slot &find_or_insert(const std::string &key, uint64_t h, bool &inserted);
+
+    // Method: reserve
+    // Purpose: Grows the table so `count` entries fit without rehashing.
+    void reserve(size_t count);
+
+    // Method: size
+    // Returns:
+    //   - The number of entries.
+    size_t size() const { return size_; }
+
+    // Method: capacity
+    // Returns:
+    //   - The number of index buckets.
+    size_t capacity() const { return capacity_; }
+
+    // Method: for_each
+    // Purpose: Calls `visit(key, value)` for every entry, in insertion order.
+    //          Keys are copied out and inline values wrapped in new blobs;
+    //          spilled values are passed as nullptr.
+    template <typename Visit>
+    void for_each(Visit &&visit) const {
+        for (size_t i = 0; i < size_; ++i) visit(entry(i).key(), entry(i).value());
+    }
+
+    // Method: for_each_slot
+    // Purpose: Calls `visit(slot)` for every entry, in insertion order, so the
+    //          caller can replace values in place.
+    template <typename Visit>
+    void for_each_slot(Visit &&visit) const {
+        for (size_t i = 0; i < size_; ++i) visit(entry(i));
+    }
+
+    // Method: entry
+    // Returns:
+    //   - Entry number `i` (< size()), in insertion order.
+    Slot &entry(size_t i) const { return chunks_[i / CHUNK][i % CHUNK]; }
+
+private:
+    static constexpr size_t GROUP = 16;    // Control bytes compared at once
+    static constexpr int8_t EMPTY = -128;  // Control byte of a free bucket
+    static constexpr size_t CHUNK = 64;    // Entries per allocation
+
+    // Method: rehash
+    // Purpose: Rebuilds the index with `capacity` buckets; entries stay put.
+    void rehash(size_t capacity);
+
+    // Method: find_empty
+    // Purpose: Finds the first free bucket on the probe sequence of hash `h`.
+    size_t find_empty(uint64_t h) const;
+
+    // Method: set_ctrl
+    // Purpose: Sets a control byte and its mirror past the end of the array.
+    void set_ctrl(size_t i, int8_t c);
+
+    int8_t *ctrl_ = nullptr;      // capacity_ + GROUP control bytes; the last
+                                  // GROUP mirror the first so a group never wraps
+    uint32_t *index_ = nullptr;   // Entry number of each full bucket
+    size_t capacity_ = 0;         // Number of buckets (0 or a power of two >= GROUP)
+    size_t size_ = 0;             // Number of entries
+    std::vector<Slot *> chunks_;  // Entry storage, CHUNK entries per allocation
+};
+
+#endif // FLATTABLE_HPP
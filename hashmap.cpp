@@ -7,6 +7,24 @@
 
 #include "hashmap.hpp"
 #include "protocol.hpp"
+#include "lz.hpp"         // lz_compress, inflate
+
+#include <algorithm>      // std::sort
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+// Method: shard_for
+// Purpose: Picks the shard responsible for a key.
+// Parameters:
+//   - hash: FlatTable::hash of the file name, computed once per call and
+//     reused by the shard's table.
+// Returns:
+//   - A reference to the shard that owns the key. The high bits of the hash are
+//     used, since the table picks its slots from the low bits.
+FileServerMap::Shard &FileServerMap::shard_for(uint64_t hash) const {
+    return shards_[(hash >> 58) & (SHARD_COUNT - 1)];
+}
 
 // Method: insert
 // Purpose: Inserts or updates a file in the map.
@@ -17,10 +35,67 @@
 //   - true if the key already existed and the file was replaced.
 //   - false if the key is new and the file was added.
 bool FileServerMap::insert(const std::string &key, const std::vector<uint8_t> &data) {
-    auto it = map_.find(key);                // Search for the key in the map
-    bool existed = (it != map_.end());       // Check if the key already exists
-    map_[key] = data;                        // Insert or update the file data
-    return existed;                          // Return whether the key existed
+    return insert(key, allocate(data.data(), data.size())); // Copy the bytes once, into a slab
+}
+
+// Method: insert
+// Purpose: Inserts or updates a file. The bytes are still copied: keeping the
+//          vector's own buffer would put the body back on the general heap.
+bool FileServerMap::insert(const std::string &key, std::vector<uint8_t> &&data) {
+    return insert(key, allocate(data.data(), data.size()));
+}
+
+// Method: allocate
+// Purpose: Returns the stored blob if the content is already there, which the
+//          bytes must confirm, not just the digest. Otherwise copies it into
+//          the slab allocator, compressed first when compression is on and it
+//          saves at least an eighth. A body whose digest collides with a
+//          different stored one is not deduplicated.
+BlobRef FileServerMap::allocate(const uint8_t *data, size_t len) {
+    if (len < DEDUP_MIN) return slabs_.make_blob(data, len);
+    Digest d = content_digest(data, len);
+    BlobRef shared = content_.find(d);
+    if (shared && ContentTable::holds(*shared, data, len)) return shared;
+    BlobRef blob;
+    if (compress_ && len >= COMPRESS_MIN) {
+        static thread_local std::vector<uint8_t> packed;
+        if (lz_compress(data, len, packed, len - len / 8))
+            blob = slabs_.make_blob(packed.data(), packed.size(), len);
+    }
+    if (!blob) blob = slabs_.make_blob(data, len);
+    if (!shared) blob->set_digest(d);
+    return blob;
+}
+
+// Method: insert
+// Purpose: Inserts or updates a file with an existing blob. The blob is built
+//          before the lock is taken, so the critical section only swaps a pointer.
+//          Resident bytes are counted per distinct body: a shared body counts
+//          when its first slot takes it and stops counting when its last lets go.
+bool FileServerMap::insert(const std::string &key, BlobRef blob) {
+    BlobRef old;                             // Released after the lock is dropped
+    uint64_t h = FlatTable::hash(key);       // Hashed outside the lock
+    Shard &s = shard_for(h);
+    size_t resident = 0;
+    blob = content_.acquire(std::move(blob), resident); // Share a body stored meanwhile
+    bool untracked = blob->digest().empty();  // Then counted per slot
+    bool added, was_spilled = false;
+    FlatTable::Slot::Extent dead = {0, 0, 0};   // Spill extent of the old data
+    {
+        RWLock::WriteGuard lock(s.lock);     // Exclusive access to this shard only
+        FlatTable::Slot &slot = s.map.find_or_insert(key, h, added); // Find or add the key
+        was_spilled = slot.is_spilled();
+        if (was_spilled) dead = slot.extent();
+        old = slot.assign(std::move(blob));  // Replace the file data
+        ++s.writes;
+        slot.touch();
+        if (!slot.is_inline() && untracked) resident += slot.value_size();
+    }
+    resident_ += resident;
+    if (old) resident_ -= old->digest().empty() ? old->size() : content_.release(old);
+    if (was_spilled && content_.release_extent(dead.offset)) spill_->release(dead.offset, dead.length);
+    if (spill_ && resident_ > max_memory_) trim();
+    return !added;                           // Return whether the key existed
 }
 
 // Method: get
@@ -28,13 +103,374 @@ bool FileServerMap::insert(const std::string &key, const std::vector<uint8_t> &d
 // Parameters:
 //   - key: The name of the file to retrieve.
 // Returns:
-//   - A vector of bytes representing the file's content.
+//   - A shared handle to the file's content; no bytes are copied unless the
+//     file is stored compressed.
 // Throws:
 //   - std::runtime_error if the key is not found in the map.
-std::vector<uint8_t> FileServerMap::get(const std::string &key) const {
-    auto it = map_.find(key);                // Search for the key in the map
-    if (it == map_.end()) {                  // If the key is not found
+BlobRef FileServerMap::get(const std::string &key) const {
+    return inflate(get_stored(key));
+}
+
+// Method: get_stored
+// Purpose: Retrieves the file data in the form it is stored in.
+BlobRef FileServerMap::get_stored(const std::string &key) const {
+    BlobRef blob = find_stored(key);
+    if (!blob) {                             // If the key is not found
         throw std::runtime_error("File not found: " + key); // Throw an exception
     }
-    return it->second;                       // Return the file data
-}
\ No newline at end of file
+    return blob;
+}
+
+// Method: find_stored
+// Purpose: Looks the key up in its shard, reading a spilled body back.
+BlobRef FileServerMap::find_stored(const std::string &key) const {
+    uint64_t h = FlatTable::hash(key);
+    Shard &s = shard_for(h);
+    {
+        RWLock::ReadGuard lock(s.lock);      // Shared access; readers run in parallel
+        FlatTable::Slot *slot = s.map.find(key, h); // Search for the key in the shard
+        if (!slot) return nullptr;           // Not found
+        if (!spill_) return slot->value();   // Share the blob (small files are copied)
+        slot->touch();                       // Recently used: spare it from the next sweep
+        if (!slot->is_spilled()) {
+            s.hits.fetch_add(1, std::memory_order_relaxed);
+            return slot->value();
+        }
+    }
+    return fault_in(s, key, h);              // On disk: read it back
+}
+
+// Method: get_stored_many
+// Purpose: Sorts the keys by shard so every shard is locked at most once.
+//          Spilled bodies are read after all the locks have been dropped.
+std::vector<BlobRef> FileServerMap::get_stored_many(const std::vector<std::string> &keys) const {
+    std::vector<BlobRef> out(keys.size());
+    std::vector<uint64_t> hashes(keys.size());
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        hashes[i] = FlatTable::hash(keys[i]);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this, &hashes](size_t a, size_t b) {
+        return &shard_for(hashes[a]) < &shard_for(hashes[b]);
+    });
+
+    std::vector<size_t> spilled;
+    for (size_t i = 0; i < order.size();) {
+        Shard &s = shard_for(hashes[order[i]]);
+        RWLock::ReadGuard lock(s.lock);
+        for (; i < order.size() && &shard_for(hashes[order[i]]) == &s; ++i) {
+            size_t k = order[i];
+            FlatTable::Slot *slot = s.map.find(keys[k], hashes[k]);
+            if (!slot) continue;                 // Not found: left as nullptr
+            if (spill_) {
+                slot->touch();
+                if (slot->is_spilled()) {
+                    spilled.push_back(k);
+                    continue;
+                }
+                s.hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            out[k] = slot->value();
+        }
+    }
+    for (size_t k : spilled) out[k] = fault_in(shard_for(hashes[k]), keys[k], hashes[k]);
+    return out;
+}
+
+// Method: fault_in
+// Purpose: The extent cannot be reused while the read lock is held, so the
+//          body is read under it, unless it is a shared body that another
+//          slot has already read back. Putting the body back needs the write
+//          lock; if the shard was written in between, the slot may no longer
+//          refer to this body, and the read value is returned without keeping
+//          it. A shared body goes back into the content table, so the slots
+//          read back share one blob again, and its extent is freed with the
+//          last slot referring to it.
+BlobRef FileServerMap::fault_in(Shard &s, const std::string &key, uint64_t h) const {
+    BlobRef blob;
+    FlatTable::Slot::Extent e;
+    uint64_t writes;
+    bool tracked;
+    {
+        RWLock::ReadGuard lock(s.lock);
+        FlatTable::Slot *slot = s.map.find(key, h);
+        if (!slot) return nullptr;                       // Removed meanwhile
+        if (!slot->is_spilled()) return slot->value();   // Read back meanwhile
+        e = slot->extent();
+        writes = s.writes;
+        Digest d;
+        tracked = content_.resident_at(e.offset, d, blob);
+        if (!blob) {
+            std::vector<uint8_t> bytes(e.length);
+            spill_->read(e.offset, bytes.data(), bytes.size());
+            blob = slabs_.make_blob(bytes.data(), bytes.size(), e.decoded_size);
+            if (tracked) blob->set_digest(d);
+        }
+    }
+    s.misses.fetch_add(1, std::memory_order_relaxed);
+    bool kept = false, free_extent = true;
+    {
+        RWLock::WriteGuard lock(s.lock);
+        if (s.writes == writes) {
+            size_t resident = blob->size();
+            if (tracked) blob = content_.fault_in(e.offset, blob, resident, free_extent);
+            s.map.find(key, h)->assign(blob);
+            ++s.writes;
+            resident_ += resident;
+            kept = true;
+        }
+    }
+    if (kept) {
+        if (free_extent) spill_->release(e.offset, e.length);
+        if (resident_ > max_memory_) trim();
+    }
+    return blob;
+}
+
+// Method: trim
+// Purpose: Advances the hand one shard at a time. Under the shard's read lock
+//          it clears reference bits until it reaches a body that was not
+//          touched since the last lap, which is then spilled with no lock held
+//          during the write. Errors from the disk stop the sweep; the budget
+//          is then exceeded until the next insert tries again.
+void FileServerMap::trim() const {
+    std::lock_guard<std::mutex> guard(evict_lock_);
+    unsigned idle_laps = 0;
+    try {
+        while (resident_ > max_memory_ && idle_laps < 2) {
+            Shard &s = shards_[hand_shard_];
+            BlobRef victim;
+            size_t index = 0;
+            {
+                RWLock::ReadGuard lock(s.lock);
+                while (!victim && hand_index_ < s.map.size()) {
+                    index = hand_index_++;
+                    const FlatTable::Slot &slot = s.map.entry(index);
+                    if (slot.is_inline() || slot.is_spilled() || slot.clear_referenced()) continue;
+                    victim = slot.value();
+                }
+            }
+            if (!victim) {
+                hand_index_ = 0;
+                if (++hand_shard_ == SHARD_COUNT) {
+                    hand_shard_ = 0;
+                    ++idle_laps;
+                }
+                continue;
+            }
+            idle_laps = 0;
+            evict(s, index, victim);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+}
+
+// Method: evict
+// Purpose: The victim reference keeps the blob alive, so an unchanged slot is
+//          recognized by still holding the same blob. A shared body is written
+//          once: the slots holding it are spilled to the same extent, and its
+//          memory is freed (and uncounted) with the last of them.
+void FileServerMap::evict(Shard &s, size_t index, const BlobRef &victim) const {
+    bool tracked = !victim->digest().empty();
+    uint64_t written = 0, offset = 0;
+    bool wrote = !(tracked && content_.extent_of(victim, offset));
+    if (wrote) offset = written = spill_->write(victim->data(), victim->size());
+    BlobRef old;                             // Released after the lock is dropped
+    size_t freed = 0;
+    {
+        RWLock::WriteGuard lock(s.lock);
+        FlatTable::Slot &slot = s.map.entry(index);
+        if (!slot.is_inline() && !slot.is_spilled() && slot.value().get() == victim.get()) {
+            bool ok = true;
+            if (tracked) ok = content_.spill(victim, offset, wrote, freed);
+            else freed = victim->size();
+            if (ok) {
+                old = slot.spill(offset);
+                ++s.writes;
+                resident_ -= freed;
+            }
+        }
+    }
+    if (old) evictions_.fetch_add(1, std::memory_order_relaxed);
+    if (wrote && (!old || offset != written))
+        spill_->release(written, victim->size());   // Replaced while we wrote, or spilled by another slot
+}
+
+// Method: enable_spill
+// Purpose: Opens the spill file and counts the bodies already held.
+void FileServerMap::enable_spill(const std::string &path, size_t max_memory) {
+    spill_.reset(new SpillFile(path));
+    max_memory_ = max_memory;
+    SpillFile *spill = spill_.get();
+    content_.set_loader([this, spill](uint64_t offset, size_t length, size_t decoded_size) {
+        std::vector<uint8_t> bytes(length);
+        spill->read(offset, bytes.data(), bytes.size());
+        return slabs_.make_blob(bytes.data(), bytes.size(), decoded_size);
+    });
+    size_t resident = 0;
+    std::unordered_set<const Blob *> shared;   // Shared bodies count once
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        RWLock::ReadGuard lock(shards_[i].lock);
+        shards_[i].map.for_each_slot([&resident, &shared](const FlatTable::Slot &slot) {
+            if (slot.is_inline()) return;
+            BlobRef blob = slot.value();
+            if (blob->digest().empty() || shared.insert(blob.get()).second) resident += blob->size();
+        });
+    }
+    resident_ = resident;
+    if (resident_ > max_memory_) trim();
+}
+
+// Method: cache_stats
+// Purpose: Sums the per-shard counters.
+FileServerMap::CacheStats FileServerMap::cache_stats() const {
+    CacheStats st;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        st.hits += shards_[i].hits.load(std::memory_order_relaxed);
+        st.misses += shards_[i].misses.load(std::memory_order_relaxed);
+    }
+    st.evictions = evictions_.load(std::memory_order_relaxed);
+    st.resident = resident_;
+    st.spilled = spill_ ? spill_->bytes_in_use() : 0;
+    return st;
+}
+
+// Method: dedup_stats
+// Purpose: Forwards to the content table.
+ContentTable::Stats FileServerMap::dedup_stats() const {
+    return content_.stats();
+}
+
+// Method: pin_spill
+// Purpose: Forwards to the spill file, if any.
+void FileServerMap::pin_spill() {
+    if (spill_) spill_->pin();
+}
+
+// Method: unpin_spill
+// Purpose: Forwards to the spill file, if any.
+void FileServerMap::unpin_spill() {
+    if (spill_) spill_->unpin();
+}
+
+// Method: enable_compression
+// Purpose: Turns on compression of newly stored bodies.
+void FileServerMap::enable_compression() {
+    compress_ = true;
+}
+
+// Method: compact
+// Purpose: Marks the sparse slabs, then rewrites every shard's bodies that
+//          live in them. A blob shared by several slots is copied once, and
+//          its content table entry follows the copy. The replaced blobs are
+//          released after each shard's lock is dropped.
+size_t FileServerMap::compact(double max_fill) {
+    std::lock_guard<std::mutex> guard(compact_lock_);
+    if (slabs_.begin_compaction(max_fill) == 0) return 0;
+    size_t moved = 0;
+    std::vector<BlobRef> old;
+    std::unordered_map<const Blob *, BlobRef> copies;   // Shared blobs moved so far
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        {
+            RWLock::WriteGuard lock(shards_[i].lock);
+            shards_[i].map.for_each_slot([&](FlatTable::Slot &slot) {
+                if (slot.is_inline() || slot.is_spilled()) return;
+                BlobRef blob = slot.value();
+                if (!slabs_.evacuating(blob.get())) return;
+                BlobRef &copy = copies[blob.get()];
+                if (!copy) {
+                    size_t decoded = blob->compressed() ? blob->decoded_size() : 0;
+                    copy = slabs_.make_blob(blob->data(), blob->size(), decoded);
+                    copy->set_digest(blob->digest());
+                    content_.replace(blob, copy);
+                    ++moved;
+                }
+                old.push_back(slot.assign(copy));
+            });
+        }
+        old.clear();                         // May unmap drained slabs
+    }
+    copies.clear();
+    slabs_.end_compaction();
+    return moved;
+}
+
+// Method: for_each
+// Purpose: Visits every stored entry, one read-locked shard at a time.
+// Parameters:
+//   - visit: Called with each file name and its content.
+void FileServerMap::for_each(const Visitor &visit) const {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        RWLock::ReadGuard lock(shards_[i].lock);
+        visit_shard(shards_[i], visit);
+    }
+}
+
+// Method: visit_shard
+// Purpose: Spilled bodies go into plain heap blobs: in a forked child another
+//          thread may have held a slab class lock at the fork.
+void FileServerMap::visit_shard(const Shard &shard, const Visitor &visit) const {
+    shard.map.for_each_slot([&](const FlatTable::Slot &slot) {
+        if (!slot.is_spilled()) {
+            visit(slot.key(), slot.value());
+            return;
+        }
+        FlatTable::Slot::Extent e = slot.extent();
+        std::vector<uint8_t> bytes(e.length);
+        spill_->read(e.offset, bytes.data(), bytes.size());
+        visit(slot.key(), make_blob(std::move(bytes), e.decoded_size));
+    });
+}
+
+// Method: size
+// Purpose: Counts the stored files across all shards.
+// Returns:
+//   - The number of stored files.
+size_t FileServerMap::size() const {
+    size_t n = 0;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        RWLock::ReadGuard lock(shards_[i].lock);
+        n += shards_[i].map.size();
+    }
+    return n;
+}
+
+// Method: reserve
+// Purpose: Spreads the expected count over the shards, with some slack since
+//          keys never divide exactly evenly.
+void FileServerMap::reserve(size_t count) {
+    size_t per_shard = count / SHARD_COUNT + count / SHARD_COUNT / 8 + 1;
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        RWLock::WriteGuard lock(shards_[i].lock);
+        shards_[i].map.reserve(shards_[i].map.size() + per_shard);
+    }
+}
+
+// Method: freeze
+// Purpose: Read-locks the shards in index order.
+void FileServerMap::freeze() const {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) shards_[i].lock.lock_shared();
+}
+
+// Method: thaw
+// Purpose: Releases every shard lock taken by freeze().
+void FileServerMap::thaw() const {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) shards_[i].lock.unlock();
+}
+
+// Method: for_each_frozen
+// Purpose: Visits every stored entry without locking.
+// Parameters:
+//   - visit: Called with each file name and its content.
+void FileServerMap::for_each_frozen(const Visitor &visit) const {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) visit_shard(shards_[i], visit);
+}
+
+// Method: for_each_name_frozen
+// Purpose: Visits every stored name without locking or reading bodies.
+void FileServerMap::for_each_name_frozen(const std::function<void(const std::string &)> &visit) const {
+    for (size_t i = 0; i < SHARD_COUNT; ++i)
+        shards_[i].map.for_each_slot([&visit](const FlatTable::Slot &slot) { visit(slot.key()); });
+}
@@ -11,14 +11,82 @@
 #include <string>
 #include <vector>
 #include <stdexcept>
-#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+
+#include "blob.hpp"   // Blob, BlobRef
+#include "flattable.hpp" // FlatTable
+#include "slab.hpp"   // SlabAllocator
+#include "spill.hpp"  // SpillFile
+#include "dedup.hpp"  // ContentTable
+
+// Class: RWLock
+// Purpose: Thin wrapper around a POSIX reader/writer lock. Any number of readers
+//          may hold it at once; a writer holds it alone.
+class RWLock {
+public:
+    RWLock() { pthread_rwlock_init(&lock_, nullptr); }
+    ~RWLock() { pthread_rwlock_destroy(&lock_); }
+    RWLock(const RWLock &) = delete;
+    RWLock &operator=(const RWLock &) = delete;
+
+    void lock_shared() { pthread_rwlock_rdlock(&lock_); }
+    void lock() { pthread_rwlock_wrlock(&lock_); }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+
+    // Class: ReadGuard
+    // Purpose: Holds the lock in shared (reader) mode for the guard's lifetime.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(RWLock &l) : l_(l) { l_.lock_shared(); }
+        ~ReadGuard() { l_.unlock(); }
+    private:
+        RWLock &l_;
+    };
+
+    // Class: WriteGuard
+    // Purpose: Holds the lock in exclusive (writer) mode for the guard's lifetime.
+    class WriteGuard {
+    public:
+        explicit WriteGuard(RWLock &l) : l_(l) { l_.lock(); }
+        ~WriteGuard() { l_.unlock(); }
+    private:
+        RWLock &l_;
+    };
+
+private:
+    pthread_rwlock_t lock_;
+};
 
 // Class: FileServerMap
 // Purpose: Represents a simple in-memory map for storing and retrieving files.
-//          It uses an unordered_map to manage file entries, where each key-value
-//          pair represents a file's name and its content (as a byte vector).
+//          It uses open-addressing hash tables to manage file entries, where each key-value
+//          pair represents a file's name and its content (as a shared, immutable
+//          Blob, so reads hand out a reference instead of copying the bytes).
+//          Keys are spread over SHARD_COUNT shards, each guarded by its own
+//          reader/writer lock, so concurrent readers never block one another and
+//          writers only block the shard they touch. File bodies are copied
+//          into a size-class slab allocator rather than the general heap, so
+//          that replacing files all day does not fragment memory. With
+//          enable_spill(), bodies are kept within a memory budget by moving
+//          cold ones to a spill file and reading them back on demand, and
+//          with enable_compression() they are stored compressed. Files with
+//          the same body share one blob, and once spilled one extent, through
+//          a content table keyed by a 128-bit digest.
 class FileServerMap {
 public:
+    // Constant: SHARD_COUNT
+    // Purpose: Number of independently locked shards (a power of two).
+    static constexpr size_t SHARD_COUNT = 64;
+
+    // Type: Visitor
+    // Purpose: Callback used by for_each to inspect stored entries.
+    using Visitor = std::function<void(const std::string &, const BlobRef &)>;
+
     // Method: insert
     // Purpose: Inserts or updates a file in the map.
     // Parameters:
@@ -29,31 +97,233 @@ public:
     //   - false if a new key was added.
     bool insert(const std::string &key, const std::vector<uint8_t> &data);
 
+    // Method: insert
+    // Purpose: Inserts or updates a file; the bytes are copied into a slab
+    //          block like the overload above.
+    bool insert(const std::string &key, std::vector<uint8_t> &&data);
+
+    // Method: insert
+    // Purpose: Inserts or updates a file with an existing blob, as is.
+    bool insert(const std::string &key, BlobRef blob);
+
+    // Method: allocate
+    // Purpose: Copies a file body into a blob from the map's slab allocator,
+    //          for callers that build the blob before inserting it. A body of
+    //          DEDUP_MIN bytes or more that is already stored under any name
+    //          is not copied: that file's blob is returned. With compression
+    //          on, the blob may hold the body compressed.
+    // Parameters:
+    //   - data, len: The content.
+    // Returns:
+    //   - The new or shared blob.
+    BlobRef allocate(const uint8_t *data, size_t len);
+
+    // Constant: DEDUP_MIN
+    // Purpose: Smallest body that is deduplicated. A content table entry
+    //          costs about a hundred bytes, which only pays for itself on
+    //          bodies well past the size kept inside the table.
+    static constexpr size_t DEDUP_MIN = 1024;
+
+    // Constant: COMPRESS_MIN
+    // Purpose: Smallest body worth trying to compress.
+    static constexpr size_t COMPRESS_MIN = 256;
+
+    // Method: enable_compression
+    // Purpose: Compresses bodies of COMPRESS_MIN bytes or more as they are
+    //          stored, keeping the compressed form when it is at least an
+    //          eighth smaller. get() decompresses; bodies that are already
+    //          stored are left as they are.
+    void enable_compression();
+
+    // Method: compact
+    // Purpose: Moves the bodies held in slabs less than `max_fill` full into
+    //          fuller ones, one write-locked shard at a time, so the sparse
+    //          slabs can be unmapped. A slab still referenced by a reader is
+    //          unmapped when the reader lets go.
+    // Returns:
+    //   - The number of bodies moved.
+    size_t compact(double max_fill = 0.5);
+
+    // Struct: CacheStats
+    // Purpose: Counters of the memory-bounded mode.
+    struct CacheStats {
+        uint64_t hits = 0;        // Gets served from memory
+        uint64_t misses = 0;      // Gets that read a spilled body
+        uint64_t evictions = 0;   // Bodies spilled
+        size_t resident = 0;      // Bytes of bodies held in memory as blobs, shared ones once
+        uint64_t spilled = 0;     // Bytes of spill file extents in use
+    };
+
+    // Method: enable_spill
+    // Purpose: Bounds the bytes of file bodies kept in memory. Whenever an
+    //          insert or a read-back takes them over `max_memory`, a CLOCK
+    //          sweep over the shards writes bodies not read or written since
+    //          its last pass to the spill file, until they fit again. Bodies
+    //          small enough to live inside the table are never spilled. Call
+    //          before the map is used.
+    // Parameters:
+    //   - path: The spill file to create.
+    //   - max_memory: The budget in bytes.
+    // Throws:
+    //   - std::runtime_error if the spill file cannot be created.
+    void enable_spill(const std::string &path, size_t max_memory);
+
+    // Method: cache_stats
+    // Returns:
+    //   - The hit, miss and eviction counters and the bytes in each tier.
+    CacheStats cache_stats() const;
+
+    // Method: dedup_stats
+    // Returns:
+    //   - How many slots share how many distinct bodies, and the bytes those
+    //     take against what copies would take; logical / stored is the
+    //     deduplication ratio.
+    ContentTable::Stats dedup_stats() const;
+
+    // Method: pin_spill / unpin_spill
+    // Purpose: While pinned, spill file extents that fall out of use are not
+    //          reused, so a forked child can still read every body it saw.
+    void pin_spill();
+    void unpin_spill();
+
+    // Method: slab_stats
+    // Returns:
+    //   - The memory held by the slab allocator.
+    SlabAllocator::Stats slab_stats() const { return slabs_.stats(); }
+
     // Method: get
-    // Purpose: Retrieves the file data associated with the given key.
+    // Purpose: Retrieves the file data associated with the given key. A
+    //          spilled body is read back from disk and kept in memory again.
     // Parameters:
     //   - key: The name of the file to retrieve.
     // Returns:
-    //   - A vector of bytes representing the file's content.
+    //   - A shared handle to the file's content. The blob stays valid even if
+    //     the file is replaced afterwards.
+    // Throws:
+    //   - std::runtime_error if the key is not found in the map, or a spilled
+    //     body cannot be read.
+    BlobRef get(const std::string &key) const;
+
+    // Method: get_stored
+    // Purpose: Like get, but a compressed file is returned compressed (see
+    //          Blob::compressed), for callers that can use it that way.
+    BlobRef get_stored(const std::string &key) const;
+
+    // Method: find_stored
+    // Purpose: Like get_stored, but tells a missing key apart from a failure.
+    // Returns:
+    //   - The stored handle, or nullptr if the key is not found.
+    // Throws:
+    //   - std::runtime_error if a spilled body cannot be read.
+    BlobRef find_stored(const std::string &key) const;
+
+    // Method: get_stored_many
+    // Purpose: Looks up a batch of keys as get_stored does, visiting each
+    //          shard once: the keys are grouped by shard and each group is
+    //          looked up under a single read lock.
+    // Parameters:
+    //   - keys: The names of the files to retrieve.
+    // Returns:
+    //   - One handle per key, in order; nullptr for a key that is not found.
     // Throws:
-    //   - std::runtime_error if the key is not found in the map.
-    std::vector<uint8_t> get(const std::string &key) const;
+    //   - std::runtime_error if a spilled body cannot be read.
+    std::vector<BlobRef> get_stored_many(const std::vector<std::string> &keys) const;
 
-    // Method: entries
-    // Purpose: Provides a const reference to the underlying map for inspecting or
-    //          persisting all stored entries.
+    // Method: for_each
+    // Purpose: Calls `visit` for every stored entry, for inspecting or persisting
+    //          the whole map. Each shard is read-locked while it is visited, so
+    //          the callback must not modify the map.
+    void for_each(const Visitor &visit) const;
+
+    // Method: size
     // Returns:
-    //   - A const reference to the unordered_map containing all file entries.
-    const std::unordered_map<std::string, std::vector<uint8_t>>& entries() const {
-        return map_;
-    }
+    //   - The number of stored files.
+    size_t size() const;
+
+    // Method: reserve
+    // Purpose: Presizes the shards for about `count` more files in total, so a
+    //          bulk load does not rehash as it goes.
+    void reserve(size_t count);
+
+    // Method: freeze
+    // Purpose: Read-locks every shard, so writers wait until thaw() and the
+    //          contents cannot change. Used to take a consistent snapshot
+    //          (for example across fork()).
+    void freeze() const;
+
+    // Method: thaw
+    // Purpose: Releases the locks taken by freeze().
+    void thaw() const;
+
+    // Method: for_each_frozen
+    // Purpose: Like for_each, but takes no locks; the caller must hold freeze(),
+    //          or be a forked child of the thread that did.
+    void for_each_frozen(const Visitor &visit) const;
+
+    // Method: for_each_name_frozen
+    // Purpose: Like for_each_frozen, but only visits the names, so spilled
+    //          bodies are not read.
+    void for_each_name_frozen(const std::function<void(const std::string &)> &visit) const;
 
 private:
-    // Member: map_
+    // Struct: Shard
+    // Purpose: One slice of the key space with its own lock. Aligned to a cache
+    //          line so locks of neighbouring shards do not share one.
+    struct alignas(64) Shard {
+        mutable RWLock lock;
+        FlatTable map;
+        uint64_t writes = 0;                     // Changes, made under the write lock
+        std::atomic<uint64_t> hits{0};           // Gets served from memory
+        std::atomic<uint64_t> misses{0};         // Gets served from the spill file
+    };
+
+    // Method: shard_for
+    // Purpose: Picks the shard responsible for a key from its FlatTable::hash.
+    Shard &shard_for(uint64_t hash) const;
+
+    // Method: visit_shard
+    // Purpose: Calls `visit` for every entry of one shard, reading spilled
+    //          bodies into heap blobs. Takes no lock.
+    void visit_shard(const Shard &shard, const Visitor &visit) const;
+
+    // Method: fault_in
+    // Purpose: Reads a spilled body under the shard's read lock, then puts it
+    //          back in the slot unless the shard changed in between.
+    //          Returns nullptr if the key was removed meanwhile.
+    BlobRef fault_in(Shard &shard, const std::string &key, uint64_t hash) const;
+
+    // Method: trim
+    // Purpose: Runs the CLOCK sweep until the resident bodies fit the budget,
+    //          or two full laps find nothing left to spill.
+    void trim() const;
+
+    // Method: evict
+    // Purpose: Writes one body to the spill file, then swaps it for its extent
+    //          if the slot still holds it.
+    void evict(Shard &shard, size_t index, const BlobRef &victim) const;
+
+    // Member: slabs_
+    // Purpose: Holds the file bodies. Declared before shards_ so it outlives
+    //          the blobs they hold.
+    mutable SlabAllocator slabs_;
+    mutable ContentTable content_; // Bodies shared by content, see allocate()
+    std::mutex compact_lock_;   // Serialises compactions
+    bool compress_ = false;     // Whether allocate() compresses
+
+    // Members: memory-bounded mode (see enable_spill)
+    std::unique_ptr<SpillFile> spill_;          // Disk tier, or nullptr
+    size_t max_memory_ = 0;                     // Budget for resident_
+    mutable std::atomic<size_t> resident_{0};   // Bytes of bodies held as blobs, a shared body once
+    mutable std::atomic<uint64_t> evictions_{0};
+    mutable std::mutex evict_lock_;             // Guards the CLOCK hand
+    mutable size_t hand_shard_ = 0;             // CLOCK hand: shard, then
+    mutable size_t hand_index_ = 0;             //   entry number within it
+
+    // Member: shards_
     // Purpose: The core data storage for the file server map.
     //          Keys are file names (std::string), and values are the file contents
-    //          as vectors of bytes (std::vector<uint8_t>).
-    std::unordered_map<std::string, std::vector<uint8_t>> map_;
+    //          as shared immutable blobs (BlobRef).
+    mutable Shard shards_[SHARD_COUNT];
 };
 
-#endif // HASHMAP_HPP
\ No newline at end of file
+#endif // HASHMAP_HPP
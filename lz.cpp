@@ -0,0 +1,230 @@
+// File: lz.cpp
+// Description: Implementation of the LZ codec used to compress stored files.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "lz.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr int HASH_BITS = 14;                 // Match finder table size
+constexpr size_t MIN_MATCH = 4;               // Shortest match encoded
+constexpr size_t LAST_LITERALS = 5;           // A frame ends with this many literals
+constexpr size_t MATCH_MARGIN = 12;           // No match starts this close to the end
+constexpr uint32_t RAW_FRAME = 0x80000000u;   // Frame header flag: body stored raw
+
+uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Function: put_length
+// Purpose: Writes the part of a count beyond its nibble's 15.
+bool put_length(uint8_t *&op, const uint8_t *end, size_t extra) {
+    for (; extra >= 255; extra -= 255) {
+        if (op == end) return false;
+        *op++ = 255;
+    }
+    if (op == end) return false;
+    *op++ = static_cast<uint8_t>(extra);
+    return true;
+}
+
+// Function: emit
+// Purpose: Writes one sequence; a zero `match` writes the final literals-only one.
+// Returns:
+//   - false if it does not fit before `end`.
+bool emit(uint8_t *&op, const uint8_t *end, const uint8_t *literals, size_t count,
+          size_t offset, size_t match) {
+    if (op == end) return false;
+    size_t extra = match ? match - MIN_MATCH : 0;
+    *op++ = static_cast<uint8_t>((std::min<size_t>(count, 15) << 4) | std::min<size_t>(extra, 15));
+    if (count >= 15 && !put_length(op, end, count - 15)) return false;
+    if (size_t(end - op) < count + (match ? 2 : 0)) return false;
+    std::memcpy(op, literals, count);
+    op += count;
+    if (!match) return true;
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    return extra < 15 || put_length(op, end, extra - 15);
+}
+
+// Function: compress_block
+// Purpose: Greedy single-pass match finder over one frame. Each position's
+//          4-byte prefix is hashed into a table of recent positions; a hit
+//          is extended both ways. Runs without a match are skipped ever faster
+//          so incompressible data costs little.
+// Returns:
+//   - The compressed size, or 0 if it would exceed `cap`.
+size_t compress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint8_t *op = dst;
+    const uint8_t *end = dst + cap;
+    size_t anchor = 0;
+    if (n > MATCH_MARGIN) {
+        uint16_t table[1 << HASH_BITS];       // Frames are at most 64 KiB
+        std::memset(table, 0, sizeof(table));
+        size_t limit = n - MATCH_MARGIN, match_end = n - LAST_LITERALS;
+        for (size_t ip = 1; ip < limit;) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash4(seq);
+            size_t ref = table[h];
+            table[h] = static_cast<uint16_t>(ip);
+            if (read32(src + ref) != seq) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            size_t len = MIN_MATCH;
+            while (ip + len < match_end && src[ref + len] == src[ip + len]) ++len;
+            if (!emit(op, end, src + anchor, ip - anchor, ip - ref, len)) return 0;
+            ip += len;
+            anchor = ip;
+            if (ip < limit) table[hash4(read32(src + ip - 2))] = static_cast<uint16_t>(ip - 2);
+        }
+    }
+    if (!emit(op, end, src + anchor, n - anchor, 0, 0)) return 0;
+    return op - dst;
+}
+
+// Function: read_length
+// Purpose: Reads the bytes that extend a nibble of 15.
+size_t read_length(const uint8_t *src, size_t n, size_t &ip) {
+    size_t v = 0;
+    uint8_t b;
+    do {
+        if (ip >= n) throw std::runtime_error("Truncated compressed data");
+        b = src[ip++];
+        v += b;
+    } while (b == 255);
+    return v;
+}
+
+// Function: decompress_block
+// Purpose: Decodes one frame body into exactly `out_len` bytes, checking every
+//          count and offset against both buffers.
+// Throws:
+//   - std::runtime_error if the body is malformed.
+void decompress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t out_len) {
+    size_t ip = 0, op = 0;
+    for (;;) {
+        if (ip >= n) throw std::runtime_error("Truncated compressed data");
+        uint8_t token = src[ip++];
+        size_t count = token >> 4;
+        if (count == 15) count += read_length(src, n, ip);
+        if (count > n - ip || count > out_len - op) throw std::runtime_error("Bad literal run");
+        std::memcpy(dst + op, src + ip, count);
+        ip += count;
+        op += count;
+        if (ip == n) break;                   // Last sequence
+        if (n - ip < 2) throw std::runtime_error("Truncated compressed data");
+        size_t offset = src[ip] | (size_t(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) throw std::runtime_error("Bad match offset");
+        size_t len = token & 15;
+        if (len == 15) len += read_length(src, n, ip);
+        len += MIN_MATCH;
+        if (len > out_len - op) throw std::runtime_error("Bad match length");
+        uint8_t *d = dst + op;
+        const uint8_t *s = d - offset;
+        if (offset >= len) {
+            std::memcpy(d, s, len);
+        } else {
+            for (size_t i = 0; i < len; ++i) d[i] = s[i];   // Overlapping run
+        }
+        op += len;
+    }
+    if (op != out_len) throw std::runtime_error("Compressed frame has the wrong length");
+}
+
+void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+} // namespace
+
+// Function: lz_compress
+// Purpose: Compresses frame by frame into a per-thread scratch buffer, and
+//          appends each frame whole, so `out` only grows by what is kept.
+bool lz_compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out, size_t limit) {
+    static thread_local std::vector<uint8_t> scratch(LZ_FRAME);
+    out.clear();
+    for (size_t pos = 0; pos < len; pos += LZ_FRAME) {
+        size_t n = std::min(LZ_FRAME, len - pos);
+        if (limit - out.size() < 4) return false;
+        size_t room = limit - out.size() - 4;
+        size_t c = compress_block(data + pos, n, scratch.data(), std::min(n - 1, room));
+        uint8_t header[4];
+        if (c) {
+            put_u32(header, static_cast<uint32_t>(c));
+            out.insert(out.end(), header, header + 4);
+            out.insert(out.end(), scratch.data(), scratch.data() + c);
+        } else {
+            if (room < n) return false;
+            put_u32(header, static_cast<uint32_t>(n) | RAW_FRAME);
+            out.insert(out.end(), header, header + 4);
+            out.insert(out.end(), data + pos, data + pos + n);
+        }
+    }
+    return true;
+}
+
+// Function: lz_decompress
+// Purpose: Walks the frame headers, decoding only the frames that overlap the
+//          range; a frame only partly wanted is decoded into a scratch buffer.
+void lz_decompress(const uint8_t *data, size_t len, size_t decoded_size,
+                   size_t offset, size_t count, uint8_t *out) {
+    if (offset > decoded_size || count > decoded_size - offset)
+        throw std::runtime_error("Range outside the compressed content");
+    std::vector<uint8_t> partial;
+    size_t ip = 0, frame = 0, done = 0;      // frame: content offset of the frame
+    while (done < count) {
+        if (len - ip < 4) throw std::runtime_error("Truncated compressed data");
+        uint32_t header = get_u32(data + ip);
+        ip += 4;
+        size_t body = header & ~RAW_FRAME;
+        if (body > len - ip) throw std::runtime_error("Truncated compressed data");
+        size_t n = std::min(LZ_FRAME, decoded_size - frame);
+        if (frame + n > offset) {
+            size_t from = std::max(offset, frame) - frame;
+            size_t take = std::min(frame + n, offset + count) - (frame + from);
+            if (header & RAW_FRAME) {
+                if (body != n) throw std::runtime_error("Raw frame has the wrong length");
+                std::memcpy(out + done, data + ip + from, take);
+            } else if (take == n) {
+                decompress_block(data + ip, body, out + done, n);
+            } else {
+                partial.resize(n);
+                decompress_block(data + ip, body, partial.data(), n);
+                std::memcpy(out + done, partial.data() + from, take);
+            }
+            done += take;
+        }
+        ip += body;
+        frame += n;
+    }
+}
+
+// Function: inflate
+// Purpose: Decodes a whole compressed blob into a new one.
+BlobRef inflate(const BlobRef &blob) {
+    if (!blob->compressed()) return blob;
+    std::vector<uint8_t> content(blob->decoded_size());
+    lz_decompress(blob->data(), blob->size(), content.size(), 0, content.size(), content.data());
+    return make_blob(std::move(content));
+}
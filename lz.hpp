@@ -0,0 +1,78 @@
+// File: lz.hpp
+// Description: Header file for the LZ codec used to compress stored files.
+//              It is a byte-oriented LZ77 in the style of LZ4: no entropy
+//              coding, so both directions run at memory-like speeds, which is
+//              what text and JSON uploads need to pay for themselves.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef LZ_HPP
+#define LZ_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "blob.hpp"   // Blob, BlobRef
+
+// Format:
+//   The content is cut into frames of LZ_FRAME bytes (the last may be
+//   shorter), compressed independently so any byte range can be decoded
+//   without the frames before it. Each frame is a u32 big-endian header and
+//   its body; bit 31 of the header marks a frame stored raw, the other bits
+//   give the body's length. A compressed body is a series of sequences:
+//     token          high nibble: literal count, low nibble: match length - 4
+//     [count bytes]  while a nibble is 15, more bytes are added (255 = go on)
+//     literals
+//     offset         u16 little-endian, 1..65535 bytes back
+//     [length bytes] as for the literal count
+//   The last sequence of a frame has only literals.
+
+// Constant: LZ_FRAME
+// Purpose: Content bytes per frame (equal to CHUNK_SIZE, so a chunked
+//          download decodes one frame per chunk).
+constexpr size_t LZ_FRAME = 64 * 1024;
+
+// Function: lz_compress
+// Purpose: Compresses `len` bytes into `out`, replacing its contents. A
+//          frame that does not shrink is stored raw.
+// Parameters:
+//   - data, len: The content.
+//   - out: Receives the frames.
+//   - limit: Largest acceptable output; compression stops early beyond it.
+// Returns:
+//   - true if the output fits in `limit` bytes.
+bool lz_compress(const uint8_t *data, size_t len, std::vector<uint8_t> &out, size_t limit);
+
+// Function: lz_decompress
+// Purpose: Decodes `count` content bytes starting at `offset` from
+//          compressed frames, skipping the frames before them.
+// Parameters:
+//   - data, len: The frames.
+//   - decoded_size: The length of the whole content.
+//   - offset, count: The range to decode.
+//   - out: Receives `count` bytes.
+// Throws:
+//   - std::runtime_error if the frames are malformed or too short.
+void lz_decompress(const uint8_t *data, size_t len, size_t decoded_size,
+                   size_t offset, size_t count, uint8_t *out);
+
+// Function: lz_plausible
+// Purpose: Checks a decoded length read from untrusted input before anything
+//          that large is allocated: it must exceed the compressed length, and
+//          every frame takes at least a header and a token.
+// Returns:
+//   - false if `len` compressed bytes cannot hold `decoded_size` bytes.
+inline bool lz_plausible(size_t len, size_t decoded_size) {
+    return decoded_size > len && (decoded_size + LZ_FRAME - 1) / LZ_FRAME * 5 <= len;
+}
+
+// Function: inflate
+// Returns:
+//   - The blob itself if it is not compressed, else a new blob holding its
+//     decoded content.
+// Throws:
+//   - std::runtime_error if the compressed content is malformed.
+BlobRef inflate(const BlobRef &blob);
+
+#endif // LZ_HPP
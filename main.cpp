@@ -5,9 +5,15 @@
 // Author: Logan Scheetz
 // Date: 5/12/25
 
-#include "protocol.hpp"   // Include for FileMessage, StatusMessage, RequestMessage, xor42
+#include "protocol.hpp"   // Include for FileMessage, StatusMessage, RequestMessage
 #include "pack109.hpp"    // Include for KVMap and serialization
 #include "hashmap.hpp"    // Include for the FileServerMap class
+#include "reactor.hpp"    // Include for the epoll Reactor
+#include "persist.hpp"    // Include for reading and writing the persistence file
+#include "transfer.hpp"   // Include for chunked uploads
+#include "wal.hpp"        // Include for the write-ahead log
+#include "snapshot.hpp"   // Include for background snapshots
+#include "lz.hpp"         // Include for decoding compressed files
 
 #include <csignal>        // Signal handling
 #include <fstream>        // File I/O
@@ -15,57 +21,372 @@
 #include <string>
 #include <vector>
 #include <cstring>        // For strcmp
+#include <cstdlib>        // For atol, strtoull
+#include <algorithm>      // For std::min
+#include <thread>         // For hardware_concurrency
+#include <memory>         // For unique_ptr
 #include <unistd.h>       // For close and other POSIX functions
 #include <sys/socket.h>   // For socket-related functions
 #include <netinet/in.h>   // For sockaddr_in
 #include <arpa/inet.h>    // For inet_pton
 
 constexpr int DEFAULT_PORT = 8081;  // Default port for the server
-constexpr int BUFFER_SIZE = 65535; // Maximum buffer size for communication
+constexpr size_t WAL_WORKERS = 32;  // Minimum workers when every write waits for fsync
 
-// Globals for persistence
+// Globals for persistence and shutdown
 static FileServerMap *g_store = nullptr;  // Global pointer to the in-memory file store
 static std::string    g_persist_file;    // Path to the persistence file
+static Reactor       *g_reactor = nullptr; // Running reactor, stopped on SIGINT
 
 // Function: handle_sigint
-// Purpose: Handles the SIGINT signal (Ctrl+C) to ensure data persistence before exiting.
+// Purpose: Handles the SIGINT signal (Ctrl+C) by waking the reactor, so that the
+//          main thread can shut down the workers and persist the store.
 // Parameters:
 //   - signal: The signal number (unused in this implementation).
 void handle_sigint(int) {
-    if (g_store && !g_persist_file.empty()) {
-        try {
-            // Convert in-memory data to a serialized map
-            KVMap out;
-            for (const auto &kv : g_store->entries()) {
-                out[kv.first] = pack109::serialize(kv.second);
-            }
-            auto bytes = pack109::serialize_map(out);
+    if (g_reactor) {
+        g_reactor->stop();
+    } else {
+        std::_Exit(0); // Not serving yet, nothing to persist
+    }
+}
+
+// Function: persist_store
+// Purpose: Writes every stored file to the persistence file, if one was given,
+//          as a final snapshot once the workers have stopped. The snapshot
+//          also empties the write-ahead log, so the next start loads one file.
+// Parameters:
+//   - snapshots: The snapshotter, or nullptr when persistence is disabled.
+// Returns:
+//   - true on success (or when persistence is disabled), false on failure.
+bool persist_store(Snapshotter *snapshots) {
+    if (!g_store || !snapshots) return true;
+    try {
+        snapshots->wait();                // Let a background snapshot finish first
+        snapshots->start();
+        if (!snapshots->wait()) return false;
+        std::cout << "\nPersisted " << g_store->size()
+                  << " files to " << g_persist_file << "\n";
+        return true;
+    } catch (const std::exception &e) {
+        std::cerr << "\nERROR: Failed to persist to '"
+                  << g_persist_file << "': " << e.what() << "\n";
+        return false;
+    }
+}
 
-            // Write serialized data to the persistence file
-            std::ofstream ofs(g_persist_file, std::ios::binary | std::ios::trunc);
-            if (!ofs) {
-                throw std::runtime_error("Cannot open file for writing");
+// Function: parse_size
+// Purpose: Parses a byte count with an optional K, M or G suffix (powers of 1024).
+// Parameters:
+//   - arg: The text to parse, e.g. "512M".
+//   - bytes: Set to the parsed value on success.
+// Returns:
+//   - true if `arg` is a positive number with at most one known suffix.
+static bool parse_size(const std::string &arg, size_t &bytes) {
+    char *end = nullptr;
+    unsigned long long n = std::strtoull(arg.c_str(), &end, 10);
+    if (end == arg.c_str() || n == 0) return false;
+    std::string suffix(end);
+    int shift = 0;
+    if (suffix == "K" || suffix == "k") shift = 10;
+    else if (suffix == "M" || suffix == "m") shift = 20;
+    else if (suffix == "G" || suffix == "g") shift = 30;
+    else if (!suffix.empty()) return false;
+    bytes = static_cast<size_t>(n) << shift;
+    return true;
+}
+
+// Function: store_file
+// Purpose: Stores a file, first appending it to the write-ahead log if one is
+//          in use, so the file is durable before the client hears "Stored".
+// Parameters:
+//   - store: The shared file store.
+//   - wal: The write-ahead log, or nullptr.
+//   - name: The file name.
+//   - data: The file content.
+// Returns:
+//   - true if the file replaced an existing one.
+// Throws:
+//   - std::runtime_error if the log cannot be written.
+static bool store_file(FileServerMap &store, WriteAheadLog *wal,
+                       const std::string &name, const std::vector<uint8_t> &data) {
+    if (wal) return wal->insert(store, name, data);
+    return store.insert(name, data);
+}
+
+// Function: store_files
+// Purpose: Stores a MultiFile batch. With a write-ahead log the whole batch is
+//          one group commit; without one each file is stored in turn.
+// Parameters:
+//   - store: The shared file store.
+//   - wal: The write-ahead log, or nullptr.
+//   - items: The parsed batch.
+// Returns:
+//   - The outcome for each file, in order.
+static std::vector<MultiStatusMessage::Result> store_files(FileServerMap &store, WriteAheadLog *wal,
+                                                           const std::vector<MultiFileMessage::ItemView> &items) {
+    std::vector<MultiStatusMessage::Result> results;
+    std::vector<std::string> names;
+    std::vector<std::vector<uint8_t>> contents;
+    std::vector<size_t> logged;          // Indices of the results insert_many fills in
+    for (const MultiFileMessage::ItemView &item : items) {
+        results.push_back({item.file.name.str(), false, ""});
+        MultiStatusMessage::Result &r = results.back();
+        if (!item.ok || item.file.encoding.size) {
+            r.message = item.ok ? "Unsupported encoding" : "No content";
+        } else if (wal) {
+            names.push_back(r.name);
+            contents.push_back(item.file.data.to_vec());
+            logged.push_back(results.size() - 1);
+        } else {
+            try {
+                r.message = store.insert(r.name, item.file.data.to_vec()) ? "Replaced" : "Stored";
+                r.ok = true;
+            } catch (const std::exception &e) {
+                r.message = std::string("Could not store: ") + e.what();
             }
-            ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
-            if (!ofs) {
-                throw std::runtime_error("Error while writing to file");
+        }
+    }
+    if (!logged.empty()) {
+        try {
+            std::vector<bool> existed = wal->insert_many(store, names, contents);
+            for (size_t i = 0; i < logged.size(); ++i) {
+                results[logged[i]].ok = true;
+                results[logged[i]].message = existed[i] ? "Replaced" : "Stored";
             }
-            std::cout << "\nPersisted " << out.size()
-                      << " files to " << g_persist_file << "\n";
         } catch (const std::exception &e) {
-            std::cerr << "\nERROR: Failed to persist to '"
-                      << g_persist_file << "': " << e.what()
-                      << "\nExiting immediately.\n";
-            std::_Exit(1); // Exit without cleanup
+            for (size_t i : logged) results[i].message = std::string("Could not store: ") + e.what();
         }
     }
-    std::_Exit(0); // Exit without cleanup
+    return results;
+}
+
+// Function: fetch_files
+// Purpose: Answers a MultiRequest with one MultiFile. All the names are looked
+//          up in one pass over the store, and the reply refers to the stored
+//          blobs rather than copying them. Files that would push the reply past
+//          MAX_FRAME_SIZE are reported as too large, to be fetched on their own;
+//          if even the reports do not fit, the batch fails with one Status.
+// Parameters:
+//   - store: The shared file store.
+//   - mr: The parsed request.
+// Returns:
+//   - The plain reply payload.
+static Reply fetch_files(FileServerMap &store, const MultiRequestMessage::View &mr) {
+    std::vector<std::string> names;
+    names.reserve(mr.names.size());
+    for (const pack109::Span &n : mr.names) names.push_back(n.str());
+    std::vector<BlobRef> blobs;
+    try {
+        blobs = store.get_stored_many(names);
+    } catch (const std::exception &e) {
+        return StatusMessage(false, e.what()).serialize();
+    }
+
+    // Decide what each item holds, keeping the reply and the ID the reactor
+    // may attach within one frame, then encode them
+    bool lz = mr.accept.equals("lz", 2);
+    std::vector<std::string> missing(names.size());
+    size_t size = MultiFileMessage::header_size(names.size()) + REQUEST_ID_SIZE;
+    for (size_t i = 0; i < names.size(); ++i) {
+        BlobRef &blob = blobs[i];
+        size_t item = 0;
+        if (blob) {
+            bool encoded = blob->compressed() && lz;
+            item = encoded ? MultiFileMessage::item_size(names[i].size(), blob->size(), 2)
+                           : MultiFileMessage::item_size(names[i].size(), blob->decoded_size());
+            if (size + item > MAX_FRAME_SIZE) {   // Checked before anything is decoded
+                blob.reset();
+                missing[i] = "Too large for a batch: " + names[i];
+            } else if (!encoded) {
+                try {
+                    blob = inflate(blob);
+                } catch (const std::exception &e) {
+                    blob.reset();
+                    missing[i] = std::string("Could not read: ") + e.what();
+                }
+            }
+        } else {
+            missing[i] = "Not found: " + names[i];
+        }
+        if (!blob) {
+            item = MultiFileMessage::missing_size(names[i].size(), missing[i].size());
+            if (size + item > MAX_FRAME_SIZE)
+                return StatusMessage(false, "Too many files for one batch").serialize();
+        }
+        size += item;
+    }
+    Reply reply;
+    MultiFileMessage::encode_header(reply.buffer(), names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        const BlobRef &blob = blobs[i];
+        if (!blob) {
+            MultiFileMessage::encode_missing(reply.buffer(), names[i], missing[i]);
+            continue;
+        }
+        if (blob->compressed())
+            MultiFileMessage::encode_item_head(reply.buffer(), names[i], blob->size(), "lz", blob->decoded_size());
+        else
+            MultiFileMessage::encode_item_head(reply.buffer(), names[i], blob->size());
+        reply.add_blob(blob, 0, blob->size());
+    }
+    return reply;
+}
+
+// Function: handle_message
+// Purpose: Processes one message received from a client and builds the reply.
+//          The reactor's framing layer has already decrypted the request and
+//          encrypts the reply while framing it.
+// Parameters:
+//   - store: The shared file store.
+//   - uploads: Chunked uploads in progress.
+//   - wal: The write-ahead log, or nullptr when --wal is not given.
+//   - snapshots: The snapshotter, or nullptr when --persist is not given.
+//   - msg: The decrypted message payload.
+// Returns:
+//   - The plain reply payload, referring to stored blobs where it carries
+//     file content.
+Reply handle_message(FileServerMap &store, UploadTable &uploads, WriteAheadLog *wal,
+                     Snapshotter *snapshots, const Bytes &msg) {
+    // Read the outer key once and run only the matching decoder
+    try {
+        switch (peek_message_type(msg)) {
+        case MessageType::Request: {
+            RequestMessage::View rm = RequestMessage::parse(msg.data(), msg.size());
+            std::string name = rm.name.str();
+            try {
+                BlobRef blob = store.find_stored(name); // Shared handle, no copy
+                if (!blob) return StatusMessage(false, "Not found: " + name).serialize();
+                bool encoded = blob->compressed() && rm.accept.equals("lz", 2);
+                size_t size = encoded ? FileMessage::encoded_size(name.size(), blob->size(), 2)
+                                      : FileMessage::encoded_size(name.size(), blob->decoded_size());
+                if (size + REQUEST_ID_SIZE > MAX_FRAME_SIZE)   // Checked before anything is decoded
+                    return StatusMessage(false, "Too large for one message, use Fetch: " + name).serialize();
+                Reply reply;
+                if (encoded) {
+                    // The client decodes it, so the stored bytes go out as they are
+                    FileMessage::encode_head(reply.buffer(), name, blob->size(), "lz", blob->decoded_size());
+                } else {
+                    blob = inflate(blob);
+                    FileMessage::encode_head(reply.buffer(), name, blob->size());
+                }
+                reply.add_blob(blob, 0, blob->size());   // Sent from the blob itself
+                return reply;
+            } catch (const std::exception &e) {   // A spill file read or a decode failed
+                return StatusMessage(false, std::string("Could not read: ") + e.what()).serialize();
+            }
+        }
+        case MessageType::File: {
+            FileMessage::View fm = FileMessage::parse(msg.data(), msg.size());
+            std::string name = fm.name.str();
+            if (fm.encoding.size)   // Only plain content is stored, as in store_files
+                return StatusMessage(false, "Unsupported encoding").serialize();
+            try {
+                bool existed = store_file(store, wal, name, fm.data.to_vec()); // Content copied once, into the blob
+                StatusMessage resp(true, existed ? "Replaced" : "Stored");
+                return resp.serialize();
+            } catch (const std::exception &e) {
+                return StatusMessage(false, std::string("Could not store: ") + e.what()).serialize();
+            }
+        }
+        case MessageType::Begin: {
+            BeginMessage bm = BeginMessage::deserialize(msg);
+            try {
+                return AckMessage(bm.name, uploads.begin(bm.name, bm.size)).serialize();
+            } catch (const std::exception &e) {
+                return StatusMessage(false, e.what()).serialize();
+            }
+        }
+        case MessageType::Chunk: {
+            ChunkMessage::View cm = ChunkMessage::parse(msg.data(), msg.size());
+            std::string name = cm.name.str();
+            try {
+                return AckMessage(name, uploads.chunk(name, cm.index, cm.size, cm.data)).serialize();
+            } catch (const std::exception &e) {
+                return StatusMessage(false, e.what()).serialize();
+            }
+        }
+        case MessageType::Commit: {
+            CommitMessage cm = CommitMessage::deserialize(msg);
+            try {
+                bool existed = uploads.commit(cm.name, [&](const std::vector<uint8_t> &data) {
+                    return store_file(store, wal, cm.name, data);   // Upload kept if this throws
+                });
+                return StatusMessage(true, existed ? "Replaced" : "Stored").serialize();
+            } catch (const std::exception &e) {
+                return StatusMessage(false, e.what()).serialize();
+            }
+        }
+        case MessageType::Fetch: {
+            // Only the requested slice of the stored blob is encoded (and, if
+            // it is compressed, decoded), so a download never holds more than
+            // one chunk per reply
+            FetchMessage fm = FetchMessage::deserialize(msg);
+            BlobRef blob;
+            try {
+                blob = store.find_stored(fm.name);
+            } catch (const std::exception &e) {
+                return StatusMessage(false, std::string("Could not read: ") + e.what()).serialize();
+            }
+            if (!blob) return StatusMessage(false, "Not found: " + fm.name).serialize();
+            uint64_t size = blob->decoded_size(), offset = fm.index * CHUNK_SIZE;
+            if (fm.index >= std::max<uint64_t>(1, chunk_count(size)))
+                return StatusMessage(false, "Chunk out of range: " + fm.name).serialize();
+            size_t len = std::min<uint64_t>(CHUNK_SIZE, size - offset);
+            if (!blob->compressed()) {
+                Reply reply;
+                ChunkMessage::encode_head(reply.buffer(), fm.name, fm.index, size, len);
+                reply.add_blob(blob, offset, len);
+                return reply;
+            }
+            Bytes slice(len);
+            try {
+                lz_decompress(blob->data(), blob->size(), size, offset, len, slice.data());
+            } catch (const std::exception &e) {
+                return StatusMessage(false, std::string("Could not read: ") + e.what()).serialize();
+            }
+            return ChunkMessage::serialize(fm.name, fm.index, size, slice.data(), len);
+        }
+        case MessageType::Snapshot: {
+            SnapshotMessage::deserialize(msg);
+            if (!snapshots) return StatusMessage(false, "Snapshots need --persist").serialize();
+            try {
+                bool started = snapshots->start();   // Returns once the child is forked
+                return StatusMessage(started, started ? "Snapshot started" : "Snapshot already running").serialize();
+            } catch (const std::exception &e) {
+                return StatusMessage(false, e.what()).serialize();
+            }
+        }
+        case MessageType::MultiRequest:
+            return fetch_files(store, MultiRequestMessage::parse(msg.data(), msg.size()));
+        case MessageType::MultiFile: {
+            MultiStatusMessage reply;
+            reply.results = store_files(store, wal, MultiFileMessage::parse(msg.data(), msg.size()));
+            return reply.serialize();
+        }
+        default:
+            break;   // Status, Ack and MultiStatus messages are never sent to the server
+        }
+    } catch (const std::exception &) {}  // Known key but malformed body
+
+    // Invalid message
+    StatusMessage resp(false, "Invalid message");
+    return resp.serialize();
 }
 
 int main(int argc, char *argv[]) {
     // Parse command-line arguments
     std::string bind_ip = "0.0.0.0";  // Default IP to bind the server
     int port = DEFAULT_PORT;          // Default port
+    size_t max_connections = 1;       // One client at a time unless -m is given
+    std::string wal_file;             // Write-ahead log path; empty disables the log
+    FsyncPolicy fsync_policy = FsyncPolicy::Always; // When the log is synced
+    unsigned fsync_interval_ms = 0;   // Period for an interval policy
+    unsigned group_window_us = 0;     // Extra time a group commit waits for more writes
+    unsigned snapshot_interval_s = 0; // Seconds between background snapshots; 0 disables
+    size_t max_memory = 0;            // Budget for file bodies in memory; 0 means unbounded
+    std::string spill_file = "fileserver.spill"; // Where bodies over the budget go
+    bool compress = false;            // Store compressible bodies compressed
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--hostname") == 0 || strcmp(argv[i], "-h") == 0) {
             // Parse hostname argument in the format IP:PORT
@@ -85,11 +406,57 @@ int main(int argc, char *argv[]) {
             if (i + 1 < argc) {
                 g_persist_file = argv[++i];
             }
+        } else if (strcmp(argv[i], "--max-connections") == 0 || strcmp(argv[i], "-m") == 0) {
+            // Parse maximum number of concurrent connections
+            if (i + 1 < argc) {
+                long m = std::atol(argv[++i]);
+                if (m < 1) {
+                    std::cerr << "Invalid max connections, must be at least 1\n";
+                    return 1;
+                }
+                max_connections = static_cast<size_t>(m);
+            }
+        } else if (strcmp(argv[i], "--wal") == 0 || strcmp(argv[i], "-w") == 0) {
+            // Parse write-ahead log file argument
+            if (i + 1 < argc) {
+                wal_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--group-window") == 0) {
+            // Parse group-commit gathering window in microseconds
+            if (i + 1 < argc) {
+                group_window_us = static_cast<unsigned>(std::atol(argv[++i]));
+            }
+        } else if (strcmp(argv[i], "--snapshot-interval") == 0) {
+            // Parse the period of background snapshots in seconds
+            if (i + 1 < argc) {
+                snapshot_interval_s = static_cast<unsigned>(std::atol(argv[++i]));
+            }
+        } else if (strcmp(argv[i], "--max-memory") == 0) {
+            // Parse the memory budget for file bodies, e.g. 512M
+            if (i + 1 < argc && !parse_size(argv[++i], max_memory)) {
+                std::cerr << "Invalid max memory, use a number of bytes with an optional K, M or G suffix\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--spill-file") == 0) {
+            // Parse the spill file path used with --max-memory
+            if (i + 1 < argc) {
+                spill_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            // Compress file bodies as they are stored
+            compress = true;
+        } else if (strcmp(argv[i], "--fsync") == 0) {
+            // Parse fsync policy: always, never, or a period in milliseconds
+            if (i + 1 < argc && !parse_fsync_policy(argv[++i], fsync_policy, fsync_interval_ms)) {
+                std::cerr << "Invalid fsync policy, use always, never or a number of milliseconds\n";
+                return 1;
+            }
         }
     }
 
-    // Setup signal handler for SIGINT
+    // Setup signal handler for SIGINT; write errors are reported by send instead of SIGPIPE
     std::signal(SIGINT, handle_sigint);
+    std::signal(SIGPIPE, SIG_IGN);
 
     // Create server socket
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -107,6 +474,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Allow quick restarts while old connections sit in TIME_WAIT
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
     // Bind server socket to the address
     if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
         perror("bind");
@@ -114,7 +485,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Start listening for incoming connections
-    if (listen(server_fd, 1) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
         return 1;
     }
@@ -123,8 +494,24 @@ int main(int argc, char *argv[]) {
 
     // Initialize in-memory file store
     FileServerMap store;
+    UploadTable uploads;
     g_store = &store;
 
+    // Compress before anything is loaded, so the replayed log is compressed too
+    if (compress) store.enable_compression();
+
+    // Bound the memory used by file bodies before anything is loaded
+    if (max_memory) {
+        try {
+            store.enable_spill(spill_file, max_memory);
+            std::cout << "Keeping at most " << (max_memory >> 20) << " MiB of file data in memory, the rest in "
+                      << spill_file << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     // Load persistence file if specified
     if (!g_persist_file.empty()) {
         std::ifstream testifs(g_persist_file);
@@ -132,15 +519,9 @@ int main(int argc, char *argv[]) {
             std::cout << "Persist file not found (" << g_persist_file
                       << "), starting with empty store." << std::endl;
         } else {
-            std::ifstream ifs(g_persist_file, std::ios::binary);
-            std::vector<uint8_t> buf((std::istreambuf_iterator<char>(ifs)), {});
             try {
-                KVMap disk_map = pack109::deserialize_map(buf);
-                for (auto &kv : disk_map) {
-                    auto data = pack109::deserialize_vec_u8(kv.second);
-                    store.insert(kv.first, data);
-                }
-                std::cout << "Loaded " << disk_map.size()
+                size_t count = read_store_file(g_persist_file, store);
+                std::cout << "Loaded " << count
                           << " files from " << g_persist_file << std::endl;
             } catch (const std::exception &e) {
                 std::cerr << "ERROR: Failed to parse persist file '"
@@ -150,63 +531,60 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Main server loop: accept and handle client connections
-    while (true) {
-        std::cout << "Waiting for connection..." << std::endl;
-        int client_fd = accept(server_fd, nullptr, nullptr);
-        if (client_fd < 0) {
-            perror("accept");
-            continue;
+    // Open the write-ahead log and replay it on top of the persisted snapshot
+    std::unique_ptr<WriteAheadLog> wal;
+    if (!wal_file.empty()) {
+        try {
+            wal.reset(new WriteAheadLog(wal_file, fsync_policy, fsync_interval_ms, group_window_us));
+            size_t replayed = wal->replay(store);
+            std::cout << "Replayed " << replayed << " records from " << wal_file << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
         }
-        std::cout << "Client connected." << std::endl;
-
-        // Communicate with the client
-        while (true) {
-            std::vector<uint8_t> buf(BUFFER_SIZE);
-            ssize_t n = recv(client_fd, buf.data(), buf.size(), 0);
-            if (n <= 0) break;  // Client closed connection or error
-            buf.resize(n);
-
-            auto decrypted = xor42(buf);
-
-            // 1) Try RequestMessage first
-            try {
-                auto rm = RequestMessage::deserialize(decrypted);
-                try {
-                    auto data = store.get(rm.name);
-                    FileMessage resp(rm.name, data);
-                    auto out = xor42(resp.serialize());
-                    send(client_fd, out.data(), out.size(), 0);
-                } catch (const std::exception &) {
-                    StatusMessage resp(false, std::string("Not found: ") + rm.name);
-                    auto out = xor42(resp.serialize());
-                    send(client_fd, out.data(), out.size(), 0);
-                }
-                continue;
-            } catch (const std::exception &) {}
-
-            // 2) Try FileMessage
-            try {
-                auto fm = FileMessage::deserialize(decrypted);
-                bool existed = store.insert(fm.name, fm.data);
-                StatusMessage resp(true, existed ? "Replaced" : "Stored");
-                auto out = xor42(resp.serialize());
-                send(client_fd, out.data(), out.size(), 0);
-                continue;
-            } catch (const std::exception &) {}
+    }
 
-            // 3) Invalid message
-            {
-                StatusMessage resp(false, "Invalid message");
-                auto out = xor42(resp.serialize());
-                send(client_fd, out.data(), out.size(), 0);
-            }
-        }
+    // Snapshots fork a child that writes the persistence file while we serve
+    std::unique_ptr<Snapshotter> snapshots;
+    if (!g_persist_file.empty())
+        snapshots.reset(new Snapshotter(g_persist_file, store, wal.get(), snapshot_interval_s));
 
-        close(client_fd);
-        std::cout << "Client disconnected." << std::endl;
+    // Serve clients until SIGINT: one epoll loop plus a pool of worker threads
+    // Workers that wait on fsync are not using a CPU, and a group commit can only
+    // batch as many writes as there are workers waiting, so allow more of them
+    size_t cpu_workers = std::max(1u, std::thread::hardware_concurrency());
+    if (wal && fsync_policy == FsyncPolicy::Always) cpu_workers = std::max<size_t>(cpu_workers, WAL_WORKERS);
+    size_t workers = std::min<size_t>(max_connections, cpu_workers);
+    std::cout << "Serving up to " << max_connections << " connection(s) with "
+              << workers << " worker thread(s)" << std::endl;
+    try {
+        Reactor reactor(server_fd, max_connections, workers,
+                        [&store, &uploads, &wal, &snapshots](const Bytes &msg) {
+                            Reply reply = handle_message(store, uploads, wal.get(), snapshots.get(), msg);
+                            uint64_t id;
+                            if (peek_request_id(msg, id)) attach_request_id(reply, id); // For pipelining clients
+                            return reply;
+                        });
+        g_reactor = &reactor;
+        reactor.run();
+        std::signal(SIGINT, SIG_IGN); // Already shutting down
+        g_reactor = nullptr;
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
     }
 
     close(server_fd);
-    return 0;
+    if (max_memory) {
+        FileServerMap::CacheStats st = store.cache_stats();
+        std::cout << "\nCache: " << st.hits << " hits, " << st.misses << " misses, "
+                  << st.evictions << " evictions" << std::endl;
+    }
+    ContentTable::Stats dedup = store.dedup_stats();
+    if (dedup.references > dedup.bodies) {
+        std::cout << "Dedup: " << dedup.references << " files share " << dedup.bodies << " bodies, "
+                  << (dedup.logical >> 20) << " MiB stored in " << (dedup.stored >> 20) << " MiB (ratio "
+                  << double(dedup.logical) / dedup.stored << ")" << std::endl;
+    }
+    return persist_store(snapshots.get()) ? 0 : 1;
 }
\ No newline at end of file
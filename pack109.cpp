@@ -12,128 +12,314 @@
 #include <map>
 #include <string>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 
-// Helper to compute the length of a single Pack109 element at a given offset
-// Parameters:
-//   - bytes: The byte vector containing Pack109 data.
-//   - offset: The offset within the vector to begin calculation.
-// Returns:
-//   - The length of the Pack109 element starting at the given offset.
-// Throws:
-//   - runtime_error if the offset is out of range or the data is malformed.
-static size_t element_length(const vec &bytes, size_t offset)
+namespace pack109
 {
-  using namespace pack109;
-  if (offset >= bytes.size())
-    throw std::runtime_error("Offset out of range in element_length");
-
-  uint8_t tag = bytes[offset];
-  switch (tag)
-  {
-  // Booleans
-  case PACK109_TRUE:
-  case PACK109_FALSE:
-    return 1; // only the tag byte
-
-  // 1-byte integers
-  case PACK109_U8:
-  case PACK109_I8:
-    return 2; // tag + 1 data byte
-
-  // 4-byte types (u32, i32, f32)
-  case PACK109_U32:
-  case PACK109_I32:
-  case PACK109_F32:
-    return 1 + 4; // tag + 4 data bytes
-
-  // 8-byte types (u64, i64, f64)
-  case PACK109_U64:
-  case PACK109_I64:
-  case PACK109_F64:
-    return 1 + 8; // tag + 8 data bytes
-
-  // String8: tag, length byte, then that many chars
-  case PACK109_S8:
-  {
-    if (offset + 1 >= bytes.size())
-      throw std::runtime_error("Truncated S8 header");
-    uint8_t len = bytes[offset + 1];
-    return 2 + len; // tag + len byte + data
-  }
-
-  // Array8 of u8 elements: tag, count, then each element as (U8 tag + byte)
-  case PACK109_A8:
-  {
-    if (offset + 1 >= bytes.size())
-      throw std::runtime_error("Truncated A8 header");
-    uint8_t count = bytes[offset + 1];
-    size_t pos = offset + 2;
-    size_t total = 2;
-    for (int i = 0; i < count; ++i)
+  // Tags of each sized family, indexed by the width class of the length field
+  static const u8 STRING_TAGS[3] = {PACK109_S8, PACK109_S16, PACK109_S32};
+  static const u8 ARRAY_TAGS[3] = {PACK109_A8, PACK109_A16, PACK109_A32};
+  static const u8 MAP_TAGS[3] = {PACK109_M8, PACK109_M16, PACK109_M32};
+  static const u8 BINARY_TAGS[3] = {PACK109_B8, PACK109_B16, PACK109_B32};
+  static const int LENGTH_WIDTHS[3] = {1, 2, 4};
+
+  // Width class of the smallest length field that can hold n
+  static int length_class(size_t n)
+  {
+    return n <= 0xFF ? 0 : n <= 0xFFFF ? 1 : 2;
+  }
+
+  // Size of a tag plus the smallest length field for n
+  static size_t header_size(size_t n)
+  {
+    return 1 + LENGTH_WIDTHS[length_class(n)];
+  }
+
+  // Encoded sizes of the variable-length forms
+  size_t encoded_string_size(size_t len) { return header_size(len) + len; }      // S tag, length, chars
+  size_t encoded_bytes_size(size_t len) { return header_size(len) + 2 * len; }   // A tag, count, U8 elements
+  size_t encoded_binary_size(size_t len) { return header_size(len) + len; }      // B tag, length, raw bytes
+  size_t encoded_array_header_size(size_t count) { return header_size(count); }  // A tag, count
+  size_t encoded_map_header_size(size_t count) { return header_size(count); }    // M tag, count
+
+  // Extend the buffer by n bytes and return a pointer to the new space
+  u8 *Encoder::grow(size_t n)
+  {
+    size_t pos = out_.size();
+    out_.resize(pos + n);
+    return out_.data() + pos;
+  }
+
+  // Write a tag followed by the low `width` bytes of raw, most significant first
+  void Encoder::put_be(u8 tag, u64 raw, int width)
+  {
+    u8 *p = grow(1 + width);
+    *p++ = tag;
+    for (int i = width - 1; i >= 0; --i)
+      *p++ = (raw >> (8 * i)) & 0xFF;
+  }
+
+  void Encoder::put(bool item) { *grow(1) = item ? PACK109_TRUE : PACK109_FALSE; }
+  void Encoder::put(u8 item) { put_be(PACK109_U8, item, 1); }
+  void Encoder::put(u32 item) { put_be(PACK109_U32, item, 4); }
+  void Encoder::put(u64 item) { put_be(PACK109_U64, item, 8); }
+  void Encoder::put(i8 item) { put_be(PACK109_I8, (u8)item, 1); }
+  void Encoder::put(i32 item) { put_be(PACK109_I32, (u32)item, 4); }
+  void Encoder::put(i64 item) { put_be(PACK109_I64, (u64)item, 8); }
+
+  void Encoder::put(f32 item)
+  {
+    u32 raw;
+    std::memcpy(&raw, &item, sizeof(raw));
+    put_be(PACK109_F32, raw, 4);
+  }
+
+  void Encoder::put(f64 item)
+  {
+    u64 raw;
+    std::memcpy(&raw, &item, sizeof(raw));
+    put_be(PACK109_F64, raw, 8);
+  }
+
+  void Encoder::put(const string &item) { put_string(item.data(), item.size()); }
+
+  // Write the tag of the smallest 8/16/32-bit form that holds n, then n itself
+  void Encoder::put_length(const u8 *tags, size_t n, const char *error)
+  {
+    if (n > 0xFFFFFFFFul)
+      throw std::runtime_error(error);
+    int c = length_class(n);
+    put_be(tags[c], n, LENGTH_WIDTHS[c]);
+  }
+
+  void Encoder::put_string(const char *data, size_t len)
+  {
+    put_length(STRING_TAGS, len, "String too long");
+    if (len)
+      std::memcpy(grow(len), data, len);
+  }
+
+  void Encoder::put_bytes(const u8 *data, size_t len)
+  {
+    put_length(ARRAY_TAGS, len, "Vector<u8> too long");
+    u8 *p = grow(2 * len);
+    for (size_t i = 0; i < len; ++i)
     {
-      if (pos + 1 >= bytes.size() || bytes[pos] != PACK109_U8)
-        throw std::runtime_error("Malformed A8 element");
-      total += 2; // each U8 element: tag + 1 byte
-      pos += 2;
+      *p++ = PACK109_U8;
+      *p++ = data[i];
     }
-    return total;
   }
 
-  // Map8: tag, count, then [ key, value ] pairs
-  case PACK109_M8:
+  // Raw bytes are copied in one block
+  void Encoder::put_binary(const u8 *data, size_t len)
+  {
+    begin_binary(len);
+    if (len)
+      std::memcpy(grow(len), data, len);
+  }
+
+  void Encoder::begin_binary(size_t len) { put_length(BINARY_TAGS, len, "Binary too long"); }
+  void Encoder::begin_array(size_t count) { put_length(ARRAY_TAGS, count, "Array too large"); }
+  void Encoder::begin_map(size_t count) { put_length(MAP_TAGS, count, "Map too large"); }
+
+  // Copy the viewed bytes out, using one memcpy when they are contiguous
+  void ByteSpan::copy_to(u8 *dst) const
   {
-    if (offset + 1 >= bytes.size())
-      throw std::runtime_error("Truncated M8 header");
-    uint8_t count = bytes[offset + 1];
-    size_t pos = offset + 2;
-    size_t total = 2;
-    for (int i = 0; i < count; ++i)
+    if (stride == 1)
     {
-      // key (always S8)
-      size_t klen = element_length(bytes, pos);
-      pos += klen;
-      total += klen;
-      // value (any element)
-      size_t vlen = element_length(bytes, pos);
-      pos += vlen;
-      total += vlen;
+      if (count)
+        std::memcpy(dst, data, count);
+      return;
     }
-    return total;
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = data[i * stride];
   }
 
-  default:
-    throw std::runtime_error(
-        std::string("Unsupported tag in element_length: ") + std::to_string(tag));
+  vec ByteSpan::to_vec() const
+  {
+    vec out(count);
+    copy_to(out.data());
+    return out;
+  }
+
+  // Consume n bytes, failing if fewer remain
+  const u8 *Reader::take(size_t n)
+  {
+    if ((size_t)(end_ - pos_) < n)
+      throw std::runtime_error("Truncated Pack109 element");
+    const u8 *p = pos_;
+    pos_ += n;
+    return p;
+  }
+
+  u8 Reader::peek_tag() const
+  {
+    if (pos_ == end_)
+      throw std::runtime_error("Truncated Pack109 element");
+    return *pos_;
+  }
+
+  // Read `tag` followed by a `width`-byte big-endian value
+  u64 Reader::read_be(u8 tag, int width)
+  {
+    if (peek_tag() != tag)
+      throw std::runtime_error("Unexpected Pack109 tag");
+    const u8 *p = take(1 + width) + 1;
+    u64 v = 0;
+    for (int i = 0; i < width; ++i)
+      v = (v << 8) | p[i];
+    return v;
+  }
+
+  bool Reader::read_bool()
+  {
+    u8 tag = peek_tag();
+    if (tag != PACK109_TRUE && tag != PACK109_FALSE)
+      throw std::runtime_error("Invalid boolean tag");
+    take(1);
+    return tag == PACK109_TRUE;
+  }
+
+  u8 Reader::read_u8() { return (u8)read_be(PACK109_U8, 1); }
+  u32 Reader::read_u32() { return (u32)read_be(PACK109_U32, 4); }
+  u64 Reader::read_u64() { return read_be(PACK109_U64, 8); }
+
+  // Read the tag and length field of any member of a sized family
+  size_t Reader::read_length(const u8 *tags)
+  {
+    u8 tag = peek_tag();
+    for (int c = 0; c < 3; ++c)
+      if (tag == tags[c])
+        return read_be(tag, LENGTH_WIDTHS[c]);
+    throw std::runtime_error("Unexpected Pack109 tag");
+  }
+
+  bool Reader::is_string() const { return tag_in(STRING_TAGS); }
+  bool Reader::is_binary() const { return tag_in(BINARY_TAGS); }
+
+  bool Reader::tag_in(const u8 *tags) const
+  {
+    u8 tag = peek_tag();
+    return tag == tags[0] || tag == tags[1] || tag == tags[2];
+  }
+
+  f64 Reader::read_f64()
+  {
+    u64 raw = read_be(PACK109_F64, 8);
+    f64 v;
+    std::memcpy(&v, &raw, sizeof(v));
+    return v;
+  }
+
+  Span Reader::read_string()
+  {
+    size_t len = read_length(STRING_TAGS);
+    Span out = {take(len), len};
+    return out;
+  }
+
+  ByteSpan Reader::read_bytes()
+  {
+    if (is_binary())
+    {
+      size_t len = read_length(BINARY_TAGS);
+      ByteSpan raw = {take(len), len, 1};
+      return raw;
+    }
+    size_t count = read_length(ARRAY_TAGS);
+    if (count > remaining() / 2)
+      throw std::runtime_error("Truncated Pack109 element");
+    const u8 *p = take(2 * count);
+    for (size_t i = 0; i < count; ++i)
+      if (p[2 * i] != PACK109_U8)
+        throw std::runtime_error("Malformed u8 in vector");
+    ByteSpan out = {p + 1, count, 2};
+    return out;
+  }
+
+  size_t Reader::read_array() { return read_length(ARRAY_TAGS); }
+  size_t Reader::read_map() { return read_length(MAP_TAGS); }
+
+  // Step over one element; containers are skipped along with their contents.
+  // Nesting is handled with a count of elements still to skip rather than by
+  // recursion, so a deeply nested value cannot exhaust the stack
+  void Reader::skip()
+  {
+    size_t pending = 1;
+    while (pending > 0)
+    {
+      --pending;
+      u8 tag = peek_tag();
+      switch (tag)
+      {
+      case PACK109_TRUE:
+      case PACK109_FALSE:
+        take(1);
+        break;
+      case PACK109_U8:
+      case PACK109_I8:
+        take(2);
+        break;
+      case PACK109_U32:
+      case PACK109_I32:
+      case PACK109_F32:
+        take(5);
+        break;
+      case PACK109_U64:
+      case PACK109_I64:
+      case PACK109_F64:
+        take(9);
+        break;
+      case PACK109_S8:
+      case PACK109_S16:
+      case PACK109_S32:
+        read_string();
+        break;
+      case PACK109_B8:
+      case PACK109_B16:
+      case PACK109_B32:
+        read_bytes();
+        break;
+      case PACK109_A8:
+      case PACK109_A16:
+      case PACK109_A32:
+        pending += read_array();
+        break;
+      case PACK109_M8:
+      case PACK109_M16:
+      case PACK109_M32:
+        pending += 2 * read_map();
+        break;
+      default:
+        throw std::runtime_error(
+            std::string("Unsupported tag in skip: ") + std::to_string(tag));
+      }
+      // Every element takes at least one byte
+      if (pending > remaining())
+        throw std::runtime_error("Truncated Pack109 element");
+    }
   }
-}
 
-namespace pack109
-{
   // Implementation of serialization and deserialization methods
   // Each method serializes/deserializes specific types into/from byte vectors.
 
-  // Serialize a map (KVMap) into a byte vector
+  // Serialize a map (KVMap) into a byte vector, sized exactly up front
   vec serialize_map(const KVMap &m)
   {
-    if (m.size() > 255)
-    {
-      throw std::runtime_error("Map too large");
-    }
+    size_t total = encoded_map_header_size(m.size());
+    for (const auto &p : m)
+      total += encoded_string_size(p.first.size()) + p.second.size();
 
     vec bytes;
-    bytes.push_back(PACK109_M8);                // map tag
-    bytes.push_back(static_cast<u8>(m.size())); // entry count
-
+    bytes.reserve(total);
+    Encoder enc(bytes);
+    enc.begin_map(m.size());
     for (const auto &p : m)
     {
-      // Key is always a string
-      vec keyb = serialize(p.first);
-      // Value must already be a tagged element
-      vec valb = p.second;
-
-      // Append key then value directly
-      bytes.insert(bytes.end(), keyb.begin(), keyb.end());
-      bytes.insert(bytes.end(), valb.begin(), valb.end());
+      // Key is always a string; value must already be a tagged element
+      enc.put(p.first);
+      bytes.insert(bytes.end(), p.second.begin(), p.second.end());
     }
 
     return bytes;
@@ -142,30 +328,23 @@ namespace pack109
   // Deserialize a map (KVMap) from a byte vector
   KVMap deserialize_map(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_M8)
+    Reader in(bytes);
+    if (bytes.empty() || !in.tag_in(MAP_TAGS))
       throw std::runtime_error("Invalid map format");
-    uint8_t count = bytes[1];
+    size_t count = in.read_map();
     KVMap out;
-    size_t pos = 2;
-    for (int i = 0; i < count; ++i)
+    for (size_t i = 0; i < count; ++i)
     {
-      // Deserialize key
-      if (pos >= bytes.size() || bytes[pos] != PACK109_S8)
+      // Key is always a string
+      if (!in.is_string())
         throw std::runtime_error("Invalid map key format");
-      size_t klen = element_length(bytes, pos);
-      std::string key(bytes.begin() + pos + 2,
-                      bytes.begin() + pos + klen);
-      pos += klen;
-
-      // Deserialize value
-      size_t vlen = element_length(bytes, pos);
-      vec val(bytes.begin() + pos, bytes.begin() + pos + vlen);
-      out[key] = val;
-      pos += vlen;
-    }
+      string key = in.read_string().str();
 
-    // if (pos != bytes.size())
-    //     throw std::runtime_error("Extra data after map deserialization");
+      // Value is copied out as a complete tagged element
+      const u8 *start = in.position();
+      in.skip();
+      out[key] = vec(start, in.position());
+    }
 
     return out;
   }
@@ -173,7 +352,7 @@ namespace pack109
   vec serialize(bool item)
   {
     vec bytes;
-    bytes.push_back(item ? PACK109_TRUE : PACK109_FALSE);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -191,8 +370,7 @@ namespace pack109
   vec serialize(u8 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_U8);
-    bytes.push_back(item);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -206,9 +384,7 @@ namespace pack109
   vec serialize(u32 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_U32);
-    for (int i = 3; i >= 0; --i)
-      bytes.push_back((item >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -225,9 +401,7 @@ namespace pack109
   vec serialize(u64 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_U64);
-    for (int i = 7; i >= 0; --i)
-      bytes.push_back((item >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -244,8 +418,7 @@ namespace pack109
   vec serialize(i8 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_I8);
-    bytes.push_back((u8)item);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -259,9 +432,7 @@ namespace pack109
   vec serialize(i32 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_I32);
-    for (int i = 3; i >= 0; --i)
-      bytes.push_back((item >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -278,9 +449,7 @@ namespace pack109
   vec serialize(i64 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_I64);
-    for (int i = 7; i >= 0; --i)
-      bytes.push_back((item >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -297,10 +466,7 @@ namespace pack109
   vec serialize(f32 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_F32);
-    u32 raw = *reinterpret_cast<u32 *>(&item);
-    for (int i = 3; i >= 0; --i)
-      bytes.push_back((raw >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -317,10 +483,7 @@ namespace pack109
   vec serialize(f64 item)
   {
     vec bytes;
-    bytes.push_back(PACK109_F64);
-    u64 raw = *reinterpret_cast<u64 *>(&item);
-    for (int i = 7; i >= 0; --i)
-      bytes.push_back((raw >> (8 * i)) & 0xFF);
+    Encoder(bytes).put(item);
     return bytes;
   }
 
@@ -336,150 +499,122 @@ namespace pack109
 
   vec serialize(const string &item)
   {
-    if (item.size() > 255)
-      throw std::runtime_error("String too long");
     vec bytes;
-    bytes.push_back(PACK109_S8);
-    bytes.push_back((u8)item.size());
-    for (char c : item)
-      bytes.push_back((u8)c);
+    bytes.reserve(encoded_string_size(item.size()));
+    Encoder(bytes).put(item);
     return bytes;
   }
 
   string deserialize_string(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_S8)
+    Reader in(bytes);
+    if (bytes.empty() || !in.is_string())
       throw std::runtime_error("Invalid string format");
-    u8 len = bytes[1];
-    if (bytes.size() != (size_t)2 + len)
+    string out = in.read_string().str();
+    if (!in.at_end())
       throw std::runtime_error("String length mismatch");
-    return string(bytes.begin() + 2, bytes.end());
+    return out;
   }
 
   vec serialize(const std::vector<u8> &items)
   {
-    if (items.size() > 255)
-      throw std::runtime_error("Vector<u8> too long");
     vec bytes;
-    bytes.push_back(PACK109_A8);
-    bytes.push_back((u8)items.size());
-    for (u8 v : items)
-    {
-      vec tmp = serialize(v);
-      bytes.insert(bytes.end(), tmp.begin(), tmp.end());
-    }
+    bytes.reserve(encoded_bytes_size(items.size()));
+    Encoder(bytes).put_bytes(items.data(), items.size());
+    return bytes;
+  }
+
+  vec serialize_binary(const u8 *data, size_t len)
+  {
+    vec bytes;
+    bytes.reserve(encoded_binary_size(len));
+    Encoder(bytes).put_binary(data, len);
     return bytes;
   }
 
   std::vector<u8> deserialize_vec_u8(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_A8)
+    if (bytes.empty())
       throw std::runtime_error("Invalid vec_u8 format");
-    u8 len = bytes[1];
-    std::vector<u8> out;
-    size_t i = 2;
-    while (out.size() < len)
-    {
-      if (i + 2 > bytes.size() || bytes[i] != PACK109_U8)
-        throw std::runtime_error("Malformed u8 in vector");
-      out.push_back(bytes[i + 1]);
-      i += 2;
-    }
-    return out;
+    Reader in(bytes);
+    return in.read_bytes().to_vec();
   }
 
   vec serialize(const std::vector<u64> &items)
   {
-    if (items.size() > 255)
-      throw std::runtime_error("Vector<u64> too long");
-    vec bytes{PACK109_A8, (u8)items.size()};
+    vec bytes;
+    bytes.reserve(encoded_array_header_size(items.size()) + 9 * items.size());
+    Encoder enc(bytes);
+    enc.begin_array(items.size());
     for (u64 v : items)
-    {
-      vec tmp = serialize(v);
-      bytes.insert(bytes.end(), tmp.begin(), tmp.end());
-    }
+      enc.put(v);
     return bytes;
   }
 
   std::vector<u64> deserialize_vec_u64(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_A8)
+    Reader in(bytes);
+    if (bytes.empty() || !in.tag_in(ARRAY_TAGS))
       throw std::runtime_error("Invalid vec_u64");
-    u8 len = bytes[1];
+    size_t len = in.read_array();
     std::vector<u64> out;
-    size_t off = 2;
-    for (int i = 0; i < len; i++)
-    {
-      if (off + 9 > bytes.size())
-        throw std::runtime_error("Truncated u64");
-      vec slice(bytes.begin() + off, bytes.begin() + off + 9);
-      out.push_back(deserialize_u64(slice));
-      off += 9;
-    }
+    out.reserve(std::min(len, in.remaining() / 9));
+    for (size_t i = 0; i < len; i++)
+      out.push_back(in.read_u64());
     return out;
   }
 
   vec serialize(const std::vector<f64> &items)
   {
-    if (items.size() > 255)
-      throw std::runtime_error("Vector<f64> too long");
-    vec bytes{PACK109_A8, (u8)items.size()};
+    vec bytes;
+    bytes.reserve(encoded_array_header_size(items.size()) + 9 * items.size());
+    Encoder enc(bytes);
+    enc.begin_array(items.size());
     for (f64 v : items)
-    {
-      vec tmp = serialize(v);
-      bytes.insert(bytes.end(), tmp.begin(), tmp.end());
-    }
+      enc.put(v);
     return bytes;
   }
 
   std::vector<f64> deserialize_vec_f64(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_A8)
+    Reader in(bytes);
+    if (bytes.empty() || !in.tag_in(ARRAY_TAGS))
       throw std::runtime_error("Invalid vec_f64");
-    u8 len = bytes[1];
+    size_t len = in.read_array();
     std::vector<f64> out;
-    size_t off = 2;
-    for (int i = 0; i < len; i++)
-    {
-      if (off + 9 > bytes.size())
-        throw std::runtime_error("Truncated f64");
-      vec slice(bytes.begin() + off, bytes.begin() + off + 9);
-      out.push_back(deserialize_f64(slice));
-      off += 9;
-    }
+    out.reserve(std::min(len, in.remaining() / 9));
+    for (size_t i = 0; i < len; i++)
+      out.push_back(in.read_f64());
     return out;
   }
 
   vec serialize(const std::vector<string> &items)
   {
-    if (items.size() > 255)
-      throw std::runtime_error("Vector<string> too long");
-    vec bytes{PACK109_A8, (u8)items.size()};
-    for (const auto &s : items)
-    {
-      vec tmp = serialize(s);
-      bytes.insert(bytes.end(), tmp.begin(), tmp.end());
-    }
+    size_t total = encoded_array_header_size(items.size());
+    for (const auto &str : items)
+      total += encoded_string_size(str.size());
+    vec bytes;
+    bytes.reserve(total);
+    Encoder enc(bytes);
+    enc.begin_array(items.size());
+    for (const auto &str : items)
+      enc.put(str);
     return bytes;
   }
 
   std::vector<string> deserialize_vec_string(const vec &bytes)
   {
-    if (bytes.size() < 2 || bytes[0] != PACK109_A8)
+    Reader in(bytes);
+    if (bytes.empty() || !in.tag_in(ARRAY_TAGS))
       throw std::runtime_error("Invalid vec_string");
-    u8 len = bytes[1];
+    size_t len = in.read_array();
     std::vector<string> out;
-    size_t off = 2;
-    for (int i = 0; i < len; i++)
+    out.reserve(std::min(len, in.remaining() / 2));
+    for (size_t i = 0; i < len; i++)
     {
-      if (off + 2 > bytes.size() || bytes[off] != PACK109_S8)
+      if (!in.is_string())
         throw std::runtime_error("Malformed string in vec");
-      u8 sl = bytes[off + 1];
-      if (off + 2 + sl > bytes.size())
-        throw std::runtime_error("Truncated string");
-      vec slice(bytes.begin() + off, bytes.begin() + off + 2 + sl);
-      out.push_back(deserialize_string(slice));
-      off += 2 + sl;
+      out.push_back(in.read_string().str());
     }
     return out;
   }
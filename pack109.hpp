@@ -9,6 +9,7 @@
 #define PACK109_HPP
 
 #include <vector>
+#include <cstring>
 #include <string>
 #include <map>
 
@@ -45,6 +46,12 @@ using KVMap = std::map<std::string, vec>;
 #define PACK109_A16   0xad // Array with 16-bit size
 #define PACK109_M8    0xae // Map with 8-bit size
 #define PACK109_M16   0xaf // Map with 16-bit size
+#define PACK109_B8    0xb0 // Raw bytes with 8-bit size
+#define PACK109_B16   0xb1 // Raw bytes with 16-bit size
+#define PACK109_B32   0xb2 // Raw bytes with 32-bit size
+#define PACK109_S32   0xb3 // String with 32-bit size
+#define PACK109_A32   0xb4 // Array with 32-bit size
+#define PACK109_M32   0xb5 // Map with 32-bit size
 
 // Struct: Person
 // Represents a simple structure with an age, height, and name.
@@ -57,6 +64,116 @@ struct Person {
 
 namespace pack109 {
 
+  // Encoded sizes, so callers can size a buffer exactly before encoding
+  size_t encoded_string_size(size_t len);        // Size of a string of `len` chars
+  size_t encoded_bytes_size(size_t len);         // Size of a byte array of `len` bytes
+  size_t encoded_binary_size(size_t len);        // Size of raw bytes of `len` bytes
+  size_t encoded_array_header_size(size_t count); // Size of an array tag and count
+  size_t encoded_map_header_size(size_t count);   // Size of a map tag and count
+
+  // Class: Encoder
+  // Purpose: Appends Pack109 elements directly to a caller-owned buffer, so a
+  //          whole message can be written without intermediate vectors. If the
+  //          caller reserves the encoded size first, encoding does not allocate.
+  //          Strings, arrays, maps and raw bytes use the smallest of the 8-, 16-
+  //          and 32-bit length forms that fits.
+  class Encoder {
+  public:
+    explicit Encoder(vec &out) : out_(out) {}
+
+    void put(bool item);                      // Append a boolean
+    void put(u8 item);                        // Append an 8-bit unsigned integer
+    void put(u32 item);                       // Append a 32-bit unsigned integer
+    void put(u64 item);                       // Append a 64-bit unsigned integer
+    void put(i8 item);                        // Append an 8-bit signed integer
+    void put(i32 item);                       // Append a 32-bit signed integer
+    void put(i64 item);                       // Append a 64-bit signed integer
+    void put(f32 item);                       // Append a 32-bit float
+    void put(f64 item);                       // Append a 64-bit float
+    void put(const string &item);             // Append a string
+    void put_string(const char *data, size_t len); // Append a string from raw chars
+    void put_bytes(const u8 *data, size_t len);    // Append a byte array
+    void put_binary(const u8 *data, size_t len);   // Append raw bytes (B8/B16/B32)
+    void begin_binary(size_t len);            // Append a raw-bytes header; `len` bytes follow
+    void begin_array(size_t count);           // Append an array header; elements follow
+    void begin_map(size_t count);             // Append a map header; key/value pairs follow
+
+    // Method: buffer
+    // Returns:
+    //   - The buffer being written to.
+    vec &buffer() { return out_; }
+
+  private:
+    u8 *grow(size_t n);                       // Extend the buffer by n bytes
+    void put_length(const u8 *tags, size_t n, const char *error); // Append the smallest 8/16/32-bit header
+    void put_be(u8 tag, u64 raw, int width);  // Append a tag and a big-endian value
+
+    vec &out_;                                // Destination buffer
+  };
+
+  // Struct: Span
+  // Purpose: Non-owning view of bytes inside a larger buffer, such as the chars
+  //          of a string element. Valid only while that buffer is alive.
+  struct Span {
+    const u8 *data;
+    size_t size;
+
+    string str() const { return string(reinterpret_cast<const char *>(data), size); }
+    bool equals(const char *s, size_t n) const { return n == size && std::memcmp(data, s, n) == 0; }
+  };
+
+  // Struct: ByteSpan
+  // Purpose: Non-owning view of the payload of a byte array. Each of the `count`
+  //          bytes sits `stride` bytes after the previous one (2 when every byte
+  //          carries its own U8 tag).
+  struct ByteSpan {
+    const u8 *data;
+    size_t count;
+    size_t stride;
+
+    void copy_to(u8 *dst) const;             // Write the bytes to dst[0..count)
+    vec to_vec() const;                      // Copy the bytes into a new vector
+  };
+
+  // Class: Reader
+  // Purpose: Cursor that walks Pack109 elements in place. Strings and byte
+  //          arrays come back as views into the original buffer, so decoding
+  //          does not allocate. Every read checks bounds and tags.
+  // Throws:
+  //   - runtime_error from any read if the data is truncated or has the wrong tag.
+  class Reader {
+  public:
+    Reader(const u8 *data, size_t len) : pos_(data), end_(data + len) {}
+    explicit Reader(const vec &bytes) : Reader(bytes.data(), bytes.size()) {}
+
+    bool at_end() const { return pos_ == end_; }
+    size_t remaining() const { return end_ - pos_; }
+    const u8 *position() const { return pos_; }
+    u8 peek_tag() const;                     // Tag of the next element, without consuming it
+    bool tag_in(const u8 *tags) const;       // Whether the next tag is one of tags[0..3)
+    bool is_string() const;                  // Whether the next element is a string
+    bool is_binary() const;                  // Whether the next element is raw bytes
+
+    bool read_bool();                        // Read a boolean
+    u8 read_u8();                            // Read an 8-bit unsigned integer
+    u32 read_u32();                          // Read a 32-bit unsigned integer
+    u64 read_u64();                          // Read a 64-bit unsigned integer
+    f64 read_f64();                          // Read a 64-bit float
+    Span read_string();                      // Read a string; returns a view of its chars
+    ByteSpan read_bytes();                   // Read an array of U8 or raw bytes; returns a view of them
+    size_t read_array();                     // Read an array header; returns its element count
+    size_t read_map();                       // Read a map header; returns its entry count
+    void skip();                             // Step over one complete element of any type
+
+  private:
+    const u8 *take(size_t n);                // Consume n bytes, returning their start
+    u64 read_be(u8 tag, int width);          // Read a tagged big-endian value
+    size_t read_length(const u8 *tags);      // Read the header of an 8/16/32-bit sized element
+
+    const u8 *pos_;                          // Next unread byte
+    const u8 *end_;                          // One past the last byte
+  };
+
   // Utility function
   // Prints the contents of a byte vector for debugging purposes
   void printVec(vec &bytes);
@@ -96,7 +213,8 @@ namespace pack109 {
   vec serialize(const std::vector<u64> &item);     // Serialize a vector of 64-bit unsigned integers
   vec serialize(const std::vector<f64> &item);     // Serialize a vector of 64-bit floats
   vec serialize(const std::vector<string> &item);  // Serialize a vector of strings
-  std::vector<u8>   deserialize_vec_u8(const vec &bytes);  // Deserialize into a vector of unsigned bytes
+  vec serialize_binary(const u8 *data, size_t len); // Serialize bytes in the compact raw form
+  std::vector<u8>   deserialize_vec_u8(const vec &bytes);  // Deserialize into a vector of unsigned bytes (either form)
   std::vector<u64>  deserialize_vec_u64(const vec &bytes); // Deserialize into a vector of 64-bit unsigned integers
   std::vector<f64>  deserialize_vec_f64(const vec &bytes); // Deserialize into a vector of 64-bit floats
   std::vector<string> deserialize_vec_string(const vec &bytes); // Deserialize into a vector of strings
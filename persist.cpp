@@ -0,0 +1,335 @@
+// File: persist.cpp
+// Description: Implementation of saving the file store to disk and loading it back.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "persist.hpp"
+#include "pack109.hpp"
+
+#include "wal.hpp"        // sync_parent_dir
+#include "lz.hpp"         // inflate
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#include <cstdio>         // rename
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>       // write, pwrite, fsync
+#include <sys/mman.h>     // mmap
+#include <sys/stat.h>     // fstat
+
+// Function: encode_store
+// Purpose: Takes a reference to every blob first, so the size can be computed
+//          and the map written from one consistent list of entries. The older
+//          format has no place to mark compressed content, so it is decoded.
+size_t encode_store(const FileServerMap &store, Bytes &out) {
+    std::vector<std::pair<std::string, BlobRef>> entries;
+    entries.reserve(store.size());
+    store.for_each([&entries](const std::string &name, const BlobRef &blob) {
+        entries.emplace_back(name, inflate(blob));
+    });
+
+    size_t total = pack109::encoded_map_header_size(entries.size());
+    for (const auto &e : entries)
+        total += pack109::encoded_string_size(e.first.size())
+               + pack109::encoded_binary_size(e.second->size());
+
+    out.reserve(out.size() + total);
+    pack109::Encoder enc(out);
+    enc.begin_map(entries.size());
+    for (const auto &e : entries) {
+        enc.put(e.first);                                   // File name
+        enc.put_binary(e.second->data(), e.second->size()); // File content
+    }
+    return entries.size();
+}
+
+// Function: decode_store
+// Purpose: Walks the encoded map in place and inserts each file.
+size_t decode_store(const uint8_t *data, size_t len, FileServerMap &store) {
+    pack109::Reader in(data, len);
+    size_t count = in.read_map();
+    for (size_t i = 0; i < count; ++i) {
+        std::string name = in.read_string().str();
+        store.insert(name, in.read_bytes().to_vec());
+    }
+    return count;
+}
+
+// Function: write_fully
+// Purpose: Writes a byte range, continuing after partial writes.
+// Throws:
+//   - std::runtime_error if a write fails.
+static void write_fully(int fd, const uint8_t *data, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error(std::string("Cannot write store: ") + strerror(errno));
+        data += n;
+        len -= n;
+    }
+}
+
+// Function: put_u64
+// Purpose: Writes a big-endian 64-bit value.
+static void put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; --i, v >>= 8) p[i] = v & 0xFF;
+}
+
+// Function: get_u64
+// Purpose: Reads a big-endian 64-bit value.
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+// Function: stream_store
+// Purpose: Writes the header with a zero index offset, then every content
+//          (small ones gathered in a buffer, large ones straight from the
+//          blob, compressed ones as they are stored) while building the index
+//          segments, then the index, and finally fills in the index offset.
+size_t stream_store(int fd, const FileServerMap &store) {
+    const size_t BUFFER = 1 << 20;
+    const size_t ENTRY = pack109::encoded_array_header_size(2) + 18;   // [U64, U64]
+    size_t count = 0, names = 0;
+    store.for_each_name_frozen([&](const std::string &name) {
+        ++count;
+        names += pack109::encoded_string_size(name.size());
+    });
+
+    // Entry i goes to segment i / per; every segment but the last is full
+    size_t per = std::max<size_t>(1, (count + STORE_INDEX_SEGMENTS - 1) / STORE_INDEX_SEGMENTS);
+    size_t segments = std::max<size_t>(1, (count + per - 1) / per);
+    std::vector<Bytes> parts(segments);
+    for (size_t k = 0; k < segments; ++k) {
+        size_t n = k + 1 < segments ? per : count - k * per;
+        parts[k].reserve(pack109::encoded_map_header_size(n) + n * ENTRY + names / segments);
+        pack109::Encoder(parts[k]).begin_map(n);
+    }
+
+    Bytes buf(STORE_HEADER_SIZE);
+    buf.reserve(BUFFER);
+    std::memcpy(buf.data(), STORE_MAGIC, sizeof(STORE_MAGIC));
+    uint64_t offset = STORE_HEADER_SIZE;
+    size_t i = 0;
+    // Bodies the store holds stay put while it is frozen, so their address
+    // identifies them; one held under several names is written once. (A
+    // blob only this pass holds, such as a spilled body read back, may
+    // reuse a freed address and is always written.)
+    std::unordered_map<const uint8_t *, uint64_t> written;
+    store.for_each_frozen([&](const std::string &name, const BlobRef &blob) {
+        pack109::Encoder idx(parts[i++ / per]);
+        idx.put(name);
+        idx.begin_array(blob->compressed() ? 3 : 2);
+        uint64_t at = offset;
+        bool fresh = true;
+        if (blob.use_count() > 1 && blob->size() > 0) {
+            auto seen = written.emplace(blob->data(), offset);
+            at = seen.first->second;
+            fresh = seen.second;
+        }
+        idx.put(at);
+        idx.put(static_cast<uint64_t>(blob->size()));
+        if (blob->compressed()) idx.put(static_cast<uint64_t>(blob->decoded_size()));
+        if (!fresh) return;                                    // Written for another name
+        if (buf.size() + blob->size() > BUFFER) {
+            write_fully(fd, buf.data(), buf.size());
+            buf.clear();
+        }
+        if (blob->size() < BUFFER / 2) {
+            buf.insert(buf.end(), blob->data(), blob->data() + blob->size());
+        } else {
+            write_fully(fd, blob->data(), blob->size());
+        }
+        offset += blob->size();
+    });
+    write_fully(fd, buf.data(), buf.size());
+
+    // Segment table, then the segments it points at
+    Bytes table;
+    pack109::Encoder t(table);
+    t.begin_array(segments);
+    uint64_t at = offset + pack109::encoded_array_header_size(segments) + segments * ENTRY;
+    for (size_t k = 0; k < segments; ++k) {
+        t.begin_array(2);
+        t.put(static_cast<uint64_t>(at));
+        t.put(static_cast<uint64_t>(k + 1 < segments ? per : count - k * per));
+        at += parts[k].size();
+    }
+    write_fully(fd, table.data(), table.size());
+    for (const Bytes &part : parts) write_fully(fd, part.data(), part.size());
+
+    uint8_t header[8];
+    put_u64(header, offset);
+    if (pwrite(fd, header, sizeof(header), sizeof(STORE_MAGIC)) != sizeof(header))
+        throw std::runtime_error(std::string("Cannot write store: ") + strerror(errno));
+    return count;
+}
+
+// Function: write_frozen_store_file
+// Purpose: Writes the temp file, makes it durable, then renames it into place.
+size_t write_frozen_store_file(const std::string &path, const FileServerMap &store) {
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot open '" + tmp + "': " + strerror(errno));
+    size_t count;
+    try {
+        count = stream_store(fd, store);
+        if (fsync(fd) != 0) throw std::runtime_error("Cannot sync '" + tmp + "': " + strerror(errno));
+    } catch (...) {
+        close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+    close(fd);
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Cannot rename '" + tmp + "': " + strerror(errno));
+    sync_parent_dir(path);
+    return count;
+}
+
+// Function: write_store_file
+// Purpose: Freezes the store around write_frozen_store_file.
+size_t write_store_file(const std::string &path, const FileServerMap &store) {
+    store.freeze();
+    try {
+        size_t count = write_frozen_store_file(path, store);
+        store.thaw();
+        return count;
+    } catch (...) {
+        store.thaw();
+        throw;
+    }
+}
+
+// Function: load_segment
+// Purpose: Decodes one index segment and inserts a blob for each entry that
+//          points into the mapping and shares ownership of it.
+// Parameters:
+//   - map, index_at: The mapping and the offset of its index; contents must
+//     lie between the header and the index.
+//   - in: Positioned on the segment's map.
+// Throws:
+//   - std::runtime_error if the segment is malformed or points outside the file.
+static size_t load_segment(const std::shared_ptr<const uint8_t> &map, uint64_t index_at,
+                           pack109::Reader in, FileServerMap &store) {
+    const uint8_t *base = map.get();
+    size_t count = in.read_map();
+    for (size_t i = 0; i < count; ++i) {
+        std::string name = in.read_string().str();
+        size_t fields = in.read_array();
+        if (fields != 2 && fields != 3) throw std::runtime_error("Bad store index entry");
+        uint64_t offset = in.read_u64(), len = in.read_u64();
+        uint64_t decoded = fields == 3 ? in.read_u64() : 0;     // Compressed content
+        if (offset < STORE_HEADER_SIZE || offset > index_at || len > index_at - offset)
+            throw std::runtime_error("Store index entry out of range: " + name);
+        if (fields == 3 && !lz_plausible(len, decoded))
+            throw std::runtime_error("Bad decoded length: " + name);
+        store.insert(name, std::make_shared<const Blob>(map, base + offset, len, decoded));
+    }
+    return count;
+}
+
+// Function: load_mapped
+// Purpose: Reads the segment table of a mapped store file, presizes the store
+//          and decodes the segments on up to `threads` threads, each taking
+//          the next undecoded segment until none are left.
+// Throws:
+//   - std::runtime_error if the index is malformed; the first error from
+//     any thread is rethrown once all have stopped.
+static size_t load_mapped(const std::shared_ptr<const uint8_t> &map, size_t size,
+                          FileServerMap &store, size_t threads) {
+    const uint8_t *base = map.get();
+    uint64_t at = get_u64(base + sizeof(STORE_MAGIC));
+    if (at < STORE_HEADER_SIZE || at > size) throw std::runtime_error("Bad store index offset");
+    pack109::Reader in(base + at, size - at);
+    uint8_t tag = in.peek_tag();
+    if (tag == PACK109_M8 || tag == PACK109_M16 || tag == PACK109_M32)
+        return load_segment(map, at, in, store);               // Unsegmented index
+
+    std::vector<std::pair<uint64_t, uint64_t>> segments(in.read_array());
+    uint64_t total = 0;
+    for (auto &seg : segments) {
+        if (in.read_array() != 2) throw std::runtime_error("Bad store index segment");
+        seg.first = in.read_u64();
+        seg.second = in.read_u64();
+        if (seg.first < at || seg.first > size) throw std::runtime_error("Store index segment out of range");
+        total += seg.second;
+    }
+    store.reserve(std::min<uint64_t>(total, size));
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, segments.size());
+    std::atomic<size_t> next(0), loaded(0);
+    std::mutex error_lock;
+    std::string error;
+    auto work = [&] {
+        for (size_t k; (k = next++) < segments.size();) {
+            try {
+                pack109::Reader seg(base + segments[k].first, size - segments[k].first);
+                loaded += load_segment(map, at, seg, store);
+            } catch (const std::exception &e) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (error.empty()) error = e.what();
+                next = segments.size();                         // Stop the others early
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) pool.emplace_back(work);
+    work();                                                     // The caller decodes too
+    for (auto &th : pool) th.join();
+    if (!error.empty()) throw std::runtime_error(error);
+    return loaded;
+}
+
+// Function: read_store_file
+// Purpose: Maps an indexed file, or reads an old-format one into memory.
+size_t read_store_file(const std::string &path, FileServerMap &store, size_t threads) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file for reading");
+    }
+    struct stat st;
+    uint8_t magic[sizeof(STORE_MAGIC)];
+    bool indexed = fstat(fd, &st) == 0 && st.st_size >= (off_t)STORE_HEADER_SIZE
+                && pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic)
+                && std::memcmp(magic, STORE_MAGIC, sizeof(magic)) == 0;
+
+    if (indexed) {
+        size_t size = st.st_size;
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);                       // The mapping keeps the file open
+        if (p == MAP_FAILED) throw std::runtime_error(std::string("Cannot map store: ") + strerror(errno));
+        madvise(p, size, MADV_RANDOM);   // Contents are paged in one GET at a time
+        std::shared_ptr<const uint8_t> map(static_cast<const uint8_t *>(p),
+                                           [size](const uint8_t *q) { munmap(const_cast<uint8_t *>(q), size); });
+        return load_mapped(map, size, store, threads);
+    }
+
+    Bytes buf;
+    size_t got = 0;
+    for (;;) {
+        buf.resize(got + (1 << 20));
+        ssize_t n = read(fd, buf.data() + got, buf.size() - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot read file");
+        }
+        if (n == 0) break;
+        got += n;
+    }
+    close(fd);
+    buf.resize(got);
+    return decode_store(buf.data(), buf.size(), store);
+}
@@ -0,0 +1,108 @@
+// File: persist.hpp
+// Description: Header file for saving the file store to disk and loading it back.
+//              The persistence file keeps the file contents back to back,
+//              followed by an index of where each one lies, so it can be
+//              memory-mapped at startup and each file paged in on first use.
+//              Files in the older format, a single Pack109 map from file name
+//              to content, are still read.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef PERSIST_HPP
+#define PERSIST_HPP
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "hashmap.hpp"   // FileServerMap
+#include "protocol.hpp"  // Bytes
+
+// Indexed store file layout:
+//   [0, 8)    STORE_MAGIC
+//   [8, 16)   Big-endian u64 offset of the index
+//   [16, i)   The file contents, back to back
+//   [i, end)  The index: a Pack109 array of segments, each a two-element
+//             array of u64 [offset of the segment, number of entries], then
+//             the segments themselves. A segment is a Pack109 map from file
+//             name to a two-element array of u64 [offset of the content,
+//             length of the content], so segments can be decoded in parallel.
+//             Content stored compressed (see lz.hpp) has a third element, its
+//             decoded length. Names with the same content may point at the
+//             same bytes. (An index that is a single map rather than an
+//             array is one segment.)
+constexpr char STORE_MAGIC[8] = {'P', '1', '0', '9', 'S', 'T', 'O', 'R'};
+constexpr size_t STORE_HEADER_SIZE = 16;
+constexpr size_t STORE_INDEX_SEGMENTS = 64;   // Most segments written per index
+
+// Function: encode_store
+// Purpose: Serializes every stored file into one Pack109 map (the older,
+//          unindexed format), appended to `out` after reserving its exact size.
+// Parameters:
+//   - store: The file store to encode.
+//   - out: The buffer to append to.
+// Returns:
+//   - The number of files encoded.
+size_t encode_store(const FileServerMap &store, Bytes &out);
+
+// Function: decode_store
+// Purpose: Inserts every file of an encoded map into the store. Names and
+//          contents are read in place; each content is copied once, into its blob.
+// Parameters:
+//   - data, len: The encoded map.
+//   - store: The store to fill.
+// Returns:
+//   - The number of files loaded.
+// Throws:
+//   - std::runtime_error if the data is not a valid encoded store.
+size_t decode_store(const uint8_t *data, size_t len, FileServerMap &store);
+
+// Function: stream_store
+// Purpose: Writes an indexed store file to a descriptor positioned at its
+//          start, through a small buffer, without building the whole image in
+//          memory. Uses for_each_frozen, so the store must be frozen (or this
+//          must run in a child forked while it was).
+// Parameters:
+//   - fd: The descriptor to write to.
+//   - store: The frozen store.
+// Returns:
+//   - The number of files written.
+// Throws:
+//   - std::runtime_error if a write fails.
+size_t stream_store(int fd, const FileServerMap &store);
+
+// Function: write_frozen_store_file
+// Purpose: Streams a frozen store to "<path>.tmp", syncs it and renames it over
+//          `path`. The old file is never modified in place, so mappings of it
+//          made by read_store_file stay valid.
+// Returns:
+//   - The number of files written.
+// Throws:
+//   - std::runtime_error if any step fails.
+size_t write_frozen_store_file(const std::string &path, const FileServerMap &store);
+
+// Function: write_store_file
+// Purpose: Like write_frozen_store_file, freezing the store while it is written.
+// Returns:
+//   - The number of files written.
+// Throws:
+//   - std::runtime_error if the file cannot be written.
+size_t write_store_file(const std::string &path, const FileServerMap &store);
+
+// Function: read_store_file
+// Purpose: Loads the files in `path` into the store. An indexed file is mapped
+//          read-only and only its index is read, one segment per thread, after
+//          presizing the store; the stored blobs point into the mapping, so a
+//          file's pages are read from disk the first time it is served. A file
+//          in the older format is read and decoded on the calling thread.
+// Parameters:
+//   - path: The store file.
+//   - store: The store to fill.
+//   - threads: Most threads to decode the index with (0 for one per core).
+// Returns:
+//   - The number of files loaded.
+// Throws:
+//   - std::runtime_error if the file cannot be read or is malformed.
+size_t read_store_file(const std::string &path, FileServerMap &store, size_t threads = 0);
+
+#endif // PERSIST_HPP
@@ -1,13 +1,20 @@
 // File: protocol.cpp
 // Description: Implementation of the protocol classes and methods for message serialization,
 //              deserialization, and encryption/decryption. Includes FileMessage, RequestMessage,
-//              StatusMessage, and XOR-42 encryption utility.
+//              StatusMessage, the XOR-42 cipher kernels, and the framing that applies them.
 // Author: Logan Scheetz
 // Date: 5/12/25
 
 #include "protocol.hpp"
 #include "pack109.hpp"
+#include "lz.hpp"         // lz_decompress
 #include <stdexcept>
+#include <cerrno>
+#include <cstring>        // memcpy
+#include <sys/socket.h>   // send, recv
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>    // SSE2 / AVX2 intrinsics
+#endif
 
 // --- Constructors ---
 // FileMessage constructor
@@ -20,8 +27,9 @@ FileMessage::FileMessage(std::string n, Bytes d)
 // RequestMessage constructor
 // Parameters:
 //   - n: The name of the requested file.
-RequestMessage::RequestMessage(std::string n)
-  : name(std::move(n)) {}
+//   - a: The accepted encoding, or empty.
+RequestMessage::RequestMessage(std::string n, std::string a)
+  : name(std::move(n)), accept(std::move(a)) {}
 
 // StatusMessage constructor
 // Parameters:
@@ -30,6 +38,40 @@ RequestMessage::RequestMessage(std::string n)
 StatusMessage::StatusMessage(bool ok_, std::string msg)
   : ok(ok_), message(std::move(msg)) {}
 
+// BeginMessage constructor
+// Parameters:
+//   - n: The name of the file being uploaded.
+//   - sz: The total length of the file in bytes.
+BeginMessage::BeginMessage(std::string n, uint64_t sz)
+  : name(std::move(n)), size(sz) {}
+
+// CommitMessage constructor
+// Parameters:
+//   - n: The name of the uploaded file.
+CommitMessage::CommitMessage(std::string n)
+  : name(std::move(n)) {}
+
+// AckMessage constructor
+// Parameters:
+//   - n: The name of the file being uploaded.
+//   - nx: The index of the next chunk the server expects.
+AckMessage::AckMessage(std::string n, uint64_t nx)
+  : name(std::move(n)), next(nx) {}
+
+// FetchMessage constructor
+// Parameters:
+//   - n: The name of the requested file.
+//   - i: The index of the requested chunk.
+FetchMessage::FetchMessage(std::string n, uint64_t i)
+  : name(std::move(n)), index(i) {}
+
+// MultiRequestMessage constructor
+// Parameters:
+//   - n: The names of the requested files.
+//   - a: The accepted encoding, or empty.
+MultiRequestMessage::MultiRequestMessage(std::vector<std::string> n, std::string a)
+  : names(std::move(n)), accept(std::move(a)) {}
+
 // --- XOR-42 helper ---
 // Function: xor42
 // Purpose: Encrypts or decrypts a byte buffer using XOR with a key (default: 42).
@@ -40,25 +82,534 @@ StatusMessage::StatusMessage(bool ok_, std::string msg)
 //   - A new byte buffer after applying the XOR operation.
 Bytes xor42(const Bytes &buf, uint8_t key) {
     Bytes out(buf.size());
-    for (size_t i = 0; i < buf.size(); ++i)
-        out[i] = buf[i] ^ key; // XOR each byte with the key
+    xor42_copy(out.data(), buf.data(), buf.size(), key);
+    return out;
+}
+
+// Function: xor_scalar
+// Purpose: Portable kernel. XORs eight bytes at a time through a 64-bit word,
+//          then finishes the tail byte by byte.
+static void xor_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key) {
+    uint64_t k = 0x0101010101010101ull * key;   // Key repeated in every byte
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, src + i, 8);
+        w ^= k;
+        std::memcpy(dst + i, &w, 8);
+    }
+    for (; i < len; ++i)
+        dst[i] = src[i] ^ key; // XOR each byte with the key
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Function: xor_sse2
+// Purpose: 16 bytes per instruction; unaligned loads and stores, so any buffer works.
+__attribute__((target("sse2")))
+static void xor_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key) {
+    __m128i k = _mm_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 48), _mm_xor_si128(d, k));
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(a, k));
+    }
+    xor_scalar(dst + i, src + i, len - i, key);
+}
+
+// Function: xor_avx2
+// Purpose: 32 bytes per instruction; only called when the CPU reports AVX2.
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key) {
+    __m256i k = _mm256_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32), _mm256_xor_si256(b, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 64), _mm256_xor_si256(c, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 96), _mm256_xor_si256(d, k));
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, k));
+    }
+    // The 16-byte step stays in this function so it is VEX-encoded too; calling
+    // the legacy-SSE kernel here would pay an AVX/SSE transition penalty.
+    if (i + 16 <= len) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_xor_si128(a, _mm256_castsi256_si128(k)));
+        i += 16;
+    }
+    xor_scalar(dst + i, src + i, len - i, key);
+}
+#endif
+
+// Type and selection of the XOR kernel, resolved once on first use
+using XorKernel = void (*)(uint8_t *, const uint8_t *, size_t, uint8_t);
+
+struct XorDispatch {
+    XorKernel kernel;
+    const char *name;
+};
+
+static XorDispatch select_xor_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {xor_avx2, "avx2"};
+    if (__builtin_cpu_supports("sse2")) return {xor_sse2, "sse2"};
+#endif
+    return {xor_scalar, "scalar"};
+}
+
+static const XorDispatch &xor_dispatch() {
+    static const XorDispatch d = select_xor_kernel();   // Thread-safe in C++11
+    return d;
+}
+
+// Function: xor42_inplace
+// Purpose: Applies the cipher to a buffer in place with the fastest kernel.
+void xor42_inplace(uint8_t *data, size_t len, uint8_t key) {
+    xor_dispatch().kernel(data, data, len, key);
+}
+
+// Function: xor42_copy
+// Purpose: Copies a buffer while applying the cipher, in one pass.
+void xor42_copy(uint8_t *dst, const uint8_t *src, size_t len, uint8_t key) {
+    xor_dispatch().kernel(dst, src, len, key);
+}
+
+// Function: xor42_impl
+// Purpose: Reports which kernel xor42_inplace and xor42_copy use.
+const char *xor42_impl() {
+    return xor_dispatch().name;
+}
+
+// --- Dispatch ---
+// Function: peek_message_type
+// Purpose: Reads just the outer map header and key of a message and compares
+//          the key against the known message names.
+// Parameters:
+//   - bytes: The plain message.
+// Returns:
+//   - The message type, or MessageType::Invalid.
+MessageType peek_message_type(const Bytes &bytes) {
+    if (bytes.size() < 4) return MessageType::Invalid;
+    if (bytes[0] != PACK109_M8 || bytes[1] != 1 || bytes[2] != PACK109_S8)
+        return MessageType::Invalid;
+    size_t len = bytes[3];
+    if (bytes.size() < 4 + len) return MessageType::Invalid;
+
+    // Compare the key in place against each candidate name
+    auto matches = [&bytes, len](const char *name, size_t n) {
+        return len == n && std::memcmp(bytes.data() + 4, name, n) == 0;
+    };
+    if (matches("File", 4)) return MessageType::File;
+    if (matches("Request", 7)) return MessageType::Request;
+    if (matches("Status", 6)) return MessageType::Status;
+    if (matches("Begin", 5)) return MessageType::Begin;
+    if (matches("Chunk", 5)) return MessageType::Chunk;
+    if (matches("Commit", 6)) return MessageType::Commit;
+    if (matches("Ack", 3)) return MessageType::Ack;
+    if (matches("Fetch", 5)) return MessageType::Fetch;
+    if (matches("Snapshot", 8)) return MessageType::Snapshot;
+    if (matches("MultiRequest", 12)) return MessageType::MultiRequest;
+    if (matches("MultiFile", 9)) return MessageType::MultiFile;
+    if (matches("MultiStatus", 11)) return MessageType::MultiStatus;
+    return MessageType::Invalid;
+}
+
+// --- Framing ---
+// Function: frame
+// Purpose: Prefixes a payload with its 4-byte big-endian length and encrypts it
+//          while copying it behind the header.
+Bytes frame(const Bytes &payload) {
+    if (payload.size() > MAX_FRAME_SIZE) throw std::runtime_error("Frame too large");
+    Bytes out(FRAME_HEADER_SIZE + payload.size());
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    out[0] = (len >> 24) & 0xFF;
+    out[1] = (len >> 16) & 0xFF;
+    out[2] = (len >> 8) & 0xFF;
+    out[3] = len & 0xFF;
+    xor42_copy(out.data() + FRAME_HEADER_SIZE, payload.data(), payload.size());
+    return out;
+}
+
+// Method: FrameReader::feed
+// Purpose: Appends received bytes to the reassembly buffer.
+void FrameReader::feed(const uint8_t *data, size_t len) {
+    std::memcpy(prepare(len), data, len);
+    commit(len);
+}
+
+// Method: FrameReader::prepare
+// Purpose: Makes room for `len` more bytes. Consumed bytes at the front are
+//          dropped first so the buffer does not grow without bound.
+uint8_t *FrameReader::prepare(size_t len) {
+    if (pos_ > 0 && buf_.size() - end_ < len) {
+        std::memmove(buf_.data(), buf_.data() + pos_, end_ - pos_);
+        end_ -= pos_;
+        pos_ = 0;
+    }
+    if (buf_.size() - end_ < len) buf_.resize(end_ + len);
+    return buf_.data() + end_;
+}
+
+// Method: FrameReader::commit
+// Purpose: Marks bytes written after prepare() as received.
+void FrameReader::commit(size_t len) {
+    end_ += len;
+}
+
+// Method: FrameReader::next
+// Purpose: Extracts the next complete payload, if it has fully arrived, and
+//          decrypts it while copying it out of the reassembly buffer.
+bool FrameReader::next(Bytes &payload) {
+    if (end_ - pos_ < FRAME_HEADER_SIZE) return false;
+    const uint8_t *h = buf_.data() + pos_;
+    size_t len = (size_t(h[0]) << 24) | (size_t(h[1]) << 16) | (size_t(h[2]) << 8) | h[3];
+    if (len > MAX_FRAME_SIZE) throw std::runtime_error("Frame too large");
+    if (end_ - pos_ < FRAME_HEADER_SIZE + len) return false;
+
+    payload.resize(len);
+    xor42_copy(payload.data(), h + FRAME_HEADER_SIZE, len);
+    pos_ += FRAME_HEADER_SIZE + len;
+    if (pos_ == end_) pos_ = end_ = 0;   // Buffer drained, start over at the front
+    return true;
+}
+
+// Function: send_all
+// Purpose: Writes a whole buffer to a blocking socket.
+static bool send_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Function: recv_all
+// Purpose: Reads exactly `len` bytes from a blocking socket.
+static bool recv_all(int fd, uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Function: send_frame
+// Purpose: Encrypts and frames a payload and writes it to a blocking socket.
+bool send_frame(int fd, const Bytes &payload) {
+    Bytes out = frame(payload);
+    return send_all(fd, out.data(), out.size());
+}
+
+// Function: recv_frame
+// Purpose: Reads one length header, then exactly that many payload bytes, and
+//          decrypts them in place.
+bool recv_frame(int fd, Bytes &payload) {
+    uint8_t h[FRAME_HEADER_SIZE];
+    if (!recv_all(fd, h, sizeof(h))) return false;
+    size_t len = (size_t(h[0]) << 24) | (size_t(h[1]) << 16) | (size_t(h[2]) << 8) | h[3];
+    if (len > MAX_FRAME_SIZE) return false;
+    payload.resize(len);
+    if (!recv_all(fd, payload.data(), len)) return false;
+    xor42_inplace(payload.data(), len);
+    return true;
+}
+
+// --- Replies ---
+// Constructor
+// Purpose: Takes over a whole payload as the only part.
+Reply::Reply(Bytes payload) {
+    parts_.push_back(Part{std::move(payload), nullptr, 0, 0});
+}
+
+// Method: buffer
+// Purpose: Starts an owned part when there is none to append to.
+Bytes &Reply::buffer() {
+    if (parts_.empty() || parts_.back().blob) parts_.push_back(Part{Bytes(), nullptr, 0, 0});
+    return parts_.back().bytes;
+}
+
+// Method: add_blob
+// Purpose: Refers to the range, or copies it if it is short.
+void Reply::add_blob(const BlobRef &blob, size_t offset, size_t length) {
+    if (length < COPY_LIMIT) {
+        Bytes &out = buffer();
+        out.insert(out.end(), blob->data() + offset, blob->data() + offset + length);
+    } else {
+        parts_.push_back(Part{Bytes(), blob, offset, length});
+    }
+}
+
+// Method: size
+// Purpose: Sums the lengths of the parts.
+size_t Reply::size() const {
+    size_t n = 0;
+    for (const Part &p : parts_) n += p.blob ? p.length : p.bytes.size();
+    return n;
+}
+
+// Method: flatten
+// Purpose: Concatenates the parts.
+Bytes Reply::flatten() const {
+    Bytes out;
+    out.reserve(size());
+    for (const Part &p : parts_) {
+        if (p.blob) out.insert(out.end(), p.blob->data() + p.offset, p.blob->data() + p.offset + p.length);
+        else out.insert(out.end(), p.bytes.begin(), p.bytes.end());
+    }
     return out;
 }
 
+// --- Request IDs and pipelining ---
+// Function: peek_request_id
+// Purpose: Walks the inner map, skipping every value but the "id" one.
+bool peek_request_id(const Bytes &msg, uint64_t &id) {
+    try {
+        pack109::Reader in(msg);
+        if (in.read_map() != 1) return false;
+        in.read_string();
+        size_t entries = in.read_map();
+        for (size_t i = 0; i < entries; ++i) {
+            if (in.read_string().equals("id", 2) && in.peek_tag() == PACK109_U64) {
+                id = in.read_u64();
+                return true;
+            }
+            in.skip();
+        }
+    } catch (const std::exception &) {}
+    return false;
+}
+
+// Function: count_new_entry
+// Purpose: Adds one to the entry count of the inner map of the message that
+//          starts `head`, rewriting its header in place unless the count needs
+//          a wider one. With `whole`, also checks that the inner map runs to
+//          the end of `head`, where the new entry will go.
+// Throws:
+//   - runtime_error if `head` does not start with a single-key message.
+static void count_new_entry(Bytes &head, bool whole) {
+    using namespace pack109;
+    Reader in(head);
+    if (in.read_map() != 1) throw std::runtime_error("Not a message");
+    in.read_string();
+    size_t start = in.position() - head.data();
+    size_t entries = in.read_map();
+    size_t header = in.position() - head.data() - start;
+    if (whole) {
+        for (size_t i = 0; i < 2 * entries; ++i) in.skip();
+        if (!in.at_end()) throw std::runtime_error("Trailing bytes after message");
+    }
+
+    Bytes widened;
+    Encoder(widened).begin_map(entries + 1);
+    if (widened.size() == header) {
+        std::memcpy(head.data() + start, widened.data(), header);
+    } else {
+        head.erase(head.begin() + start, head.begin() + start + header);
+        head.insert(head.begin() + start, widened.begin(), widened.end());
+    }
+}
+
+// Function: attach_request_id
+// Purpose: The inner map is the last element of a message, so the new entry
+//          is appended; only its header changes.
+void attach_request_id(Bytes &msg, uint64_t id) {
+    count_new_entry(msg, true);
+    pack109::Encoder enc(msg);
+    enc.put_string("id", 2);
+    enc.put((u64)id);
+}
+
+// Function: attach_request_id
+// Purpose: The header is in the first part and the entry goes after the last.
+void attach_request_id(Reply &reply, uint64_t id) {
+    std::vector<Reply::Part> &parts = reply.parts();
+    if (parts.size() == 1 && !parts[0].blob) return attach_request_id(parts[0].bytes, id);
+    if (parts.empty() || parts[0].blob) throw std::runtime_error("Not a message");
+    count_new_entry(parts[0].bytes, false);
+    pack109::Encoder enc(reply.buffer());
+    enc.put_string("id", 2);
+    enc.put((u64)id);
+}
+
+// Constructor
+// Purpose: Initializes a pipeline with nothing outstanding.
+Pipeline::Pipeline(int fd, size_t window) : fd_(fd), window_(window ? window : 1) {}
+
+// Method: submit
+// Purpose: Makes room in the window, then tags and sends the request.
+uint64_t Pipeline::submit(Bytes payload) {
+    if (next_id_ - next_reply_ - ready_.size() >= window_) read_reply();
+    uint64_t id = next_id_;
+    attach_request_id(payload, id);
+    if (!send_frame(fd_, payload)) throw std::runtime_error("Send failed");
+    ++next_id_;
+    return id;
+}
+
+// Method: receive
+// Purpose: Hands out queued replies first, since they are the oldest.
+uint64_t Pipeline::receive(Bytes &reply) {
+    if (in_flight() == 0) throw std::runtime_error("No request outstanding");
+    if (ready_.empty()) read_reply();
+    reply = std::move(ready_.front());
+    ready_.pop_front();
+    return next_reply_++;
+}
+
+// Method: read_reply
+// Purpose: Reads the reply to the oldest request not yet read and checks that
+//          it carries that request's ID.
+void Pipeline::read_reply() {
+    Bytes reply;
+    if (!recv_frame(fd_, reply)) throw std::runtime_error("Receive failed");
+    uint64_t id;
+    if (!peek_request_id(reply, id) || id != next_reply_ + ready_.size())
+        throw std::runtime_error("Reply out of order");
+    ready_.push_back(std::move(reply));
+}
+
 // --- FileMessage ---
 // Method: serialize
 // Purpose: Serializes the FileMessage into a byte buffer.
 // Returns:
 //   - A byte buffer representing the serialized FileMessage.
 Bytes FileMessage::serialize() const {
-    KVMap inner;
-    inner["name"]  = pack109::serialize(name);  // Serialize the file name
-    inner["bytes"] = pack109::serialize(data);  // Serialize the file data
+    return serialize(name, data.data(), data.size());
+}
+
+// Static Method: serialize
+// Purpose: Serializes a File message from borrowed file bytes. The message is
+//          written into one buffer of the exact final size; the file bytes are
+//          read once and never copied into an intermediate vector.
+// Parameters:
+//   - name: The file name.
+//   - data: Pointer to the file content.
+//   - len: Length of the file content.
+// Returns:
+//   - A byte buffer representing the serialized File message.
+// Throws:
+//   - runtime_error if the name is longer than 255 characters.
+Bytes FileMessage::serialize(const std::string &name, const uint8_t *data, size_t len) {
+    Bytes out;
+    out.reserve(encoded_size(name.size(), len));
+    encode(out, name, data, len);
+    return out;
+}
+
+// Static Method: encoded_size
+// Purpose: Computes the size of {"File": {"name": S8, "bytes": B8/B16/B32}}.
+size_t FileMessage::encoded_size(size_t name_len, size_t data_len) {
+    using namespace pack109;
+    return encoded_map_header_size(1) + encoded_string_size(4)
+         + encoded_map_header_size(2)
+         + encoded_string_size(4) + encoded_string_size(name_len)
+         + encoded_string_size(5) + encoded_binary_size(data_len);
+}
+
+// Static Method: encode
+// Purpose: Appends a File message to `out`, keys laid out as in the README. The
+//          content is written as one raw B8/B16/B32 block rather than an A8 of
+//          tagged bytes, halving its size; parse() still accepts the A8 form.
+// Throws:
+//   - runtime_error if the name is longer than 255 characters.
+void FileMessage::encode(Bytes &out, const std::string &name, const uint8_t *data, size_t len) {
+    encode_head(out, name, len);
+    out.insert(out.end(), data, data + len);  // Content as one raw block
+}
+
+// Static Method: encoded_size
+// Purpose: Computes the size of {"File": {"name": S8, "bytes": B, "encoding": S8,
+//          "size": U64}}.
+size_t FileMessage::encoded_size(size_t name_len, size_t data_len, size_t encoding_len) {
+    using namespace pack109;
+    return encoded_size(name_len, data_len)
+         + encoded_string_size(8) + encoded_string_size(encoding_len)
+         + encoded_string_size(4) + 9;
+}
 
-    Bytes inner_ser = pack109::serialize_map(inner); // Serialize the inner KVMap
-    KVMap outer{{"File", inner_ser}};                // Wrap in an outer KVMap
+// Static Method: encode
+// Purpose: Appends a File message with encoded content to `out`.
+void FileMessage::encode(Bytes &out, const std::string &name, const uint8_t *data, size_t len,
+                         const std::string &encoding, uint64_t size) {
+    encode_head(out, name, len, encoding, size);
+    out.insert(out.end(), data, data + len);  // Encoded content
+}
+
+// Static Method: encode_head
+// Purpose: Writes the keys with "bytes" last, so its raw block header ends the
+//          head and the content can follow from anywhere.
+void FileMessage::encode_head(Bytes &out, const std::string &name, size_t len,
+                              const std::string &encoding, uint64_t size) {
+    pack109::Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("File", 4);
+    enc.begin_map(encoding.empty() ? 2 : 4);
+    enc.put_string("name", 4);
+    enc.put(name);
+    if (!encoding.empty()) {
+        enc.put_string("encoding", 8);
+        enc.put(encoding);
+        enc.put_string("size", 4);
+        enc.put((u64)size);               // Decoded length
+    }
+    enc.put_string("bytes", 5);
+    enc.begin_binary(len);
+}
+
+// Function: open_message
+// Purpose: Steps into the body of a single-key message {"<key>": {...}}.
+// Returns:
+//   - The number of entries in the inner map; `in` is left on the first one.
+// Throws:
+//   - runtime_error if the outer key is not `key` or the body is not a map.
+static size_t open_message(pack109::Reader &in, const char *key, size_t key_len) {
+    if (in.read_map() != 1 || !in.read_string().equals(key, key_len))
+        throw std::runtime_error(std::string("Missing ") + key + " key");
+    return in.read_map();
+}
 
-    return xor42(pack109::serialize_map(outer));     // Encrypt and return
+// Function: decode_content
+// Purpose: Copies the content of a parsed File body out of its buffer,
+//          decoding it if it is "lz" encoded.
+// Throws:
+//   - runtime_error for another encoding or an implausible decoded size.
+static Bytes decode_content(const FileMessage::View &v) {
+    if (v.encoding.size == 0) return v.data.to_vec();
+    if (!v.encoding.equals("lz", 2)) throw std::runtime_error("Unsupported encoding: " + v.encoding.str());
+    if (!lz_plausible(v.data.count, v.size)) throw std::runtime_error("Bad decoded size");
+    Bytes packed;
+    const uint8_t *src = v.data.data;
+    if (v.data.stride != 1) {                 // A8 form: gather the bytes first
+        packed = v.data.to_vec();
+        src = packed.data();
+    }
+    Bytes content(v.size);
+    lz_decompress(src, v.data.count, v.size, 0, v.size, content.data());
+    return content;
 }
 
 // Method: deserialize
@@ -70,22 +621,60 @@ Bytes FileMessage::serialize() const {
 // Throws:
 //   - runtime_error if the buffer is invalid or missing required keys.
 FileMessage FileMessage::deserialize(const Bytes &buf) {
-    Bytes decrypted = xor42(buf); // Decrypt the buffer
-    auto outer = pack109::deserialize_map(decrypted); // Deserialize the outer map
-
-    auto it = outer.find("File");
-    if (it == outer.end()) throw std::runtime_error("Missing File key");
-    auto inner = pack109::deserialize_map(it->second); // Deserialize the inner map
-
-    auto itn = inner.find("name");
-    if (itn == inner.end()) throw std::runtime_error("Missing name key");
-    std::string fname = pack109::deserialize_string(itn->second); // Deserialize file name
+    View v = parse(buf.data(), buf.size());
+    return FileMessage(v.name.str(), decode_content(v));
+}
 
-    auto itd = inner.find("bytes");
-    if (itd == inner.end()) throw std::runtime_error("Missing bytes key");
-    Bytes fdata = pack109::deserialize_vec_u8(itd->second); // Deserialize file data
+// Function: read_file_body
+// Purpose: Reads the `entries` keys of a File body, or of a MultiFile item,
+//          in any order, skipping unknown ones. An item's "ok" and "message"
+//          keys are stored through `ok` and `message` when those are given.
+// Returns:
+//   - The view; `data` is left empty when there is no "bytes" key.
+// Throws:
+//   - runtime_error if the body is malformed, has no name, or has an
+//     encoding but no decoded size.
+static FileMessage::View read_file_body(pack109::Reader &in, size_t entries, bool &have_bytes,
+                                        bool *ok = nullptr, pack109::Span *message = nullptr) {
+    bool have_name = false, have_size = false;
+    FileMessage::View v = {{nullptr, 0}, {nullptr, 0, 1}, {nullptr, 0}, 0};
+    have_bytes = false;
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (key.equals("name", 4)) {
+            v.name = in.read_string();        // File name
+            have_name = true;
+        } else if (key.equals("bytes", 5)) {
+            v.data = in.read_bytes();         // File content
+            have_bytes = true;
+        } else if (key.equals("encoding", 8)) {
+            v.encoding = in.read_string();    // Content encoding
+        } else if (key.equals("size", 4)) {
+            v.size = in.read_u64();           // Decoded length
+            have_size = true;
+        } else if (ok && key.equals("ok", 2)) {
+            *ok = in.read_bool();             // Whether the item was found
+        } else if (message && key.equals("message", 7)) {
+            *message = in.read_string();      // Why it was not
+        } else {
+            in.skip();
+        }
+    }
+    if (!have_name) throw std::runtime_error("Missing name key");
+    if (v.encoding.size && !have_size) throw std::runtime_error("Missing size key");
+    return v;
+}
 
-    return FileMessage(fname, fdata);
+// Static Method: parse
+// Purpose: Walks the File message in place. The inner keys may come in any
+//          order and unknown keys are skipped.
+FileMessage::View FileMessage::parse(const uint8_t *data, size_t len) {
+    pack109::Reader in(data, len);
+    size_t entries = open_message(in, "File", 4);
+    bool have_bytes;
+    View v = read_file_body(in, entries, have_bytes);
+    if (!have_bytes) throw std::runtime_error("Missing bytes key");
+    return v;
 }
 
 // --- RequestMessage ---
@@ -94,9 +683,33 @@ FileMessage FileMessage::deserialize(const Bytes &buf) {
 // Returns:
 //   - A byte buffer representing the serialized RequestMessage.
 Bytes RequestMessage::serialize() const {
-    KVMap inner{{"name", pack109::serialize(name)}};  // Serialize the request name
-    KVMap outer{{"Request", pack109::serialize_map(inner)}}; // Wrap in an outer KVMap
-    return xor42(pack109::serialize_map(outer)); // Encrypt and return
+    Bytes out;
+    out.reserve(encoded_size());          // One allocation of the exact size
+    encode(out);
+    return out;
+}
+
+// Method: encoded_size
+// Purpose: Computes the size of {"Request": {"name": S8[, "accept": S8]}}.
+size_t RequestMessage::encoded_size() const {
+    using namespace pack109;
+    return encoded_map_header_size(1) + encoded_string_size(7)
+         + encoded_map_header_size(accept.empty() ? 1 : 2) + encoded_string_size(4) + encoded_string_size(name.size())
+         + (accept.empty() ? 0 : encoded_string_size(6) + encoded_string_size(accept.size()));
+}
+
+// Method: encode
+// Purpose: Appends the RequestMessage to `out`.
+void RequestMessage::encode(Bytes &out) const {
+    pack109::Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("Request", 7);
+    enc.begin_map(accept.empty() ? 1 : 2);
+    enc.put_string("name", 4);
+    enc.put(name);                        // Request name
+    if (accept.empty()) return;
+    enc.put_string("accept", 6);
+    enc.put(accept);                      // Encoding the client decodes
 }
 
 // Method: deserialize
@@ -108,16 +721,30 @@ Bytes RequestMessage::serialize() const {
 // Throws:
 //   - runtime_error if the buffer is invalid or missing required keys.
 RequestMessage RequestMessage::deserialize(const Bytes &buf) {
-    Bytes decrypted = xor42(buf); // Decrypt the buffer
-    auto outer = pack109::deserialize_map(decrypted); // Deserialize the outer map
-
-    auto it = outer.find("Request");
-    if (it == outer.end()) throw std::runtime_error("Missing Request key");
-    auto inner = pack109::deserialize_map(it->second); // Deserialize the inner map
+    View v = parse(buf.data(), buf.size());
+    return RequestMessage(v.name.str(), v.accept.str());
+}
 
-    auto itn = inner.find("name");
-    if (itn == inner.end()) throw std::runtime_error("Missing name key");
-    return RequestMessage(pack109::deserialize_string(itn->second)); // Deserialize and return
+// Static Method: parse
+// Purpose: Walks the Request message in place; keys may come in any order.
+RequestMessage::View RequestMessage::parse(const uint8_t *data, size_t len) {
+    pack109::Reader in(data, len);
+    size_t entries = open_message(in, "Request", 7);
+    View v = {{nullptr, 0}, {nullptr, 0}};
+    bool have_name = false;
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (key.equals("name", 4)) {
+            v.name = in.read_string();        // Requested name
+            have_name = true;
+        } else if (key.equals("accept", 6)) {
+            v.accept = in.read_string();      // Accepted encoding
+        } else {
+            in.skip();
+        }
+    }
+    if (!have_name) throw std::runtime_error("Missing name key");
+    return v;
 }
 
 // --- StatusMessage ---
@@ -126,11 +753,34 @@ RequestMessage RequestMessage::deserialize(const Bytes &buf) {
 // Returns:
 //   - A byte buffer representing the serialized StatusMessage.
 Bytes StatusMessage::serialize() const {
-    KVMap inner;
-    inner["ok"]      = pack109::serialize(ok);      // Serialize the status flag
-    inner["message"] = pack109::serialize(message); // Serialize the status message
-    KVMap outer{{"Status", pack109::serialize_map(inner)}}; // Wrap in an outer KVMap
-    return xor42(pack109::serialize_map(outer)); // Encrypt and return
+    Bytes out;
+    out.reserve(encoded_size());          // One allocation of the exact size
+    encode(out);
+    return out;
+}
+
+// Method: encoded_size
+// Purpose: Computes the size of {"Status": {"message": S8, "ok": bool}}.
+size_t StatusMessage::encoded_size() const {
+    using namespace pack109;
+    return encoded_map_header_size(1) + encoded_string_size(6)
+         + encoded_map_header_size(2)
+         + encoded_string_size(7) + encoded_string_size(message.size())
+         + encoded_string_size(2) + 1;
+}
+
+// Method: encode
+// Purpose: Appends the StatusMessage to `out`. Keys are written in the sorted
+//          order the KVMap-based encoder used, so the bytes are unchanged.
+void StatusMessage::encode(Bytes &out) const {
+    pack109::Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("Status", 6);
+    enc.begin_map(2);
+    enc.put_string("message", 7);
+    enc.put(message);                     // Status message
+    enc.put_string("ok", 2);
+    enc.put(ok);                          // Status flag
 }
 
 // Method: deserialize
@@ -142,21 +792,528 @@ Bytes StatusMessage::serialize() const {
 // Throws:
 //   - runtime_error if the buffer is invalid or missing required keys.
 StatusMessage StatusMessage::deserialize(const Bytes &buf) {
-    Bytes decrypted = xor42(buf); // Decrypt the buffer
-    auto outer = pack109::deserialize_map(decrypted); // Deserialize the outer map
-
-    auto it = outer.find("Status");
-    if (it == outer.end()) throw std::runtime_error("Missing Status key");
-    auto inner = pack109::deserialize_map(it->second); // Deserialize the inner map
-
-    auto iko = inner.find("ok");
-    if (iko == inner.end()) throw std::runtime_error("Missing ok key");
-    bool ok_flag = pack109::deserialize_bool(iko->second); // Deserialize the status flag
+    pack109::Reader in(buf);
+    size_t entries = open_message(in, "Status", 6);
 
-    auto imsg = inner.find("message");
+    bool have_ok = false, ok_flag = false;
     std::string msg;
-    if (imsg != inner.end())
-        msg = pack109::deserialize_string(imsg->second); // Deserialize the status message if present
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (key.equals("ok", 2)) {
+            ok_flag = in.read_bool();         // Status flag
+            have_ok = true;
+        } else if (key.equals("message", 7)) {
+            msg = in.read_string().str();     // Status message, optional
+        } else {
+            in.skip();
+        }
+    }
+    if (!have_ok) throw std::runtime_error("Missing ok key");
 
     return StatusMessage(ok_flag, msg);
-}
\ No newline at end of file
+}
+
+// --- Chunked transfer messages ---
+// Function: encode_name_u64
+// Purpose: Writes {"<key>": {"name": S, "<field>": u64}}, the shape shared by
+//          Begin, Ack and Fetch.
+static Bytes encode_name_u64(const char *key, size_t key_len, const std::string &name,
+                             const char *field, size_t field_len, uint64_t value) {
+    using namespace pack109;
+    Bytes out;
+    out.reserve(encoded_map_header_size(1) + encoded_string_size(key_len)
+              + encoded_map_header_size(2) + encoded_string_size(4) + encoded_string_size(name.size())
+              + encoded_string_size(field_len) + 9);
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string(key, key_len);
+    enc.begin_map(2);
+    enc.put_string("name", 4);
+    enc.put(name);
+    enc.put_string(field, field_len);
+    enc.put((u64)value);
+    return out;
+}
+
+// Function: decode_name_u64
+// Purpose: Reads the shape written by encode_name_u64, in any key order.
+// Throws:
+//   - runtime_error if the buffer is malformed or a key is missing.
+static void decode_name_u64(const Bytes &buf, const char *key, size_t key_len, std::string &name,
+                            const char *field, size_t field_len, uint64_t &value) {
+    pack109::Reader in(buf);
+    size_t entries = open_message(in, key, key_len);
+    bool have_name = false, have_value = false;
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span k = in.read_string();
+        if (k.equals("name", 4)) {
+            name = in.read_string().str();
+            have_name = true;
+        } else if (k.equals(field, field_len)) {
+            value = in.read_u64();
+            have_value = true;
+        } else {
+            in.skip();
+        }
+    }
+    if (!have_name) throw std::runtime_error("Missing name key");
+    if (!have_value) throw std::runtime_error(std::string("Missing ") + field + " key");
+}
+
+// Method: serialize
+// Purpose: Serializes the BeginMessage into a byte buffer of its exact size.
+Bytes BeginMessage::serialize() const {
+    return encode_name_u64("Begin", 5, name, "size", 4, size);
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a BeginMessage object.
+// Throws:
+//   - runtime_error if the buffer is invalid or missing required keys.
+BeginMessage BeginMessage::deserialize(const Bytes &buf) {
+    BeginMessage m("", 0);
+    decode_name_u64(buf, "Begin", 5, m.name, "size", 4, m.size);
+    return m;
+}
+
+// Static Method: serialize
+// Purpose: Builds {"Chunk": {"name": S, "index": u64, "size": u64, "bytes": B}}
+//          in one allocation, copying the chunk content once.
+Bytes ChunkMessage::serialize(const std::string &name, uint64_t index, uint64_t size,
+                              const uint8_t *data, size_t len) {
+    using namespace pack109;
+    Bytes out;
+    out.reserve(encoded_map_header_size(1) + encoded_string_size(5)
+              + encoded_map_header_size(4)
+              + encoded_string_size(4) + encoded_string_size(name.size())
+              + encoded_string_size(5) + 9 + encoded_string_size(4) + 9
+              + encoded_string_size(5) + encoded_binary_size(len));
+    encode_head(out, name, index, size, len);
+    out.insert(out.end(), data, data + len);
+    return out;
+}
+
+// Static Method: encode_head
+// Purpose: Writes everything up to and including the raw block header of "bytes".
+void ChunkMessage::encode_head(Bytes &out, const std::string &name, uint64_t index, uint64_t size,
+                               size_t len) {
+    using namespace pack109;
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("Chunk", 5);
+    enc.begin_map(4);
+    enc.put_string("name", 4);
+    enc.put(name);
+    enc.put_string("index", 5);
+    enc.put((u64)index);
+    enc.put_string("size", 4);
+    enc.put((u64)size);
+    enc.put_string("bytes", 5);
+    enc.begin_binary(len);
+}
+
+// Static Method: parse
+// Purpose: Walks the Chunk message in place; keys may come in any order.
+ChunkMessage::View ChunkMessage::parse(const uint8_t *data, size_t len) {
+    pack109::Reader in(data, len);
+    size_t entries = open_message(in, "Chunk", 5);
+    View v = {{nullptr, 0}, 0, 0, {nullptr, 0, 1}};
+    unsigned seen = 0;                        // One bit per required key
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (key.equals("name", 4)) {
+            v.name = in.read_string();
+            seen |= 1;
+        } else if (key.equals("index", 5)) {
+            v.index = in.read_u64();
+            seen |= 2;
+        } else if (key.equals("size", 4)) {
+            v.size = in.read_u64();
+            seen |= 4;
+        } else if (key.equals("bytes", 5)) {
+            v.data = in.read_bytes();
+            seen |= 8;
+        } else {
+            in.skip();
+        }
+    }
+    if (seen != 15) throw std::runtime_error("Missing Chunk key");
+    return v;
+}
+
+// Method: serialize
+// Purpose: Serializes the CommitMessage into a byte buffer of its exact size.
+Bytes CommitMessage::serialize() const {
+    using namespace pack109;
+    Bytes out;
+    out.reserve(encoded_map_header_size(1) + encoded_string_size(6)
+              + encoded_map_header_size(1) + encoded_string_size(4) + encoded_string_size(name.size()));
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("Commit", 6);
+    enc.begin_map(1);
+    enc.put_string("name", 4);
+    enc.put(name);
+    return out;
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a CommitMessage object.
+// Throws:
+//   - runtime_error if the buffer is invalid or missing required keys.
+CommitMessage CommitMessage::deserialize(const Bytes &buf) {
+    pack109::Reader in(buf);
+    size_t entries = open_message(in, "Commit", 6);
+    for (size_t i = 0; i < entries; ++i) {
+        if (in.read_string().equals("name", 4))
+            return CommitMessage(in.read_string().str());
+        in.skip();
+    }
+    throw std::runtime_error("Missing name key");
+}
+
+// Method: serialize
+// Purpose: Serializes the AckMessage into a byte buffer of its exact size.
+Bytes AckMessage::serialize() const {
+    return encode_name_u64("Ack", 3, name, "next", 4, next);
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a AckMessage object.
+// Throws:
+//   - runtime_error if the buffer is invalid or missing required keys.
+AckMessage AckMessage::deserialize(const Bytes &buf) {
+    AckMessage m("", 0);
+    decode_name_u64(buf, "Ack", 3, m.name, "next", 4, m.next);
+    return m;
+}
+
+// Method: serialize
+// Purpose: Serializes the FetchMessage into a byte buffer of its exact size.
+Bytes FetchMessage::serialize() const {
+    return encode_name_u64("Fetch", 5, name, "index", 5, index);
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a FetchMessage object.
+// Throws:
+//   - runtime_error if the buffer is invalid or missing required keys.
+FetchMessage FetchMessage::deserialize(const Bytes &buf) {
+    FetchMessage m("", 0);
+    decode_name_u64(buf, "Fetch", 5, m.name, "index", 5, m.index);
+    return m;
+}
+
+// Method: serialize
+// Purpose: Serializes the SnapshotMessage: {"Snapshot": {}}.
+Bytes SnapshotMessage::serialize() const {
+    using namespace pack109;
+    Bytes out;
+    out.reserve(encoded_map_header_size(1) + encoded_string_size(8) + encoded_map_header_size(0));
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("Snapshot", 8);
+    enc.begin_map(0);
+    return out;
+}
+
+// Method: deserialize
+// Purpose: Checks that a byte buffer holds a Snapshot message. Inner keys are
+//          ignored, so later versions can add options.
+// Throws:
+//   - runtime_error if the buffer is invalid.
+SnapshotMessage SnapshotMessage::deserialize(const Bytes &buf) {
+    pack109::Reader in(buf);
+    size_t entries = open_message(in, "Snapshot", 8);
+    for (size_t i = 0; i < entries; ++i) {
+        in.read_string();
+        in.skip();
+    }
+    return SnapshotMessage();
+}
+
+// --- Batch messages ---
+// Method: serialize
+// Purpose: Serializes {"MultiRequest": {"names": [S...][, "accept": S]}}.
+Bytes MultiRequestMessage::serialize() const {
+    using namespace pack109;
+    size_t size = encoded_map_header_size(1) + encoded_string_size(12)
+                + encoded_map_header_size(2) + encoded_string_size(5)
+                + encoded_array_header_size(names.size())
+                + encoded_string_size(6) + encoded_string_size(accept.size());
+    for (const std::string &n : names) size += encoded_string_size(n.size());
+    Bytes out;
+    out.reserve(size);
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("MultiRequest", 12);
+    enc.begin_map(accept.empty() ? 1 : 2);
+    enc.put_string("names", 5);
+    enc.begin_array(names.size());
+    for (const std::string &n : names) enc.put(n);
+    if (!accept.empty()) {
+        enc.put_string("accept", 6);
+        enc.put(accept);
+    }
+    return out;
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a MultiRequestMessage object.
+// Throws:
+//   - runtime_error if the buffer is invalid or missing required keys.
+MultiRequestMessage MultiRequestMessage::deserialize(const Bytes &buf) {
+    View v = parse(buf.data(), buf.size());
+    MultiRequestMessage m({}, v.accept.str());
+    m.names.reserve(v.names.size());
+    for (const pack109::Span &n : v.names) m.names.push_back(n.str());
+    return m;
+}
+
+// Static Method: parse
+// Purpose: Walks the MultiRequest in place; unknown keys are skipped.
+MultiRequestMessage::View MultiRequestMessage::parse(const uint8_t *data, size_t len) {
+    pack109::Reader in(data, len);
+    size_t entries = open_message(in, "MultiRequest", 12);
+    View v;
+    v.accept = {nullptr, 0};
+    bool have_names = false;
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (key.equals("names", 5)) {
+            size_t count = in.read_array();
+            if (count > in.remaining()) throw std::runtime_error("Truncated names");
+            v.names.clear();
+            v.names.reserve(count);
+            for (size_t j = 0; j < count; ++j) v.names.push_back(in.read_string());
+            have_names = true;
+        } else if (key.equals("accept", 6)) {
+            v.accept = in.read_string();
+        } else {
+            in.skip();
+        }
+    }
+    if (!have_names) throw std::runtime_error("Missing names key");
+    return v;
+}
+
+// Static Method: header_size
+// Purpose: Computes the size of {"MultiFile": {"files": A<count>}}, without the items.
+size_t MultiFileMessage::header_size(size_t count) {
+    using namespace pack109;
+    return encoded_map_header_size(1) + encoded_string_size(9)
+         + encoded_map_header_size(1) + encoded_string_size(5)
+         + encoded_array_header_size(count);
+}
+
+// Static Method: encode_header
+// Purpose: Appends the message header; `count` items must follow.
+void MultiFileMessage::encode_header(Bytes &out, size_t count) {
+    pack109::Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("MultiFile", 9);
+    enc.begin_map(1);
+    enc.put_string("files", 5);
+    enc.begin_array(count);
+}
+
+// Static Method: item_size
+// Purpose: Computes the size of {"name": S, "ok": true, "bytes": B[, "encoding": S,
+//          "size": U64]}; an encoding_len of 0 means plain content.
+size_t MultiFileMessage::item_size(size_t name_len, size_t data_len, size_t encoding_len) {
+    using namespace pack109;
+    size_t size = encoded_map_header_size(5)
+                + encoded_string_size(4) + encoded_string_size(name_len)
+                + encoded_string_size(2) + 1
+                + encoded_string_size(5) + encoded_binary_size(data_len);
+    if (encoding_len)
+        size += encoded_string_size(8) + encoded_string_size(encoding_len) + encoded_string_size(4) + 9;
+    return size;
+}
+
+// Static Method: encode_item
+// Purpose: Appends a found item; the content is one raw block as in File.
+void MultiFileMessage::encode_item(Bytes &out, const std::string &name, const uint8_t *data, size_t len,
+                                   const std::string &encoding, uint64_t size) {
+    encode_item_head(out, name, len, encoding, size);
+    out.insert(out.end(), data, data + len);
+}
+
+// Static Method: encode_item_head
+// Purpose: Writes a found item with "bytes" last, up to its raw block header.
+void MultiFileMessage::encode_item_head(Bytes &out, const std::string &name, size_t len,
+                                        const std::string &encoding, uint64_t size) {
+    pack109::Encoder enc(out);
+    enc.begin_map(encoding.empty() ? 3 : 5);
+    enc.put_string("name", 4);
+    enc.put(name);
+    enc.put_string("ok", 2);
+    enc.put(true);
+    if (!encoding.empty()) {
+        enc.put_string("encoding", 8);
+        enc.put(encoding);
+        enc.put_string("size", 4);
+        enc.put((u64)size);               // Decoded length
+    }
+    enc.put_string("bytes", 5);
+    enc.begin_binary(len);
+}
+
+// Static Method: missing_size
+// Purpose: Computes the size of {"name": S, "ok": false, "message": S}.
+size_t MultiFileMessage::missing_size(size_t name_len, size_t message_len) {
+    using namespace pack109;
+    return encoded_map_header_size(3)
+         + encoded_string_size(4) + encoded_string_size(name_len)
+         + encoded_string_size(2) + 1
+         + encoded_string_size(7) + encoded_string_size(message_len);
+}
+
+// Static Method: encode_missing
+// Purpose: Appends an item for a file that could not be returned.
+void MultiFileMessage::encode_missing(Bytes &out, const std::string &name, const std::string &message) {
+    pack109::Encoder enc(out);
+    enc.begin_map(3);
+    enc.put_string("name", 4);
+    enc.put(name);
+    enc.put_string("ok", 2);
+    enc.put(false);
+    enc.put_string("message", 7);
+    enc.put(message);
+}
+
+// Method: serialize
+// Purpose: Encodes the items into one buffer of the exact final size.
+Bytes MultiFileMessage::serialize() const {
+    size_t size = header_size(files.size());
+    for (const Item &f : files)
+        size += f.ok ? item_size(f.name.size(), f.data.size()) : missing_size(f.name.size(), f.message.size());
+    Bytes out;
+    out.reserve(size);
+    encode_header(out, files.size());
+    for (const Item &f : files) {
+        if (f.ok) encode_item(out, f.name, f.data.data(), f.data.size());
+        else encode_missing(out, f.name, f.message);
+    }
+    return out;
+}
+
+// Method: deserialize
+// Purpose: Copies every item out of the buffer, decoding its content.
+MultiFileMessage MultiFileMessage::deserialize(const Bytes &buf) {
+    std::vector<ItemView> views = parse(buf.data(), buf.size());
+    MultiFileMessage m;
+    m.files.reserve(views.size());
+    for (const ItemView &v : views)
+        m.files.push_back(Item{v.file.name.str(), v.ok, v.ok ? decode_content(v.file) : Bytes(), v.message.str()});
+    return m;
+}
+
+// Static Method: parse
+// Purpose: Walks the items in place with the File body reader, so an item
+//          accepts every form a File message does.
+std::vector<MultiFileMessage::ItemView> MultiFileMessage::parse(const uint8_t *data, size_t len) {
+    pack109::Reader in(data, len);
+    size_t entries = open_message(in, "MultiFile", 9);
+    std::vector<ItemView> items;
+    bool have_files = false;
+    for (size_t i = 0; i < entries; ++i) {
+        pack109::Span key = in.read_string();
+        if (!key.equals("files", 5)) {
+            in.skip();
+            continue;
+        }
+        size_t count = in.read_array();
+        if (count > in.remaining()) throw std::runtime_error("Truncated files");
+        items.clear();
+        items.reserve(count);
+        for (size_t j = 0; j < count; ++j) {
+            ItemView item;
+            item.ok = true;
+            item.message = {nullptr, 0};
+            bool have_bytes;
+            item.file = read_file_body(in, in.read_map(), have_bytes, &item.ok, &item.message);
+            if (item.ok && !have_bytes) throw std::runtime_error("Missing bytes key");
+            items.push_back(item);
+        }
+        have_files = true;
+    }
+    if (!have_files) throw std::runtime_error("Missing files key");
+    return items;
+}
+
+// Method: serialize
+// Purpose: Serializes {"MultiStatus": {"results": [{"name": S, "ok": bool,
+//          "message": S}...]}}.
+Bytes MultiStatusMessage::serialize() const {
+    using namespace pack109;
+    size_t size = encoded_map_header_size(1) + encoded_string_size(11)
+                + encoded_map_header_size(1) + encoded_string_size(7)
+                + encoded_array_header_size(results.size());
+    for (const Result &r : results)
+        size += MultiFileMessage::missing_size(r.name.size(), r.message.size());  // Same shape
+    Bytes out;
+    out.reserve(size);
+    Encoder enc(out);
+    enc.begin_map(1);
+    enc.put_string("MultiStatus", 11);
+    enc.begin_map(1);
+    enc.put_string("results", 7);
+    enc.begin_array(results.size());
+    for (const Result &r : results) {
+        enc.begin_map(3);
+        enc.put_string("name", 4);
+        enc.put(r.name);
+        enc.put_string("ok", 2);
+        enc.put(r.ok);
+        enc.put_string("message", 7);
+        enc.put(r.message);
+    }
+    return out;
+}
+
+// Method: deserialize
+// Purpose: Deserializes a byte buffer into a MultiStatusMessage object. Keys
+//          may come in any order and unknown keys are skipped.
+// Throws:
+//   - runtime_error if the buffer is invalid or a result has no name or flag.
+MultiStatusMessage MultiStatusMessage::deserialize(const Bytes &buf) {
+    pack109::Reader in(buf);
+    size_t entries = open_message(in, "MultiStatus", 11);
+    MultiStatusMessage m;
+    bool have_results = false;
+    for (size_t i = 0; i < entries; ++i) {
+        if (!in.read_string().equals("results", 7)) {
+            in.skip();
+            continue;
+        }
+        size_t count = in.read_array();
+        if (count > in.remaining()) throw std::runtime_error("Truncated results");
+        m.results.clear();
+        m.results.reserve(count);
+        for (size_t j = 0; j < count; ++j) {
+            size_t keys = in.read_map();
+            Result r{"", false, ""};
+            bool have_name = false, have_ok = false;
+            for (size_t k = 0; k < keys; ++k) {
+                pack109::Span key = in.read_string();
+                if (key.equals("name", 4)) {
+                    r.name = in.read_string().str();
+                    have_name = true;
+                } else if (key.equals("ok", 2)) {
+                    r.ok = in.read_bool();
+                    have_ok = true;
+                } else if (key.equals("message", 7)) {
+                    r.message = in.read_string().str();
+                } else {
+                    in.skip();
+                }
+            }
+            if (!have_name || !have_ok) throw std::runtime_error("Incomplete result");
+            m.results.push_back(std::move(r));
+        }
+        have_results = true;
+    }
+    if (!have_results) throw std::runtime_error("Missing results key");
+    return m;
+}
@@ -10,11 +10,34 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+
+#include "pack109.hpp"   // Span, ByteSpan views
+#include "blob.hpp"      // BlobRef, for replies that refer to stored content
 
 // Type alias for byte buffer
 using Bytes = std::vector<uint8_t>;
 
+// Wire framing: every message on the socket is a 4-byte big-endian payload
+// length followed by the encrypted Pack109 payload. The message classes below
+// produce and consume plain Pack109; the framing functions apply the XOR-42
+// cipher, so each payload byte is transformed exactly once per direction.
+constexpr size_t FRAME_HEADER_SIZE = 4;          // Size of the length prefix
+constexpr size_t MAX_FRAME_SIZE = 16 * 1024 * 1024; // Largest accepted payload
+
+// Chunked transfer: files of any size move as a sequence of Chunk messages of
+// CHUNK_SIZE bytes (the last one may be shorter), so neither side holds more
+// than one chunk of a transfer in its network buffers.
+//   Upload:   Begin{name,size} -> Ack{next};  Chunk{index=next,...} -> Ack{next+1};
+//             ...;  Commit{name} -> Status.   Re-sending Begin after a dropped
+//             connection returns the index of the first chunk still missing.
+//   Download: Fetch{name,index} -> Chunk{index,size,bytes}, for index 0, 1, ...
+//             until the received bytes reach `size`.
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
 // Function: xor42
 // Purpose: Encrypts or decrypts a byte buffer using XOR with a key (default: 42).
 // Parameters:
@@ -24,11 +47,282 @@ using Bytes = std::vector<uint8_t>;
 //   - A new byte buffer after applying the XOR operation.
 Bytes xor42(const Bytes& input, uint8_t key = 42);
 
+// Function: xor42_inplace
+// Purpose: Encrypts or decrypts `len` bytes in place. Uses AVX2 or SSE2 when
+//          the CPU supports them and a word-at-a-time scalar loop otherwise.
+// Parameters:
+//   - data: The bytes to transform.
+//   - len: Number of bytes.
+//   - key: The key to use for the XOR operation (default is 42).
+void xor42_inplace(uint8_t* data, size_t len, uint8_t key = 42);
+
+// Function: xor42_copy
+// Purpose: Copies `len` bytes from `src` to `dst` while applying the cipher, so
+//          copying a payload into a send buffer and encrypting it is one pass.
+//          `dst` may equal `src`.
+void xor42_copy(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key = 42);
+
+// Function: xor42_impl
+// Returns:
+//   - The name of the kernel selected for this CPU ("avx2", "sse2" or "scalar").
+const char* xor42_impl();
+
+// Enum: MessageType
+// Purpose: The kinds of top-level protocol messages, named by their outer map key.
+enum class MessageType {
+    File,     // {"File": {...}}
+    Request,  // {"Request": {...}}
+    Status,   // {"Status": {...}}
+    Begin,    // {"Begin": {...}}
+    Chunk,    // {"Chunk": {...}}
+    Commit,   // {"Commit": {...}}
+    Ack,      // {"Ack": {...}}
+    Fetch,    // {"Fetch": {...}}
+    Snapshot, // {"Snapshot": {}}
+    MultiRequest, // {"MultiRequest": {...}}
+    MultiFile,    // {"MultiFile": {...}}
+    MultiStatus,  // {"MultiStatus": {...}}
+    Invalid   // Anything else
+};
+
+// Function: peek_message_type
+// Purpose: Classifies a message by reading only its outer M8 header and key, so
+//          it can be handed to the one matching decoder without trial decoding.
+// Parameters:
+//   - bytes: The plain (decrypted) message.
+// Returns:
+//   - The message type, or MessageType::Invalid if the header is not a
+//     one-entry map with a known key. Never throws.
+MessageType peek_message_type(const Bytes& bytes);
+
+// Function: frame
+// Purpose: Encrypts a payload and prefixes it with its length for sending.
+// Parameters:
+//   - payload: The plain message bytes.
+// Returns:
+//   - The length header followed by the encrypted payload.
+// Throws:
+//   - runtime_error if the payload is larger than MAX_FRAME_SIZE.
+Bytes frame(const Bytes& payload);
+
+// Class: FrameReader
+// Purpose: Reassembles length-prefixed messages from a byte stream. Bytes can be
+//          fed in arbitrary pieces; a message split across many reads, or several
+//          messages arriving in one read, come out as whole decrypted payloads in
+//          order.
+class FrameReader {
+public:
+    // Method: feed
+    // Purpose: Appends received bytes to the reassembly buffer.
+    void feed(const uint8_t* data, size_t len);
+
+    // Method: prepare
+    // Purpose: Reserves space at the end of the buffer so a socket can read into
+    //          it directly. Must be followed by commit().
+    // Returns:
+    //   - A pointer to at least `len` writable bytes.
+    uint8_t* prepare(size_t len);
+
+    // Method: commit
+    // Purpose: Marks `len` bytes written after prepare() as received.
+    void commit(size_t len);
+
+    // Method: next
+    // Purpose: Extracts the next complete payload, if one has fully arrived.
+    // Parameters:
+    //   - payload: Receives the decrypted message bytes (without the length header).
+    // Returns:
+    //   - true if a payload was extracted, false if more bytes are needed.
+    // Throws:
+    //   - runtime_error if the announced length exceeds MAX_FRAME_SIZE.
+    bool next(Bytes& payload);
+
+    // Method: buffered
+    // Returns:
+    //   - The number of received bytes not yet returned by next().
+    size_t buffered() const { return end_ - pos_; }
+
+private:
+    Bytes buf_;      // Reassembly buffer
+    size_t pos_ = 0; // Start of unconsumed data in buf_
+    size_t end_ = 0; // End of received data in buf_
+};
+
+// Function: send_frame
+// Purpose: Encrypts and frames a plain payload and writes all of it to a
+//          blocking socket.
+// Returns:
+//   - true on success, false if the socket failed.
+bool send_frame(int fd, const Bytes& payload);
+
+// Function: recv_frame
+// Purpose: Reads exactly one framed payload from a blocking socket and decrypts it.
+// Parameters:
+//   - fd: The socket to read from.
+//   - payload: Receives the plain message bytes.
+// Returns:
+//   - true on success, false if the peer closed the socket or it failed.
+bool recv_frame(int fd, Bytes& payload);
+
+// Class: Reply
+// Purpose: A plain message payload made of parts, each either bytes the reply
+//          owns or a range of a shared blob it only refers to. A server builds
+//          a reply around stored file content this way, so the content is not
+//          copied into the payload; whoever sends the reply reads each blob
+//          range once, applying the cipher on the way to the socket. A Bytes
+//          payload converts to a reply of one owned part.
+class Reply {
+public:
+    // Struct: Part
+    // Purpose: One piece of the payload.
+    struct Part {
+        Bytes bytes;         // Owned bytes, when blob is null
+        BlobRef blob;        // Shared content
+        size_t offset;       // Start of the range in blob
+        size_t length;       // Length of the range in blob
+    };
+
+    // Constant: COPY_LIMIT
+    // Purpose: Blob ranges shorter than this are copied into the owned bytes;
+    //          a separate part would cost more than the copy saves.
+    static constexpr size_t COPY_LIMIT = 4096;
+
+    Reply() {}
+    Reply(Bytes payload);    // A reply of one owned part (implicit on purpose)
+
+    // Method: buffer
+    // Returns:
+    //   - The owned bytes at the end of the reply, for encoding more elements
+    //     into; a new part is started if the reply ends with a blob range.
+    Bytes& buffer();
+
+    // Method: add_blob
+    // Purpose: Appends `length` bytes of `blob`, from `offset`, to the payload.
+    void add_blob(const BlobRef& blob, size_t offset, size_t length);
+
+    // Method: size
+    // Returns:
+    //   - The length of the whole payload.
+    size_t size() const;
+
+    // Method: flatten
+    // Returns:
+    //   - The payload copied into one buffer.
+    Bytes flatten() const;
+
+    std::vector<Part>& parts() { return parts_; }
+    const std::vector<Part>& parts() const { return parts_; }
+
+private:
+    std::vector<Part> parts_;
+};
+
+// Request IDs: a client may send many requests on a connection without waiting
+// for the replies. The server answers them in the order received, and a
+// request whose inner map has an "id" key (a u64) gets a reply carrying the
+// same "id", so the client can match replies to requests. Every decoder skips
+// keys it does not know, so tagged messages decode exactly as untagged ones.
+
+// Function: peek_request_id
+// Purpose: Looks for an "id" key in the inner map of a message.
+// Parameters:
+//   - msg: The plain message.
+//   - id: Set to the request ID if one is found.
+// Returns:
+//   - true if the message carries a request ID. Never throws.
+bool peek_request_id(const Bytes& msg, uint64_t& id);
+
+// Function: attach_request_id
+// Purpose: Adds an "id" key to the inner map of a message, widening the map
+//          header if its entry count no longer fits.
+// Parameters:
+//   - msg: The plain message, changed in place.
+//   - id: The request ID.
+// Throws:
+//   - runtime_error if `msg` is not a single-key message with a map body.
+void attach_request_id(Bytes& msg, uint64_t id);
+
+// Function: attach_request_id
+// Purpose: As above for a reply whose first part holds at least the message
+//          header and the inner map header, as every encode_head below writes.
+void attach_request_id(Reply& reply, uint64_t id);
+
+// Constant: REQUEST_ID_SIZE
+// Purpose: Most bytes attach_request_id adds to a message: the "id" key (4),
+//          its u64 (9) and a map header widened by up to 2 bytes. Replies are
+//          sized with this much room to spare, so the ID never pushes one
+//          past MAX_FRAME_SIZE.
+constexpr size_t REQUEST_ID_SIZE = 15;
+
+// Class: Pipeline
+// Purpose: Client side of request pipelining over a blocking socket. Up to
+//          `window` requests are kept outstanding; each is tagged with the next
+//          request ID, and replies come back in the order the requests were
+//          submitted. Requests should be small next to the replies (Request,
+//          Fetch), or the window small, so the socket buffers can hold a whole
+//          window of requests while the server waits for replies to be read.
+class Pipeline {
+public:
+    // Constructor
+    // Parameters:
+    //   - fd: A connected, blocking socket.
+    //   - window: Most requests outstanding at once (at least 1).
+    Pipeline(int fd, size_t window);
+
+    // Method: submit
+    // Purpose: Tags a request with the next ID and sends it. When the window is
+    //          full, the oldest reply is read first and kept for receive().
+    // Parameters:
+    //   - payload: The plain request.
+    // Returns:
+    //   - The ID the request was sent with.
+    // Throws:
+    //   - runtime_error if the socket fails or the request is malformed.
+    uint64_t submit(Bytes payload);
+
+    // Method: receive
+    // Purpose: Returns the oldest reply not yet returned, reading it from the
+    //          socket if it has not arrived yet.
+    // Parameters:
+    //   - reply: Receives the plain reply, still carrying its "id" key.
+    // Returns:
+    //   - The ID of the request the reply answers.
+    // Throws:
+    //   - runtime_error if nothing is outstanding, the socket fails, or the
+    //     reply does not carry the expected ID.
+    uint64_t receive(Bytes& reply);
+
+    // Method: in_flight
+    // Returns:
+    //   - The number of submitted requests whose replies receive() has not
+    //     returned yet.
+    size_t in_flight() const { return next_id_ - next_reply_; }
+
+private:
+    void read_reply();              // Read one reply from the socket into ready_
+
+    int fd_;                        // Connected socket
+    size_t window_;                 // Most requests outstanding at once
+    uint64_t next_id_ = 1;          // ID for the next submit()
+    uint64_t next_reply_ = 1;       // ID the next receive() returns
+    std::deque<Bytes> ready_;       // Replies read while the window was full
+};
+
 // Class: FileMessage
 // Purpose: Represents a file message, containing a file's name and its data.
 //          Provides serialization and deserialization methods.
 class FileMessage {
 public:
+    // Struct: View
+    // Purpose: A decoded File message that still points into the buffer it was
+    //          parsed from; nothing is copied.
+    struct View {
+        pack109::Span name;      // File name chars
+        pack109::ByteSpan data;  // File content, encoded if `encoding` is set
+        pack109::Span encoding;  // Content encoding ("lz"), empty if plain
+        uint64_t size;           // Decoded content length when encoded
+    };
+
     std::string name; // Name of the file
     Bytes data;       // File content as a byte buffer
 
@@ -41,43 +335,119 @@ public:
     // Method: serialize
     // Purpose: Serializes the FileMessage into a byte buffer.
     // Returns:
-    //   - A byte buffer representing the serialized FileMessage.
+    //   - A byte buffer with the plain Pack109 encoding of the FileMessage.
     Bytes serialize() const;
 
+    // Static Method: serialize
+    // Purpose: Serializes a File message straight from borrowed file bytes, e.g. a
+    //          stored blob, without first copying them into a FileMessage.
+    // Parameters:
+    //   - name: Name of the file
+    //   - data: Pointer to the file content
+    //   - len: Length of the file content
+    // Returns:
+    //   - A byte buffer with the plain Pack109 encoding of the File message.
+    static Bytes serialize(const std::string& name, const uint8_t* data, size_t len);
+
+    // Static Method: encoded_size
+    // Returns:
+    //   - The exact encoded size of a File message with the given name and content lengths.
+    static size_t encoded_size(size_t name_len, size_t data_len);
+
+    // Static Method: encode
+    // Purpose: Appends a File message built from borrowed file bytes to `out`.
+    //          Reserving encoded_size() first makes this allocation-free.
+    static void encode(Bytes& out, const std::string& name, const uint8_t* data, size_t len);
+
+    // Static Method: encoded_size / encode
+    // Purpose: As above for content sent encoded, as a server may do for a
+    //          client whose Request accepts the encoding. The message gets
+    //          "encoding" and "size" (the decoded length) keys.
+    static size_t encoded_size(size_t name_len, size_t data_len, size_t encoding_len);
+    static void encode(Bytes& out, const std::string& name, const uint8_t* data, size_t len,
+                       const std::string& encoding, uint64_t size);
+
+    // Static Method: encode_head
+    // Purpose: Appends all of a File message but its `len` content bytes,
+    //          which come last and must follow, e.g. as a blob in a Reply. An
+    //          empty encoding gives the plain form.
+    static void encode_head(Bytes& out, const std::string& name, size_t len,
+                            const std::string& encoding = "", uint64_t size = 0);
+
     // Static Method: deserialize
-    // Purpose: Deserializes a byte buffer into a FileMessage object.
+    // Purpose: Deserializes a byte buffer into a FileMessage object, decoding
+    //          "lz" content.
     // Parameters:
-    //   - bytes: The byte buffer to deserialize.
+    //   - bytes: The plain byte buffer to deserialize.
     // Returns:
     //   - A FileMessage object.
+    // Throws:
+    //   - runtime_error if the message is malformed or uses another encoding.
     static FileMessage deserialize(const Bytes& bytes);
+
+    // Static Method: parse
+    // Purpose: Decodes a File message in place, without allocating.
+    // Parameters:
+    //   - data, len: The plain message bytes, which must outlive the view.
+    // Returns:
+    //   - Views of the name and content inside `data`.
+    // Throws:
+    //   - runtime_error if the message is malformed or missing required keys.
+    static View parse(const uint8_t* data, size_t len);
 };
 
 // Class: RequestMessage
-// Purpose: Represents a request message, containing the name of the requested file.
-//          Provides serialization and deserialization methods.
+// Purpose: Represents a request message, containing the name of the requested file
+//          and optionally a content encoding the client can decode, under the
+//          "accept" key. Provides serialization and deserialization methods.
 class RequestMessage {
 public:
-    std::string name; // Name of the requested file
+    // Struct: View
+    // Purpose: A decoded Request that still points into the buffer it was parsed from.
+    struct View {
+        pack109::Span name;      // Requested name chars
+        pack109::Span accept;    // Accepted encoding, empty if none
+    };
+
+    std::string name;   // Name of the requested file
+    std::string accept; // Encoding the reply may use ("lz"), or empty
 
     // Constructor
     // Parameters:
     //   - n: Name of the requested file
-    RequestMessage(std::string n);
+    //   - a: Accepted encoding; empty sends no "accept" key
+    RequestMessage(std::string n, std::string a = "");
 
     // Method: serialize
     // Purpose: Serializes the RequestMessage into a byte buffer.
     // Returns:
-    //   - A byte buffer representing the serialized RequestMessage.
+    //   - A byte buffer with the plain Pack109 encoding of the RequestMessage.
     Bytes serialize() const;
 
+    // Method: encoded_size
+    // Returns:
+    //   - The exact number of bytes serialize() produces.
+    size_t encoded_size() const;
+
+    // Method: encode
+    // Purpose: Appends the plain Pack109 encoding to `out` without intermediate buffers.
+    void encode(Bytes& out) const;
+
     // Static Method: deserialize
     // Purpose: Deserializes a byte buffer into a RequestMessage object.
     // Parameters:
-    //   - bytes: The byte buffer to deserialize.
+    //   - bytes: The plain byte buffer to deserialize.
     // Returns:
     //   - A RequestMessage object.
     static RequestMessage deserialize(const Bytes& bytes);
+
+    // Static Method: parse
+    // Purpose: Decodes a Request message in place, without allocating.
+    // Returns:
+    //   - Views of the requested name and accepted encoding inside `data`.
+    // Throws:
+    //   - runtime_error if the message is malformed or missing the name.
+    static View parse(const uint8_t* data, size_t len);
 };
 
 // Class: StatusMessage
@@ -97,16 +467,248 @@ public:
     // Method: serialize
     // Purpose: Serializes the StatusMessage into a byte buffer.
     // Returns:
-    //   - A byte buffer representing the serialized StatusMessage.
+    //   - A byte buffer with the plain Pack109 encoding of the StatusMessage.
     Bytes serialize() const;
 
+    // Method: encoded_size
+    // Returns:
+    //   - The exact number of bytes serialize() produces.
+    size_t encoded_size() const;
+
+    // Method: encode
+    // Purpose: Appends the plain Pack109 encoding to `out` without intermediate buffers.
+    void encode(Bytes& out) const;
+
     // Static Method: deserialize
     // Purpose: Deserializes a byte buffer into a StatusMessage object.
     // Parameters:
-    //   - bytes: The byte buffer to deserialize.
+    //   - bytes: The plain byte buffer to deserialize.
     // Returns:
     //   - A StatusMessage object.
     static StatusMessage deserialize(const Bytes& bytes);
 };
 
-#endif // PROTOCOL_HPP
\ No newline at end of file
+// Class: BeginMessage
+// Purpose: Starts (or resumes) a chunked upload of a file of `size` bytes.
+class BeginMessage {
+public:
+    std::string name; // Name of the file
+    uint64_t size;    // Total length of the file in bytes
+
+    BeginMessage(std::string n, uint64_t sz);
+
+    // Method: serialize
+    // Returns:
+    //   - A byte buffer with the plain Pack109 encoding of the BeginMessage.
+    Bytes serialize() const;
+
+    // Static Method: deserialize
+    // Throws:
+    //   - runtime_error if the buffer is invalid or missing required keys.
+    static BeginMessage deserialize(const Bytes& bytes);
+};
+
+// Class: ChunkMessage
+// Purpose: One CHUNK_SIZE slice of a file, sent by the client while uploading
+//          and by the server in reply to a Fetch.
+class ChunkMessage {
+public:
+    // Struct: View
+    // Purpose: A decoded Chunk that still points into the buffer it was parsed from.
+    struct View {
+        pack109::Span name;      // File name chars
+        uint64_t index;          // Position of the chunk in the file
+        uint64_t size;           // Total length of the file
+        pack109::ByteSpan data;  // Chunk content
+    };
+
+    // Static Method: serialize
+    // Purpose: Serializes a chunk straight from borrowed file bytes.
+    // Parameters:
+    //   - name: Name of the file
+    //   - index: Position of the chunk in the file
+    //   - size: Total length of the file
+    //   - data, len: The chunk content
+    static Bytes serialize(const std::string& name, uint64_t index, uint64_t size,
+                           const uint8_t* data, size_t len);
+
+    // Static Method: encode_head
+    // Purpose: Appends all of a Chunk message but its `len` content bytes,
+    //          which come last and must follow.
+    static void encode_head(Bytes& out, const std::string& name, uint64_t index, uint64_t size,
+                            size_t len);
+
+    // Static Method: parse
+    // Purpose: Decodes a Chunk message in place, without allocating.
+    // Throws:
+    //   - runtime_error if the message is malformed or missing required keys.
+    static View parse(const uint8_t* data, size_t len);
+};
+
+// Class: CommitMessage
+// Purpose: Completes a chunked upload; the file becomes visible to readers.
+class CommitMessage {
+public:
+    std::string name; // Name of the file
+
+    CommitMessage(std::string n);
+
+    Bytes serialize() const;                          // Plain Pack109 encoding
+    static CommitMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+};
+
+// Class: AckMessage
+// Purpose: The server's reply to Begin and Chunk: the index of the next chunk
+//          it expects for the named upload.
+class AckMessage {
+public:
+    std::string name; // Name of the file
+    uint64_t next;    // Index of the next chunk to send
+
+    AckMessage(std::string n, uint64_t nx);
+
+    Bytes serialize() const;                          // Plain Pack109 encoding
+    static AckMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+};
+
+// Class: FetchMessage
+// Purpose: Asks the server for one chunk of a stored file.
+class FetchMessage {
+public:
+    std::string name; // Name of the file
+    uint64_t index;   // Position of the chunk in the file
+
+    FetchMessage(std::string n, uint64_t i);
+
+    Bytes serialize() const;                          // Plain Pack109 encoding
+    static FetchMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+};
+
+// Class: SnapshotMessage
+// Purpose: Admin request asking the server to start a background snapshot of
+//          the store. The server replies with a Status.
+class SnapshotMessage {
+public:
+    Bytes serialize() const;                             // Plain Pack109 encoding
+    static SnapshotMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+};
+
+// Batches: several files fetched or stored with one message and one reply.
+//   Multi-get: MultiRequest{names: [S...], accept?} -> MultiFile{files: [item...]},
+//              one item per name, in order: {name, ok: true, bytes[, encoding,
+//              size]} for a file found, {name, ok: false, message} otherwise.
+//   Multi-put: MultiFile{files: [{name, bytes}...]} -> MultiStatus{results:
+//              [{name, ok, message}...]}, one result per file, in order.
+// A batch travels as one frame, so it is bounded by MAX_FRAME_SIZE.
+
+// Class: MultiRequestMessage
+// Purpose: Asks for several files at once, optionally accepting an encoding
+//          for all of them as RequestMessage does.
+class MultiRequestMessage {
+public:
+    // Struct: View
+    // Purpose: A decoded MultiRequest that still points into the buffer it was parsed from.
+    struct View {
+        std::vector<pack109::Span> names; // Requested name chars, in order
+        pack109::Span accept;             // Accepted encoding, empty if none
+    };
+
+    std::vector<std::string> names; // Names of the requested files
+    std::string accept;             // Encoding the reply may use ("lz"), or empty
+
+    // Constructor
+    // Parameters:
+    //   - n: Names of the requested files
+    //   - a: Accepted encoding; empty sends no "accept" key
+    MultiRequestMessage(std::vector<std::string> n, std::string a = "");
+
+    Bytes serialize() const;                                 // Plain Pack109 encoding
+    static MultiRequestMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+
+    // Static Method: parse
+    // Purpose: Decodes a MultiRequest in place; only the vector of names is allocated.
+    // Throws:
+    //   - runtime_error if the message is malformed or missing the names.
+    static View parse(const uint8_t* data, size_t len);
+};
+
+// Class: MultiFileMessage
+// Purpose: Several files in one message: a batch to store, or the server's
+//          reply to a MultiRequest with a status per item.
+class MultiFileMessage {
+public:
+    // Struct: Item
+    // Purpose: One file of the batch, or the reason it is missing.
+    struct Item {
+        std::string name;    // Name of the file
+        bool ok;             // Whether the file is present
+        Bytes data;          // File content, decoded, if ok
+        std::string message; // Why the file is missing, if not ok
+    };
+
+    // Struct: ItemView
+    // Purpose: A decoded item that still points into the buffer it was parsed from.
+    struct ItemView {
+        FileMessage::View file;  // Name and content, as in a File message
+        bool ok;                 // Whether the file is present
+        pack109::Span message;   // Why it is missing, if not ok
+    };
+
+    std::vector<Item> files; // The items, in order
+
+    // Method: serialize
+    // Purpose: Encodes every item, with its content plain.
+    Bytes serialize() const;
+
+    // Static Method: deserialize
+    // Purpose: Decodes a MultiFile message, decoding "lz" content.
+    // Throws:
+    //   - runtime_error if the message is malformed or uses another encoding.
+    static MultiFileMessage deserialize(const Bytes& bytes);
+
+    // Static Method: parse
+    // Purpose: Decodes a MultiFile message in place; only the vector of items
+    //          is allocated. Items without an "ok" key count as present.
+    // Throws:
+    //   - runtime_error if the message is malformed, or an item has no name,
+    //     or is present without content.
+    static std::vector<ItemView> parse(const uint8_t* data, size_t len);
+
+    // Static Methods: encode_header / encode_item / encode_missing
+    // Purpose: Build a MultiFile from borrowed bytes, e.g. stored blobs, without
+    //          copying them into Items first: the header for `count` items, then
+    //          each item in turn, found (optionally with encoded content, as in
+    //          FileMessage::encode) or missing. encode_item_head writes a found
+    //          item but its content, which comes last in the item and must
+    //          follow. The *_size methods give the exact encoded size of each
+    //          part, for reserving the buffer.
+    static size_t header_size(size_t count);
+    static void encode_header(Bytes& out, size_t count);
+    static size_t item_size(size_t name_len, size_t data_len, size_t encoding_len = 0);
+    static void encode_item(Bytes& out, const std::string& name, const uint8_t* data, size_t len,
+                            const std::string& encoding = "", uint64_t size = 0);
+    static void encode_item_head(Bytes& out, const std::string& name, size_t len,
+                                 const std::string& encoding = "", uint64_t size = 0);
+    static size_t missing_size(size_t name_len, size_t message_len);
+    static void encode_missing(Bytes& out, const std::string& name, const std::string& message);
+};
+
+// Class: MultiStatusMessage
+// Purpose: The server's reply to a MultiFile batch: a status per file, in order.
+class MultiStatusMessage {
+public:
+    // Struct: Result
+    // Purpose: The outcome of storing one file.
+    struct Result {
+        std::string name;    // Name of the file
+        bool ok;             // Whether it was stored
+        std::string message; // "Stored", "Replaced", or the error
+    };
+
+    std::vector<Result> results; // One per file, in order
+
+    Bytes serialize() const;                                // Plain Pack109 encoding
+    static MultiStatusMessage deserialize(const Bytes& bytes); // Throws runtime_error if malformed
+};
+
+#endif // PROTOCOL_HPP
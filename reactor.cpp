@@ -0,0 +1,347 @@
+// File: reactor.cpp
+// Description: Implementation of the epoll reactor and worker pool that let the
+//              file server handle many client connections at once.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "reactor.hpp"
+
+#include <algorithm>      // std::min
+#include <cerrno>
+#include <cstdio>         // perror
+#include <stdexcept>
+#include <unistd.h>       // read, write, close
+#include <fcntl.h>        // fcntl
+#include <sys/epoll.h>    // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/eventfd.h>  // eventfd
+#include <sys/socket.h>   // accept4, recv, sendmsg
+#include <sys/uio.h>      // iovec
+
+constexpr size_t READ_CHUNK = 65536; // Bytes read per recv call
+constexpr int MAX_EVENTS = 64;       // Events fetched per epoll_wait call
+constexpr size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024; // Queued reply bytes that pause a connection
+constexpr size_t STAGE_SIZE = 256 * 1024; // Blob bytes encrypted per send
+constexpr size_t COALESCE_LIMIT = 65536;  // Owned parts up to this size share a segment
+constexpr int IOV_BATCH = 64;             // Segments handed to one sendmsg call
+
+// Constructor
+// Purpose: Creates the epoll instance and wake-up eventfd, registers the
+//          listening socket and starts the worker threads.
+Reactor::Reactor(int listen_fd, size_t max_connections, size_t workers, Handler handler)
+  : listen_fd_(listen_fd), epoll_fd_(-1), wake_fd_(-1),
+    max_connections_(max_connections ? max_connections : 1),
+    handler_(std::move(handler)), active_(0), accepting_(true), stopping_(false) {
+    int flags = fcntl(listen_fd_, F_GETFL, 0);
+    fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) throw std::runtime_error("epoll_create1 failed");
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) throw std::runtime_error("eventfd failed");
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;              // nullptr marks the listening socket
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0)
+        throw std::runtime_error("epoll_ctl on listen socket failed");
+    ev.data.ptr = &wake_fd_;            // &wake_fd_ marks the wake-up eventfd
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0)
+        throw std::runtime_error("epoll_ctl on eventfd failed");
+
+    if (workers == 0) workers = 1;
+    for (size_t i = 0; i < workers; ++i)
+        workers_.emplace_back(&Reactor::worker_loop, this);
+}
+
+// Destructor
+// Purpose: Joins the workers, then closes all remaining client sockets.
+Reactor::~Reactor() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto &t : workers_) t.join();
+
+    for (Connection *c : conns_) {
+        close(c->fd);
+        delete c;
+    }
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+// Method: run
+// Purpose: Waits for socket events. New clients are accepted inline; readable or
+//          writable clients are queued for the worker pool.
+void Reactor::run() {
+    epoll_event events[MAX_EVENTS];
+    while (true) {
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return;
+        }
+        bool queued = false;
+        for (int i = 0; i < n; ++i) {
+            void *tag = events[i].data.ptr;
+            if (tag == nullptr) {
+                accept_ready();
+            } else if (tag == &wake_fd_) {
+                uint64_t count;
+                ssize_t r = read(wake_fd_, &count, sizeof(count));
+                (void)r;
+                return;
+            } else {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                ready_.push_back(static_cast<Connection*>(tag));
+                queued = true;
+            }
+        }
+        if (queued) queue_cv_.notify_all();
+    }
+}
+
+// Method: stop
+// Purpose: Signals the eventfd so that run() returns.
+void Reactor::stop() {
+    uint64_t one = 1;
+    ssize_t r = write(wake_fd_, &one, sizeof(one));
+    (void)r;
+}
+
+// Method: accept_ready
+// Purpose: Accepts pending clients. Once the connection cap is reached the
+//          listening socket is disarmed, so extra clients queue in the kernel
+//          backlog instead of being dropped.
+void Reactor::accept_ready() {
+    std::lock_guard<std::mutex> lock(accept_mutex_);
+    while (true) {
+        if (active_.load() >= max_connections_) {
+            set_accepting(false);
+            return;
+        }
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+
+        Connection *c = new Connection(fd);
+        conns_.insert(c);
+        ++active_;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = c;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            conns_.erase(c);
+            --active_;
+            close(fd);
+            delete c;
+        }
+    }
+}
+
+// Method: set_accepting
+// Purpose: Arms or disarms the listening socket. Caller holds accept_mutex_.
+void Reactor::set_accepting(bool on) {
+    if (accepting_ == on) return;
+    epoll_event ev{};
+    ev.events = on ? static_cast<uint32_t>(EPOLLIN) : 0u;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, listen_fd_, &ev);
+    accepting_ = on;
+}
+
+// Method: worker_loop
+// Purpose: Body of each worker thread.
+void Reactor::worker_loop() {
+    while (true) {
+        Connection *c;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return stopping_ || !ready_.empty(); });
+            if (stopping_) return;
+            c = ready_.front();
+            ready_.pop_front();
+        }
+        service(c);
+    }
+}
+
+// Method: service
+// Purpose: Answers the frames received on a connection, in order, reading more
+//          until the socket is drained. Replies are sent as they accumulate, so
+//          a client with many requests in flight starts getting answers before
+//          the last one is read. When the peer does not read its replies and
+//          MAX_PENDING_OUTPUT bytes are queued, the connection stops reading
+//          and answering until EPOLLOUT, which bounds the memory a pipelining
+//          client can pin. The connection is re-armed afterwards, or closed
+//          when the peer is done and all output has been flushed.
+void Reactor::service(Connection *c) {
+    Bytes msg;
+    while (true) {
+        // A frame may span several reads, and one read may hold several frames
+        bool stalled;
+        try {
+            while (!(stalled = c->pending() >= MAX_PENDING_OUTPUT) && c->reader.next(msg)) {
+                queue(c, handler_(msg));
+                if (c->pending() >= READ_CHUNK && !flush(c)) {
+                    close_connection(c);
+                    return;
+                }
+            }
+        } catch (const std::exception &) {
+            close_connection(c);   // Oversized frame or handler failure
+            return;
+        }
+        if (!flush(c)) {
+            close_connection(c);
+            return;
+        }
+        if (c->pending() >= MAX_PENDING_OUTPUT) break;   // Wait for EPOLLOUT
+        if (stalled) continue;                           // The flush made room
+        if (c->eof) break;
+
+        ssize_t n = recv(c->fd, c->reader.prepare(READ_CHUNK), READ_CHUNK, 0);
+        if (n > 0) {
+            c->reader.commit(n);
+        } else if (n == 0) {
+            c->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(c);
+            return;
+        }
+    }
+
+    if (c->eof && c->out.empty()) {
+        close_connection(c);
+        return;
+    }
+    rearm(c);
+}
+
+// Method: queue
+// Purpose: Appends the length header and the reply's parts to the output. Owned
+//          parts are encrypted in place and moved in, or copied into the last
+//          segment when small, so a run of small replies goes out as one
+//          buffer; blob parts are queued by reference.
+// Throws:
+//   - runtime_error if the reply is larger than MAX_FRAME_SIZE.
+void Reactor::queue(Connection *c, Reply &&reply) {
+    size_t len = reply.size();
+    if (len > MAX_FRAME_SIZE) throw std::runtime_error("Frame too large");
+    auto append = [c](const uint8_t *data, size_t n) {
+        if (c->out.empty() || c->out.back().blob || c->out.back().end >= COALESCE_LIMIT)
+            c->out.push_back(Segment{Bytes(), nullptr, 0, 0, 0, 0});
+        Segment &s = c->out.back();
+        s.bytes.insert(s.bytes.end(), data, data + n);
+        s.end = s.bytes.size();
+    };
+    uint8_t header[FRAME_HEADER_SIZE] = {
+        uint8_t(len >> 24), uint8_t(len >> 16), uint8_t(len >> 8), uint8_t(len)};
+    append(header, sizeof(header));
+    for (Reply::Part &p : reply.parts()) {
+        if (p.blob) {
+            if (p.length) c->out.push_back(Segment{Bytes(), std::move(p.blob), p.offset, p.offset + p.length, p.offset, p.offset});
+            continue;
+        }
+        xor42_inplace(p.bytes.data(), p.bytes.size());
+        if (p.bytes.size() < COALESCE_LIMIT) {
+            append(p.bytes.data(), p.bytes.size());
+        } else {
+            size_t n = p.bytes.size();
+            c->out.push_back(Segment{std::move(p.bytes), nullptr, 0, n, 0, 0});
+        }
+    }
+    c->queued += FRAME_HEADER_SIZE + len;
+}
+
+// Method: flush
+// Purpose: Sends as much queued output as the socket accepts without blocking,
+//          gathering up to IOV_BATCH segments per sendmsg. The first blob
+//          segment in the batch is encrypted STAGE_SIZE bytes at a time into
+//          the connection's stage and sent from there, so stored content is
+//          read once, straight into a buffer that stays in cache, instead of
+//          being copied into the reply, then encrypted into a frame, then
+//          copied into the output buffer.
+// Returns:
+//   - false if the socket failed, true otherwise.
+bool Reactor::flush(Connection *c) {
+    while (!c->out.empty()) {
+        iovec iov[IOV_BATCH];
+        int n = 0;
+        for (Segment &s : c->out) {
+            if (n == IOV_BATCH) break;
+            if (!s.blob) {
+                iov[n].iov_base = s.bytes.data() + s.offset;
+                iov[n++].iov_len = s.end - s.offset;
+                continue;
+            }
+            if (s.offset == s.stage_end) {   // Stage the next piece
+                c->stage.resize(STAGE_SIZE);
+                s.stage_begin = s.offset;
+                s.stage_end = s.offset + std::min(STAGE_SIZE, s.end - s.offset);
+                xor42_copy(c->stage.data(), s.blob->data() + s.offset, s.stage_end - s.offset);
+            }
+            iov[n].iov_base = c->stage.data() + (s.offset - s.stage_begin);
+            iov[n++].iov_len = s.stage_end - s.offset;
+            break;                           // The stage holds one piece at a time
+        }
+
+        msghdr mh{};
+        mh.msg_iov = iov;
+        mh.msg_iovlen = n;
+        ssize_t sent = sendmsg(c->fd, &mh, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (sent <= 0) return false;
+
+        c->queued -= sent;
+        size_t left = static_cast<size_t>(sent);
+        while (left > 0) {
+            Segment &s = c->out.front();
+            size_t k = std::min(left, s.end - s.offset);
+            s.offset += k;
+            left -= k;
+            if (s.offset == s.end) c->out.pop_front();
+        }
+    }
+    if (!c->stage.empty()) Bytes().swap(c->stage);   // Idle connections keep no stage
+    return true;
+}
+
+// Method: rearm
+// Purpose: Waits for more input unless the output is backed up, and for
+//          writability while output is pending.
+void Reactor::rearm(Connection *c) {
+    epoll_event ev{};
+    ev.events = EPOLLONESHOT;
+    if (!c->eof && c->pending() < MAX_PENDING_OUTPUT) ev.events |= EPOLLIN | EPOLLRDHUP;
+    if (!c->out.empty()) ev.events |= EPOLLOUT;
+    ev.data.ptr = c;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->fd, &ev) < 0)
+        close_connection(c);
+}
+
+// Method: close_connection
+// Purpose: Closes a client socket, frees its state and re-arms the listening
+//          socket if it had been disarmed by the connection cap.
+void Reactor::close_connection(Connection *c) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+
+    std::lock_guard<std::mutex> lock(accept_mutex_);
+    conns_.erase(c);
+    delete c;
+    --active_;
+    if (active_.load() < max_connections_) set_accepting(true);
+}
@@ -0,0 +1,125 @@
+// File: reactor.hpp
+// Description: Header file for the event-driven connection core of the file server.
+//              A single epoll loop accepts non-blocking client sockets and hands
+//              readable connections to a pool of worker threads, which run the
+//              message handler and write the responses back.
+// Author: [Your Name]
+// Date: [Insert Date]
+
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "protocol.hpp"   // Bytes, Reply
+
+// Struct: Segment
+// Purpose: A piece of a connection's queued output: bytes already framed and
+//          encrypted, or a range of a shared blob that is encrypted as it is
+//          sent (see Reactor::flush).
+struct Segment {
+    Bytes bytes;         // Wire bytes, when blob is null
+    BlobRef blob;        // Plain content, when the segment refers to a blob
+    size_t offset;       // Start of the unsent data, in bytes or in blob
+    size_t end;          // End of the data, in bytes or in blob
+    size_t stage_begin;  // For a blob: range encrypted into the connection's
+    size_t stage_end;    //   stage; empty until the segment is first sent
+};
+
+// Struct: Connection
+// Purpose: Per-client state owned by the reactor. A connection is armed with
+//          EPOLLONESHOT, so at most one worker touches it at any time.
+struct Connection {
+    int fd;                   // Non-blocking client socket
+    FrameReader reader;       // Reassembles framed requests from received bytes
+    std::deque<Segment> out;  // Response data waiting to be sent, in order
+    size_t queued = 0;        // Bytes in `out` not yet sent
+    Bytes stage;              // Encrypted piece of the first blob segment
+    bool eof = false;         // Peer shut down its write side
+
+    explicit Connection(int fd_) : fd(fd_) {}
+
+    // Method: pending
+    // Returns:
+    //   - The number of response bytes queued but not yet sent.
+    size_t pending() const { return queued; }
+};
+
+// Class: Reactor
+// Purpose: Accepts clients on a listening socket and services them concurrently.
+//          The calling thread runs the epoll loop; `workers` threads read framed
+//          requests, call the handler once per frame and flush the framed
+//          replies. A client may send many requests without waiting; they are
+//          answered in order. At most `max_connections` clients are served at
+//          once; further clients wait in the listen backlog until a slot frees up.
+class Reactor {
+public:
+    // Type: Handler
+    // Purpose: Turns one received message payload into the reply payload,
+    //          which may refer to stored blobs instead of copying them.
+    using Handler = std::function<Reply(const Bytes &)>;
+
+    // Constructor
+    // Parameters:
+    //   - listen_fd: A bound, listening socket (made non-blocking here).
+    //   - max_connections: Maximum number of clients served at once (at least 1).
+    //   - workers: Number of worker threads (at least 1).
+    //   - handler: Called for every received message.
+    // Throws:
+    //   - std::runtime_error if epoll cannot be set up.
+    Reactor(int listen_fd, size_t max_connections, size_t workers, Handler handler);
+
+    // Destructor
+    // Purpose: Stops the workers and closes every open client connection.
+    ~Reactor();
+
+    // Method: run
+    // Purpose: Runs the event loop until stop() is called.
+    void run();
+
+    // Method: stop
+    // Purpose: Wakes the event loop and makes run() return. Only performs a
+    //          write(2), so it is safe to call from a signal handler.
+    void stop();
+
+    // Method: active_connections
+    // Returns:
+    //   - The number of clients currently being served.
+    size_t active_connections() const { return active_.load(); }
+
+private:
+    void accept_ready();                 // Accept clients until EAGAIN or the cap
+    void set_accepting(bool on);         // Enable or disable the listening socket
+    void worker_loop();                  // Pop ready connections and service them
+    void service(Connection *c);         // Read, handle, write, then re-arm or close
+    void queue(Connection *c, Reply &&reply); // Frame and encrypt a reply into c->out
+    bool flush(Connection *c);           // Send queued output; false on socket error
+    void rearm(Connection *c);           // Re-register a connection for its next event
+    void close_connection(Connection *c);
+
+    int listen_fd_;                      // Listening socket
+    int epoll_fd_;                       // epoll instance
+    int wake_fd_;                        // eventfd used by stop()
+    size_t max_connections_;             // Cap on concurrently served clients
+    Handler handler_;                    // Message handler
+
+    std::atomic<size_t> active_;         // Number of open client connections
+    bool accepting_;                     // Whether the listen socket is armed
+    std::mutex accept_mutex_;            // Guards accepting_ and conns_
+    std::unordered_set<Connection*> conns_; // All open connections
+
+    std::mutex queue_mutex_;             // Guards ready_ and stopping_
+    std::condition_variable queue_cv_;   // Signals workers when ready_ grows
+    std::deque<Connection*> ready_;      // Connections with pending events
+    bool stopping_;                      // Set when the workers should exit
+    std::vector<std::thread> workers_;   // Worker pool
+};
+
+#endif // REACTOR_HPP
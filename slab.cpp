@@ -0,0 +1,318 @@
+// File: slab.cpp
+// Description: Implementation of the size-class slab allocator.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "slab.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>     // mmap, munmap
+
+struct SizeClass;
+
+// Struct: Slab
+// Purpose: Header at the start of every slab; the blocks follow it. Slabs are
+//          aligned to SLAB_SIZE, so a block finds its slab by masking its
+//          address.
+struct Slab {
+    SizeClass *cls;            // Class the blocks belong to
+    Slab *prev, *next;         // Neighbours in the class's partial or evacuating list
+    void *free_list;           // Freed blocks, linked through their first word
+    uint32_t used;             // Blocks handed out
+    uint32_t fresh;            // Blocks never handed out start at this index
+    bool evacuating;           // On the evacuating list instead of the partial one
+    bool listed;               // On either list (full slabs are on neither)
+};
+
+// Struct: SizeClass
+// Purpose: The slabs of one block size. Slabs with a free block are kept on
+//          the partial list and new blocks come from its head.
+struct SizeClass {
+    std::mutex lock;           // Guards everything below and the slabs' headers
+    SlabPool *pool = nullptr;  // Owner of this class
+    size_t block = 0;          // Block size
+    uint32_t capacity = 0;     // Blocks per slab
+    Slab *partial = nullptr;   // Slabs with a free block
+    Slab *evacuating = nullptr; // Slabs being drained by a compaction
+    size_t slabs = 0;          // Slabs mapped
+    size_t used = 0;           // Blocks handed out
+};
+
+static constexpr size_t CLASS_COUNT = 41;   // 64 B, then four per doubling up to 64 KiB
+
+// Struct: SlabPool
+// Purpose: All size classes. It is shared by the allocator and its slabs, and
+//          deleted when the allocator is gone and the last slab is unmapped.
+struct SlabPool {
+    SizeClass classes[CLASS_COUNT];
+    std::atomic<size_t> refs{1};   // The allocator plus one per slab
+    bool orphaned = false;         // Set (under every class lock) by ~SlabAllocator
+};
+
+namespace {
+
+// Bytes reserved at the front of a block for the shared_ptr control block
+constexpr size_t CONTROL_ROOM = 32;
+// Offset of the content in a block
+constexpr size_t HEADER = (CONTROL_ROOM + sizeof(Blob) + 15) & ~size_t(15);
+// Offset of the first block in a slab
+constexpr size_t SLAB_HEADER = (sizeof(Slab) + 63) & ~size_t(63);
+
+// Function: class_index
+// Purpose: Picks the smallest class whose blocks hold `n` bytes. Above 64 the
+//          classes are 2^b + q * 2^(b-2) for q = 1..4.
+size_t class_index(size_t n) {
+    if (n <= SlabAllocator::MIN_BLOCK) return 0;
+    size_t b = 63 - __builtin_clzll(n - 1);              // 2^b < n <= 2^(b+1)
+    size_t step = size_t(1) << (b - 2);
+    size_t q = (n - (size_t(1) << b) + step - 1) / step;
+    return (b - 6) * 4 + q;
+}
+
+// Function: class_size
+// Purpose: Block size of class `i`; the inverse of class_index.
+size_t class_size(size_t i) {
+    if (i == 0) return SlabAllocator::MIN_BLOCK;
+    size_t b = 6 + (i - 1) / 4, q = (i - 1) % 4 + 1;
+    return (size_t(1) << b) + q * (size_t(1) << (b - 2));
+}
+
+// Function: slab_of
+// Returns:
+//   - The slab a block (or any address inside one) belongs to.
+Slab *slab_of(const void *p) {
+    return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(SlabAllocator::SLAB_SIZE - 1));
+}
+
+// Function: push / unlink
+// Purpose: Maintain a class's intrusive slab lists.
+void push(Slab *&head, Slab *s) {
+    s->prev = nullptr;
+    s->next = head;
+    if (head) head->prev = s;
+    head = s;
+    s->listed = true;
+}
+
+void unlink(Slab *&head, Slab *s) {
+    if (s->prev) s->prev->next = s->next;
+    else head = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->listed = false;
+}
+
+// Function: map_slab
+// Purpose: Maps SLAB_SIZE bytes aligned to SLAB_SIZE, by mapping twice that
+//          and trimming both ends.
+// Throws:
+//   - std::bad_alloc if the kernel refuses.
+Slab *map_slab() {
+    const size_t size = SlabAllocator::SLAB_SIZE;
+    void *p = mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = (start + size - 1) & ~uintptr_t(size - 1);
+    if (aligned > start) munmap(p, aligned - start);
+    if (aligned + size < start + 2 * size) munmap(reinterpret_cast<void *>(aligned + size), start + size - aligned);
+    return reinterpret_cast<Slab *>(aligned);
+}
+
+// Function: drop_ref
+// Purpose: Deletes the pool when neither the allocator nor a slab uses it.
+void drop_ref(SlabPool *pool) {
+    if (pool->refs.fetch_sub(1) == 1) delete pool;
+}
+
+// Function: allocate_block
+// Purpose: Takes a block from the head of the partial list, mapping a new
+//          slab if there is none.
+void *allocate_block(SizeClass &cls) {
+    std::lock_guard<std::mutex> guard(cls.lock);
+    Slab *s = cls.partial;
+    if (!s) {
+        s = map_slab();
+        s->cls = &cls;
+        s->free_list = nullptr;
+        s->used = s->fresh = 0;
+        s->evacuating = false;
+        push(cls.partial, s);
+        ++cls.slabs;
+        cls.pool->refs.fetch_add(1);
+    }
+    void *block;
+    if (s->free_list) {
+        block = s->free_list;
+        s->free_list = *static_cast<void **>(block);
+    } else {
+        block = reinterpret_cast<char *>(s) + SLAB_HEADER + s->fresh++ * cls.block;
+    }
+    ++cls.used;
+    if (++s->used == cls.capacity) unlink(cls.partial, s);
+    return block;
+}
+
+// Function: release_block
+// Purpose: Returns a block to its slab. An empty slab is unmapped unless it
+//          is its class's last one (kept to avoid mapping it again at once).
+void release_block(void *block) {
+    Slab *s = slab_of(block);
+    SizeClass &cls = *s->cls;
+    SlabPool *pool = cls.pool;
+    bool unmap = false;
+    {
+        std::lock_guard<std::mutex> guard(cls.lock);
+        *static_cast<void **>(block) = s->free_list;
+        s->free_list = block;
+        --cls.used;
+        --s->used;
+        if (s->used == 0 && (cls.slabs > 1 || s->evacuating || pool->orphaned)) {
+            if (s->listed) unlink(s->evacuating ? cls.evacuating : cls.partial, s);
+            --cls.slabs;
+            unmap = true;
+        } else if (!s->listed) {
+            push(cls.partial, s);       // Was full
+        }
+    }
+    if (unmap) {
+        munmap(s, SlabAllocator::SLAB_SIZE);
+        drop_ref(pool);
+    }
+}
+
+// Struct: DestroyBlob
+// Purpose: Deleter of a slab blob. It only ends the Blob's lifetime; the
+//          block is released with the control block, by BlockAllocator.
+struct DestroyBlob {
+    void operator()(const Blob *blob) const { blob->~Blob(); }
+};
+
+// Class: BlockAllocator
+// Purpose: Places a shared_ptr control block at the front of a slab block,
+//          and releases the block when the control block goes away (after
+//          the last shared and weak reference).
+template <typename T>
+struct BlockAllocator {
+    using value_type = T;
+    void *block;
+
+    explicit BlockAllocator(void *b) : block(b) {}
+    template <typename U>
+    BlockAllocator(const BlockAllocator<U> &other) : block(other.block) {}
+
+    T *allocate(size_t) {
+        static_assert(sizeof(T) <= CONTROL_ROOM, "Control block does not fit its room");
+        return static_cast<T *>(block);
+    }
+    void deallocate(T *, size_t) { release_block(block); }
+
+    template <typename U>
+    bool operator==(const BlockAllocator<U> &other) const { return block == other.block; }
+    template <typename U>
+    bool operator!=(const BlockAllocator<U> &other) const { return block != other.block; }
+};
+
+} // namespace
+
+// Constructor
+// Purpose: Sets up the size classes; no slab is mapped until it is needed.
+SlabAllocator::SlabAllocator() : pool_(new SlabPool) {
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        SizeClass &cls = pool_->classes[i];
+        cls.pool = pool_;
+        cls.block = class_size(i);
+        cls.capacity = static_cast<uint32_t>((SLAB_SIZE - SLAB_HEADER) / cls.block);
+    }
+}
+
+// Destructor
+// Purpose: Orphans the pool, unmapping each class's empty slab; the last
+//          slab to empty out afterwards deletes the pool.
+SlabAllocator::~SlabAllocator() {
+    for (SizeClass &cls : pool_->classes) {
+        Slab *empty = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(cls.lock);
+            pool_->orphaned = true;
+            for (Slab *s = cls.partial; s; s = s->next)
+                if (s->used == 0) empty = s;    // There is at most one
+            if (empty) {
+                unlink(cls.partial, empty);
+                --cls.slabs;
+            }
+        }
+        if (empty) {
+            munmap(empty, SLAB_SIZE);
+            drop_ref(pool_);
+        }
+    }
+    drop_ref(pool_);
+}
+
+// Method: make_blob
+// Purpose: Lays a block out as [control block | Blob | bytes] and hands the
+//          shared_ptr an allocator that returns the block's front.
+BlobRef SlabAllocator::make_blob(const uint8_t *data, size_t len, size_t decoded_size) {
+    if (len > MAX_BLOCK - HEADER) return ::make_blob(std::vector<uint8_t>(data, data + len), decoded_size);
+    uint8_t *block = static_cast<uint8_t *>(allocate_block(pool_->classes[class_index(HEADER + len)]));
+    uint8_t *bytes = block + HEADER;
+    if (len) std::memcpy(bytes, data, len);
+    const Blob *blob = new (block + CONTROL_ROOM) Blob(nullptr, bytes, len, decoded_size);
+    return BlobRef(blob, DestroyBlob(), BlockAllocator<Blob>(block));
+}
+
+// Method: stats
+// Purpose: Sums the classes, locking each in turn.
+SlabAllocator::Stats SlabAllocator::stats() const {
+    Stats st;
+    for (SizeClass &cls : pool_->classes) {
+        std::lock_guard<std::mutex> guard(cls.lock);
+        st.slabs += cls.slabs;
+        st.in_use += cls.used * cls.block;
+    }
+    st.mapped = st.slabs * SLAB_SIZE;
+    return st;
+}
+
+// Method: begin_compaction
+// Purpose: Moves the sparse slabs of each class from its partial list to its
+//          evacuating list, and records their addresses for evacuating().
+size_t SlabAllocator::begin_compaction(double max_fill) {
+    size_t marked = 0;
+    for (SizeClass &cls : pool_->classes) {
+        std::lock_guard<std::mutex> guard(cls.lock);
+        if (cls.slabs < 2) continue;
+        for (Slab *s = cls.partial, *next; s; s = next) {
+            next = s->next;
+            if (s->used >= max_fill * cls.capacity) continue;
+            unlink(cls.partial, s);
+            push(cls.evacuating, s);
+            s->evacuating = true;
+            marked_.insert(reinterpret_cast<uintptr_t>(s));
+            ++marked;
+        }
+    }
+    return marked;
+}
+
+// Method: evacuating
+// Purpose: Looks the blob's slab address up without touching the slab, since
+//          the blob may not come from a slab at all.
+bool SlabAllocator::evacuating(const Blob *blob) const {
+    return !marked_.empty() && marked_.count(reinterpret_cast<uintptr_t>(slab_of(blob)));
+}
+
+// Method: end_compaction
+// Purpose: Puts the slabs that did not drain back on their partial lists.
+void SlabAllocator::end_compaction() {
+    for (SizeClass &cls : pool_->classes) {
+        std::lock_guard<std::mutex> guard(cls.lock);
+        while (Slab *s = cls.evacuating) {
+            unlink(cls.evacuating, s);
+            s->evacuating = false;
+            push(cls.partial, s);
+        }
+    }
+    marked_.clear();
+}
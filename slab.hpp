@@ -0,0 +1,95 @@
+// File: slab.hpp
+// Description: Header file for the size-class slab allocator that holds stored
+//              file bodies. Bodies of similar size share 1 MiB slabs mapped
+//              straight from the kernel, so replacing a file reuses a block of
+//              the same class instead of fragmenting the general heap, and a
+//              slab whose blocks are all free goes back to the kernel.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+
+#include "blob.hpp"   // Blob, BlobRef
+
+struct SlabPool;      // Size classes and their slabs (slab.cpp)
+
+// Class: SlabAllocator
+// Purpose: Copies file bodies into blocks carved from per-size-class slabs.
+//          There are four classes per power of two between MIN_BLOCK and
+//          MAX_BLOCK, so a block wastes at most a fifth of its size. A block
+//          holds the blob's reference counts, the Blob and the bytes, so a
+//          stored body costs no general heap allocation at all; bodies too
+//          large for a class are still allocated on the heap.
+//
+//          Blocks freed at random leave slabs partly empty. compact() support
+//          lets the owner move the bodies out of sparse slabs, so that those
+//          slabs can be unmapped once readers drop their old references.
+class SlabAllocator {
+public:
+    static constexpr size_t SLAB_SIZE = 1 << 20;   // Bytes per slab (and its alignment)
+    static constexpr size_t MIN_BLOCK = 64;        // Smallest block
+    static constexpr size_t MAX_BLOCK = 64 << 10;  // Largest block
+
+    // Struct: Stats
+    // Purpose: Memory held by the allocator.
+    struct Stats {
+        size_t slabs = 0;        // Slabs mapped
+        size_t mapped = 0;       // Bytes mapped for them
+        size_t in_use = 0;       // Bytes of blocks handed out
+    };
+
+    SlabAllocator();
+
+    // Destructor
+    // Purpose: Unmaps the empty slabs. Slabs still holding blobs stay mapped
+    //          until the last of those blobs is released.
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator &) = delete;
+    SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+    // Method: make_blob
+    // Purpose: Copies a byte range into a new blob.
+    // Parameters:
+    //   - data, len: The content.
+    //   - decoded_size: As for the Blob constructor.
+    // Returns:
+    //   - A blob in a slab block, or on the heap if it is too large for one.
+    // Throws:
+    //   - std::bad_alloc if a new slab cannot be mapped.
+    BlobRef make_blob(const uint8_t *data, size_t len, size_t decoded_size = 0);
+
+    // Method: stats
+    // Returns:
+    //   - The slabs mapped and the bytes handed out from them.
+    Stats stats() const;
+
+    // Method: begin_compaction
+    // Purpose: Marks the slabs less than `max_fill` full as evacuating, in
+    //          every class that has more than one slab. New blocks are never
+    //          taken from an evacuating slab, so moving its blobs elsewhere
+    //          lets it drain. Only one compaction may run at a time.
+    // Returns:
+    //   - The number of slabs marked.
+    size_t begin_compaction(double max_fill);
+
+    // Method: evacuating
+    // Returns:
+    //   - Whether the blob lives in a slab marked by begin_compaction.
+    bool evacuating(const Blob *blob) const;
+
+    // Method: end_compaction
+    // Purpose: Returns the slabs that still hold blobs to normal use.
+    void end_compaction();
+
+private:
+    SlabPool *pool_;                        // Shared with the slabs
+    std::unordered_set<uintptr_t> marked_;  // Evacuating slab addresses
+};
+
+#endif // SLAB_HPP
@@ -0,0 +1,145 @@
+// File: snapshot.cpp
+// Description: Implementation of fork-based background snapshots.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "snapshot.hpp"
+#include "persist.hpp"    // write_frozen_store_file
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>       // fork, _exit
+#include <sys/wait.h>     // waitpid
+
+// Constructor
+// Purpose: Records the configuration and starts the background thread.
+Snapshotter::Snapshotter(const std::string &path, FileServerMap &store, WriteAheadLog *wal,
+                         unsigned interval_s)
+  : path_(path), store_(store), wal_(wal), interval_s_(interval_s) {
+    thread_ = std::thread(&Snapshotter::run, this);
+}
+
+// Destructor
+// Purpose: Stops the thread, then lets a running snapshot finish.
+Snapshotter::~Snapshotter() {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+    std::lock_guard<std::mutex> guard(lock_);
+    reap(true);
+}
+
+// Method: start
+// Purpose: Freezes the store, forks, and thaws it again in the parent. The
+//          child only streams its copy of the store to disk and exits; it
+//          never returns into the server.
+bool Snapshotter::start() {
+    std::lock_guard<std::mutex> guard(lock_);
+    reap(false);
+    if (child_ > 0) return false;
+
+    pid_t pid = -1;
+    auto fork_writer = [this, &pid] {
+        store_.freeze();                 // No writer is mid-update at the fork
+        store_.pin_spill();              // The child reads spilled bodies
+        pid = fork();
+        if (pid == 0) {
+            int status = 0;
+            try {
+                write_frozen_store_file(path_, store_);
+            } catch (const std::exception &) {
+                status = 1;
+            }
+            _exit(status);
+        }
+        int err = errno;
+        if (pid < 0) store_.unpin_spill();
+        store_.thaw();
+        if (pid < 0) throw std::runtime_error(std::string("Cannot fork snapshot: ") + strerror(err));
+    };
+    uint64_t segment = 0;
+    if (wal_) {
+        segment = wal_->rotate(fork_writer);
+    } else {
+        fork_writer();
+    }
+    child_ = pid;
+    segment_ = segment;
+    wake_.notify_all();                  // Start polling for the child
+    return true;
+}
+
+// Method: wait
+// Purpose: Reaps the running child, blocking until it exits.
+bool Snapshotter::wait() {
+    std::lock_guard<std::mutex> guard(lock_);
+    reap(true);
+    return !failed_;
+}
+
+// Method: completed
+// Purpose: Reports how many snapshots were written.
+uint64_t Snapshotter::completed() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return completed_;
+}
+
+// Method: reap
+// Purpose: waitpid on the child; on success the log segments it covers are no
+//          longer needed for recovery. On failure they are kept, and the next
+//          snapshot covers them instead.
+void Snapshotter::reap(bool block) {
+    if (child_ <= 0) return;
+    int status = 0;
+    pid_t r;
+    do {
+        r = waitpid(child_, &status, block ? 0 : WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) return;                  // Still writing
+    bool ok = r == child_ && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    child_ = -1;
+    store_.unpin_spill();
+    failed_ = !ok;
+    if (!ok) {
+        std::cerr << "ERROR: Snapshot to '" << path_ << "' failed" << std::endl;
+        return;
+    }
+    ++completed_;
+    if (wal_) wal_->drop_segments(segment_);
+}
+
+// Method: run
+// Purpose: Polls a running child every 50 ms and starts a snapshot whenever
+//          the interval has passed; otherwise sleeps until one of those is due.
+void Snapshotter::run() {
+    using clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> guard(lock_);
+    clock::time_point due = clock::now() + std::chrono::seconds(interval_s_);
+    while (!stopping_) {
+        if (child_ > 0) {
+            wake_.wait_for(guard, std::chrono::milliseconds(50));
+        } else if (interval_s_) {
+            wake_.wait_until(guard, due);
+        } else {
+            wake_.wait(guard);
+        }
+        if (stopping_) break;
+        reap(false);
+        if (interval_s_ && clock::now() >= due) {
+            due = clock::now() + std::chrono::seconds(interval_s_);
+            guard.unlock();
+            try {
+                start();
+            } catch (const std::exception &e) {
+                std::cerr << "ERROR: " << e.what() << std::endl;
+            }
+            guard.lock();
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// File: snapshot.hpp
+// Description: Header file for background snapshots of the file store. A
+//              snapshot forks the server: the child inherits a copy-on-write
+//              image of the store and streams it to the persistence file while
+//              the parent keeps serving, so writing a large store never blocks
+//              requests for longer than the fork itself.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <sys/types.h>   // pid_t
+
+#include "hashmap.hpp"   // FileServerMap
+#include "wal.hpp"       // WriteAheadLog
+
+// Class: Snapshotter
+// Purpose: Starts snapshots on request or every `interval_s` seconds, and reaps
+//          the child that writes each one. With a write-ahead log, the log is
+//          rotated at the moment of the fork, so the live log only ever holds
+//          what happened since the last snapshot began; the rotated segment is
+//          deleted once the child has renamed the new snapshot into place.
+class Snapshotter {
+public:
+    // Constructor
+    // Purpose: Starts the background thread that reaps children and runs the
+    //          periodic trigger.
+    // Parameters:
+    //   - path: The persistence file to replace.
+    //   - store: The store to snapshot.
+    //   - wal: The write-ahead log to rotate, or nullptr.
+    //   - interval_s: Seconds between periodic snapshots (0 disables them).
+    Snapshotter(const std::string &path, FileServerMap &store, WriteAheadLog *wal,
+                unsigned interval_s);
+
+    // Destructor
+    // Purpose: Stops the background thread and waits for a running child.
+    ~Snapshotter();
+
+    Snapshotter(const Snapshotter &) = delete;
+    Snapshotter &operator=(const Snapshotter &) = delete;
+
+    // Method: start
+    // Purpose: Forks a child to write a snapshot, unless one is already running.
+    //          The store is frozen (and the log quiesced) only for the fork.
+    // Returns:
+    //   - false if a snapshot is already in progress.
+    // Throws:
+    //   - std::runtime_error if the log cannot be rotated or fork fails.
+    bool start();
+
+    // Method: wait
+    // Purpose: Blocks until the running snapshot, if any, has finished.
+    // Returns:
+    //   - false if the last snapshot failed.
+    bool wait();
+
+    // Method: completed
+    // Returns:
+    //   - The number of snapshots written successfully.
+    uint64_t completed() const;
+
+private:
+    // Method: reap
+    // Purpose: Collects the child if it has exited (blocking if `block`), and
+    //          drops the log segment its snapshot covers. Called with lock_ held.
+    void reap(bool block);
+
+    // Method: run
+    // Purpose: Body of the background thread.
+    void run();
+
+    std::string path_;               // Persistence file
+    FileServerMap &store_;           // Store to snapshot
+    WriteAheadLog *wal_;             // Log to rotate, or nullptr
+    unsigned interval_s_;            // Period of automatic snapshots
+
+    mutable std::mutex lock_;        // Guards the fields below
+    pid_t child_ = -1;               // Running snapshot writer, or -1
+    uint64_t segment_ = 0;           // Log segment the running snapshot covers
+    uint64_t completed_ = 0;         // Successful snapshots
+    bool failed_ = false;            // Whether the last snapshot failed
+    bool stopping_ = false;          // Set by the destructor
+    std::condition_variable wake_;   // Wakes the background thread
+    std::thread thread_;             // Reaper and periodic trigger
+};
+
+#endif // SNAPSHOT_HPP
@@ -0,0 +1,131 @@
+// File: spill.cpp
+// Description: Implementation of the spill file.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "spill.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>        // open, fallocate
+#include <unistd.h>       // pread, pwrite, close, unlink
+
+// Constructor
+// Purpose: Opens the file empty; anything left from an earlier run is stale.
+SpillFile::SpillFile(const std::string &path) : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) throw std::runtime_error("Cannot open spill file '" + path + "': " + strerror(errno));
+}
+
+// Destructor
+// Purpose: The bodies in the file are copies, so it is simply deleted.
+SpillFile::~SpillFile() {
+    ::close(fd_);
+    ::unlink(path_.c_str());
+}
+
+// Method: extent_size
+// Purpose: Rounds small bodies up to a power of two and large ones to blocks.
+size_t SpillFile::extent_size(size_t len) {
+    if (len > BLOCK / 2) return (len + BLOCK - 1) & ~(BLOCK - 1);
+    size_t size = SMALL_MIN;
+    while (size < len) size *= 2;
+    return size;
+}
+
+// Method: write
+// Purpose: Takes a small extent from its free list (carving a fresh block
+//          into extents when the list is empty) or appends a large one, then
+//          writes the body there without holding the lock.
+uint64_t SpillFile::write(const uint8_t *data, size_t len) {
+    size_t size = extent_size(len);
+    uint64_t offset;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (size < BLOCK) {
+            std::vector<uint64_t> &list = free_[__builtin_ctzll(size / SMALL_MIN)];
+            if (list.empty()) {
+                for (size_t k = BLOCK / size; k-- > 0;) list.push_back(end_ + k * size);
+                end_ += BLOCK;
+            }
+            offset = list.back();
+            list.pop_back();
+        } else {
+            offset = end_;
+            end_ += size;
+        }
+        in_use_ += size;
+    }
+    for (size_t done = 0; done < len;) {
+        ssize_t n = ::pwrite(fd_, data + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            std::string err = strerror(errno);
+            release(offset, len);
+            throw std::runtime_error("Cannot write spill file '" + path_ + "': " + err);
+        }
+        done += n;
+    }
+    return offset;
+}
+
+// Method: read
+// Purpose: pread until the whole body is in.
+void SpillFile::read(uint64_t offset, uint8_t *out, size_t len) const {
+    for (size_t done = 0; done < len;) {
+        ssize_t n = ::pread(fd_, out + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Cannot read spill file '" + path_ + "': " +
+                                             (n < 0 ? strerror(errno) : "short file"));
+        done += n;
+    }
+}
+
+// Method: release
+// Purpose: Frees the extent now, or queues it while a snapshot is running.
+void SpillFile::release(uint64_t offset, size_t len) {
+    std::lock_guard<std::mutex> guard(lock_);
+    in_use_ -= extent_size(len);
+    if (pins_) {
+        deferred_.push_back(std::make_pair(offset, len));
+    } else {
+        free_extent(offset, len);
+    }
+}
+
+// Method: free_extent
+// Purpose: Small extents are reused as they are; large ones give their blocks
+//          back to the file system. A file system without hole punching just
+//          keeps them allocated.
+void SpillFile::free_extent(uint64_t offset, size_t len) {
+    size_t size = extent_size(len);
+    if (size < BLOCK) {
+        free_[__builtin_ctzll(size / SMALL_MIN)].push_back(offset);
+    } else {
+        fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+    }
+}
+
+// Method: pin
+// Purpose: Counts a reader of the current extents.
+void SpillFile::pin() {
+    std::lock_guard<std::mutex> guard(lock_);
+    ++pins_;
+}
+
+// Method: unpin
+// Purpose: Frees the queued extents once the last pin is gone.
+void SpillFile::unpin() {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (pins_ == 0 || --pins_ > 0) return;
+    for (const std::pair<uint64_t, size_t> &e : deferred_) free_extent(e.first, e.second);
+    deferred_.clear();
+}
+
+// Method: bytes_in_use
+// Purpose: Reports the live extents' size.
+uint64_t SpillFile::bytes_in_use() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return in_use_;
+}
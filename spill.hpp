@@ -0,0 +1,99 @@
+// File: spill.hpp
+// Description: Header file for the spill file, the disk tier that holds the
+//              bodies a memory-bounded FileServerMap evicts. The file is only
+//              a cache: it is created empty at startup and removed on exit,
+//              while durability stays with the snapshot and the log.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef SPILL_HPP
+#define SPILL_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Class: SpillFile
+// Purpose: Hands out extents of one file and reads and writes bodies there.
+//          Bodies of up to 2 KiB get power-of-two extents that are reused
+//          through per-size free lists; larger ones are appended in whole
+//          4 KiB blocks and punched out of the file when freed, so the disk
+//          space used follows the bodies actually spilled. All methods are
+//          thread-safe; the disk I/O itself runs outside the lock.
+class SpillFile {
+public:
+    // Constructor
+    // Purpose: Creates (or truncates) the spill file.
+    // Parameters:
+    //   - path: Where to put it.
+    // Throws:
+    //   - std::runtime_error if the file cannot be created.
+    explicit SpillFile(const std::string &path);
+
+    // Destructor
+    // Purpose: Closes and removes the file.
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    // Method: write
+    // Purpose: Copies a body into a new extent.
+    // Parameters:
+    //   - data, len: The body.
+    // Returns:
+    //   - The extent's offset; free it with release(offset, len).
+    // Throws:
+    //   - std::runtime_error on a write error (the extent is freed again).
+    uint64_t write(const uint8_t *data, size_t len);
+
+    // Method: read
+    // Purpose: Reads a body back. The extent must not be released meanwhile.
+    // Throws:
+    //   - std::runtime_error on a read error or a short file.
+    void read(uint64_t offset, uint8_t *out, size_t len) const;
+
+    // Method: release
+    // Purpose: Frees an extent written with `len` bytes. While the file is
+    //          pinned the extent is only queued, and freed by unpin().
+    void release(uint64_t offset, size_t len);
+
+    // Method: pin / unpin
+    // Purpose: Keep released extents from being reused or punched, for as long
+    //          as a forked snapshot may still read the bodies that were there.
+    void pin();
+    void unpin();
+
+    // Method: bytes_in_use
+    // Returns:
+    //   - The bytes of all extents currently handed out.
+    uint64_t bytes_in_use() const;
+
+private:
+    static constexpr size_t BLOCK = 4096;        // Unit of large extents
+    static constexpr size_t SMALL_MIN = 64;      // Smallest extent
+    static constexpr size_t SMALL_CLASSES = 6;   // 64 B .. 2 KiB
+
+    // Method: extent_size
+    // Returns:
+    //   - The bytes taken by an extent for a `len`-byte body.
+    static size_t extent_size(size_t len);
+
+    // Method: free_extent
+    // Purpose: Returns an extent to its free list, or punches it out of the
+    //          file. Called with lock_ held.
+    void free_extent(uint64_t offset, size_t len);
+
+    std::string path_;                            // File name, removed on close
+    int fd_;                                      // Open spill file
+    mutable std::mutex lock_;                     // Guards the fields below
+    uint64_t end_ = 0;                            // End of the allocated region
+    uint64_t in_use_ = 0;                         // Bytes of live extents
+    std::vector<uint64_t> free_[SMALL_CLASSES];   // Free small extents by class
+    unsigned pins_ = 0;                           // Running pin() holders
+    std::vector<std::pair<uint64_t, size_t>> deferred_; // Released while pinned
+};
+
+#endif // SPILL_HPP
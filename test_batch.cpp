@@ -0,0 +1,146 @@
+// File: test_batch.cpp
+// Description: Batch test for the file server. Stores many small files with
+//              MultiFile messages and reads them back with MultiRequest messages
+//              (plus one name that does not exist per batch), checks every item
+//              and its status, and compares the rate with one file per message.
+//              Finally checks that a batch too large to answer fails cleanly.
+//              Usage: test_batch [--hostname ip:port] [--files N] [--batch B]
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "protocol.hpp"  // for MultiFileMessage, MultiRequestMessage, MultiStatusMessage, StatusMessage, framing
+
+// Function: name_of / body_of
+// Returns:
+//   - The name and content of file number i.
+static std::string name_of(size_t i) {
+    return "batch_" + std::to_string(i) + ".txt";
+}
+
+static Bytes body_of(size_t i) {
+    std::string body = "batched payload " + std::to_string(i);
+    return Bytes(body.begin(), body.end());
+}
+
+// Function: exchange
+// Purpose: Sends one message and reads its reply.
+// Throws:
+//   - runtime_error if the socket fails.
+static Bytes exchange(int sock, const Bytes &msg) {
+    Bytes reply;
+    if (!send_frame(sock, msg) || !recv_frame(sock, reply)) throw std::runtime_error("Connection failed");
+    return reply;
+}
+
+// Function: seconds_since
+// Returns:
+//   - The time elapsed since `start`, in seconds.
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const char *hostname = "127.0.0.1"; // Server hostname or IP address
+    int port = 8081;                    // Server port
+    size_t files = 1000;                // Files stored and requested
+    size_t batch = 100;                 // Files per batch message
+
+    std::string host_arg;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--hostname") == 0 || strcmp(argv[i], "-h") == 0) && i + 1 < argc) {
+            host_arg = argv[++i];
+            auto colon = host_arg.find(':');
+            if (colon == std::string::npos) {
+                std::cerr << "Invalid hostname format, use IP:PORT\n";
+                return 1;
+            }
+            port = std::atoi(host_arg.c_str() + colon + 1);
+            host_arg.resize(colon);
+            hostname = host_arg.c_str();
+        } else if ((strcmp(argv[i], "--files") == 0 || strcmp(argv[i], "-n") == 0) && i + 1 < argc) {
+            files = std::strtoul(argv[++i], nullptr, 10);
+        } else if ((strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "-b") == 0) && i + 1 < argc) {
+            batch = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+    if (batch == 0) batch = 1;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    inet_pton(AF_INET, hostname, &addr.sin_addr);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    size_t stored = 0, fetched = 0, missing = 0, single = 0, overflow = 0;
+    try {
+        // 1. Store every file, `batch` per MultiFile
+        auto start = std::chrono::steady_clock::now();
+        for (size_t first = 0; first < files; first += batch) {
+            MultiFileMessage mf;
+            for (size_t i = first; i < std::min(files, first + batch); ++i)
+                mf.files.push_back({name_of(i), true, body_of(i), ""});
+            MultiStatusMessage ms = MultiStatusMessage::deserialize(exchange(sock, mf.serialize()));
+            for (size_t k = 0; k < ms.results.size(); ++k)
+                if (ms.results[k].ok && ms.results[k].name == name_of(first + k)) ++stored;
+        }
+        double store_secs = seconds_since(start);
+
+        // 2. Request them back, with one missing name per batch
+        start = std::chrono::steady_clock::now();
+        for (size_t first = 0; first < files; first += batch) {
+            std::vector<std::string> names;
+            for (size_t i = first; i < std::min(files, first + batch); ++i) names.push_back(name_of(i));
+            names.push_back("batch_missing.txt");
+            MultiFileMessage mf = MultiFileMessage::deserialize(exchange(sock, MultiRequestMessage(names).serialize()));
+            if (mf.files.size() != names.size()) continue;
+            for (size_t k = 0; k + 1 < names.size(); ++k)
+                if (mf.files[k].ok && mf.files[k].name == names[k] && mf.files[k].data == body_of(first + k)) ++fetched;
+            if (!mf.files.back().ok) ++missing;
+        }
+        double fetch_secs = seconds_since(start);
+
+        // 3. The same reads one Request per file, for comparison
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < files; ++i)
+            if (FileMessage::deserialize(exchange(sock, RequestMessage(name_of(i)).serialize())).data == body_of(i)) ++single;
+        double single_secs = seconds_since(start);
+
+        // 4. A batch whose reports alone would not fit in one frame fails with
+        //    one Status rather than an oversized reply
+        std::vector<std::string> absent;
+        for (size_t i = 0; i < 9000; ++i) absent.push_back(std::string(1000, 'x') + std::to_string(i));
+        StatusMessage status = StatusMessage::deserialize(exchange(sock, MultiRequestMessage(absent).serialize()));
+        if (!status.ok) ++overflow;
+
+        std::cout << "Stored  " << stored << "/" << files << " files in batches of " << batch << ": "
+                  << files / store_secs << " files/sec\n";
+        std::cout << "Fetched " << fetched << "/" << files << " files in batches of " << batch << ": "
+                  << files / fetch_secs << " files/sec\n";
+        std::cout << "Fetched " << single << "/" << files << " files one per message: "
+                  << files / single_secs << " files/sec\n";
+        std::cout << "Oversized batch " << (overflow ? "rejected" : "not rejected") << "\n";
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+    }
+    close(sock);
+
+    size_t batches = (files + batch - 1) / batch;
+    return (stored == files && fetched == files && single == files && missing == batches &&
+            overflow == 1) ? 0 : 1;
+}
@@ -2,6 +2,7 @@
 // Description: Implementation of a client application for communicating with a server
 //              using the defined protocol. The client sends a file message to the server,
 //              receives a response, and processes the response using encryption and serialization.
+//              It then checks that the same file sent "lz" encoded is refused.
 // Author: Logan Scheetz
 // Date: 5/12/25
 
@@ -11,7 +12,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
-#include "protocol.hpp"  // for FileMessage, RequestMessage, StatusMessage, xor42
+#include "protocol.hpp"  // for FileMessage, RequestMessage, StatusMessage, framing
 #include "pack109.hpp"   // for serialize_map, Bytes
 
 int main(int argc, char *argv[]) {
@@ -32,10 +33,6 @@ int main(int argc, char *argv[]) {
     // Convert the FileMessage into a serialized byte buffer.
     auto serialized = fm.serialize();
 
-    // 4. Encrypt
-    // Encrypt the serialized data using XOR-42 encryption.
-    auto encrypted = xor42(serialized);
-
     // --- Socket setup ---
     // Create a socket for TCP communication.
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -58,36 +55,32 @@ int main(int argc, char *argv[]) {
     }
     std::cout << "Connected!\n";
 
-    // 5. Send FileMessage
-    // Send the encrypted FileMessage to the server.
-    send(sock, encrypted.data(), encrypted.size(), 0);
+    // 4. Send FileMessage
+    // Send the FileMessage to the server as one length-prefixed frame;
+    // send_frame applies the XOR-42 encryption while framing it.
+    send_frame(sock, serialized);
 
-    // 5a. Signal end of write to server
+    // 5. Signal end of write to server
     // Indicate that the client has finished sending data.
     shutdown(sock, SHUT_WR);
 
     // 6. Receive response
-    // Read the response from the server into a buffer.
+    // Read one framed response from the server into a buffer.
     std::vector<uint8_t> resp_buf;
-    uint8_t tmp[4096];
-    ssize_t n;
-    while ((n = recv(sock, tmp, sizeof(tmp), 0)) > 0) {
-        resp_buf.insert(resp_buf.end(), tmp, tmp + n); // Append received data to response buffer
-    }
+    bool got = recv_frame(sock, resp_buf);
     close(sock); // Close the socket after receiving the response
 
-    if (n < 0) {
-        perror("recv");
+    if (!got) {
+        std::cerr << "recv: connection closed before a full response arrived\n";
         return 1; // Exit if receiving data fails
     }
 
-    std::cout << "Got " << resp_buf.size() << " bytes encrypted back\n";
+    std::cout << "Received " << resp_buf.size() << " bytes back\n";
 
-    // 7. Decrypt and deserialize StatusMessage
-    // Decrypt the response and attempt to parse it as a StatusMessage.
-    auto resp_dec = xor42(resp_buf);
+    // 7. Deserialize StatusMessage
+    // recv_frame already decrypted the response; parse it as a StatusMessage.
     try {
-        auto status = StatusMessage::deserialize(resp_dec);
+        auto status = StatusMessage::deserialize(resp_buf);
         std::cout << "Server responded: " 
                   << (status.ok ? "OK" : "ERROR")
                   << " – " << status.message << "\n";
@@ -95,5 +88,28 @@ int main(int argc, char *argv[]) {
         std::cerr << "Failed to parse status: " << e.what() << "\n";
     }
 
+    // 8. Send the file again, labelled "lz" encoded
+    // The server stores plain content only, so it must refuse an encoded File
+    // rather than store the encoded bytes as if they were the content.
+    Bytes encoded;
+    FileMessage::encode(encoded, filename, file_data.data(), file_data.size(), "lz", file_data.size());
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        perror("connect");
+        if (sock >= 0) close(sock);
+        return 1;
+    }
+    got = send_frame(sock, encoded) && recv_frame(sock, resp_buf);
+    close(sock);
+    try {
+        if (!got) throw std::runtime_error("connection closed before a full response arrived");
+        auto status = StatusMessage::deserialize(resp_buf);
+        std::cout << "Encoded file: " << (status.ok ? "OK" : "ERROR") << " – " << status.message << "\n";
+        if (status.ok) return 1;
+    } catch (const std::exception &e) {
+        std::cerr << "Encoded file: " << e.what() << "\n";
+        return 1;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+// File: test_concurrency.cpp
+// Description: Throughput test for the multi-connection server. Opens hundreds of
+//              client sockets at once, stores one file over each of them, then
+//              requests every file back over another batch of sockets, and reports
+//              the achieved message rate.
+//              Usage: test_concurrency [--hostname ip:port] [--connections N]
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "protocol.hpp"  // for FileMessage, RequestMessage, StatusMessage, framing
+
+// Function: open_socket
+// Purpose: Connects a new TCP socket to the server.
+// Returns:
+//   - The socket descriptor, or -1 on failure.
+static int open_socket(const sockaddr_in &addr) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Function: run_batch
+// Purpose: Opens one socket per message, sends every message before reading any
+//          reply, and validates each reply.
+// Parameters:
+//   - addr: Server address.
+//   - msgs: The serialized messages to send, one per connection.
+//   - check: Returns true if a reply is the expected one.
+// Returns:
+//   - The number of replies that passed the check.
+template <typename Check>
+static size_t run_batch(const sockaddr_in &addr, const std::vector<Bytes> &msgs, Check check) {
+    std::vector<int> socks;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        int sock = open_socket(addr);
+        if (sock < 0) {
+            perror("connect");
+            break;
+        }
+        socks.push_back(sock);
+    }
+
+    // Every connection is open before the first request goes out
+    for (size_t i = 0; i < socks.size(); ++i) {
+        send_frame(socks[i], msgs[i]);
+    }
+
+    size_t ok = 0;
+    for (size_t i = 0; i < socks.size(); ++i) {
+        Bytes reply;
+        bool got = recv_frame(socks[i], reply);
+        close(socks[i]);
+        try {
+            if (got && check(i, reply)) ++ok;
+        } catch (const std::exception &) {}
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char *hostname = "127.0.0.1"; // Server hostname or IP address
+    int port = 8081;                    // Server port
+    size_t connections = 300;           // Concurrent sockets per batch
+
+    std::string host_arg;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--hostname") == 0 || strcmp(argv[i], "-h") == 0) && i + 1 < argc) {
+            host_arg = argv[++i];
+            auto colon = host_arg.find(':');
+            if (colon == std::string::npos) {
+                std::cerr << "Invalid hostname format, use IP:PORT\n";
+                return 1;
+            }
+            port = std::atoi(host_arg.c_str() + colon + 1);
+            host_arg.resize(colon);
+            hostname = host_arg.c_str();
+        } else if ((strcmp(argv[i], "--connections") == 0 || strcmp(argv[i], "-c") == 0) && i + 1 < argc) {
+            connections = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    inet_pton(AF_INET, hostname, &addr.sin_addr);
+
+    // 1. One File message per connection
+    std::vector<Bytes> puts, gets;
+    for (size_t i = 0; i < connections; ++i) {
+        std::string name = "conc_" + std::to_string(i) + ".txt";
+        std::string body = "payload " + std::to_string(i);
+        puts.push_back(FileMessage(name, Bytes(body.begin(), body.end())).serialize());
+        gets.push_back(RequestMessage(name).serialize());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t stored = run_batch(addr, puts, [](size_t, const Bytes &reply) {
+        return StatusMessage::deserialize(reply).ok;
+    });
+
+    // 2. Request every file back, again over concurrent connections
+    size_t fetched = run_batch(addr, gets, [](size_t i, const Bytes &reply) {
+        auto fm = FileMessage::deserialize(reply);
+        std::string body = "payload " + std::to_string(i);
+        return fm.data == Bytes(body.begin(), body.end());
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Stored  " << stored << "/" << connections << " files\n";
+    std::cout << "Fetched " << fetched << "/" << connections << " files\n";
+    std::cout << "Throughput: " << (2 * connections) / secs << " msgs/sec over "
+              << connections << " concurrent connections\n";
+
+    return (stored == connections && fetched == connections) ? 0 : 1;
+}
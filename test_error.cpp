@@ -11,7 +11,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
-#include "protocol.hpp" // For RequestMessage, StatusMessage, xor42
+#include "protocol.hpp" // For RequestMessage, StatusMessage, framing
 
 int main() {
     // Server connection details
@@ -22,8 +22,8 @@ int main() {
     // 1. Create a RequestMessage for the missing file
     RequestMessage req(missing);
 
-    // 2. Serialize and encrypt the RequestMessage
-    auto enc = xor42(req.serialize());
+    // 2. Serialize the RequestMessage (send_frame encrypts it)
+    auto ser = req.serialize();
 
     // --- Socket setup ---
     // Create a socket for TCP communication
@@ -45,30 +45,25 @@ int main() {
         return 1; // Exit if connection fails
     }
 
-    // 3. Send the encrypted RequestMessage to the server
-    send(sock, enc.data(), enc.size(), 0);
+    // 3. Send the RequestMessage to the server as one encrypted frame
+    send_frame(sock, ser);
 
     // 4. Signal end of write to server
     shutdown(sock, SHUT_WR);
 
-    // 5. Receive the server's response
+    // 5. Receive the server's framed response
     std::vector<uint8_t> buf; // Buffer to hold the response
-    uint8_t tmp[4096];        // Temporary buffer for reading chunks
-    ssize_t n;
-    while ((n = recv(sock, tmp, sizeof(tmp), 0)) > 0) {
-        buf.insert(buf.end(), tmp, tmp + n); // Append received data to the buffer
-    }
+    bool got = recv_frame(sock, buf);
     close(sock); // Close the socket after receiving the response
 
-    if (n < 0) {
-        perror("recv");
+    if (!got) {
+        std::cerr << "recv: connection closed before a full response arrived\n";
         return 1; // Exit if receiving data fails
     }
 
-    // 6. Decrypt and deserialize the response
-    auto dec = xor42(buf);
+    // 6. Deserialize the response (recv_frame already decrypted it)
     try {
-        auto st = StatusMessage::deserialize(dec); // Parse the response as a StatusMessage
+        auto st = StatusMessage::deserialize(buf); // Parse the response as a StatusMessage
 
         // Display the server's response
         std::cout << "Status ok=" << st.ok
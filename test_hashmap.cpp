@@ -0,0 +1,807 @@
+// File: test_hashmap.cpp
+// Description: Unit tests for the FileServerMap store, including concurrent
+//              access from several threads.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "hashmap.hpp"  // FileServerMap
+#include "slab.hpp"     // SlabAllocator
+#include "spill.hpp"    // SpillFile
+#include "persist.hpp"  // encode_store, read_store_file
+#include "transfer.hpp" // UploadTable
+#include "protocol.hpp" // CHUNK_SIZE
+#include "wal.hpp"      // WriteAheadLog
+#include "snapshot.hpp" // Snapshotter
+#include "lz.hpp"       // lz_compress, lz_decompress
+#include "digest.hpp"   // content_digest
+
+#include <sys/stat.h>   // stat
+#include <unistd.h>     // unlink, truncate, access
+
+// Test basic insert, replace and get
+// Function: test_insert_get
+// Purpose: Verifies insert reports new vs. replaced keys and get returns the latest data.
+void test_insert_get() {
+    FileServerMap store;
+    std::vector<uint8_t> a = {'a'}, b = {'b', 'b'};
+    assert(store.insert("x.txt", a) == false);   // New key
+    assert(store.get("x.txt")->copy() == a);
+    assert(store.insert("x.txt", b) == true);    // Replaced key
+    assert(store.get("x.txt")->copy() == b);
+    assert(store.size() == 1);
+    std::cout << "[ PASS ] insert/get/replace\n";
+}
+
+// Test shared blobs
+// Function: test_shared_blobs
+// Purpose: Verifies get hands out a stored large blob itself rather than a
+//          copy, that a handle stays valid after the file is replaced, and
+//          that small files are kept in the table and copied out instead.
+void test_shared_blobs() {
+    FileServerMap store;
+    std::vector<uint8_t> big(1000, 3);
+    store.insert("y.txt", big);
+    BlobRef first = store.get("y.txt");
+    assert(store.get("y.txt").get() == first.get());   // Same blob, no copy
+    store.insert("y.txt", std::vector<uint8_t>{9});
+    assert(first->copy() == big);                     // Old handle unaffected
+    BlobRef small = store.get("y.txt");
+    assert(small->copy() == std::vector<uint8_t>{9});
+    assert(store.get("y.txt").get() != small.get());   // Inline: a fresh copy each time
+    std::cout << "[ PASS ] shared immutable blobs\n";
+}
+
+// Test missing keys
+// Function: test_missing
+// Purpose: Verifies get throws for a key that was never stored, and
+//          find_stored returns nullptr instead.
+void test_missing() {
+    FileServerMap store;
+    bool threw = false;
+    try { store.get("nope"); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+    assert(!store.find_stored("nope"));
+    store.insert("yes", std::vector<uint8_t>{1, 2, 3});
+    assert(store.find_stored("yes") && store.find_stored("yes")->copy() == std::vector<uint8_t>({1, 2, 3}));
+    std::cout << "[ PASS ] missing key throws\n";
+}
+
+// Test for_each
+// Function: test_for_each
+// Purpose: Verifies every entry, across all shards, is visited exactly once.
+void test_for_each() {
+    FileServerMap store;
+    for (int i = 0; i < 1000; ++i)
+        store.insert("f" + std::to_string(i), std::vector<uint8_t>(1, (uint8_t)i));
+    size_t seen = 0;
+    store.for_each([&seen](const std::string &name, const BlobRef &blob) {
+        assert(blob->size() == 1 && blob->data()[0] == (uint8_t)std::stoi(name.substr(1)));
+        ++seen;
+    });
+    assert(seen == 1000 && store.size() == 1000);
+    std::cout << "[ PASS ] for_each visits every entry\n";
+}
+
+// Test the open-addressing table
+// Function: test_flat_table
+// Purpose: Verifies entries survive growth and reserve, that bodies move
+//          between the slot and a blob as their size changes, and that keys
+//          whose hashes collide completely are still told apart by their bytes.
+void test_flat_table() {
+    FlatTable table;
+    bool added;
+    for (int i = 0; i < 5000; ++i) {
+        std::string key = "k" + std::to_string(i);
+        table.find_or_insert(key, FlatTable::hash(key), added).assign(make_blob(std::vector<uint8_t>(1, (uint8_t)i)));
+        assert(added);
+    }
+    assert(table.size() == 5000 && table.capacity() * 7 >= table.size() * 8);
+    table.reserve(100000);                                   // Rehash keeps every entry
+    for (int i = 0; i < 5000; ++i) {
+        std::string key = "k" + std::to_string(i);
+        FlatTable::Slot *slot = table.find(key, FlatTable::hash(key));
+        assert(slot && slot->value()->data()[0] == (uint8_t)i);
+    }
+    assert(!table.find("k5000", FlatTable::hash("k5000")));
+
+    FlatTable::Slot &slot = table.find_or_insert(std::string(100, 'L'), 7, added);  // Key out of line
+    slot.assign(make_blob(std::vector<uint8_t>(20, 1)));
+    assert(slot.is_inline() && slot.key() == std::string(100, 'L'));
+    BlobRef large = make_blob(std::vector<uint8_t>(FlatTable::Slot::INLINE, 2));
+    assert(!slot.assign(large) && !slot.is_inline() && slot.value().get() == large.get());
+    assert(slot.assign(make_blob(std::vector<uint8_t>{5})).get() == large.get()); // Old blob handed back
+    assert(slot.value()->copy() == std::vector<uint8_t>{5});
+
+    FlatTable same;                                          // Every key has hash 42
+    for (int i = 0; i < 100; ++i) same.find_or_insert("c" + std::to_string(i), 42, added);
+    same.find_or_insert("c7", 42, added);
+    assert(!added && same.size() == 100);
+    assert(same.find("c99", 42) && !same.find("c100", 42));
+    size_t seen = 0;
+    same.for_each([&seen](const std::string &, const BlobRef &) { ++seen; });
+    assert(seen == 100);
+    std::cout << "[ PASS ] open-addressing table\n";
+}
+
+// Test slab blobs and compaction
+// Function: test_slab_allocator
+// Purpose: Verifies slab blobs hold their bytes, keep their block while weak
+//          references remain, outlive their allocator, and that compaction frees sparse slabs without
+//          disturbing readers.
+void test_slab_allocator() {
+    BlobRef kept;
+    {
+        SlabAllocator slabs;
+        std::vector<uint8_t> body(1000, 7);
+        BlobRef blob = slabs.make_blob(body.data(), body.size());
+        assert(blob->copy() == body && slabs.stats().slabs == 1);
+        assert(slabs.stats().in_use >= 1000 && slabs.stats().in_use < 1400);
+        std::weak_ptr<const Blob> weak = blob;
+        blob.reset();
+        assert(weak.expired() && slabs.stats().in_use > 0);   // Control block still there
+        weak.reset();
+        assert(slabs.stats().in_use == 0);
+        std::vector<uint8_t> huge(SlabAllocator::MAX_BLOCK, 1);
+        assert(slabs.make_blob(huge.data(), huge.size())->copy() == huge);  // Heap, not slab
+        assert(slabs.stats().in_use == 0);
+        kept = slabs.make_blob(body.data(), body.size());
+    }
+    assert(kept->size() == 1000 && kept->data()[999] == 7);   // Outlives the allocator
+
+    FileServerMap store;
+    const int files = 4000;
+    auto body = [](size_t size, int i) {                     // Distinct, so none are shared
+        std::vector<uint8_t> v(size, (uint8_t)i);
+        v[1] = (uint8_t)(i >> 8);
+        return v;
+    };
+    for (int i = 0; i < files; ++i) store.insert("f" + std::to_string(i), body(1000, i));
+    size_t full = store.slab_stats().slabs;
+    for (int i = 0; i < files; ++i)                          // Three in four move to another class
+        if (i % 4) store.insert("f" + std::to_string(i), body(3000, i));
+    BlobRef reader = store.get("f0");
+    size_t before = store.slab_stats().slabs;
+    assert(before > full);
+    assert(store.compact() > 0);
+    assert(store.slab_stats().slabs < before);
+    for (int i = 0; i < files; ++i) {
+        BlobRef b = store.get("f" + std::to_string(i));
+        assert(b->size() == (i % 4 ? 3000u : 1000u) && b->data()[0] == (uint8_t)i);
+    }
+    assert(reader->size() == 1000 && reader->data()[0] == 0); // Old block still readable
+    std::cout << "[ PASS ] slab allocator and compaction\n";
+}
+
+// Test the memory budget and the spill file
+// Function: test_spill
+// Purpose: Verifies bodies over the budget are spilled and read back intact,
+//          that recently read files stay in memory, that small spill extents
+//          are reused, and that a snapshot includes spilled bodies.
+void test_spill() {
+    const char *spill = "test_spill.tmp", *path = "test_spill_store.tmp";
+    {
+        SpillFile file(spill);
+        std::vector<uint8_t> body(100, 9), out(100);
+        uint64_t a = file.write(body.data(), body.size());
+        file.read(a, out.data(), out.size());
+        assert(out == body && file.bytes_in_use() == 128);
+        file.release(a, body.size());
+        assert(file.write(body.data(), body.size()) == a);   // Extent reused
+        file.pin();
+        file.release(a, body.size());
+        assert(file.write(body.data(), body.size()) != a);   // Not while pinned
+        file.unpin();
+        assert(file.write(body.data(), body.size()) == a);
+    }
+    assert(access(spill, F_OK) != 0);                          // Removed on close
+
+    const size_t files = 200, size = 10000, budget = 500000;
+    FileServerMap store;
+    store.enable_spill(spill, budget);
+    for (size_t i = 0; i < files; ++i) {
+        store.insert("f" + std::to_string(i), std::vector<uint8_t>(size, (uint8_t)i));
+        store.get("f0");                                       // Hot file
+    }
+    store.insert("small", std::vector<uint8_t>{1, 2, 3});      // Inline: never spilled
+    FileServerMap::CacheStats st = store.cache_stats();
+    assert(st.resident <= budget && st.evictions >= files - budget / size);
+    assert(st.spilled >= (files - budget / size) * size);
+    assert(st.hits == files && st.misses == 0);                // f0 was never spilled
+    uint64_t misses = st.misses;
+    for (size_t i = 0; i < files; ++i)
+        assert(store.get("f" + std::to_string(i))->copy() == std::vector<uint8_t>(size, (uint8_t)i));
+    assert(store.cache_stats().misses > misses && store.cache_stats().resident <= budget);
+    store.get("f150");
+    st = store.cache_stats();
+    store.get("f150");                                         // Read back, then a hit
+    assert(store.cache_stats().hits == st.hits + 1 && store.cache_stats().misses == st.misses);
+
+    write_store_file(path, store);                             // Snapshot reads spilled bodies
+    FileServerMap loaded;
+    assert(read_store_file(path, loaded) == files + 1);
+    for (size_t i = 0; i < files; i += 7)
+        assert(loaded.get("f" + std::to_string(i))->copy() == std::vector<uint8_t>(size, (uint8_t)i));
+    unlink(path);
+    std::cout << "[ PASS ] memory budget and spill file\n";
+}
+
+// Test the LZ codec and compressed storage
+// Function: test_compression
+// Purpose: Verifies the codec round-trips text, runs and random bytes across
+//          frame boundaries, decodes ranges, rejects corrupt input, and that
+//          a compressing store keeps compressible bodies compressed through
+//          spilling and the store file while get() returns the content.
+void test_compression() {
+    std::string text;
+    for (int i = 0; text.size() < 200000; ++i)
+        text += "{\"id\": " + std::to_string(i) + ", \"name\": \"user" + std::to_string(i * 7 % 1000) + "\"}\n";
+    std::vector<uint8_t> json(text.begin(), text.end()), noise(150000), runs(70000, 'a');
+    uint32_t x = 1;
+    for (uint8_t &b : noise) b = (x = x * 1103515245 + 12345) >> 24;
+
+    std::vector<uint8_t> packed;
+    for (const std::vector<uint8_t> *in : {&json, &noise, &runs}) {
+        for (size_t len : {size_t(0), size_t(1), size_t(13), size_t(4096), LZ_FRAME, LZ_FRAME + 1, in->size()}) {
+            if (len > in->size()) continue;
+            assert(lz_compress(in->data(), len, packed, len + 4 * (len / LZ_FRAME + 1)));
+            std::vector<uint8_t> out(len);
+            lz_decompress(packed.data(), packed.size(), len, 0, len, out.data());
+            assert(std::equal(out.begin(), out.end(), in->begin()));
+        }
+    }
+    assert(lz_compress(json.data(), json.size(), packed, json.size() / 2));
+    assert(!lz_compress(noise.data(), noise.size(), packed, noise.size()));  // Does not pay off
+
+    // A range spanning frames, decoded without the frames before it
+    assert(lz_compress(json.data(), json.size(), packed, json.size()));
+    std::vector<uint8_t> slice(100000);
+    lz_decompress(packed.data(), packed.size(), json.size(), 70000, slice.size(), slice.data());
+    assert(std::equal(slice.begin(), slice.end(), json.begin() + 70000));
+
+    // Truncated or damaged frames throw, never read or write out of bounds
+    std::vector<uint8_t> out(json.size());
+    for (size_t cut = 0; cut < packed.size(); cut += packed.size() / 50 + 1) {
+        bool threw = false;
+        try { lz_decompress(packed.data(), cut, json.size(), 0, json.size(), out.data()); }
+        catch (const std::runtime_error &) { threw = true; }
+        assert(threw);
+    }
+    for (size_t at = 4; at < packed.size(); at += 997) {
+        std::vector<uint8_t> bad = packed;
+        bad[at] ^= 0x5A;
+        try { lz_decompress(bad.data(), bad.size(), json.size(), 0, json.size(), out.data()); }
+        catch (const std::runtime_error &) {}
+    }
+
+    const char *spill = "test_compress_spill.tmp", *path = "test_compress_store.tmp";
+    FileServerMap store;
+    store.enable_compression();
+    store.enable_spill(spill, 100000);
+    for (int i = 0; i < 20; ++i) store.insert("j" + std::to_string(i), std::vector<uint8_t>(json));
+    store.insert("noise", std::vector<uint8_t>(noise));
+    store.insert("short", std::vector<uint8_t>(json.begin(), json.begin() + 200));
+    assert(store.get_stored("j0")->compressed() && store.get_stored("j0")->size() < json.size() / 2);
+    assert(!store.get_stored("noise")->compressed() && !store.get_stored("short")->compressed());
+    assert(store.cache_stats().spilled > 0);                   // Compressed bodies spill too
+    for (int i = 0; i < 20; ++i) assert(store.get("j" + std::to_string(i))->copy() == json);
+    assert(store.get("noise")->copy() == noise && store.get("short")->size() == 200);
+
+    write_store_file(path, store);
+    FileServerMap loaded;                                      // Compression off: still decodes
+    assert(read_store_file(path, loaded) == 22);
+    assert(loaded.get_stored("j3")->compressed() && loaded.get("j3")->copy() == json);
+    assert(loaded.get("noise")->copy() == noise);
+    unlink(path);
+    std::cout << "[ PASS ] compression\n";
+}
+
+// Test content-addressed deduplication
+// Function: test_dedup
+// Purpose: Verifies the digest tells contents apart, that names with the same
+//          body share one blob that is freed with its last name, that the
+//          sharing survives compaction and spilling, and that the store file
+//          holds a shared body once.
+void test_dedup() {
+    std::vector<uint8_t> a(2000, 1), b = a;
+    b[1999] = 2;
+    assert(content_digest(a.data(), 1999) == content_digest(b.data(), 1999));
+    assert(content_digest(a.data(), a.size()) != content_digest(b.data(), b.size()));
+    for (size_t len = 0; len < 40; ++len)
+        assert(!content_digest(a.data(), len).empty() && content_digest(a.data(), len) != content_digest(a.data(), len + 1));
+
+    const char *path = "test_dedup_store.tmp";
+    std::vector<uint8_t> body(10000);
+    for (size_t i = 0; i < body.size(); ++i) body[i] = (uint8_t)(i * 31);
+    FileServerMap store;
+    for (int i = 0; i < 100; ++i) store.insert("copy" + std::to_string(i), std::vector<uint8_t>(body));
+    store.insert("tiny1", std::vector<uint8_t>(10, 3));      // Kept inline, not tracked
+    store.insert("tiny2", std::vector<uint8_t>(10, 3));
+    BlobRef first = store.get("copy0");
+    for (int i = 1; i < 100; ++i) assert(store.get("copy" + std::to_string(i)).get() == first.get());
+    ContentTable::Stats st = store.dedup_stats();
+    assert(st.references == 100 && st.bodies == 1 && st.stored == body.size());
+    assert(st.logical == 100 * body.size() && store.slab_stats().in_use < 2 * body.size());
+
+    store.insert("copy0", std::vector<uint8_t>(a));          // Replaced: one fewer reference
+    assert(store.dedup_stats().references == 99 + 1 && store.dedup_stats().bodies == 2);
+    store.compact(1.0);
+    assert(store.get("copy1").get() == store.get("copy99").get());
+    assert(store.dedup_stats().references == 100 && store.get("copy1")->copy() == body);
+
+    write_store_file(path, store);
+    struct stat info;
+    assert(stat(path, &info) == 0 && size_t(info.st_size) < 2 * body.size() + 20000);
+    FileServerMap loaded;
+    assert(read_store_file(path, loaded) == 102);
+    assert(loaded.get("copy5")->copy() == body && loaded.get("copy0")->copy() == a);
+    assert(loaded.get("copy5")->data() == loaded.get("copy6")->data());   // Same bytes in the file
+    write_store_file(path, loaded);                          // Still written once
+    assert(stat(path, &info) == 0 && size_t(info.st_size) < 2 * body.size() + 20000);
+    unlink(path);
+
+    for (int i = 1; i < 100; ++i) store.insert("copy" + std::to_string(i), std::vector<uint8_t>(5000, (uint8_t)i));
+    assert(store.dedup_stats().bodies == 100 && store.dedup_stats().references == 100);   // Body freed
+    first.reset();
+
+    // With a memory budget, a shared body counts once, is spilled to one
+    // extent, and is still shared after being read back
+    const char *spill = "test_dedup_spill.tmp";
+    const size_t extent = (body.size() + 4095) / 4096 * 4096;
+    FileServerMap bounded;
+    bounded.enable_spill(spill, 3 * body.size());
+    for (int i = 0; i < 20; ++i) bounded.insert("s" + std::to_string(i), std::vector<uint8_t>(body));
+    assert(bounded.cache_stats().resident == body.size() && bounded.cache_stats().evictions == 0);
+    for (int i = 0; i < 20; ++i) bounded.insert("u" + std::to_string(i), std::vector<uint8_t>(body.size(), (uint8_t)i));
+    FileServerMap::CacheStats cs = bounded.cache_stats();
+    assert(cs.evictions > 20 && cs.resident <= 3 * body.size());
+    assert(cs.spilled <= 21 * extent && cs.spilled + cs.resident <= 22 * extent);   // Body on disk once
+    assert(bounded.dedup_stats().references == 40 && bounded.dedup_stats().bodies == 21);
+    for (int i = 0; i < 20; ++i) assert(bounded.get("s" + std::to_string(i))->copy() == body);
+    assert(bounded.dedup_stats().references == 40 && bounded.dedup_stats().bodies == 21);
+    BlobRef held = bounded.get_stored("s0");
+    for (int i = 1; i < 20; ++i) assert(bounded.get_stored("s" + std::to_string(i)).get() == held.get());
+    held.reset();
+    for (int i = 0; i < 20; ++i) bounded.get("u" + std::to_string(i));   // Push the body out again
+    bounded.insert("s20", std::vector<uint8_t>(body));         // Compared with the copy on disk
+    assert(bounded.dedup_stats().references == 41 && bounded.dedup_stats().bodies == 21);
+    for (int i = 0; i < 20; ++i) bounded.insert("s" + std::to_string(i), std::vector<uint8_t>(10, 1));
+    bounded.insert("s20", std::vector<uint8_t>(10, 1));
+    assert(bounded.dedup_stats().bodies == 20 && bounded.cache_stats().spilled <= 20 * extent);   // Freed
+    std::cout << "[ PASS ] content deduplication\n";
+}
+
+// Function: make_collision
+// Purpose: Builds two different bodies with the same content_digest, the way
+//          an attacker could: a shared prefix, one differing block, then a
+//          block solved so that both lanes end up in the same state. Each
+//          block goes through a bijective mix, which is inverted here.
+static void make_collision(std::vector<uint8_t> &x, std::vector<uint8_t> &y) {
+    const uint64_t C1 = 0x87c37b91114253d5ull, C2 = 0x4cf5ad432745937full;
+    auto rotl = [](uint64_t v, int r) { return (v << r) | (v >> (64 - r)); };
+    auto inverse = [](uint64_t a) { uint64_t v = a; for (int i = 0; i < 6; ++i) v *= 2 - a * v; return v; };
+    struct Lanes { uint64_t h1, h2; };
+    auto mix = [&](Lanes s, uint64_t k1, uint64_t k2) {
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; s.h1 ^= k1;
+        s.h1 = rotl(s.h1, 27); s.h1 += s.h2; s.h1 = s.h1 * 5 + 0x52dce729;
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; s.h2 ^= k2;
+        s.h2 = rotl(s.h2, 31); s.h2 += s.h1; s.h2 = s.h2 * 5 + 0x38495ab5;
+        return s;
+    };
+    auto put = [](std::vector<uint8_t> &v, uint64_t k1, uint64_t k2) {
+        for (int i = 0; i < 8; ++i) v.push_back(uint8_t(k1 >> (8 * i)));
+        for (int i = 0; i < 8; ++i) v.push_back(uint8_t(k2 >> (8 * i)));
+    };
+
+    Lanes s = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full};
+    x.clear();
+    for (uint64_t i = 0; i < 128; ++i) {                  // 2 KiB of text-like prefix
+        uint64_t k = 0x6f6c6c6568202020ull + i;
+        put(x, k, k);
+        s = mix(s, k, k);
+    }
+    y = x;
+    Lanes a = mix(mix(s, 1, 2), 3, 4), b = mix(s, 5, 6);
+    put(x, 1, 2);
+    put(x, 3, 4);
+    // Solve the last block of y so that mix(b, k1, k2) == a
+    uint64_t inv5 = inverse(5);
+    uint64_t t1 = rotl((a.h1 - 0x52dce729) * inv5 - b.h2, 64 - 27) ^ b.h1;
+    uint64_t t2 = rotl((a.h2 - 0x38495ab5) * inv5 - a.h1, 64 - 31) ^ b.h2;
+    uint64_t k1 = rotl(t1 * inverse(C2), 64 - 31) * inverse(C1);
+    uint64_t k2 = rotl(t2 * inverse(C1), 64 - 33) * inverse(C2);
+    put(y, 5, 6);
+    put(y, k1, k2);
+}
+
+// Test digest collisions
+// Function: test_dedup_collision
+// Purpose: Verifies that a body crafted to collide with another one's digest
+//          is never served in its place: stored first, it does not capture
+//          later uploads of the real body, compressed or not, and two blobs
+//          racing into the content table are compared before being shared.
+void test_dedup_collision() {
+    std::vector<uint8_t> evil, real;
+    make_collision(evil, real);
+    assert(evil != real && evil.size() == real.size());
+    assert(content_digest(evil.data(), evil.size()) == content_digest(real.data(), real.size()));
+
+    for (int compressed = 0; compressed < 2; ++compressed) {
+        FileServerMap store;
+        if (compressed) store.enable_compression();
+        store.insert("evil", std::vector<uint8_t>(evil));
+        store.insert("real", std::vector<uint8_t>(real));
+        store.insert("real2", std::vector<uint8_t>(real));
+        store.insert("evil2", std::vector<uint8_t>(evil));
+        assert(store.get_stored("evil")->compressed() == (compressed == 1));
+        assert(store.get("real")->copy() == real && store.get("real2")->copy() == real);
+        assert(store.get("evil")->copy() == evil && store.get("evil2")->copy() == evil);
+        assert(store.get_stored("evil").get() == store.get_stored("evil2").get());
+        assert(store.dedup_stats().bodies == 1 && store.dedup_stats().references == 2);
+    }
+
+    // Blobs built before either was tracked, as by two racing uploads
+    ContentTable table;
+    Digest d = content_digest(evil.data(), evil.size());
+    BlobRef e = make_blob(evil), r = make_blob(real);
+    e->set_digest(d);
+    r->set_digest(d);
+    size_t resident;
+    assert(table.acquire(e, resident) == e && resident == evil.size());
+    assert(table.acquire(r, resident) == r && r->digest().empty());   // Left out, not shared
+    BlobRef e2 = make_blob(evil);
+    e2->set_digest(d);
+    assert(table.acquire(e2, resident) == e && resident == 0 && table.stats().references == 2);
+    assert(ContentTable::holds(*e, evil.data(), evil.size()) && !ContentTable::holds(*e, real.data(), real.size()));
+    std::cout << "[ PASS ] digest collisions\n";
+}
+
+// Test concurrent access
+// Function: test_concurrent
+// Purpose: Verifies writers and readers on many threads do not lose or corrupt entries.
+void test_concurrent() {
+    FileServerMap store;
+    const int threads = 8, per_thread = 2000;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&store, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                std::string key = "t" + std::to_string(t) + "_" + std::to_string(i);
+                store.insert(key, std::vector<uint8_t>(4, (uint8_t)t));
+                assert(store.get(key)->copy() == std::vector<uint8_t>(4, (uint8_t)t));
+            }
+        });
+    }
+    for (auto &th : pool) th.join();
+    assert(store.size() == (size_t)threads * per_thread);
+    std::cout << "[ PASS ] concurrent insert/get\n";
+}
+
+// Test persistence encoding
+// Function: test_persist_roundtrip
+// Purpose: Verifies a store of 100k files, well past the 8-bit map limit,
+//          encodes to its exact size and loads back unchanged.
+void test_persist_roundtrip() {
+    const size_t files = 100000;
+    FileServerMap store;
+    for (size_t i = 0; i < files; ++i)
+        store.insert("file_" + std::to_string(i), std::vector<uint8_t>(i % 300, (uint8_t)i));
+
+    Bytes bytes;
+    assert(encode_store(store, bytes) == files);
+    assert(bytes[0] == PACK109_M32 && bytes.capacity() == bytes.size());
+
+    FileServerMap loaded;
+    assert(decode_store(bytes.data(), bytes.size(), loaded) == files);
+    assert(loaded.size() == files);
+    for (size_t i = 0; i < files; i += 997)
+        assert(loaded.get("file_" + std::to_string(i))->copy() == std::vector<uint8_t>(i % 300, (uint8_t)i));
+
+    bool threw = false;                           // Truncated files are rejected
+    try { decode_store(bytes.data(), bytes.size() / 2, loaded); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+    std::cout << "[ PASS ] persist 100k files\n";
+}
+
+// Test the mapped store file
+// Function: test_mapped_store
+// Purpose: Verifies an indexed store file loads by mapping, on one thread or
+//          several, with every blob pointing into one mapping that outlives
+//          the file being replaced, and that files in the older single-map
+//          format still load.
+void test_mapped_store() {
+    const std::string path = "/tmp/test_hashmap.store";
+    FileServerMap store;
+    for (int i = 0; i < 500; ++i)
+        store.insert("m" + std::to_string(i), std::vector<uint8_t>(i * 37 % 5000, (uint8_t)i));
+    store.insert("empty", std::vector<uint8_t>());
+    store.insert("large", std::vector<uint8_t>(2 << 20, 0x5a));     // Written past the buffer
+    assert(write_store_file(path, store) == 502);
+
+    FileServerMap loaded;
+    assert(read_store_file(path, loaded) == 502 && loaded.size() == 502);
+    BlobRef first = loaded.get("m1"), large = loaded.get("large");
+    for (int i = 0; i < 500; i += 7)
+        assert(loaded.get("m" + std::to_string(i))->copy() == std::vector<uint8_t>(i * 37 % 5000, (uint8_t)i));
+    assert(loaded.get("empty")->size() == 0);
+    FileServerMap parallel;                                        // Segments on 4 threads
+    assert(read_store_file(path, parallel, 4) == 502 && parallel.size() == 502);
+    assert(parallel.get("m499")->copy() == loaded.get("m499")->copy());
+
+    store.insert("m1", std::vector<uint8_t>{1});                   // Replace the file on disk
+    write_store_file(path, store);
+    assert(first->copy() == std::vector<uint8_t>(37, 1));          // Old mapping still valid
+    assert(large->size() == (2u << 20) && large->data()[(2 << 20) - 1] == 0x5a);
+
+    Bytes legacy;                                                  // Older format
+    encode_store(store, legacy);
+    FILE *f = fopen(path.c_str(), "wb");
+    fwrite(legacy.data(), 1, legacy.size(), f);
+    fclose(f);
+    FileServerMap old;
+    assert(read_store_file(path, old) == 502 && old.get("m1")->copy() == std::vector<uint8_t>{1});
+
+    Bytes bad(STORE_MAGIC, STORE_MAGIC + sizeof(STORE_MAGIC));     // Index offset past the end
+    bad.resize(STORE_HEADER_SIZE, 0xff);
+    f = fopen(path.c_str(), "wb");
+    fwrite(bad.data(), 1, bad.size(), f);
+    fclose(f);
+    bool threw = false;
+    try { read_store_file(path, old); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+    unlink(path.c_str());
+    std::cout << "[ PASS ] mapped store file\n";
+}
+
+// Test chunked uploads
+// Function: test_uploads
+// Purpose: Verifies chunks are accepted only in order, an upload resumes from
+//          its first missing chunk, and commit releases only complete files.
+void test_uploads() {
+    FileServerMap store;
+    UploadTable uploads;
+    const uint64_t size = 2 * CHUNK_SIZE + 10;
+    Bytes full(CHUNK_SIZE, 1), tail(10, 2);
+    pack109::ByteSpan full_span = {full.data(), full.size(), 1}, tail_span = {tail.data(), tail.size(), 1};
+
+    assert(uploads.begin("u.bin", size) == 0);
+    assert(uploads.chunk("u.bin", 0, size, full_span) == 1);
+    assert(uploads.chunk("u.bin", 0, size, full_span) == 1);    // Duplicate ignored
+    assert(uploads.chunk("u.bin", 2, size, tail_span) == 1);    // Early chunk ignored
+    assert(uploads.begin("u.bin", size) == 1);                  // Resume point
+
+    bool threw = false;
+    try { uploads.chunk("u.bin", 1, size, tail_span); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);                                              // Short middle chunk
+    threw = false;
+    auto store_u = [&store](const std::vector<uint8_t> &data) { return store.insert("u.bin", data); };
+    try { uploads.commit("u.bin", store_u); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw && store.size() == 0);                         // Incomplete
+
+    assert(uploads.chunk("u.bin", 1, size, full_span) == 2);
+    assert(uploads.chunk("u.bin", 2, size, tail_span) == 3);
+    threw = false;
+    try {
+        uploads.commit("u.bin", [](const std::vector<uint8_t> &) -> bool { throw std::runtime_error("disk full"); });
+    } catch (const std::runtime_error &) { threw = true; }
+    assert(threw && uploads.pending() == 1 && uploads.bytes() == size);   // Kept for a retry
+    assert(uploads.begin("u.bin", size) == 3);
+    assert(uploads.commit("u.bin", store_u) == false);
+    assert(uploads.pending() == 0 && uploads.bytes() == 0 && store.get("u.bin")->size() == size);
+    assert(store.get("u.bin")->data()[size - 1] == 2);
+
+    assert(uploads.begin("e.bin", 0) == 0);                     // Empty file: no chunks
+    assert(!uploads.commit("e.bin", [](const std::vector<uint8_t> &data) { return !data.empty(); }));
+    assert(uploads.bytes() == 0);
+
+    // Limits: two uploads, two chunks of data between them, 50 ms idle
+    UploadTable limited(2, 2 * CHUNK_SIZE, 50);
+    auto fails = [](const std::function<void()> &f) {
+        try { f(); } catch (const std::runtime_error &) { return true; }
+        return false;
+    };
+    assert(fails([&] { limited.begin("big", 3 * CHUNK_SIZE); }));
+    assert(limited.begin("a", CHUNK_SIZE + 10) == 0 && limited.begin("b", CHUNK_SIZE) == 0);
+    assert(fails([&] { limited.begin("c", 1); }));               // Too many
+    assert(limited.chunk("a", 0, CHUNK_SIZE + 10, full_span) == 1);
+    assert(limited.chunk("b", 0, CHUNK_SIZE, full_span) == 1);
+    assert(limited.bytes() == 2 * CHUNK_SIZE);
+    assert(fails([&] { limited.chunk("a", 1, CHUNK_SIZE + 10, tail_span); }));   // Out of room
+    assert(limited.begin("b", 5) == 0 && limited.bytes() == CHUNK_SIZE);          // Replaced: freed
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    assert(limited.begin("c", 1) == 0);                          // Idle ones dropped first
+    assert(limited.pending() == 1 && limited.bytes() == 0);
+    assert(fails([&] { limited.chunk("a", 1, CHUNK_SIZE + 10, tail_span); }));
+    std::cout << "[ PASS ] chunked uploads\n";
+}
+
+// Test the write-ahead log
+// Function: test_wal
+// Purpose: Verifies logged inserts replay in order after reopening, and that a
+//          torn final record is dropped and cut off without losing earlier ones.
+void test_wal() {
+    const char *path = "/tmp/test_hashmap.wal";
+    unlink(path);
+    off_t intact;
+    {
+        FileServerMap store;
+        WriteAheadLog wal(path, FsyncPolicy::Never, 0);
+        assert(wal.insert(store, "a", std::vector<uint8_t>{1}) == false);
+        assert(wal.insert(store, "b", std::vector<uint8_t>(100000, 2)) == false);
+        assert(wal.insert(store, "a", std::vector<uint8_t>{3}) == true);
+        assert(store.get("a")->copy() == std::vector<uint8_t>{3});
+        struct stat st;
+        assert(stat(path, &st) == 0);
+        intact = st.st_size;
+        wal.insert(store, "c", std::vector<uint8_t>(50, 4));
+    }
+    assert(truncate(path, intact + 20) == 0);         // Tear the last record
+
+    FileServerMap store;
+    {
+        WriteAheadLog wal(path, FsyncPolicy::Always, 0);
+        assert(wal.replay(store) == 3);
+        assert(store.size() == 2 && store.get("a")->copy() == std::vector<uint8_t>{3});
+        assert(store.get("b")->size() == 100000);
+        wal.insert(store, "d", std::vector<uint8_t>{5}); // Appended after the cut
+    }
+    FileServerMap again;
+    WriteAheadLog wal(path, FsyncPolicy::Never, 0);
+    assert(wal.replay(again) == 4 && again.get("d")->copy() == std::vector<uint8_t>{5});
+    unlink(path);
+    std::cout << "[ PASS ] write-ahead log replay\n";
+}
+
+// Test group commit
+// Function: test_group_commit
+// Purpose: Verifies concurrent logged inserts are batched into fewer commits
+//          than records, and that every record survives a replay.
+void test_group_commit() {
+    const char *path = "/tmp/test_hashmap_group.wal";
+    unlink(path);
+    const int threads = 8, per_thread = 50;
+    uint64_t batches;
+    {
+        FileServerMap store;
+        WriteAheadLog wal(path, FsyncPolicy::Always, 0, 500);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&store, &wal, t] {
+                for (int i = 0; i < per_thread; ++i)
+                    wal.insert(store, "g" + std::to_string(t) + "_" + std::to_string(i), std::vector<uint8_t>(64, (uint8_t)t));
+            });
+        }
+        for (auto &th : pool) th.join();
+        assert(wal.records() == (uint64_t)threads * per_thread);
+        batches = wal.batches();
+        assert(batches < wal.records());
+        assert(store.size() == (size_t)threads * per_thread);
+    }
+    FileServerMap replayed;
+    WriteAheadLog wal(path, FsyncPolicy::Never, 0);
+    assert(wal.replay(replayed) == (size_t)threads * per_thread);
+    unlink(path);
+    std::cout << "[ PASS ] group commit (" << threads * per_thread << " records in " << batches << " batches)\n";
+}
+
+// Test background snapshots
+// Function: test_snapshot
+// Purpose: Verifies a forked snapshot holds exactly the store as of its start,
+//          that the log rotated at that moment is dropped once the snapshot is
+//          in place, and that snapshot plus live log recover every file.
+void test_snapshot() {
+    const std::string snap = "/tmp/test_hashmap.snap", log = "/tmp/test_hashmap_snap.wal";
+    unlink(snap.c_str());
+    unlink(log.c_str());
+    {
+        FileServerMap store;
+        WriteAheadLog wal(log, FsyncPolicy::Never, 0);
+        for (int i = 0; i < 1000; ++i)
+            wal.insert(store, "s" + std::to_string(i), std::vector<uint8_t>(i % 100 + 1, (uint8_t)i));
+        wal.insert(store, "big", std::vector<uint8_t>(3 << 20, 7));   // Bypasses the write buffer
+
+        Snapshotter snapshots(snap, store, &wal, 0);
+        assert(snapshots.start());
+        assert(wal.segments().size() == 1);
+        wal.insert(store, "after", std::vector<uint8_t>{9});          // Served while the child writes
+        assert(snapshots.wait() && snapshots.completed() == 1);
+        assert(wal.segments().empty());
+
+        FileServerMap loaded;
+        assert(read_store_file(snap, loaded) == 1001);
+        assert(loaded.get("big")->size() == (3u << 20) && loaded.get("s999")->size() == 100);
+        bool threw = false;                                          // Not in the snapshot
+        try { loaded.get("after"); } catch (const std::runtime_error &) { threw = true; }
+        assert(threw);
+    }
+    FileServerMap recovered;
+    read_store_file(snap, recovered);
+    WriteAheadLog wal(log, FsyncPolicy::Never, 0);
+    assert(wal.replay(recovered) == 1);                              // Only the new record
+    assert(recovered.size() == 1002 && recovered.get("after")->copy() == std::vector<uint8_t>{9});
+    unlink(snap.c_str());
+    unlink(log.c_str());
+    std::cout << "[ PASS ] fork snapshot and log rotation\n";
+}
+
+// Test batched lookups and logged batch inserts
+// Function: test_batches
+// Purpose: Verifies get_stored_many returns one handle per key in order, with
+//          nullptr for missing keys and spilled bodies read back, and that
+//          insert_many logs a batch as one commit that replays in full.
+void test_batches() {
+    FileServerMap store;
+    store.enable_spill("test_batches.spill", 200000);
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; ++i) {
+        names.push_back("m" + std::to_string(i));
+        store.insert(names.back(), std::vector<uint8_t>(10000, (uint8_t)i));
+    }
+    assert(store.cache_stats().spilled > 0);
+    names.insert(names.begin() + 50, "absent");
+    names.push_back("m7");                                        // Repeats are answered twice
+    std::vector<BlobRef> blobs = store.get_stored_many(names);
+    assert(blobs.size() == names.size() && !blobs[50] && blobs.back() && blobs.back()->size() == 10000);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (i == 50) continue;
+        int n = std::stoi(names[i].substr(1));
+        assert(blobs[i]->copy() == std::vector<uint8_t>(10000, (uint8_t)n));
+    }
+    assert(store.get_stored_many({}).empty());
+
+    const char *path = "/tmp/test_hashmap_batch.wal";
+    unlink(path);
+    {
+        FileServerMap logged;
+        WriteAheadLog wal(path, FsyncPolicy::Always, 0);
+        wal.insert(logged, "b1", std::vector<uint8_t>{1});
+        std::vector<std::string> batch = {"b0", "b1", "b2"};
+        std::vector<std::vector<uint8_t>> data = {{10}, {11}, std::vector<uint8_t>(5000, 12)};
+        std::vector<bool> existed = wal.insert_many(logged, batch, data);
+        assert(existed == std::vector<bool>({false, true, false}));
+        assert(wal.records() == 4 && wal.batches() == 2);
+        assert(logged.get("b1")->copy() == std::vector<uint8_t>{11});
+        assert(wal.insert_many(logged, {}, {}).empty());
+    }
+    FileServerMap replayed;
+    WriteAheadLog wal(path, FsyncPolicy::Never, 0);
+    assert(wal.replay(replayed) == 4 && replayed.size() == 3);
+    assert(replayed.get("b2")->size() == 5000 && replayed.get("b1")->copy() == std::vector<uint8_t>{11});
+    unlink(path);
+    std::cout << "[ PASS ] batched lookups and logged batches\n";
+}
+
+// Entry point for the test suite
+// Function: main
+// Purpose: Runs all the unit tests for the file store.
+int main() {
+    test_insert_get();   // Test insert/get/replace
+    test_shared_blobs(); // Test blob handles
+    test_missing();      // Test missing-key error
+    test_for_each();     // Test whole-map iteration
+    test_flat_table();   // Test the shard hash table directly
+    test_slab_allocator(); // Test slab blobs and compaction
+    test_spill();        // Test the memory budget and the spill file
+    test_compression();  // Test the LZ codec and compressed storage
+    test_dedup();        // Test content-addressed deduplication
+    test_dedup_collision(); // Test bodies crafted to collide
+    test_concurrent();   // Test multi-threaded access
+    test_persist_roundtrip(); // Test encoding a large store
+    test_mapped_store(); // Test the indexed, memory-mapped store file
+    test_uploads();      // Test chunked upload bookkeeping
+    test_wal();          // Test log append, replay and torn tails
+    test_group_commit(); // Test batched appends from many threads
+    test_snapshot();     // Test forked snapshots and log rotation
+    test_batches();      // Test batched lookups and logged batch inserts
+    std::cout << "All hashmap tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,128 @@
+// File: test_pipeline.cpp
+// Description: Pipelining test for the file server. Stores many small files and
+//              requests them back over a single connection, first one request
+//              per round trip and then with a window of requests in flight, checks
+//              every reply against its request ID and reports both rates.
+//              Usage: test_pipeline [--hostname ip:port] [--files N] [--window W]
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "protocol.hpp"  // for FileMessage, RequestMessage, StatusMessage, Pipeline
+
+// Function: body_of
+// Returns:
+//   - The content stored under file number i.
+static Bytes body_of(size_t i) {
+    std::string body = "pipelined payload " + std::to_string(i);
+    return Bytes(body.begin(), body.end());
+}
+
+// Function: run_window
+// Purpose: Sends every message through a pipeline with the given window and
+//          validates each reply as it comes back.
+// Parameters:
+//   - sock: Connected socket.
+//   - msgs: The serialized messages to send.
+//   - window: Requests kept in flight.
+//   - check: Returns true if the reply to message i is the expected one.
+// Returns:
+//   - The number of replies that passed the check.
+template <typename Check>
+static size_t run_window(int sock, const std::vector<Bytes> &msgs, size_t window, Check check) {
+    Pipeline pipe(sock, window);
+    std::vector<uint64_t> ids;       // ids[i] is the request ID of msgs[i]
+    size_t ok = 0, done = 0;
+    Bytes reply;
+    auto collect = [&]() {
+        uint64_t id = pipe.receive(reply);
+        try {
+            if (id == ids[done] && check(done, reply)) ++ok;
+        } catch (const std::exception &) {}
+        ++done;
+    };
+    for (const Bytes &msg : msgs) {
+        ids.push_back(pipe.submit(msg));
+        if (pipe.in_flight() >= window) collect();
+    }
+    while (pipe.in_flight() > 0) collect();
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char *hostname = "127.0.0.1"; // Server hostname or IP address
+    int port = 8081;                    // Server port
+    size_t files = 1000;                // Files stored and requested
+    size_t window = 64;                 // Requests in flight when pipelining
+
+    std::string host_arg;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--hostname") == 0 || strcmp(argv[i], "-h") == 0) && i + 1 < argc) {
+            host_arg = argv[++i];
+            auto colon = host_arg.find(':');
+            if (colon == std::string::npos) {
+                std::cerr << "Invalid hostname format, use IP:PORT\n";
+                return 1;
+            }
+            port = std::atoi(host_arg.c_str() + colon + 1);
+            host_arg.resize(colon);
+            hostname = host_arg.c_str();
+        } else if ((strcmp(argv[i], "--files") == 0 || strcmp(argv[i], "-n") == 0) && i + 1 < argc) {
+            files = std::strtoul(argv[++i], nullptr, 10);
+        } else if ((strcmp(argv[i], "--window") == 0 || strcmp(argv[i], "-w") == 0) && i + 1 < argc) {
+            window = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    inet_pton(AF_INET, hostname, &addr.sin_addr);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    std::vector<Bytes> puts, gets;
+    for (size_t i = 0; i < files; ++i) {
+        std::string name = "pipe_" + std::to_string(i) + ".txt";
+        puts.push_back(FileMessage(name, body_of(i)).serialize());
+        gets.push_back(RequestMessage(name).serialize());
+    }
+    auto stored = [](size_t, const Bytes &reply) { return StatusMessage::deserialize(reply).ok; };
+    auto fetched = [](size_t i, const Bytes &reply) { return FileMessage::deserialize(reply).data == body_of(i); };
+
+    size_t ok = 0;
+    try {
+        // 1. Store every file with the window open
+        ok = run_window(sock, puts, window, stored);
+        std::cout << "Stored  " << ok << "/" << files << " files\n";
+
+        // 2. Request them back one round trip at a time, then pipelined
+        size_t windows[] = {1, window};
+        for (size_t w : windows) {
+            auto start = std::chrono::steady_clock::now();
+            size_t got = run_window(sock, gets, w, fetched);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Fetched " << got << "/" << files << " files with window " << w << ": "
+                      << files / secs << " requests/sec\n";
+            ok += got;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+    }
+    close(sock);
+
+    return ok == 3 * files ? 0 : 1;
+}
@@ -8,9 +8,13 @@
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "protocol.hpp"  // FileMessage, RequestMessage, StatusMessage, xor42
 #include "pack109.hpp"   // Bytes alias
+#include "lz.hpp"        // lz_compress
 
 // Helper to check round-trip encryption and decryption using xor42
 // Function: test_xor42
@@ -20,7 +24,23 @@ void test_xor42() {
     auto enc = xor42(data);                      // Encrypt the data
     auto dec = xor42(enc);                       // Decrypt the encrypted data
     assert(dec == data);                         // Ensure the decrypted data matches the original
-    std::cout << "[ PASS ] XOR-42 helper tests passed.\n";
+
+    // The vectorized kernels must match a byte-by-byte XOR for every length and
+    // alignment, including the tails left over after the wide loops
+    for (size_t len = 0; len < 300; ++len) {
+        for (size_t off = 0; off < 4; ++off) {
+            Bytes buf(len + off), expect(len);
+            for (size_t i = 0; i < buf.size(); ++i) buf[i] = (uint8_t)(i * 31 + len);
+            for (size_t i = 0; i < len; ++i) expect[i] = buf[off + i] ^ 42;
+
+            Bytes copied(len);
+            xor42_copy(copied.data(), buf.data() + off, len);
+            assert(copied == expect);
+            xor42_inplace(buf.data() + off, len);
+            assert(Bytes(buf.begin() + off, buf.end()) == expect);
+        }
+    }
+    std::cout << "[ PASS ] XOR-42 helper tests passed (" << xor42_impl() << " kernel).\n";
 }
 
 // Test FileMessage serialization and deserialization
@@ -36,6 +56,43 @@ void test_file_message() {
 
     assert(fm2.name == name);                           // Check the file name
     assert(fm2.data == payload);                        // Check the file content
+
+    // The README's "file.txt" example (A8 of tagged bytes) still decodes
+    Bytes readme = {0xAE, 0x01, 0xAA, 0x04, 0x46, 0x69, 0x6C, 0x65, 0xAE, 0x02, 0xAA, 0x04,
+                    0x6E, 0x61, 0x6D, 0x65, 0xAA, 0x08, 0x66, 0x69, 0x6C, 0x65, 0x2E, 0x74,
+                    0x78, 0x74, 0xAA, 0x05, 0x62, 0x79, 0x74, 0x65, 0x73, 0xAC, 0x05, 0xA2,
+                    0x48, 0xA2, 0x65, 0xA2, 0x6C, 0xA2, 0x6C, 0xA2, 0x6F};
+    auto decoded = FileMessage::deserialize(readme);
+    assert(decoded.name == "file.txt" && decoded.data == payload);
+
+    // Serializing writes the same layout with the content as one B8 block
+    Bytes expected(readme.begin(), readme.begin() + 33);
+    expected.insert(expected.end(), {0xB0, 0x05, 'H', 'e', 'l', 'l', 'o'});
+    auto direct = FileMessage::serialize("file.txt", payload.data(), payload.size());
+    assert(direct == expected);
+
+    // Compressed content comes back decoded
+    std::string text;
+    for (int i = 0; i < 3000; ++i) text += "{\"key\": " + std::to_string(i % 17) + "}, ";
+    Bytes content(text.begin(), text.end()), packed;
+    assert(lz_compress(content.data(), content.size(), packed, content.size()));
+    Bytes msg;
+    msg.reserve(FileMessage::encoded_size(8, packed.size(), 2));
+    FileMessage::encode(msg, "file.txt", packed.data(), packed.size(), "lz", content.size());
+    assert(msg.size() == FileMessage::encoded_size(8, packed.size(), 2));
+    FileMessage::View v = FileMessage::parse(msg.data(), msg.size());
+    assert(v.encoding.equals("lz", 2) && v.size == content.size() && v.data.count == packed.size());
+    assert(FileMessage::deserialize(msg).data == content);
+
+    // An unknown encoding, or a size the content cannot hold, is rejected
+    for (int bad = 0; bad < 2; ++bad) {
+        msg.clear();
+        FileMessage::encode(msg, "file.txt", packed.data(), packed.size(), bad ? "lz" : "zz",
+                            bad ? uint64_t(1) << 40 : content.size());
+        bool threw = false;
+        try { FileMessage::deserialize(msg); } catch (const std::runtime_error &) { threw = true; }
+        assert(threw);
+    }
     std::cout << "[ PASS ] FileMessage serialize/deserialize\n";
 }
 
@@ -50,6 +107,13 @@ void test_request_message() {
     auto rm2 = RequestMessage::deserialize(ser);        // Deserialize it back
 
     assert(rm2.name == name);                           // Check the requested file name
+    assert(rm2.accept.empty());                         // No "accept" key was sent
+
+    RequestMessage lz(name, "lz");                      // Accepts compressed replies
+    Bytes with = lz.serialize();
+    assert(with.size() == lz.encoded_size() && with.size() > ser.size());
+    RequestMessage::View v = RequestMessage::parse(with.data(), with.size());
+    assert(v.name.equals("bar.dat", 7) && v.accept.equals("lz", 2));
     std::cout << "[ PASS ] RequestMessage serialize/deserialize\n";
 }
 
@@ -78,6 +142,510 @@ void test_status_message() {
     std::cout << "[ PASS ] StatusMessage serialize/deserialize\n";
 }
 
+// Test exact-size encoding
+// Function: test_exact_encoding
+// Purpose: Verifies each message's encoded_size matches what is written, that
+//          serialize allocates exactly once, and that the bytes match the
+//          generic KVMap encoding.
+void test_exact_encoding() {
+    for (size_t len : {0, 1, 17, 255}) {
+        std::string name(len ? len : 1, 'n');
+        Bytes payload(len, 0x5a);
+        Bytes ser = FileMessage::serialize(name, payload.data(), payload.size());
+        assert(ser.size() == FileMessage::encoded_size(name.size(), len));
+        assert(ser.capacity() == ser.size());           // No regrowth, no slack
+
+        Bytes appended = {0xEE};                        // encode() appends after existing bytes
+        FileMessage::encode(appended, name, payload.data(), payload.size());
+        assert(Bytes(appended.begin() + 1, appended.end()) == ser);
+    }
+
+    RequestMessage req("file.txt");
+    KVMap rin{{"name", pack109::serialize(req.name)}};
+    KVMap rout{{"Request", pack109::serialize_map(rin)}};
+    Bytes rser = req.serialize();
+    assert(rser == pack109::serialize_map(rout));
+    assert(rser.size() == req.encoded_size() && rser.capacity() == rser.size());
+
+    for (bool flag : {true, false}) {
+        StatusMessage st(flag, flag ? "Stored" : "");
+        KVMap sin;
+        sin["ok"] = pack109::serialize(st.ok);
+        sin["message"] = pack109::serialize(st.message);
+        KVMap sout{{"Status", pack109::serialize_map(sin)}};
+        Bytes sser = st.serialize();
+        assert(sser == pack109::serialize_map(sout));
+        assert(sser.size() == st.encoded_size() && sser.capacity() == sser.size());
+    }
+
+    std::string long_name(300, 'x');                    // Name needs the S16 form
+    Bytes lser = FileMessage::serialize(long_name, nullptr, 0);
+    assert(lser.size() == FileMessage::encoded_size(long_name.size(), 0) && lser.capacity() == lser.size());
+    assert(FileMessage::deserialize(lser).name == long_name);
+
+    std::cout << "[ PASS ] exact-size message encoding\n";
+}
+
+// Test large payloads
+// Function: test_binary_payloads
+// Purpose: Verifies file content round-trips at every B8/B16/B32 boundary and is
+//          viewed in place (stride 1) rather than copied.
+void test_binary_payloads() {
+    for (size_t len : {0, 255, 256, 65535, 65536, 1 << 20}) {
+        Bytes payload(len);
+        for (size_t i = 0; i < len; ++i) payload[i] = (uint8_t)(i * 31);
+        Bytes msg = FileMessage::serialize("big.bin", payload.data(), len);
+        assert(msg.size() == FileMessage::encoded_size(7, len));
+        FileMessage::View v = FileMessage::parse(msg.data(), msg.size());
+        assert(v.data.count == len && v.data.stride == 1);
+        assert(v.data.to_vec() == payload);
+        assert(pack109::deserialize_vec_u8(pack109::serialize_binary(payload.data(), len)) == payload);
+    }
+    std::cout << "[ PASS ] binary payloads\n";
+}
+
+// Test 16- and 32-bit containers
+// Function: test_wide_containers
+// Purpose: Verifies strings, arrays and maps round-trip on both sides of the
+//          8/16/32-bit boundaries and that the smallest form is chosen.
+void test_wide_containers() {
+    const struct { size_t n; uint8_t s, a, m; } cases[] = {
+        {255, PACK109_S8, PACK109_A8, PACK109_M8},
+        {256, PACK109_S16, PACK109_A16, PACK109_M16},
+        {65535, PACK109_S16, PACK109_A16, PACK109_M16},
+        {65536, PACK109_S32, PACK109_A32, PACK109_M32},
+    };
+    for (const auto &c : cases) {
+        std::string str(c.n, 's');
+        Bytes sb = pack109::serialize(str);
+        assert(sb[0] == c.s && sb.size() == pack109::encoded_string_size(c.n));
+        assert(pack109::deserialize_string(sb) == str);
+
+        std::vector<u64> nums(c.n);
+        for (size_t i = 0; i < c.n; ++i) nums[i] = i * 1000003;
+        Bytes ab = pack109::serialize(nums);
+        assert(ab[0] == c.a && pack109::deserialize_vec_u64(ab) == nums);
+
+        KVMap m;
+        for (size_t i = 0; i < c.n; ++i) m["k" + std::to_string(i)] = pack109::serialize((u8)i);
+        Bytes mb = pack109::serialize_map(m);
+        assert(mb[0] == c.m && pack109::deserialize_map(mb) == m);
+
+        pack109::Reader in(mb);                         // One skip covers the whole map
+        in.skip();
+        assert(in.at_end());
+    }
+
+    std::vector<std::string> names = {std::string(70000, 'a'), "b"};
+    assert(pack109::deserialize_vec_string(pack109::serialize(names)) == names);
+
+    std::cout << "[ PASS ] 16/32-bit containers\n";
+}
+
+// Test in-place decoding
+// Function: test_zero_copy_reader
+// Purpose: Verifies parsed views point into the original buffer, that inner keys
+//          may come in either order, and that truncated input is rejected.
+void test_zero_copy_reader() {
+    Bytes payload = {1, 2, 3, 4, 5};
+    Bytes msg = FileMessage("a.txt", payload).serialize();
+    FileMessage::View v = FileMessage::parse(msg.data(), msg.size());
+    assert(v.name.data > msg.data() && v.name.data + v.name.size <= msg.data() + msg.size());
+    assert(v.data.data > msg.data() && v.data.data < msg.data() + msg.size());
+    assert(v.name.str() == "a.txt" && v.data.to_vec() == payload);
+
+    // Keys in sorted (bytes, name) order, as the generic KVMap encoder writes them
+    KVMap inner{{"name", pack109::serialize(std::string("a.txt"))}, {"bytes", pack109::serialize(payload)}};
+    KVMap outer{{"File", pack109::serialize_map(inner)}};
+    FileMessage fm = FileMessage::deserialize(pack109::serialize_map(outer));
+    assert(fm.name == "a.txt" && fm.data == payload);
+
+    Bytes req = RequestMessage("b.txt").serialize();
+    assert(RequestMessage::parse(req.data(), req.size()).name.equals("b.txt", 5));
+
+    // Every proper prefix of a message is rejected
+    for (size_t cut = 0; cut < msg.size(); ++cut) {
+        bool threw = false;
+        try { FileMessage::parse(msg.data(), cut); } catch (const std::runtime_error &) { threw = true; }
+        assert(threw);
+    }
+
+    // skip() steps over a nested element in one call
+    pack109::Reader in(msg);
+    in.skip();
+    assert(in.at_end());
+
+    // An unknown key holding millions of nested arrays is skipped without
+    // recursion, and a truncated nest is rejected
+    const size_t depth = 4 * 1024 * 1024;
+    Bytes deep;
+    {
+        pack109::Encoder enc(deep);
+        enc.begin_map(1);
+        enc.put_string("Request", 7);
+        enc.begin_map(2);
+        enc.put_string("zz", 2);
+    }
+    for (size_t i = 0; i < depth; ++i) deep.insert(deep.end(), {0xac, 0x01});
+    deep.push_back(0xa0);
+    {
+        pack109::Encoder enc(deep);
+        enc.put_string("name", 4);
+        enc.put(std::string("b.txt"));
+    }
+    assert(RequestMessage::parse(deep.data(), deep.size()).name.equals("b.txt", 5));
+    uint64_t id;
+    assert(!peek_request_id(deep, id));
+    bool threw = false;
+    try { RequestMessage::parse(deep.data(), 12 + depth); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+
+    std::cout << "[ PASS ] zero-copy reader\n";
+}
+
+// Test chunked-transfer messages
+// Function: test_transfer_messages
+// Purpose: Verifies Begin, Chunk, Commit, Ack and Fetch round-trip and are
+//          classified by their outer key.
+void test_transfer_messages() {
+    Bytes b = BeginMessage("big.bin", 5000000000ull).serialize();
+    assert(peek_message_type(b) == MessageType::Begin);
+    BeginMessage bm = BeginMessage::deserialize(b);
+    assert(bm.name == "big.bin" && bm.size == 5000000000ull);
+
+    Bytes content(CHUNK_SIZE, 0x7e);
+    Bytes c = ChunkMessage::serialize("big.bin", 3, 5000000000ull, content.data(), content.size());
+    assert(peek_message_type(c) == MessageType::Chunk);
+    ChunkMessage::View cv = ChunkMessage::parse(c.data(), c.size());
+    assert(cv.name.equals("big.bin", 7) && cv.index == 3 && cv.size == 5000000000ull);
+    assert(cv.data.stride == 1 && cv.data.to_vec() == content);
+
+    Bytes m = CommitMessage("big.bin").serialize();
+    assert(peek_message_type(m) == MessageType::Commit);
+    assert(CommitMessage::deserialize(m).name == "big.bin");
+
+    Bytes a = AckMessage("big.bin", 4).serialize();
+    assert(peek_message_type(a) == MessageType::Ack);
+    AckMessage am = AckMessage::deserialize(a);
+    assert(am.name == "big.bin" && am.next == 4);
+
+    Bytes f = FetchMessage("big.bin", 7).serialize();
+    assert(peek_message_type(f) == MessageType::Fetch);
+    FetchMessage fm = FetchMessage::deserialize(f);
+    assert(fm.name == "big.bin" && fm.index == 7);
+
+    bool threw = false;                                 // A Fetch is not a Begin
+    try { BeginMessage::deserialize(f); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+
+    std::cout << "[ PASS ] chunked-transfer messages\n";
+}
+
+// Test message classification
+// Function: test_peek_message_type
+// Purpose: Verifies the outer-key classifier recognises every message type and
+//          rejects malformed or unknown headers without throwing.
+void test_peek_message_type() {
+    assert(peek_message_type(FileMessage("a", {1}).serialize()) == MessageType::File);
+    assert(peek_message_type(RequestMessage("a").serialize()) == MessageType::Request);
+    assert(peek_message_type(StatusMessage(true, "ok").serialize()) == MessageType::Status);
+    Bytes snap = SnapshotMessage().serialize();
+    assert(snap == Bytes({0xae, 0x01, 0xaa, 0x08, 'S', 'n', 'a', 'p', 's', 'h', 'o', 't', 0xae, 0x00}));
+    assert(peek_message_type(snap) == MessageType::Snapshot);
+    SnapshotMessage::deserialize(snap);
+    assert(peek_message_type(Bytes()) == MessageType::Invalid);               // Too short
+    assert(peek_message_type({0xae, 0x01, 0xaa, 0x04, 'F', 'i'}) == MessageType::Invalid); // Truncated key
+    assert(peek_message_type({0xae, 0x01, 0xaa, 0x03, 'F', 'o', 'o'}) == MessageType::Invalid);
+    assert(peek_message_type({0xac, 0x01, 0xa2, 0x00}) == MessageType::Invalid); // Not a map
+    std::cout << "[ PASS ] peek_message_type\n";
+}
+
+// Test length-prefixed framing and reassembly
+// Function: test_framing
+// Purpose: Verifies that FrameReader reassembles messages split across many reads
+//          and separates several messages delivered in a single read.
+void test_framing() {
+    Bytes a = RequestMessage("a.txt").serialize();
+    Bytes b = StatusMessage(true, "Stored").serialize();
+    Bytes stream = frame(a);
+    Bytes fb = frame(b);
+    stream.insert(stream.end(), fb.begin(), fb.end());
+    assert(stream.size() == a.size() + b.size() + 2 * FRAME_HEADER_SIZE);
+
+    // Case 1: both messages in one read
+    {
+        FrameReader r;
+        r.feed(stream.data(), stream.size());
+        Bytes out;
+        assert(r.next(out) && out == a);
+        assert(r.next(out) && out == b);
+        assert(!r.next(out));
+        assert(r.buffered() == 0);
+    }
+
+    // Case 2: one byte per read, including split length headers
+    {
+        FrameReader r;
+        std::vector<Bytes> got;
+        Bytes out;
+        for (uint8_t byte : stream) {
+            r.feed(&byte, 1);
+            while (r.next(out)) got.push_back(out);
+        }
+        assert(got.size() == 2 && got[0] == a && got[1] == b);
+    }
+
+    // Case 3: an empty payload is still a message
+    {
+        FrameReader r;
+        Bytes empty = frame(Bytes());
+        r.feed(empty.data(), empty.size());
+        Bytes out{1};
+        assert(r.next(out) && out.empty());
+    }
+
+    // Case 4: an oversized length header is rejected
+    {
+        FrameReader r;
+        uint8_t huge[] = {0xff, 0xff, 0xff, 0xff};
+        r.feed(huge, sizeof(huge));
+        Bytes out;
+        bool threw = false;
+        try { r.next(out); } catch (const std::runtime_error &) { threw = true; }
+        assert(threw);
+    }
+
+    std::cout << "[ PASS ] Framing reassembly\n";
+}
+
+// Test request IDs and the pipelining client
+// Function: test_pipelining
+// Purpose: Verifies that a request ID can be attached to and read back from any
+//          message without changing how it decodes, and that Pipeline keeps its
+//          window and matches replies to requests over a socket.
+void test_pipelining() {
+    uint64_t id = 0;
+    Bytes req = RequestMessage("a.txt", "lz").serialize();
+    assert(!peek_request_id(req, id));
+    attach_request_id(req, 7);
+    assert(peek_request_id(req, id) && id == 7);
+    RequestMessage rm = RequestMessage::deserialize(req);
+    assert(rm.name == "a.txt" && rm.accept == "lz");
+
+    Bytes status = StatusMessage(true, "Stored").serialize();
+    attach_request_id(status, 1ull << 40);
+    assert(peek_request_id(status, id) && id == (1ull << 40));
+    assert(StatusMessage::deserialize(status).message == "Stored");
+
+    Bytes snap = SnapshotMessage().serialize();   // Empty inner map
+    attach_request_id(snap, 3);
+    assert(peek_request_id(snap, id) && id == 3);
+    SnapshotMessage::deserialize(snap);
+
+    // 255 entries fit an M8 header; the 256th needs an M16 one
+    Bytes wide;
+    {
+        pack109::Encoder enc(wide);
+        enc.begin_map(1);
+        enc.put_string("Status", 6);
+        enc.begin_map(255);
+        enc.put_string("ok", 2);
+        enc.put(true);
+        for (int i = 1; i < 255; ++i) {
+            enc.put(std::string("k") + std::to_string(i));
+            enc.put((u8)i);
+        }
+    }
+    attach_request_id(wide, 9);
+    assert(wide[10] == PACK109_M16);       // After the outer header and "Status"
+    assert(peek_request_id(wide, id) && id == 9);
+    assert(StatusMessage::deserialize(wide).ok);
+
+    assert(!peek_request_id(Bytes(), id));
+    bool threw = false;
+    Bytes junk = {0xac, 0x00};
+    try { attach_request_id(junk, 1); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+
+    // A server that echoes each request's name and ID, and checks that the
+    // client never has more than the window outstanding
+    const size_t window = 4, count = 50;
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::thread server([&fds, window]() {
+        FrameReader reader;
+        uint8_t buf[4096];
+        Bytes msg;
+        uint64_t answered = 0, id;
+        ssize_t n;
+        while ((n = recv(fds[1], buf, sizeof(buf), 0)) > 0) {
+            reader.feed(buf, n);
+            while (reader.next(msg)) {
+                assert(peek_request_id(msg, id) && id == answered + 1);
+                assert(id - answered <= window);
+                Bytes reply = StatusMessage(true, RequestMessage::deserialize(msg).name).serialize();
+                attach_request_id(reply, id);
+                assert(send_frame(fds[1], reply));
+                ++answered;
+            }
+        }
+    });
+
+    Pipeline pipe(fds[0], window);
+    std::vector<uint64_t> ids;
+    size_t done = 0;
+    Bytes reply;
+    for (size_t i = 0; i < count; ++i) {
+        ids.push_back(pipe.submit(RequestMessage("f" + std::to_string(i)).serialize()));
+        assert(pipe.in_flight() == i + 1 - done);
+        if (i % 3 == 2) {               // Fall behind, so submit() has to read
+            assert(pipe.receive(reply) == ids[done]);
+            assert(StatusMessage::deserialize(reply).message == "f" + std::to_string(done));
+            ++done;
+        }
+    }
+    while (pipe.in_flight() > 0) {
+        assert(pipe.receive(reply) == ids[done]);
+        assert(StatusMessage::deserialize(reply).message == "f" + std::to_string(done));
+        ++done;
+    }
+    assert(done == count);
+    threw = false;
+    try { pipe.receive(reply); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+    close(fds[0]);
+    server.join();
+    close(fds[1]);
+
+    std::cout << "[ PASS ] Request IDs and pipelining\n";
+}
+
+// Test the batch messages
+// Function: test_batch_messages
+// Purpose: Verifies MultiRequest, MultiFile and MultiStatus round-trip, that the
+//          borrowed-bytes encoders produce exactly the sizes they announce, and
+//          that items carry their status and decode "lz" content.
+void test_batch_messages() {
+    MultiRequestMessage mr({"a.txt", "b.txt", ""}, "lz");
+    Bytes mrb = mr.serialize();
+    assert(peek_message_type(mrb) == MessageType::MultiRequest);
+    MultiRequestMessage mr2 = MultiRequestMessage::deserialize(mrb);
+    assert(mr2.names == mr.names && mr2.accept == "lz");
+    MultiRequestMessage::View mv = MultiRequestMessage::parse(mrb.data(), mrb.size());
+    assert(mv.names.size() == 3 && mv.names[1].equals("b.txt", 5) && mv.accept.equals("lz", 2));
+    assert(MultiRequestMessage::deserialize(MultiRequestMessage({}).serialize()).names.empty());
+
+    MultiFileMessage mf;
+    mf.files.push_back({"one", true, {1, 2, 3}, ""});
+    mf.files.push_back({"gone", false, {}, "Not found: gone"});
+    mf.files.push_back({"big", true, Bytes(70000, 5), ""});           // B32 content
+    Bytes mfb = mf.serialize();
+    assert(peek_message_type(mfb) == MessageType::MultiFile);
+    MultiFileMessage mf2 = MultiFileMessage::deserialize(mfb);
+    assert(mf2.files.size() == 3);
+    assert(mf2.files[0].ok && mf2.files[0].name == "one" && mf2.files[0].data == Bytes({1, 2, 3}));
+    assert(!mf2.files[1].ok && mf2.files[1].message == "Not found: gone" && mf2.files[1].data.empty());
+    assert(mf2.files[2].data == Bytes(70000, 5));
+
+    // The server's path: exact sizes, and an item sent compressed
+    Bytes text;
+    for (int i = 0; i < 200; ++i) text.insert(text.end(), {'a', 'b', 'c', 'd', 'e'});
+    Bytes packed;
+    assert(lz_compress(text.data(), text.size(), packed, text.size()));
+    size_t size = MultiFileMessage::header_size(2) + MultiFileMessage::item_size(1, packed.size(), 2)
+                + MultiFileMessage::missing_size(1, 4);
+    Bytes out;
+    MultiFileMessage::encode_header(out, 2);
+    MultiFileMessage::encode_item(out, "z", packed.data(), packed.size(), "lz", text.size());
+    MultiFileMessage::encode_missing(out, "q", "gone");
+    assert(out.size() == size);
+    std::vector<MultiFileMessage::ItemView> views = MultiFileMessage::parse(out.data(), out.size());
+    assert(views.size() == 2 && views[0].ok && views[0].file.encoding.equals("lz", 2) && !views[1].ok);
+    MultiFileMessage mf3 = MultiFileMessage::deserialize(out);
+    assert(mf3.files[0].data == text && mf3.files[1].name == "q");
+
+    // A client batch may leave out "ok"; a present item needs content
+    Bytes bare;
+    {
+        pack109::Encoder enc(bare);
+        MultiFileMessage::encode_header(bare, 1);
+        enc.begin_map(1);
+        enc.put_string("name", 4);
+        enc.put(std::string("x"));
+    }
+    bool threw = false;
+    try { MultiFileMessage::parse(bare.data(), bare.size()); } catch (const std::runtime_error &) { threw = true; }
+    assert(threw);
+
+    MultiStatusMessage ms;
+    ms.results.push_back({"one", true, "Stored"});
+    ms.results.push_back({"two", false, "Could not store: disk full"});
+    Bytes msb = ms.serialize();
+    assert(peek_message_type(msb) == MessageType::MultiStatus);
+    MultiStatusMessage ms2 = MultiStatusMessage::deserialize(msb);
+    assert(ms2.results.size() == 2 && ms2.results[0].ok && ms2.results[0].message == "Stored");
+    assert(!ms2.results[1].ok && ms2.results[1].name == "two");
+
+    std::cout << "[ PASS ] Batch messages\n";
+}
+
+// Function: test_replies
+// Purpose: Verifies that a reply built from a head encoder and a blob range
+//          decodes as the same message encoded in one buffer, that short
+//          ranges are copied and long ones referred to, and that a request ID
+//          can be attached to a reply whose content lives in a blob.
+void test_replies() {
+    Bytes content(100000);
+    for (size_t i = 0; i < content.size(); ++i) content[i] = (uint8_t)(i * 7);
+    BlobRef blob = make_blob(content);
+
+    Reply reply;
+    FileMessage::encode_head(reply.buffer(), "big.bin", content.size());
+    reply.add_blob(blob, 0, content.size());
+    assert(reply.parts().size() == 2 && reply.parts()[1].blob == blob);
+    assert(reply.size() == FileMessage::encoded_size(7, content.size()));
+    assert(reply.flatten() == FileMessage::serialize("big.bin", content.data(), content.size()));
+
+    // A chunk is a range of the blob
+    Reply chunk;
+    ChunkMessage::encode_head(chunk.buffer(), "big.bin", 1, content.size(), 40000);
+    chunk.add_blob(blob, 40000, 40000);
+    Bytes flat = chunk.flatten();
+    assert(flat == ChunkMessage::serialize("big.bin", 1, content.size(), content.data() + 40000, 40000));
+
+    // Short ranges are copied, so the reply stays one buffer
+    Reply small;
+    FileMessage::encode_head(small.buffer(), "s", 10);
+    small.add_blob(blob, 5, 10);
+    assert(small.parts().size() == 1 && !small.parts()[0].blob);
+    assert(FileMessage::deserialize(small.flatten()).data == Bytes(content.begin() + 5, content.begin() + 15));
+
+    // The request ID goes after the blob, and the map count is rewritten in place
+    attach_request_id(reply, 77);
+    assert(reply.parts().size() == 3 && reply.parts()[1].blob == blob);
+    Bytes tagged = reply.flatten();
+    uint64_t id = 0;
+    assert(peek_request_id(tagged, id) && id == 77);
+    FileMessage fm = FileMessage::deserialize(tagged);
+    assert(fm.name == "big.bin" && fm.data == content);
+
+    // Batches mix copied items, referred items and missing ones
+    Reply batch;
+    MultiFileMessage::encode_header(batch.buffer(), 3);
+    MultiFileMessage::encode_item_head(batch.buffer(), "a", 3);
+    batch.add_blob(blob, 0, 3);
+    MultiFileMessage::encode_item_head(batch.buffer(), "b", content.size());
+    batch.add_blob(blob, 0, content.size());
+    MultiFileMessage::encode_missing(batch.buffer(), "c", "Not found");
+    attach_request_id(batch, 1u << 20);
+    MultiFileMessage mf = MultiFileMessage::deserialize(batch.flatten());
+    assert(mf.files.size() == 3 && mf.files[0].data == Bytes(content.begin(), content.begin() + 3));
+    assert(mf.files[1].data == content && !mf.files[2].ok);
+    assert(peek_request_id(batch.flatten(), id) && id == (1u << 20));
+
+    std::cout << "[ PASS ] Replies\n";
+}
+
 // Entry point for the test suite
 // Function: main
 // Purpose: Runs all the unit tests for the protocol classes and helper functions.
@@ -86,6 +654,16 @@ int main() {
     test_file_message();        // Test FileMessage serialization/deserialization
     test_request_message();     // Test RequestMessage serialization/deserialization
     test_status_message();      // Test StatusMessage serialization/deserialization
+    test_exact_encoding();      // Test single-allocation encoders
+    test_wide_containers();     // Test S16/A16/M16 and 32-bit forms
+    test_zero_copy_reader();    // Test in-place decoding
+    test_binary_payloads();     // Test B8/B16/B32 file content
+    test_transfer_messages();   // Test Begin/Chunk/Commit/Ack/Fetch
+    test_peek_message_type();   // Test outer-key message classification
+    test_framing();             // Test length-prefixed framing and reassembly
+    test_pipelining();          // Test request IDs and the pipelining client
+    test_batch_messages();      // Test MultiRequest/MultiFile/MultiStatus
+    test_replies();             // Test multi-part replies that refer to blobs
     std::cout << "All protocol tests passed!\n";
     return 0;
 }
\ No newline at end of file
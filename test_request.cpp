@@ -11,7 +11,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
-#include "protocol.hpp"  // For RequestMessage, FileMessage, xor42
+#include "protocol.hpp"  // For RequestMessage, FileMessage, framing
 
 int main() {
     // Server connection details
@@ -21,12 +21,12 @@ int main() {
 
     // 1. Build RequestMessage
     // Create a RequestMessage object for the specified file name.
-    RequestMessage req(filename);
+    RequestMessage req(filename, "lz");  // The reply may come compressed
 
-    // 2. Serialize & encrypt
-    // Convert the RequestMessage into a serialized byte buffer and encrypt it.
+    // 2. Serialize
+    // Convert the RequestMessage into a serialized byte buffer. It is encrypted
+    // by send_frame when it goes out.
     auto serialized = req.serialize();
-    auto encrypted = xor42(serialized);
 
     // --- Socket setup ---
     // Create a socket for TCP communication.
@@ -51,34 +51,29 @@ int main() {
     std::cout << "Connected to server for request.\n";
 
     // 3. Send RequestMessage
-    // Send the encrypted RequestMessage to the server.
-    send(sock, encrypted.data(), encrypted.size(), 0);
+    // Send the RequestMessage to the server as one encrypted, length-prefixed frame.
+    send_frame(sock, serialized);
 
     // Signal the server that the client has finished sending data.
     shutdown(sock, SHUT_WR);
 
     // 4. Receive FileMessage
-    // Read the response from the server into a buffer.
+    // Read one framed response from the server into a buffer.
     std::vector<uint8_t> resp_buf; // Buffer to hold the response
-    uint8_t tmp[4096];             // Temporary buffer for reading chunks
-    ssize_t n;
-    while ((n = recv(sock, tmp, sizeof(tmp), 0)) > 0) {
-        resp_buf.insert(resp_buf.end(), tmp, tmp + n); // Append received data to the buffer
-    }
+    bool got = recv_frame(sock, resp_buf);
     close(sock); // Close the socket after receiving the response
 
-    if (n < 0) {
-        perror("recv");
+    if (!got) {
+        std::cerr << "recv: connection closed before a full response arrived\n";
         return 1; // Exit if receiving data fails
     }
 
-    std::cout << "Received " << resp_buf.size() << " bytes encrypted back\n";
+    std::cout << "Received " << resp_buf.size() << " bytes back\n";
 
-    // 5. Decrypt & deserialize FileMessage
-    // Decrypt the response and attempt to parse it as a FileMessage.
-    auto dec = xor42(resp_buf);
+    // 5. Deserialize FileMessage
+    // recv_frame already decrypted the response; parse it as a FileMessage.
     try {
-        auto fm = FileMessage::deserialize(dec); // Parse the response
+        auto fm = FileMessage::deserialize(resp_buf); // Parse the response
         std::cout << "File name: " << fm.name << "\n"; // Display the file name
         std::cout << "Data (as string):\n";
         std::cout << std::string(fm.data.begin(), fm.data.end()); // Display the file content
@@ -0,0 +1,168 @@
+// File: test_transfer.cpp
+// Description: End-to-end test of chunked transfers against a live server.
+//              Uploads a multi-megabyte file in chunks, drops the connection
+//              part-way through and resumes it on a new one, commits it, then
+//              downloads it chunk by chunk and compares the bytes, and checks
+//              that a plain Request for it is answered.
+//              Usage: test_transfer [--hostname ip:port] [--size bytes]
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "protocol.hpp"  // for Begin/Chunk/Commit/Ack/Fetch/Request messages, framing
+
+// Function: open_socket
+// Purpose: Connects a new TCP socket to the server.
+// Returns:
+//   - The socket descriptor, or -1 on failure.
+static int open_socket(const sockaddr_in &addr) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Function: exchange
+// Purpose: Sends one message and waits for its reply.
+// Throws:
+//   - std::runtime_error if the connection fails.
+static Bytes exchange(int sock, const Bytes &msg) {
+    Bytes reply;
+    if (!send_frame(sock, msg) || !recv_frame(sock, reply))
+        throw std::runtime_error("connection closed");
+    return reply;
+}
+
+// Function: expect_ack
+// Purpose: Decodes an Ack reply, reporting a Status reply as an error.
+// Returns:
+//   - The index of the next chunk the server expects.
+static uint64_t expect_ack(const Bytes &reply) {
+    if (peek_message_type(reply) == MessageType::Status)
+        throw std::runtime_error("server: " + StatusMessage::deserialize(reply).message);
+    return AckMessage::deserialize(reply).next;
+}
+
+// Function: upload
+// Purpose: Sends Begin, then chunks from the index the server asks for.
+// Parameters:
+//   - stop_after: Return after sending this many chunks, without committing, to
+//     simulate an interrupted transfer (0 runs to completion).
+// Returns:
+//   - The index the server reported in reply to Begin.
+static uint64_t upload(int sock, const std::string &name, const Bytes &data, uint64_t stop_after) {
+    uint64_t resumed = expect_ack(exchange(sock, BeginMessage(name, data.size()).serialize()));
+    uint64_t next = resumed, sent = 0;
+    while (next * CHUNK_SIZE < data.size()) {
+        if (stop_after && sent == stop_after) return resumed;
+        size_t off = next * CHUNK_SIZE;
+        size_t len = std::min(CHUNK_SIZE, data.size() - off);
+        next = expect_ack(exchange(sock, ChunkMessage::serialize(name, next, data.size(), data.data() + off, len)));
+        ++sent;
+    }
+    StatusMessage st = StatusMessage::deserialize(exchange(sock, CommitMessage(name).serialize()));
+    if (!st.ok) throw std::runtime_error("commit: " + st.message);
+    return resumed;
+}
+
+// Function: download
+// Purpose: Fetches chunks 0, 1, ... until the whole file has arrived.
+static Bytes download(int sock, const std::string &name) {
+    Bytes out;
+    uint64_t index = 0, size = 0;
+    do {
+        Bytes reply = exchange(sock, FetchMessage(name, index).serialize());
+        if (peek_message_type(reply) != MessageType::Chunk)
+            throw std::runtime_error("server: " + StatusMessage::deserialize(reply).message);
+        ChunkMessage::View v = ChunkMessage::parse(reply.data(), reply.size());
+        size = v.size;
+        out.resize(out.size() + v.data.count);
+        v.data.copy_to(out.data() + out.size() - v.data.count);
+        ++index;
+    } while (out.size() < size);
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    const char *hostname = "127.0.0.1"; // Server hostname or IP address
+    int port = 8081;                    // Server port
+    size_t size = 5 * 1024 * 1024 + 123; // Bytes in the test file (not a chunk multiple)
+
+    std::string host_arg;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--hostname") == 0 || strcmp(argv[i], "-h") == 0) && i + 1 < argc) {
+            host_arg = argv[++i];
+            auto colon = host_arg.find(':');
+            if (colon == std::string::npos) {
+                std::cerr << "Invalid hostname format, use IP:PORT\n";
+                return 1;
+            }
+            port = std::atoi(host_arg.c_str() + colon + 1);
+            host_arg.resize(colon);
+            hostname = host_arg.c_str();
+        } else if ((strcmp(argv[i], "--size") == 0 || strcmp(argv[i], "-s") == 0) && i + 1 < argc) {
+            size = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    inet_pton(AF_INET, hostname, &addr.sin_addr);
+
+    Bytes data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = (uint8_t)(i * 2654435761u >> 24);
+    const std::string name = "transfer.bin";
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+
+        // 1. Upload part of the file, then drop the connection
+        int sock = open_socket(addr);
+        if (sock < 0) { perror("connect"); return 1; }
+        uint64_t total = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        upload(sock, name, data, total / 2);
+        close(sock);
+
+        // 2. Reconnect and resume from the first missing chunk
+        sock = open_socket(addr);
+        if (sock < 0) { perror("connect"); return 1; }
+        uint64_t resumed = upload(sock, name, data, 0);
+        std::cout << "Resumed upload at chunk " << resumed << " of " << total << "\n";
+
+        // 3. Download and compare
+        Bytes back = download(sock, name);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // 4. A plain Request gets the file in one message, or a Status if it
+        //    cannot fit in one frame
+        Bytes reply = exchange(sock, RequestMessage(name).serialize());
+        close(sock);
+        bool fits = FileMessage::encoded_size(name.size(), size) + REQUEST_ID_SIZE <= MAX_FRAME_SIZE;
+        bool answered = fits ? FileMessage::deserialize(reply).data == data
+                             : !StatusMessage::deserialize(reply).ok;
+
+        if (resumed != total / 2 || back != data || !answered) {
+            std::cerr << "FAIL: " << (back != data ? "content differs" : !answered ? "wrong reply to Request"
+                                                                     : "upload did not resume") << "\n";
+            return 1;
+        }
+        std::cout << "Transferred " << size << " bytes each way in " << secs << " s\n";
+    } catch (const std::exception &e) {
+        std::cerr << "FAIL: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
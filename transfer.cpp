@@ -0,0 +1,167 @@
+// File: transfer.cpp
+// Description: Implementation of the server side of chunked uploads.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "transfer.hpp"
+#include "protocol.hpp"   // CHUNK_SIZE
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// Function: chunk_count
+// Purpose: Rounds the file length up to whole chunks.
+uint64_t chunk_count(uint64_t size) {
+    return (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+// Function: now_ms
+// Returns:
+//   - The steady clock in milliseconds, for the idle timeout.
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Constructor
+// Purpose: Records the limits.
+UploadTable::UploadTable(size_t max_uploads, uint64_t max_bytes, unsigned idle_ms)
+  : max_uploads_(max_uploads), max_bytes_(max_bytes), idle_ms_(idle_ms) {}
+
+// Method: find
+// Purpose: Looks up an upload under the table lock; the caller then locks the
+//          upload itself.
+std::shared_ptr<UploadTable::Upload> UploadTable::find(const std::string &name) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = uploads_.find(name);
+    return it == uploads_.end() ? nullptr : it->second;
+}
+
+// Method: drop
+// Purpose: Locks the upload so no chunk is being appended meanwhile.
+void UploadTable::drop(Upload &up) {
+    std::lock_guard<std::mutex> guard(up.lock);
+    if (up.dropped) return;
+    up.dropped = true;
+    bytes_ -= up.data.size();
+    std::vector<uint8_t>().swap(up.data);
+}
+
+// Method: expire
+// Purpose: Walks the whole table; it holds at most max_uploads_ entries.
+void UploadTable::expire() {
+    int64_t now = now_ms();
+    for (auto it = uploads_.begin(); it != uploads_.end();) {
+        if (now - it->second->used.load() > idle_ms_ && !it->second->committing) {
+            drop(*it->second);
+            it = uploads_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Method: begin
+// Purpose: Resumes an upload with the same name and size; otherwise replaces it
+//          with a fresh one. Nothing is reserved up front: the content grows
+//          as chunks arrive, so an upload only holds what was sent.
+uint64_t UploadTable::begin(const std::string &name, uint64_t size) {
+    if (size > MAX_FILE_SIZE || size > max_bytes_) throw std::runtime_error("File too large: " + name);
+
+    std::lock_guard<std::mutex> guard(lock_);
+    expire();
+    auto it = uploads_.find(name);
+    if (it != uploads_.end()) {
+        std::shared_ptr<Upload> up = it->second;
+        {
+            std::lock_guard<std::mutex> up_guard(up->lock);
+            if (up->size == size) {                // Resume where it stopped
+                up->used = now_ms();
+                return up->next;
+            }
+            if (up->committing) throw std::runtime_error("Upload being committed: " + name);
+        }
+        drop(*up);
+        uploads_.erase(it);
+    }
+    if (uploads_.size() >= max_uploads_) throw std::runtime_error("Too many uploads in progress");
+
+    std::shared_ptr<Upload> fresh = std::make_shared<Upload>();
+    fresh->size = size;
+    fresh->next = 0;
+    fresh->used = now_ms();
+    uploads_[name] = fresh;
+    return 0;
+}
+
+// Method: chunk
+// Purpose: Checks the chunk against the upload's state and appends it.
+uint64_t UploadTable::chunk(const std::string &name, uint64_t index, uint64_t size,
+                            const pack109::ByteSpan &data) {
+    std::shared_ptr<Upload> up = find(name);
+    if (!up) throw std::runtime_error("No upload in progress: " + name);
+
+    std::lock_guard<std::mutex> guard(up->lock);
+    if (up->dropped) throw std::runtime_error("No upload in progress: " + name);
+    if (up->size != size) throw std::runtime_error("Upload size mismatch: " + name);
+    up->used = now_ms();
+    if (index != up->next) return up->next;       // Duplicate or early chunk
+
+    uint64_t offset = index * CHUNK_SIZE;
+    if (offset >= up->size) throw std::runtime_error("Chunk out of range: " + name);
+    uint64_t expected = std::min<uint64_t>(CHUNK_SIZE, up->size - offset);
+    if (data.count != expected) throw std::runtime_error("Chunk has wrong length: " + name);
+    if (bytes_.fetch_add(expected) + expected > max_bytes_) {
+        bytes_ -= expected;
+        throw std::runtime_error("Too much upload data in progress: " + name);
+    }
+
+    up->data.resize(offset + expected);           // Grows geometrically
+    data.copy_to(up->data.data() + offset);
+    return ++up->next;
+}
+
+// Method: commit
+// Purpose: Marks the completed upload as committing, then stores its content
+//          with no lock held: a complete upload takes no more chunks, and
+//          begin() and expire() leave a committing one alone. The upload is
+//          removed only after the store succeeded.
+bool UploadTable::commit(const std::string &name, const Store &store) {
+    std::shared_ptr<Upload> up;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = uploads_.find(name);
+        if (it == uploads_.end()) throw std::runtime_error("No upload in progress: " + name);
+        up = it->second;
+        std::lock_guard<std::mutex> up_guard(up->lock);
+        if (up->next != chunk_count(up->size)) throw std::runtime_error("Upload incomplete: " + name);
+        if (up->committing) throw std::runtime_error("Upload being committed: " + name);
+        up->committing = true;
+    }
+
+    bool existed;
+    try {
+        existed = store(up->data);
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(lock_);   // expire() reads committing under lock_ alone
+        std::lock_guard<std::mutex> up_guard(up->lock);
+        up->committing = false;
+        up->used = now_ms();
+        throw;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = uploads_.find(name);
+    if (it != uploads_.end() && it->second == up) uploads_.erase(it);
+    up->committing = false;
+    drop(*up);
+    return existed;
+}
+
+// Method: pending
+// Purpose: Counts the uploads in progress.
+size_t UploadTable::pending() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return uploads_.size();
+}
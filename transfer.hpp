@@ -0,0 +1,149 @@
+// File: transfer.hpp
+// Description: Header file for the server side of chunked uploads. Uploads in
+//              progress are kept apart from the store until they are committed,
+//              and outlive the connection that started them so an interrupted
+//              transfer can be resumed.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef TRANSFER_HPP
+#define TRANSFER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+#include "pack109.hpp"   // ByteSpan
+
+// Constant: MAX_FILE_SIZE
+// Purpose: Largest file accepted by an upload; the persistence file stores
+//          lengths in 32 bits.
+constexpr uint64_t MAX_FILE_SIZE = 0xFFFFFFFFull;
+
+// Class: UploadTable
+// Purpose: Tracks every upload in progress by file name. Each upload has its
+//          own lock, so chunks of different files are copied in parallel.
+//          Uploads hold only the bytes received so far, and the table bounds
+//          how many there are and the bytes they hold together; an upload
+//          left idle for longer than the timeout is dropped by the next
+//          begin(), so abandoned transfers do not hold memory for good.
+class UploadTable {
+public:
+    // Constant: MAX_UPLOADS / MAX_UPLOAD_BYTES / IDLE_TIMEOUT_MS
+    // Purpose: Default limits: uploads in progress, bytes they hold in
+    //          total, and how long one may go without a Begin or a Chunk.
+    static constexpr size_t MAX_UPLOADS = 256;
+    static constexpr uint64_t MAX_UPLOAD_BYTES = 1ull << 30;
+    static constexpr unsigned IDLE_TIMEOUT_MS = 10 * 60 * 1000;
+
+    // Constructor
+    // Parameters:
+    //   - max_uploads: Most uploads in progress at once.
+    //   - max_bytes: Most bytes held by all uploads together.
+    //   - idle_ms: Time after which an upload nobody sends to is dropped.
+    explicit UploadTable(size_t max_uploads = MAX_UPLOADS, uint64_t max_bytes = MAX_UPLOAD_BYTES,
+                         unsigned idle_ms = IDLE_TIMEOUT_MS);
+
+    // Method: begin
+    // Purpose: Starts an upload, or resumes one of the same name and size.
+    //          Uploads idle past the timeout are dropped first.
+    // Parameters:
+    //   - name: The file name.
+    //   - size: The total length of the file in bytes.
+    // Returns:
+    //   - The index of the first chunk the server still needs.
+    // Throws:
+    //   - std::runtime_error if size is larger than MAX_FILE_SIZE or the byte
+    //     limit, or if the table already holds the most uploads allowed.
+    uint64_t begin(const std::string &name, uint64_t size);
+
+    // Method: chunk
+    // Purpose: Appends one chunk to an upload. A chunk whose index is not the
+    //          expected one is ignored, so a client that resends after losing
+    //          an Ack simply learns where to continue.
+    // Parameters:
+    //   - name: The file name.
+    //   - index: The position of the chunk in the file.
+    //   - size: The total file length the client announced.
+    //   - data: The chunk content.
+    // Returns:
+    //   - The index of the next chunk the server expects.
+    // Throws:
+    //   - std::runtime_error if no matching upload is in progress, the chunk
+    //     has the wrong length, or the uploads would hold more than the byte
+    //     limit.
+    uint64_t chunk(const std::string &name, uint64_t index, uint64_t size,
+                   const pack109::ByteSpan &data);
+
+    // Type: Store
+    // Purpose: Stores (and logs) a committed upload's content like any other
+    //          write; returns whether it replaced a file.
+    using Store = std::function<bool(const std::vector<uint8_t> &)>;
+
+    // Method: commit
+    // Purpose: Hands a completed upload's content to `store`, and ends the
+    //          upload only once `store` has returned. If `store` throws, the
+    //          upload is kept as it was, so the client can Commit again.
+    //          While `store` runs the upload cannot be replaced or expired.
+    // Returns:
+    //   - What `store` returned.
+    // Throws:
+    //   - std::runtime_error if no upload is in progress, chunks are missing
+    //     or the upload is already being committed; anything `store` throws.
+    bool commit(const std::string &name, const Store &store);
+
+    // Method: pending
+    // Returns:
+    //   - The number of uploads in progress.
+    size_t pending() const;
+
+    // Method: bytes
+    // Returns:
+    //   - The bytes held by the uploads in progress.
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    // Struct: Upload
+    // Purpose: The chunks received so far for one file.
+    struct Upload {
+        std::mutex lock;
+        uint64_t size;               // Announced file length
+        uint64_t next;               // Index of the next expected chunk
+        std::vector<uint8_t> data;   // Content received so far
+        bool dropped = false;        // Removed from the table; takes no more chunks
+        bool committing = false;     // Being stored by commit(); not to be dropped. Written with lock_ held
+        std::atomic<int64_t> used{0}; // Last Begin or Chunk, in steady-clock ms
+    };
+
+    // Method: find
+    // Purpose: Looks up an upload in progress, or returns null.
+    std::shared_ptr<Upload> find(const std::string &name);
+
+    // Method: drop
+    // Purpose: Frees an upload's bytes and marks it dropped. The caller has
+    //          already taken it out of uploads_ (or is about to).
+    void drop(Upload &up);
+
+    // Method: expire
+    // Purpose: Drops the uploads idle past the timeout. Called with lock_ held.
+    void expire();
+
+    const size_t max_uploads_;
+    const uint64_t max_bytes_;
+    const int64_t idle_ms_;
+    std::atomic<uint64_t> bytes_{0};                                 // Bytes held by all uploads
+    mutable std::mutex lock_;                                        // Guards uploads_
+    std::unordered_map<std::string, std::shared_ptr<Upload>> uploads_; // Uploads by file name
+};
+
+// Function: chunk_count
+// Returns:
+//   - The number of CHUNK_SIZE chunks a file of `size` bytes is split into.
+uint64_t chunk_count(uint64_t size);
+
+#endif // TRANSFER_HPP
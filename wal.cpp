@@ -0,0 +1,450 @@
+// File: wal.cpp
+// Description: Implementation of the append-only write-ahead log.
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#include "wal.hpp"
+#include "protocol.hpp"   // FileMessage
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>        // IOV_MAX
+#include <sys/uio.h>      // writev
+#include <dirent.h>       // opendir, for listing segments
+#include <cstdio>         // rename
+
+// Function: parse_fsync_policy
+// Purpose: Maps "always", "never" or a millisecond count to a policy.
+bool parse_fsync_policy(const std::string &arg, FsyncPolicy &policy, unsigned &interval_ms) {
+    if (arg == "always") {
+        policy = FsyncPolicy::Always;
+    } else if (arg == "never") {
+        policy = FsyncPolicy::Never;
+    } else {
+        char *end = nullptr;
+        unsigned long ms = std::strtoul(arg.c_str(), &end, 10);
+        if (arg.empty() || *end != '\0' || ms == 0) return false;
+        policy = FsyncPolicy::Interval;
+        interval_ms = static_cast<unsigned>(ms);
+    }
+    return true;
+}
+
+// Function: crc32
+// Purpose: Table-driven CRC-32 with the reflected IEEE polynomial.
+uint32_t crc32(const uint8_t *data, size_t len) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Function: put_u32
+// Purpose: Writes a big-endian 32-bit value.
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+// Function: get_u32
+// Purpose: Reads a big-endian 32-bit value.
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Function: split_path
+// Purpose: Splits a path into its directory ("." if none) and file name.
+static void split_path(const std::string &path, std::string &dir, std::string &base) {
+    size_t slash = path.rfind('/');
+    dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    base = slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Function: sync_parent_dir
+// Purpose: Opens the containing directory and fsyncs it.
+bool sync_parent_dir(const std::string &path) {
+    std::string dir, base;
+    split_path(path, dir, base);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Function: read_all
+// Purpose: Reads the first `size` bytes of a file, continuing after short reads.
+// Throws:
+//   - std::runtime_error if the file cannot be read.
+static std::vector<uint8_t> read_all(int fd, size_t size, const std::string &path) {
+    std::vector<uint8_t> buf(size);
+    size_t got = 0;
+    while (got < buf.size()) {
+        ssize_t n = pread(fd, buf.data() + got, buf.size() - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Cannot read log '" + path + "'");
+        got += n;
+    }
+    return buf;
+}
+
+// Function: apply_records
+// Purpose: Applies the intact records at the start of `buf` to the store.
+// Parameters:
+//   - end: Set to the length of the intact prefix.
+// Returns:
+//   - The number of records applied.
+static size_t apply_records(const std::vector<uint8_t> &buf, FileServerMap &store, size_t &end) {
+    size_t pos = 0, applied = 0;
+    while (buf.size() - pos >= WAL_HEADER_SIZE) {
+        uint32_t len = get_u32(&buf[pos]);
+        uint32_t sum = get_u32(&buf[pos + 4]);
+        if (len > buf.size() - pos - WAL_HEADER_SIZE) break;     // Torn record
+        const uint8_t *payload = &buf[pos + WAL_HEADER_SIZE];
+        if (crc32(payload, len) != sum) break;                    // Corrupt record
+        FileMessage::View rec;
+        try {
+            rec = FileMessage::parse(payload, len);
+        } catch (const std::exception &) {
+            break;
+        }
+        store.insert(rec.name.str(), rec.data.to_vec());
+        pos += WAL_HEADER_SIZE + len;
+        ++applied;
+    }
+    end = pos;
+    return applied;
+}
+
+// Constructor
+// Purpose: Opens the log and starts the flusher for the interval policy.
+WriteAheadLog::WriteAheadLog(const std::string &path, FsyncPolicy policy, unsigned interval_ms,
+                             unsigned window_us)
+  : fd_(-1), path_(path), policy_(policy), interval_ms_(interval_ms), window_us_(window_us) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) throw std::runtime_error("Cannot open log '" + path + "': " + strerror(errno));
+    struct stat st;
+    if (fstat(fd_, &st) == 0) size_ = st.st_size;
+    std::vector<uint64_t> old = segments();
+    if (!old.empty()) next_segment_ = old.back() + 1;
+    if (policy_ == FsyncPolicy::Interval) flusher_ = std::thread(&WriteAheadLog::flush_loop, this);
+}
+
+// Destructor
+// Purpose: Stops the flusher, makes the log durable and closes it.
+WriteAheadLog::~WriteAheadLog() {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (flusher_.joinable()) flusher_.join();
+    if (policy_ != FsyncPolicy::Never) fdatasync(fd_);
+    close(fd_);
+}
+
+// Method: replay
+// Purpose: Reads each segment and then the live log, applies each record whose
+//          length and checksum are intact, and truncates the live log after the
+//          last one.
+size_t WriteAheadLog::replay(FileServerMap &store) {
+    size_t applied = 0, end;
+    for (uint64_t n : segments()) {
+        std::string seg = segment_path(n);
+        int fd = open(seg.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Cannot open log '" + seg + "': " + strerror(errno));
+        struct stat st;
+        std::vector<uint8_t> buf;
+        try {
+            buf = read_all(fd, fstat(fd, &st) == 0 ? st.st_size : 0, seg);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        applied += apply_records(buf, store, end);
+    }
+
+    std::vector<uint8_t> buf = read_all(fd_, size_, path_);
+    applied += apply_records(buf, store, end);
+    if (end != buf.size()) {
+        if (ftruncate(fd_, end) != 0)
+            throw std::runtime_error("Cannot truncate log '" + path_ + "': " + strerror(errno));
+        size_ = end;
+    }
+    return applied;
+}
+
+// Method: insert
+// Purpose: Builds the record outside the lock, queues it, and either leads the
+//          next batch or waits for the current leader to finish it.
+bool WriteAheadLog::insert(FileServerMap &store, const std::string &name, const std::vector<uint8_t> &data) {
+    Pending p;
+    prepare(p, store, name, data);
+    commit(std::vector<Pending *>(1, &p));
+    return p.existed;
+}
+
+// Method: insert_many
+// Purpose: The records are queued under one lock, so the leader that takes
+//          the first of them takes them all.
+std::vector<bool> WriteAheadLog::insert_many(FileServerMap &store, const std::vector<std::string> &names,
+                                             const std::vector<std::vector<uint8_t>> &data) {
+    std::vector<Pending> records(names.size());
+    std::vector<Pending *> queued(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        prepare(records[i], store, names[i], data[i]);
+        queued[i] = &records[i];
+    }
+    std::vector<bool> existed(names.size());
+    if (names.empty()) return existed;
+    commit(queued);
+    for (size_t i = 0; i < names.size(); ++i) existed[i] = records[i].existed;
+    return existed;
+}
+
+// Method: prepare
+// Purpose: Encodes the record as a File message behind its length and CRC.
+// Throws:
+//   - std::runtime_error if the record is too large to log.
+void WriteAheadLog::prepare(Pending &p, FileServerMap &store, const std::string &name,
+                            const std::vector<uint8_t> &data) {
+    size_t payload = FileMessage::encoded_size(name.size(), data.size());
+    if (payload > 0xFFFFFFFFul) throw std::runtime_error("File too large to log: " + name);
+    p.record.reserve(WAL_HEADER_SIZE + payload);
+    p.record.resize(WAL_HEADER_SIZE);
+    FileMessage::encode(p.record, name, data.data(), data.size());
+    put_u32(&p.record[0], static_cast<uint32_t>(payload));
+    put_u32(&p.record[4], crc32(p.record.data() + WAL_HEADER_SIZE, payload));
+    p.store = &store;
+    p.name = &name;
+    p.blob = store.allocate(data.data(), data.size());
+}
+
+// Method: commit
+// Purpose: Leads a batch whenever none is in flight, until the records are done.
+void WriteAheadLog::commit(const std::vector<Pending *> &records) {
+    std::unique_lock<std::mutex> guard(lock_);
+    queue_.insert(queue_.end(), records.begin(), records.end());
+    while (!records.back()->done) {
+        if (leading_ || rotating_) {
+            committed_.wait(guard);      // Another caller is writing a batch
+        } else {
+            lead(guard);                 // Our records are in the queue; write them
+        }
+    }
+    if (!records.back()->error.empty()) throw std::runtime_error(records.back()->error);
+}
+
+// Function: write_all
+// Purpose: Writes every iovec, continuing after partial writes.
+// Returns:
+//   - 0 on success, or the errno of the failed write.
+static int write_all(int fd, std::vector<iovec> &iov) {
+    size_t first = 0;
+    while (first < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t n = writev(fd, &iov[first], count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n < 0 ? errno : EIO;
+        size_t left = static_cast<size_t>(n);
+        while (first < iov.size() && left >= iov[first].iov_len) left -= iov[first++].iov_len;
+        if (left) {
+            iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+        }
+    }
+    return 0;
+}
+
+// Method: lead
+// Purpose: Takes the queue as one batch and commits it with the lock released,
+//          so the next batch can gather while this one is on its way to disk.
+void WriteAheadLog::lead(std::unique_lock<std::mutex> &guard) {
+    leading_ = true;
+    if (window_us_) {
+        guard.unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(window_us_));
+        guard.lock();
+    }
+    std::vector<Pending *> batch;
+    batch.swap(queue_);
+    uint64_t start = size_;
+    guard.unlock();
+
+    std::vector<iovec> iov(batch.size());
+    size_t bytes = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        iov[i].iov_base = batch[i]->record.data();
+        iov[i].iov_len = batch[i]->record.size();
+        bytes += batch[i]->record.size();
+    }
+    std::string error;
+    int err = write_all(fd_, iov);
+    if (err) {
+        error = "Cannot append to log '" + path_ + "': " + strerror(err);
+    } else if (policy_ == FsyncPolicy::Always && fdatasync(fd_) != 0) {
+        error = "Cannot sync log '" + path_ + "': " + strerror(errno);
+    }
+    // A failed batch is reported as failed and not applied, so it must not
+    // stay in the log either, or replay would apply it after a restart. If
+    // it cannot be cut off, the log no longer matches what clients were told.
+    if (!error.empty() && ftruncate(fd_, start) != 0) {
+        std::cerr << "FATAL: " << error << ", and cannot drop the batch: " << strerror(errno) << std::endl;
+        std::abort();
+    }
+
+    guard.lock();
+    if (error.empty()) {
+        size_ = start + bytes;
+        records_ += batch.size();
+        if (policy_ == FsyncPolicy::Always) synced_ = records_;
+        for (Pending *p : batch)          // Apply in log order
+            p->existed = p->store->insert(*p->name, std::move(p->blob));
+    }
+    ++batches_;
+    for (Pending *p : batch) {
+        p->error = error;
+        p->done = true;
+    }
+    leading_ = false;
+    committed_.notify_all();
+}
+
+// Method: rotate
+// Purpose: Renames the live log to the next segment and swaps an empty file in
+//          behind fd_ with dup3, so sync() and the flusher never see a closed
+//          descriptor. Runs with lock_ held and no batch in flight.
+uint64_t WriteAheadLog::rotate(const std::function<void()> &at_rotation) {
+    std::unique_lock<std::mutex> guard(lock_);
+    rotating_ = true;                    // New batches wait for us
+    while (leading_) committed_.wait(guard);
+    std::string error;
+    uint64_t n = next_segment_;
+    std::string seg = segment_path(n);
+    if (policy_ != FsyncPolicy::Never && fdatasync(fd_) != 0) {
+        error = "Cannot sync log '" + path_ + "': " + strerror(errno);
+    } else if (std::rename(path_.c_str(), seg.c_str()) != 0) {
+        error = "Cannot rotate log '" + path_ + "': " + strerror(errno);
+    } else {
+        int fresh = open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+        if (fresh < 0 || dup3(fresh, fd_, O_CLOEXEC) < 0) {
+            error = "Cannot rotate log '" + path_ + "': " + strerror(errno);
+            std::rename(seg.c_str(), path_.c_str());   // Put the old log back
+        }
+        if (fresh >= 0) close(fresh);
+    }
+    if (error.empty()) {
+        if (policy_ != FsyncPolicy::Never) {
+            sync_parent_dir(path_);
+            synced_ = records_;
+        }
+        ++next_segment_;
+        size_ = 0;
+        try {
+            at_rotation();
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+    }
+    rotating_ = false;
+    committed_.notify_all();
+    if (!error.empty()) throw std::runtime_error(error);
+    return n;
+}
+
+// Method: drop_segments
+// Purpose: Unlinks the covered segments and syncs the directory.
+void WriteAheadLog::drop_segments(uint64_t upto) {
+    bool dropped = false;
+    for (uint64_t n : segments()) {
+        if (n > upto) break;
+        dropped |= unlink(segment_path(n).c_str()) == 0;
+    }
+    if (dropped && policy_ != FsyncPolicy::Never) sync_parent_dir(path_);
+}
+
+// Method: segments
+// Purpose: Lists "<name>.<digits>" next to the live log.
+std::vector<uint64_t> WriteAheadLog::segments() const {
+    std::string dir, base;
+    split_path(path_, dir, base);
+    std::vector<uint64_t> found;
+    DIR *d = opendir(dir.c_str());
+    if (!d) return found;
+    while (struct dirent *e = readdir(d)) {
+        const char *name = e->d_name;
+        if (std::strncmp(name, base.c_str(), base.size()) != 0 || name[base.size()] != '.') continue;
+        const char *digits = name + base.size() + 1;
+        char *end = nullptr;
+        unsigned long long n = std::strtoull(digits, &end, 10);
+        if (*digits >= '0' && *digits <= '9' && *end == '\0') found.push_back(n);
+    }
+    closedir(d);
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+// Method: segment_path
+// Purpose: Appends the segment number to the log path.
+std::string WriteAheadLog::segment_path(uint64_t n) const {
+    return path_ + "." + std::to_string(n);
+}
+
+// Method: sync
+// Purpose: fdatasyncs the log and records how far it is known to be durable.
+void WriteAheadLog::sync() {
+    uint64_t target;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        target = records_;
+    }
+    if (fdatasync(fd_) != 0)
+        throw std::runtime_error("Cannot sync log '" + path_ + "': " + strerror(errno));
+    std::lock_guard<std::mutex> guard(lock_);
+    if (synced_ < target) synced_ = target;
+}
+
+// Method: records
+// Purpose: Reports how many records were appended since open.
+uint64_t WriteAheadLog::records() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return records_;
+}
+
+// Method: batches
+// Purpose: Reports how many group commits ran since open.
+uint64_t WriteAheadLog::batches() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return batches_;
+}
+
+// Method: flush_loop
+// Purpose: Syncs the log every interval_ms while there are unsynced records.
+void WriteAheadLog::flush_loop() {
+    std::unique_lock<std::mutex> guard(lock_);
+    while (!stopping_) {
+        wake_.wait_for(guard, std::chrono::milliseconds(interval_ms_));
+        if (stopping_ || synced_ == records_) continue;
+        guard.unlock();
+        try { sync(); } catch (const std::exception &) {}   // Retried next period
+        guard.lock();
+    }
+}
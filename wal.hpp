@@ -0,0 +1,231 @@
+// File: wal.hpp
+// Description: Header file for the append-only write-ahead log. Every stored
+//              file is appended to the log as a checksummed record before the
+//              client is told it was stored, and the log is replayed on startup,
+//              so a crash loses nothing that was acknowledged (subject to the
+//              fsync policy).
+// Author: Logan Scheetz
+// Date: 5/12/25
+
+#ifndef WAL_HPP
+#define WAL_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include "hashmap.hpp"   // FileServerMap
+
+// Log record layout: 4-byte big-endian payload length, 4-byte big-endian CRC-32
+// of the payload, then the payload, which is a plain File message.
+constexpr size_t WAL_HEADER_SIZE = 8;
+
+// Enum: FsyncPolicy
+// Purpose: When appended records are forced to stable storage.
+enum class FsyncPolicy {
+    Always,    // Before every acknowledgement
+    Interval,  // By a background thread every interval_ms
+    Never      // Left to the operating system
+};
+
+// Function: parse_fsync_policy
+// Purpose: Reads a --fsync argument: "always", "never", or a number of milliseconds.
+// Parameters:
+//   - arg: The argument text.
+//   - policy, interval_ms: Set from the argument.
+// Returns:
+//   - false if the argument is not recognised.
+bool parse_fsync_policy(const std::string &arg, FsyncPolicy &policy, unsigned &interval_ms);
+
+// Function: crc32
+// Purpose: Computes the CRC-32 (IEEE) checksum of a byte range.
+uint32_t crc32(const uint8_t *data, size_t len);
+
+// Function: sync_parent_dir
+// Purpose: fsyncs the directory holding `path`, so a rename or unlink of the
+//          file survives a crash.
+// Returns:
+//   - false if the directory cannot be opened or synced.
+bool sync_parent_dir(const std::string &path);
+
+// Class: WriteAheadLog
+// Purpose: Owns the log file, plus any segments ("<path>.<n>") that rotate()
+//          set aside for a snapshot still being written. Inserts are group-committed: callers queue their
+//          records, and one of them (the leader) writes everything queued with
+//          a single writev, issues a single fsync, applies the batch to the
+//          store in queue order, and wakes the rest. Only one batch is in
+//          flight at a time, so log order matches the order of store updates.
+class WriteAheadLog {
+public:
+    // Constructor
+    // Purpose: Opens (creating if needed) the log for appending.
+    // Parameters:
+    //   - path: The log file.
+    //   - policy: When to fsync.
+    //   - interval_ms: The period for FsyncPolicy::Interval.
+    //   - window_us: How long a leader waits for more records before writing
+    //     its batch (0 writes whatever has queued up by the time it leads).
+    // Throws:
+    //   - std::runtime_error if the file cannot be opened.
+    WriteAheadLog(const std::string &path, FsyncPolicy policy, unsigned interval_ms,
+                  unsigned window_us = 0);
+
+    // Destructor
+    // Purpose: Stops the background flusher and syncs the log one last time.
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // Method: replay
+    // Purpose: Applies every intact record to the store, in order: first the
+    //          rotated segments, oldest first, then the live log. A torn or
+    //          corrupt record (from a crash mid-append) ends a file; in the live
+    //          log it and anything after it are cut off so new records follow
+    //          the last good one.
+    // Returns:
+    //   - The number of records applied.
+    // Throws:
+    //   - std::runtime_error if the file cannot be read or truncated.
+    size_t replay(FileServerMap &store);
+
+    // Method: insert
+    // Purpose: Logs a file and then stores it, as one step with respect to
+    //          other writers. Returns once the record's batch is durable per the
+    //          policy and applied to the store.
+    // Parameters:
+    //   - store: The store to update.
+    //   - name: The file name.
+    //   - data: The file content.
+    // Returns:
+    //   - true if the store already held a file of that name.
+    // Throws:
+    //   - std::runtime_error if the batch cannot be written; the store is
+    //     then left unchanged.
+    bool insert(FileServerMap &store, const std::string &name, const std::vector<uint8_t> &data);
+
+    // Method: insert_many
+    // Purpose: Logs and stores several files as insert() does, with all their
+    //          records in the same group commit, so the batch costs one write
+    //          and one sync and is applied as a unit.
+    // Parameters:
+    //   - store: The store to update.
+    //   - names: The file names.
+    //   - data: The file contents, one per name.
+    // Returns:
+    //   - For each file, whether the store already held a file of that name.
+    // Throws:
+    //   - std::runtime_error if the batch cannot be written; the store is
+    //     then left unchanged.
+    std::vector<bool> insert_many(FileServerMap &store, const std::vector<std::string> &names,
+                                  const std::vector<std::vector<uint8_t>> &data);
+
+    // Method: rotate
+    // Purpose: Starts a fresh log for a snapshot. Waits until no batch is in
+    //          flight and holds off new ones while it moves the live log aside
+    //          as the next numbered segment, opens an empty log in its place and
+    //          calls `at_rotation`. At that moment the store holds exactly the
+    //          records of the segments, so a snapshot taken by `at_rotation`
+    //          (by forking, say) covers them, and drop_segments can delete them
+    //          once the snapshot is on disk.
+    // Parameters:
+    //   - at_rotation: Called with the log quiesced and already rotated.
+    // Returns:
+    //   - The number of the new segment.
+    // Throws:
+    //   - std::runtime_error if the log cannot be rotated (it is then left as
+    //     it was), or whatever `at_rotation` throws.
+    uint64_t rotate(const std::function<void()> &at_rotation);
+
+    // Method: drop_segments
+    // Purpose: Deletes the segments numbered up to `upto`, once a snapshot
+    //          covering them is durable.
+    void drop_segments(uint64_t upto);
+
+    // Method: segments
+    // Returns:
+    //   - The numbers of the rotated segments on disk, oldest first.
+    std::vector<uint64_t> segments() const;
+
+    // Method: sync
+    // Purpose: Forces every appended record to stable storage.
+    void sync();
+
+    // Method: records
+    // Returns:
+    //   - The number of records appended since the log was opened.
+    uint64_t records() const;
+
+    // Method: batches
+    // Returns:
+    //   - The number of group commits (writev + fsync rounds) since open.
+    uint64_t batches() const;
+
+private:
+    // Struct: Pending
+    // Purpose: One caller's record waiting in the group-commit queue.
+    struct Pending {
+        std::vector<uint8_t> record;  // Header and payload, ready to write
+        FileServerMap *store;         // Store to apply the record to
+        const std::string *name;      // File name
+        BlobRef blob;                 // File content
+        bool existed = false;         // Result of the store update
+        bool done = false;            // Set when the batch has finished
+        std::string error;            // Set if the batch failed
+    };
+
+    // Method: prepare
+    // Purpose: Builds a record and allocates the blob for one file.
+    void prepare(Pending &p, FileServerMap &store, const std::string &name,
+                 const std::vector<uint8_t> &data);
+
+    // Method: commit
+    // Purpose: Queues prepared records together and waits until their batch
+    //          has finished.
+    // Throws:
+    //   - std::runtime_error if the batch failed.
+    void commit(const std::vector<Pending *> &records);
+
+    // Method: lead
+    // Purpose: Writes, syncs and applies everything queued, as the leader.
+    //          Called and returns with `guard` held.
+    void lead(std::unique_lock<std::mutex> &guard);
+
+    // Method: segment_path
+    // Returns:
+    //   - The file name of segment `n`.
+    std::string segment_path(uint64_t n) const;
+
+    // Method: flush_loop
+    // Purpose: Body of the background thread for FsyncPolicy::Interval.
+    void flush_loop();
+
+    int fd_;                          // Live log file, opened O_APPEND; rotate()
+                                      // swaps the file behind the same number
+    std::string path_;                // Log file path, for error messages
+    FsyncPolicy policy_;              // When to fsync
+    unsigned interval_ms_;            // Flush period for FsyncPolicy::Interval
+    unsigned window_us_;              // Group-commit gathering window
+
+    mutable std::mutex lock_;         // Guards the queue and the counters
+    std::vector<Pending *> queue_;    // Records waiting for the next batch
+    bool leading_ = false;            // Whether a leader is writing a batch
+    bool rotating_ = false;           // Whether rotate() is holding off batches
+    std::condition_variable committed_; // Signalled when a batch finishes
+    uint64_t records_ = 0;            // Records appended since open
+    uint64_t batches_ = 0;            // Group commits since open
+    uint64_t size_ = 0;               // Length of the intact log in bytes
+    uint64_t synced_ = 0;             // Records known to be on stable storage
+    uint64_t next_segment_ = 1;       // Number for the next rotated segment
+
+    std::condition_variable wake_;    // Wakes the flusher early on shutdown
+    bool stopping_ = false;           // Set by the destructor
+    std::thread flusher_;             // Background fsync thread, if any
+};
+
+#endif // WAL_HPP